@@ -3,6 +3,7 @@
 
 #include "HydraVSGFExport.h"
 #include "HydraXMLHelpers.h"
+#include "HydraChunkCompression.h"
 
 #include <sstream>
 #include <fstream>
@@ -373,6 +374,7 @@ std::shared_ptr<IHRMesh> HydraFactoryCommon::CreateVSGFFromSimpleInputMesh(HRMes
     currOffset += currSize;
   }
 
+  pMeshImpl->m_chunkId     = g_objManager.scnData.m_vbCache.DeduplicateChunk(chunkId); // same geometry --> same chunk
   pMeshImpl->m_vertNum     = totalVertNumber;
   pMeshImpl->m_indNum      = totalMeshTriIndices;
 
@@ -447,15 +449,9 @@ std::shared_ptr<IHRMesh> HydraFactoryCommon::CreateVSGFFromFile(HRMesh* pSysObj,
   }
   else
   {
-  #ifdef WIN32
-    std::ifstream fin(a_fileName.c_str(), std::ios::binary);
-  #else
-    std::string fileIn(a_fileName.begin(), a_fileName.end());
-    std::ifstream fin(fileIn.c_str(), std::ios::binary);
-  #endif
+    HydraChunkStream fin(a_fileName);
     fin.seekg(moffset);
     fin.read((char*)mindices.data(), msize);
-    fin.close();
   }
   
   pMeshImpl->m_matDrawList = FormMatDrawListRLE(mindices);
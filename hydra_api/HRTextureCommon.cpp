@@ -35,18 +35,16 @@ bool IHRTextureNode::ReadDataFromChunkTo(std::vector<int>& a_dataConteiner)
 
   // copy from memory
   //
-  if (chunk.InMemory())
+  char* data = (char*)chunk.GetMemoryNow(); // may swap chunk in if demand paging is enabled
+  if (data != nullptr)
   {
-    char* data = (char*)chunk.GetMemoryNow();
-    if (data != nullptr)
-    {
-      memcpy(a_dataConteiner.data(), data + sizeof(int)*2, DataSizeInBytes());
-      return true;
-    }
+    memcpy(a_dataConteiner.data(), data + sizeof(int)*2, DataSizeInBytes());
+    return true;
   }
 
   // if fail then try to load from file
   //
+  g_objManager.scnData.m_vbCache.WaitForWrites();
   std::wstring locPath = g_objManager.scnData.m_path + std::wstring(L"/") + ChunkName(chunk);
 
   InternalImageTool chunkLoader;
@@ -62,8 +60,6 @@ const void* IHRTextureNode::GetData() const
     return nullptr;
   
   auto chunk = g_objManager.scnData.m_vbCache.chunk_at(chunkId());
-  if (!chunk.InMemory())
-    return nullptr;
 
   const char* ptr = (const char*)chunk.GetMemoryNow();
   if (ptr == nullptr)
@@ -157,8 +153,10 @@ std::shared_ptr<IHRTextureNode> HydraFactoryCommon::CreateTexture2DFromMemory(HR
 
   memcpy(data, a_data, textureSizeInBytes);
 
-  std::shared_ptr<BitmapLDRNode> p1 = std::make_shared<BitmapLDRNode>(width, height, totalByteSizeOfTexture, chunkId);
-  std::shared_ptr<BitmapHDRNode> p2 = std::make_shared<BitmapHDRNode>(width, height, totalByteSizeOfTexture, chunkId);
+  const size_t sharedChunkId = g_objManager.scnData.m_vbCache.DeduplicateChunk(chunkId); // same pixels --> same chunk
+
+  std::shared_ptr<BitmapLDRNode> p1 = std::make_shared<BitmapLDRNode>(width, height, totalByteSizeOfTexture, sharedChunkId);
+  std::shared_ptr<BitmapHDRNode> p2 = std::make_shared<BitmapHDRNode>(width, height, totalByteSizeOfTexture, sharedChunkId);
 
   std::shared_ptr<IHRTextureNode> p11 = p1;
   std::shared_ptr<IHRTextureNode> p22 = p2;
@@ -8,6 +8,8 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include <cstring> // memcpy in linux
 #include <cmath>   // sqrt, exp, fmax, fmin
@@ -286,6 +288,50 @@ namespace HydraRender
   ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
   ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+  /**
+  \brief Call a_pixelFunc(i,j) for every pixel so that each call observes exactly the image state the serial scan-line order (j, then i) would give it.
+  \param a_radius - how far (in pixels) a_pixelFunc reads around (i,j).
+
+  Rows are distributed between threads; row j processes pixel i only after row j-1 has finished pixel i + a_radius.
+  This lets in-place filters, whose result depends on already processed neighbours, run in parallel and stay deterministic.
+
+  */
+  template<typename PixelFunc>
+  static void InPlaceWavefront(int w, int h, int a_radius, PixelFunc a_pixelFunc)
+  {
+    constexpr int PUBLISH_STEP = 16; // don't touch shared counter for each pixel
+
+    std::vector< std::atomic<int> > rowsDone(h);
+    for (auto& done : rowsDone)
+      done.store(0, std::memory_order_relaxed);
+
+    #pragma omp parallel for schedule(static, 1) // rows must be taken in ascending order by each thread
+    for (int j = 0; j < h; ++j)
+    {
+      cvex::set_ftz();
+
+      int prevDone = (j == 0) ? w : 0;
+
+      for (int i = 0; i < w; ++i)
+      {
+        const int need = std::min(i + a_radius + 1, w);
+        while (prevDone < need)
+        {
+          prevDone = rowsDone[j - 1].load(std::memory_order_acquire);
+          if (prevDone < need)
+            std::this_thread::yield();
+        }
+
+        a_pixelFunc(i, j);
+
+        if ((i + 1) % PUBLISH_STEP == 0)
+          rowsDone[j].store(i + 1, std::memory_order_release);
+      }
+
+      rowsDone[j].store(w, std::memory_order_release);
+    }
+  }
+
   void HDRImage4f::medianFilterInPlace(float a_thresholdValue)
   {
     cvex::set_ftz();
@@ -294,12 +340,11 @@ namespace HydraRender
     const int h = height();
 
     const float ts2         = a_thresholdValue*a_thresholdValue;
-    const vfloat4 invEight  = cvex::splat(1.0f / 8.0f);
     const vfloat4 threshold = {ts2, ts2, ts2, 100000.0f};
 
     float* pData = data();
 
-    for (int j = 0; j < h; ++j)
+    InPlaceWavefront(w, h, 1, [=](int i, int j)
     {
       int offsetY0 = (j - 1)*w * 4;
       int offsetY1 = (j + 0)*w * 4;
@@ -311,80 +356,75 @@ namespace HydraRender
       if (j + 1 >= h)
         offsetY2 = offsetY1;
 
-      for (int i = 0; i < w; ++i)
-      {
-        int offsetX0 = (i - 1) * 4;
-        int offsetX1 = (i + 0) * 4;
-        int offsetX2 = (i + 1) * 4;
+      int offsetX0 = (i - 1) * 4;
+      int offsetX1 = (i + 0) * 4;
+      int offsetX2 = (i + 1) * 4;
 
-        if (i - 1 < 0)
-          offsetX0 = offsetX1;
+      if (i - 1 < 0)
+        offsetX0 = offsetX1;
 
-        if (i + 1 >= w)
-          offsetX2 = offsetX1;
+      if (i + 1 >= w)
+        offsetX2 = offsetX1;
 
-        const vfloat4 xm = cvex::load(pData + offsetY1 + offsetX1);
+      const vfloat4 xm = cvex::load(pData + offsetY1 + offsetX1);
 
-        const vfloat4 x0 = cvex::load(pData + offsetY1 + offsetX0);
-        const vfloat4 x1 = cvex::load(pData + offsetY1 + offsetX2);
-        const vfloat4 x2 = cvex::load(pData + offsetY0 + offsetX1);
-        const vfloat4 x3 = cvex::load(pData + offsetY2 + offsetX1);
+      const vfloat4 x0 = cvex::load(pData + offsetY1 + offsetX0);
+      const vfloat4 x1 = cvex::load(pData + offsetY1 + offsetX2);
+      const vfloat4 x2 = cvex::load(pData + offsetY0 + offsetX1);
+      const vfloat4 x3 = cvex::load(pData + offsetY2 + offsetX1);
 
-        const vfloat4 diff0sq = (xm - x0)*(xm - x0);
-        const vfloat4 diff1sq = (xm - x1)*(xm - x1);
-        const vfloat4 diff2sq = (xm - x2)*(xm - x2);
-        const vfloat4 diff3sq = (xm - x3)*(xm - x3);
+      const vfloat4 diff0sq = (xm - x0)*(xm - x0);
+      const vfloat4 diff1sq = (xm - x1)*(xm - x1);
+      const vfloat4 diff2sq = (xm - x2)*(xm - x2);
+      const vfloat4 diff3sq = (xm - x3)*(xm - x3);
 
-        int numFailed = 0;
+      int numFailed = 0;
 
-        if (cvex::cmpgt_any(diff0sq, threshold))
-          numFailed++;
+      if (cvex::cmpgt_any(diff0sq, threshold))
+        numFailed++;
 
-        if (cvex::cmpgt_any(diff1sq, threshold))
-          numFailed++;
+      if (cvex::cmpgt_any(diff1sq, threshold))
+        numFailed++;
 
-        if (cvex::cmpgt_any(diff2sq, threshold))
-          numFailed++;
+      if (cvex::cmpgt_any(diff2sq, threshold))
+        numFailed++;
 
-        if (cvex::cmpgt_any(diff3sq, threshold))
-          numFailed++;
+      if (cvex::cmpgt_any(diff3sq, threshold))
+        numFailed++;
 
-        if (numFailed >= 3)
-        {
-          const vfloat4 x4 = cvex::load(pData + offsetY0 + offsetX0);
-          const vfloat4 x5 = cvex::load(pData + offsetY0 + offsetX2);
-          const vfloat4 x6 = cvex::load(pData + offsetY2 + offsetX0);
-          const vfloat4 x7 = cvex::load(pData + offsetY2 + offsetX2);
-
-          const vfloat4 xi[9] = { xm, x0, x1, x2, x3, x4, x5, x6, x7 };
-
-          float red  [9];
-          float green[9];
-          float blue [9];
-
-          #pragma gcc ivdep
-          for (int i = 0; i < 9; i++)
-          {
-            const vfloat4 xc = xi[i];
-
-            cvex::store_s(red   + i, xc);
-            cvex::store_s(green + i, cvex::splat_1(xc));
-            cvex::store_s(blue  + i, cvex::splat_2(xc));
-          }
-
-          std::sort(red,   red   + 9);
-          std::sort(green, green + 9);
-          std::sort(blue,  blue  + 9);
-
-          pData[offsetY1 + offsetX1 + 0] = red  [4];
-          pData[offsetY1 + offsetX1 + 1] = green[4];
-          pData[offsetY1 + offsetX1 + 2] = blue [4];
-          pData[offsetY1 + offsetX1 + 3] = 1.0f;
-        }
+      if (numFailed < 3)
+        return;
+
+      const vfloat4 x4 = cvex::load(pData + offsetY0 + offsetX0);
+      const vfloat4 x5 = cvex::load(pData + offsetY0 + offsetX2);
+      const vfloat4 x6 = cvex::load(pData + offsetY2 + offsetX0);
+      const vfloat4 x7 = cvex::load(pData + offsetY2 + offsetX2);
 
-      } // for (int i = 0; i < w; ++i)
+      const vfloat4 xi[9] = { xm, x0, x1, x2, x3, x4, x5, x6, x7 };
 
-    } //  for (int j = 0; j < h; ++j)
+      float red  [9];
+      float green[9];
+      float blue [9];
+
+      #pragma gcc ivdep
+      for (int k = 0; k < 9; k++)
+      {
+        const vfloat4 xc = xi[k];
+
+        cvex::store_s(red   + k, xc);
+        cvex::store_s(green + k, cvex::splat_1(xc));
+        cvex::store_s(blue  + k, cvex::splat_2(xc));
+      }
+
+      std::sort(red,   red   + 9);
+      std::sort(green, green + 9);
+      std::sort(blue,  blue  + 9);
+
+      pData[offsetY1 + offsetX1 + 0] = red  [4];
+      pData[offsetY1 + offsetX1 + 1] = green[4];
+      pData[offsetY1 + offsetX1 + 2] = blue [4];
+      pData[offsetY1 + offsetX1 + 3] = 1.0f;
+    });
 
   }
 
@@ -399,8 +439,6 @@ namespace HydraRender
     if (a_windowSize > maxWindowsSize)
       a_windowSize = maxWindowsSize;
 
-    const int windowWidth = 2 * a_windowSize + 1;
-
     const int w = width();
     const int h = height();
 
@@ -418,21 +456,19 @@ namespace HydraRender
       vfloat4 color;
     };
 
-    std::vector<Pixel, aligned16<Pixel> > badPixels;
-    badPixels.reserve(w*h);
+    typedef std::vector<Pixel, aligned16<Pixel> > PixelArray;
+
+    std::vector<PixelArray> badPixelsInRow(h); // each row is owned by a single thread; merged in scan-line order below
     //////////////////////////////////////////////////////////////////////////////////////
 
     const float ts2 = a_thresholdValue*a_thresholdValue;
-    const vfloat4 invEight = cvex::splat(1.0f / 8.0f);
     const vfloat4 threshold = { ts2, ts2, ts2, 100000.0f };
 
     float* pData = tempImage.data();
 
-    float red       [maxWindowWidth*maxWindowWidth];
-    float green     [maxWindowWidth*maxWindowWidth];
-    float blue      [maxWindowWidth*maxWindowWidth];
+    const int windowRadius = std::max(a_windowSize, 1); // the neighbour test below always reads 3x3
 
-    for (int j = 0; j < h; ++j)
+    InPlaceWavefront(w, h, windowRadius, [=, &badPixelsInRow](int i, int j)
     {
       const int minY = std::max(j - a_windowSize, 0);
       const int maxY = std::min(j + a_windowSize, h - 1);
@@ -447,94 +483,102 @@ namespace HydraRender
       if (j + 1 >= h)
         offsetY2 = offsetY1;
 
-      for (int i = 0; i < w; ++i)
-      {
-        const int minX = std::max(i - a_windowSize, 0);
-        const int maxX = std::min(i + a_windowSize, w - 1);
+      const int minX = std::max(i - a_windowSize, 0);
+      const int maxX = std::min(i + a_windowSize, w - 1);
+
+      int offsetX0 = (i - 1) * 4;
+      int offsetX1 = (i + 0) * 4;
+      int offsetX2 = (i + 1) * 4;
 
-        int offsetX0 = (i - 1) * 4;
-        int offsetX1 = (i + 0) * 4;
-        int offsetX2 = (i + 1) * 4;
+      if (i - 1 < 0)
+        offsetX0 = offsetX1;
 
-        if (i - 1 < 0)
-          offsetX0 = offsetX1;
+      if (i + 1 >= w)
+        offsetX2 = offsetX1;
 
-        if (i + 1 >= w)
-          offsetX2 = offsetX1;
+      const vfloat4 xm = cvex::load(pData + offsetY1 + offsetX1);
 
-        const vfloat4 xm = cvex::load(pData + offsetY1 + offsetX1);
+      const vfloat4 x0 = cvex::load(pData + offsetY1 + offsetX0);
+      const vfloat4 x1 = cvex::load(pData + offsetY1 + offsetX2);
+      const vfloat4 x2 = cvex::load(pData + offsetY0 + offsetX1);
+      const vfloat4 x3 = cvex::load(pData + offsetY2 + offsetX1);
 
-        const vfloat4 x0 = cvex::load(pData + offsetY1 + offsetX0);
-        const vfloat4 x1 = cvex::load(pData + offsetY1 + offsetX2);
-        const vfloat4 x2 = cvex::load(pData + offsetY0 + offsetX1);
-        const vfloat4 x3 = cvex::load(pData + offsetY2 + offsetX1);
+      const vfloat4 diff0sq = (xm - x0)*(xm - x0);
+      const vfloat4 diff1sq = (xm - x1)*(xm - x1);
+      const vfloat4 diff2sq = (xm - x2)*(xm - x2);
+      const vfloat4 diff3sq = (xm - x3)*(xm - x3);
 
-        const vfloat4 diff0sq = (xm - x0)*(xm - x0);
-        const vfloat4 diff1sq = (xm - x1)*(xm - x1);
-        const vfloat4 diff2sq = (xm - x2)*(xm - x2);
-        const vfloat4 diff3sq = (xm - x3)*(xm - x3);
+      int numFailed = 0;
 
-        int numFailed = 0;
+      if (cvex::cmpgt_any(diff0sq, threshold))
+        numFailed++;
 
-        if (cvex::cmpgt_any(diff0sq, threshold))
-          numFailed++;
+      if (cvex::cmpgt_any(diff1sq, threshold))
+        numFailed++;
 
-        if (cvex::cmpgt_any(diff1sq, threshold))
-          numFailed++;
+      if (cvex::cmpgt_any(diff2sq, threshold))
+        numFailed++;
 
-        if (cvex::cmpgt_any(diff2sq, threshold))
-          numFailed++;
+      if (cvex::cmpgt_any(diff3sq, threshold))
+        numFailed++;
 
-        if (cvex::cmpgt_any(diff3sq, threshold))
-          numFailed++;
+      if (numFailed < 3)
+        return;
 
-        if (numFailed < 3)
-          continue;
+      const vfloat4 curr = cvex::load(pData + (j*w + i)*4);
 
-        const vfloat4 curr = cvex::load(pData + (j*w + i)*4);
+      float red  [maxWindowWidth*maxWindowWidth];
+      float green[maxWindowWidth*maxWindowWidth];
+      float blue [maxWindowWidth*maxWindowWidth];
 
-        ///////////////////////////////////////////////////////////////////////////////////////
-        int counter = 0;
-        for (int y = minY; y <= maxY; y++)
+      ///////////////////////////////////////////////////////////////////////////////////////
+      int counter = 0;
+      for (int y = minY; y <= maxY; y++)
+      {
+        for (int x = minX; x <= maxX; x++)
         {
-          for (int x = minX; x <= maxX; x++)
-          {
-            const vfloat4 p_xy = cvex::load(pData + (y*w + x)*4);
-
-            cvex::store_s(red   + counter, p_xy);
-            cvex::store_s(green + counter, cvex::splat_1(p_xy));
-            cvex::store_s(blue  + counter, cvex::splat_2(p_xy));
-            counter++;
-          }
+          const vfloat4 p_xy = cvex::load(pData + (y*w + x)*4);
+
+          cvex::store_s(red   + counter, p_xy);
+          cvex::store_s(green + counter, cvex::splat_1(p_xy));
+          cvex::store_s(blue  + counter, cvex::splat_2(p_xy));
+          counter++;
         }
-        ///////////////////////////////////////////////////////////////////////////////////////
+      }
+      ///////////////////////////////////////////////////////////////////////////////////////
 
-        std::sort(red,   red   + counter);
-        std::sort(green, green + counter);
-        std::sort(blue,  blue  + counter);
+      std::sort(red,   red   + counter);
+      std::sort(green, green + counter);
+      std::sort(blue,  blue  + counter);
 
-        const int medId = counter / 2;
+      const int medId = counter / 2;
 
-        const vfloat4 filtered = { red[medId], green[medId], blue[medId], 1.0f };
-        const vfloat4 diff     = (curr - filtered);
-        const float diffVal    = sqrtf(cvex::dot3f(diff, diff));
+      const vfloat4 filtered = { red[medId], green[medId], blue[medId], 1.0f };
+      const vfloat4 diff     = (curr - filtered);
+      const float diffVal    = sqrtf(cvex::dot3f(diff, diff));
 
-        if (diffVal > a_thresholdValue)
-        {
-          Pixel pix;
-          pix.x     = i;
-          pix.y     = j;
-          pix.dummy = 0;
-          pix.diff  = diffVal;
-          pix.color = filtered;
-          badPixels.push_back(pix);
-        }
+      if (diffVal > a_thresholdValue)
+      {
+        Pixel pix;
+        pix.x     = i;
+        pix.y     = j;
+        pix.dummy = 0;
+        pix.diff  = diffVal;
+        pix.color = filtered;
+        badPixelsInRow[j].push_back(pix);
+      }
 
-        cvex::store(pData + (j*w + i) * 4, filtered);
+      cvex::store(pData + (j*w + i) * 4, filtered);
+    });
 
-      } // for (int i = 0; i < w; ++i)
+    size_t totalBad = 0;
+    for (const auto& row : badPixelsInRow)
+      totalBad += row.size();
 
-    } //  for (int j = 0; j < h; ++j)
+    PixelArray badPixels;
+    badPixels.reserve(totalBad);
+    for (const auto& row : badPixelsInRow)
+      badPixels.insert(badPixels.end(), row.begin(), row.end());
 
     std::cout << "badPixels.size() = " << badPixels.size() << std::endl;
 
@@ -542,7 +586,9 @@ namespace HydraRender
 
     float* pData2 = data();
 
-    for (int i = 0; i < a_pixelsNum; i++)
+    const int pixelsNum = std::min(a_pixelsNum, int(badPixels.size()));
+
+    for (int i = 0; i < pixelsNum; i++)
     {
       const Pixel& pix = badPixels[i];
       cvex::store(pData2 + 4*(pix.y*w + pix.x), pix.color);
@@ -581,11 +627,73 @@ namespace HydraRender
     return gKernel;
   }
 
+  /**
+  \brief 1D gauss pass along rows of (w,h) image; pixels outside of the row are clamped to the edge. a_in and a_out must not overlap.
+  */
+  static void GaussBlurRows(const float* a_in, float* a_out, int w, int h, int BLUR_RADIUS2, const vfloat4* weights)
+  {
+    #pragma omp parallel for
+    for (int y = 0; y < h; y++)
+    {
+      cvex::set_ftz();
+
+      const float* rowIn  = a_in  + size_t(y)*size_t(w)*4;
+      float*       rowOut = a_out + size_t(y)*size_t(w)*4;
+
+      for (int x = 0; x < w; x++)
+      {
+        vfloat4 summ = weights[BLUR_RADIUS2]*cvex::load(rowIn + x * 4);
+
+        for (int wid = 1; wid < BLUR_RADIUS2; wid++)
+        {
+          const int x0 = std::max(x - wid, 0);
+          const int x1 = std::min(x + wid, w - 1);
+
+          vfloat4 p0 = weights[wid + BLUR_RADIUS2]*cvex::load(rowIn + x0 * 4);
+          vfloat4 p1 = weights[wid + BLUR_RADIUS2]*cvex::load(rowIn + x1 * 4);
+          summ = summ + (p0 + p1);
+        }
+
+        cvex::store(rowOut + x * 4, summ);
+      }
+    }
+  }
+
+  /**
+  \brief a_out(h,w) = transpose(a_in(w,h)); done by 32x32 pixel blocks to keep both sides in cache. a_in and a_out must not overlap.
+  */
+  static void TransposeImage4f(const float* a_in, float* a_out, int w, int h)
+  {
+    constexpr int BLOCK_SIZE = 32;
+
+    const int blocksX = (w + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const int blocksY = (h + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    #pragma omp parallel for
+    for (int blockId = 0; blockId < blocksX*blocksY; blockId++)
+    {
+      const int startX = (blockId % blocksX)*BLOCK_SIZE;
+      const int startY = (blockId / blocksX)*BLOCK_SIZE;
+      const int endX   = std::min(startX + BLOCK_SIZE, w);
+      const int endY   = std::min(startY + BLOCK_SIZE, h);
+
+      for (int y = startY; y < endY; y++)
+        for (int x = startX; x < endX; x++)
+          cvex::store(a_out + (size_t(x)*size_t(h) + y) * 4, cvex::load(a_in + (size_t(y)*size_t(w) + x) * 4));
+    }
+  }
+
   void HDRImage4f::gaussBlur(int BLUR_RADIUS2, float a_sigma)
   {
     cvex::set_ftz();
 
-    size_t imSize = size_t(m_width)*size_t(m_height) * sizeof(vfloat4);
+    if (m_width <= 0 || m_height <= 0)
+      return;
+
+    if (BLUR_RADIUS2 < 0)
+      BLUR_RADIUS2 = 0;
+    else if (BLUR_RADIUS2 > 31)
+      BLUR_RADIUS2 = 31; // 2*R+1 weights must fit into 'weights[64]'
 
     float sigma = a_sigma; // = 0.85f + 0.05f*float(BLUR_RADIUS2);
     std::vector<float> kernel = createGaussKernelWeights1D_HDRImage(BLUR_RADIUS2 * 2 + 1, sigma);
@@ -603,58 +711,15 @@ namespace HydraRender
       weights[i] = cvex::splat(w);
     }
 
-    const float* m_dataInBrightPixels = this->data();
-    float*       m_dataOut = this->data();
-    HDRImage4f temp(this->width(), this->height());
-
-    // horisontal blur pass
+    // vertical pass is done as horisontal one on transposed image; this avoids walking columns with (m_width*4) stride
     //
+    HDRImage4f temp(m_width, m_height);
+    HDRImage4f tempT(m_height, m_width);
 
-    float* tmpData = temp.data();
-
-    memset(tmpData, 0, imSize); // THIS IS IMPORTANT BECAUSE BOUNDARIES ARE NOT SET BY THE FINAL PASS
-
-    for (int y = 0; y < m_height; y++)
-    {
-      int offset = y*m_width * 4;
-
-      for (int x = BLUR_RADIUS2; x < m_width - BLUR_RADIUS2; x++)
-      {
-        vfloat4 summ = weights[BLUR_RADIUS2]*cvex::load(m_dataInBrightPixels + offset + (x + 0) * 4);
-
-        for (int wid = 1; wid < BLUR_RADIUS2; wid++)
-        {
-          vfloat4 p0 = weights[wid + BLUR_RADIUS2]*cvex::load(m_dataInBrightPixels + offset + (x - wid) * 4);
-          vfloat4 p1 = weights[wid + BLUR_RADIUS2]*cvex::load(m_dataInBrightPixels + offset + (x + wid) * 4);
-          summ = summ + (p0 + p1);
-        }
-
-        cvex::store(tmpData + offset + x * 4, summ);
-      }
-
-    }
-
-    memset(m_dataOut, 0, imSize); // THIS IS IMPORTANT BECAUSE BOUNDARIES ARE NOT SET BY THE FINAL PASS
-
-    // vertical blur pass and blend pass
-    //
-    for (int x = 0; x < m_width; x++)
-    {
-      for (int y = BLUR_RADIUS2; y < m_height - BLUR_RADIUS2; y++)
-      {
-        vfloat4 summ = weights[BLUR_RADIUS2]*cvex::load(tmpData + y*m_width * 4 + x * 4);
-
-        for (int wid = 1; wid < BLUR_RADIUS2; wid++)
-        {
-          vfloat4 p0 = weights[wid + BLUR_RADIUS2]*cvex::load(tmpData + 4 * (y - wid)*m_width + x * 4);
-          vfloat4 p1 = weights[wid + BLUR_RADIUS2]*cvex::load(tmpData + 4 * (y + wid)*m_width + x * 4);
-          summ = summ + (p0 + p1);
-        }
-
-        cvex::store(m_dataOut + y*m_width * 4 + x * 4, summ);
-      }
-    }
-
+    GaussBlurRows   (this->data(), temp.data(), m_width, m_height, BLUR_RADIUS2, weights); // horisontal blur pass
+    TransposeImage4f(temp.data(), tempT.data(), m_width, m_height);
+    GaussBlurRows   (tempT.data(), temp.data(), m_height, m_width, BLUR_RADIUS2, weights); // vertical blur pass; temp is (m_height, m_width) now
+    TransposeImage4f(temp.data(), this->data(), m_height, m_width);
   }
 
   unsigned int HR_HDRImage4f_RealColorToUint32(float a_r, float a_g, float a_b, float a_alpha)
@@ -9,6 +9,7 @@
 #include "HR_HDRImage.h"
 #include "HR_HDRImageTool.h"
 #include "HydraObjectManager.h"
+#include "HydraChunkCompression.h"
 
 #include "FreeImage.h"
 #pragma comment(lib, "FreeImage.lib")
@@ -288,12 +289,7 @@ bool InternalImageTool::LoadImageFromFile(const wchar_t* a_fileName,
 {
   const std::wstring fileExt = CutFileExt(a_fileName);
 
-#ifdef WIN32
-  std::ifstream fin(a_fileName, std::ios::binary);
-#else
-  std::string   s2 = ws2s(a_fileName);
-  std::ifstream fin(s2.c_str(), std::ios::binary);
-#endif
+  HydraChunkStream fin(a_fileName); // internal formats are also used for chunks that may be compressed
 
   if (!fin.is_open())
     return false;
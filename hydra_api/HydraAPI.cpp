@@ -135,7 +135,7 @@ HAPI int32_t hrSceneLibraryOpen(const wchar_t* a_libPath, HR_OPEN_MODE a_openMod
   
   int libStateId   = -1;
   std::wstring libFile, libFolder;
-  if(input.substr(input.size() - 4) == L".xml")
+  if(input.substr(input.size() - 4) == L".xml" || HydraXMLHelpers::IsBinaryDocumentPath(input))
   {
     // split path to file to (path to folder, file name)
     auto pos  = input.find_last_of(L"/");
@@ -191,6 +191,7 @@ HAPI int32_t hrSceneLibraryOpen(const wchar_t* a_libPath, HR_OPEN_MODE a_openMod
   g_objManager.renderSettings.clear();
 
   g_objManager.scnData.clear();
+  g_objManager.m_commitList.clear();
   g_objManager.m_tempBuffer = std::vector<int>();
 
   if (g_objManager.m_pDriver != nullptr)
@@ -383,6 +384,7 @@ HAPI void hrSceneOpen(HRSceneInstRef a_pScn, HR_OPEN_MODE a_mode)
 
     pScn->m_remapList.clear();
     pScn->m_remapCache.clear();
+    pScn->clearChangeTracker();
   }
   else if (a_mode == HR_OPEN_EXISTING)
   {
@@ -412,6 +414,32 @@ HAPI pugi::xml_node hrSceneParamNode(HRSceneInstRef a_pScn)
   return pScn->xml_node_next(pScn->openMode); // pScn->_xml_node_curr();  // 
 }
 
+static bool ExternalRenderReadsStateXML() ///< 'HydraModern' render process parses <instance> nodes of statex_*.xml and knows nothing about binary instance table 
+{
+  for (const auto& settings : g_objManager.renderSettings)
+  {
+    if (settings.name == L"HydraModern")
+      return true;
+  }
+  return false;
+}
+
+static std::wstring SaveStateDocument(const std::wstring& a_path) ///< return path of saved state; falls back to text state if binary one can't be written
+{
+  if (HydraXMLHelpers::IsBinaryDocumentPath(a_path))
+  {
+    if (HydraXMLHelpers::SaveBinaryDocument(g_objManager.scnData.m_xmlDoc, a_path))
+      return a_path;
+
+    const std::wstring textPath = a_path.substr(0, a_path.find_last_of(L'.')) + L".xml";
+    g_objManager.scnData.m_xmlDoc.save_file(textPath.c_str(), L"  ");
+    return textPath;
+  }
+
+  g_objManager.scnData.m_xmlDoc.save_file(a_path.c_str(), L"  ");
+  return a_path;
+}
+
 HAPI void hrSceneClose(HRSceneInstRef a_pScn)
 {
   HRSceneInst* pScn = g_objManager.PtrById(a_pScn);
@@ -455,32 +483,46 @@ HAPI void hrSceneClose(HRSceneInstRef a_pScn)
     }
   }
 
-  //// add all instances to xml
+  //// add all instances to xml or to binary table; external render process reads <instance> nodes from state xml itself
   //
-  for (size_t i = pScn->drawBegin; i < pScn->drawList.size(); i++)
+  const bool binaryTable = g_objManager.m_binaryInstances && !ExternalRenderReadsStateXML();
+
+  if (binaryTable)
+  {
+    if (pScn->drawBegin < pScn->drawList.size())
+    {
+      pugi::xml_node tableNode = sceneNode.append_child(L"instances_table");
+      HR_SaveInstanceTable(pScn->drawList.data() + pScn->drawBegin, pScn->drawList.size() - pScn->drawBegin,
+                           int32_t(pScn->drawBegin), pScn->id, tableNode);
+    }
+  }
+  else
   {
-    pugi::xml_node nodeXML = sceneNode.append_child(L"instance");
+    for (size_t i = pScn->drawBegin; i < pScn->drawList.size(); i++)
+    {
+      pugi::xml_node nodeXML = sceneNode.append_child(L"instance");
     
-    auto& elem = pScn->drawList[i];
-
-    std::wstring id      = ToWString(i);
-    std::wstring mod_id  = ToWString(elem.meshId);
-    std::wstring mat_id  = ToWString(elem.remapListId);
-    std::wstring scn_id  = ToWString(elem.scene_id);
-    std::wstring scn_sid = ToWString(elem.scene_sid);
-
-    std::wstringstream outMat;
-    for (int j = 0; j < 16;j++)
-      outMat << elem.m[j] << L" ";
-
-    std::wstring mstr = outMat.str();
-
-    nodeXML.append_attribute(L"id").set_value(id.c_str());
-    nodeXML.append_attribute(L"mesh_id").set_value(mod_id.c_str());
-    nodeXML.append_attribute(L"rmap_id").set_value(mat_id.c_str());
-    nodeXML.append_attribute(L"scn_id").set_value(scn_id.c_str());
-    nodeXML.append_attribute(L"scn_sid").set_value(scn_sid.c_str());
-    nodeXML.append_attribute(L"matrix").set_value(mstr.c_str());
+      auto& elem = pScn->drawList[i];
+
+      std::wstring id      = ToWString(i);
+      std::wstring mod_id  = ToWString(elem.meshId);
+      std::wstring mat_id  = ToWString(elem.remapListId);
+      std::wstring scn_id  = ToWString(elem.scene_id);
+      std::wstring scn_sid = ToWString(elem.scene_sid);
+
+      std::wstringstream outMat;
+      for (int j = 0; j < 16;j++)
+        outMat << elem.m[j] << L" ";
+
+      std::wstring mstr = outMat.str();
+
+      nodeXML.append_attribute(L"id").set_value(id.c_str());
+      nodeXML.append_attribute(L"mesh_id").set_value(mod_id.c_str());
+      nodeXML.append_attribute(L"rmap_id").set_value(mat_id.c_str());
+      nodeXML.append_attribute(L"scn_id").set_value(scn_id.c_str());
+      nodeXML.append_attribute(L"scn_sid").set_value(scn_sid.c_str());
+      nodeXML.append_attribute(L"matrix").set_value(mstr.c_str());
+    }
   }
 
   // lights
@@ -701,6 +743,8 @@ std::unique_ptr<IHRRenderDriver> CreateRenderFromString(const wchar_t *a_classNa
     return std::unique_ptr<IHRRenderDriver>(CreateOpenGL32Deferred_RenderDriver());
   else if (!wcscmp(a_className, L"opengl3Utility"))
     return std::unique_ptr<IHRRenderDriver>(CreateOpenGL3_Utilty_RenderDriver());
+  else if (!wcscmp(a_className, L"cpuUtility"))
+    return std::unique_ptr<IHRRenderDriver>(CreateCPU_Utility_RenderDriver());
   else if (!wcscmp(a_className, L"HydraModern"))
     return std::unique_ptr<IHRRenderDriver>(CreateHydraConnection_RenderDriver());
   else
@@ -1013,16 +1057,7 @@ HAPI void hrCommit(HRSceneInstRef a_pScn, HRRenderRef a_pRender, HRCameraRef a_p
     }
   }
   
-  // clear temporary trash and changes xml
-  // 
-  clear_node_childs(g_objManager.trash_node()); 
-  clear_node_childs(g_objManager.scnData.m_texturesLibChanges);
-  clear_node_childs(g_objManager.scnData.m_materialsLibChanges);
-  clear_node_childs(g_objManager.scnData.m_geometryLibChanges);
-  clear_node_childs(g_objManager.scnData.m_lightsLibChanges);
-  clear_node_childs(g_objManager.scnData.m_cameraLibChanges);
-  clear_node_childs(g_objManager.scnData.m_sceneNodeChanges);
-  clear_node_childs(g_objManager.scnData.m_settingsNodeChanges);
+  // temporary trash and changes xml were already dropped by CommitChanges (see HRSceneData::reset_changes)
   
   if(g_objManager.m_tempBuffer.size() > TEMP_BUFFER_MAX_SIZE_DONT_FREE)
     g_objManager.m_tempBuffer = g_objManager.EmptyBuffer();
@@ -1040,13 +1075,26 @@ HAPI void hrFlush(HRSceneInstRef a_pScn, HRRenderRef a_pRender, HRCameraRef a_pC
   std::wstring cngPath = outStr2.str();
   std::wstring newPath = outStr3.str();
 
-  g_objManager.scnData.m_xmlDoc.save_file(oldPath.c_str(), L"  ");
+  // '-binary_state 1' saves both states as 'statex_XXXXX.bxml'; 'HydraModern' render process reads text states only
+  //
+  if (g_objManager.m_binaryState && !ExternalRenderReadsStateXML())
+  {
+    oldPath = oldPath.substr(0, oldPath.size() - 4) + L".bxml";
+    newPath = newPath.substr(0, newPath.size() - 4) + L".bxml";
+  }
+
+  // state before commit; if nothing was committed since previous hrFlush, it is already in 'statex_{m_commitId}'
+  //
+  if (!g_objManager.scnData.m_stateSaved)
+    oldPath = SaveStateDocument(oldPath);
+
   g_objManager.m_tempPathToChangeFile = cngPath; // postpone g_objManager.scnData.m_xmlDocChanges.save_file(cngPath.c_str(), L"  ");
 
   hrCommit(a_pScn, a_pRender, a_pCam);
   
   g_objManager.scnData.m_commitId++;
-  g_objManager.scnData.m_xmlDoc.save_file(newPath.c_str(), L"  ");
+  newPath = SaveStateDocument(newPath); // utility passes below read this one
+  g_objManager.scnData.m_stateSaved = true;
   
   HRRender* pSettings = g_objManager.PtrById(a_pRender);
   
@@ -923,6 +923,48 @@ HAPI bool hrRenderGetFrameBufferLineHDR4f(HRRenderRef pRender, int a_begin, int
 */
 HAPI bool hrRenderGetFrameBufferLineLDR1i(HRRenderRef pRender, int a_begin, int a_end, int a_y, int32_t* imgData);  // w*h*sizeof(int) --> RGBA
 
+/**
+\brief frame buffer tile returned by hrRenderGetFrameBufferTilesHDR4f
+*/
+struct HRFrameBufferTile
+{
+  int32_t x;   ///< tile origin in pixels
+  int32_t y;   ///< tile origin in pixels
+  int32_t w;   ///< tile width;  border tiles may be smaller than a_tileSize
+  int32_t h;   ///< tile height; border tiles may be smaller than a_tileSize
+  float   spp; ///< samples per pixel of the whole frame if render driver reports it, 0 otherwise; render drivers don't count samples per tile
+};
+
+/**
+\brief get only those framebuffer tiles whose content was changed since previous call.
+\param pRender    - render
+\param w          - framebuffer width
+\param h          - framebuffer height
+\param a_tileSize - tile size in pixels
+\param a_tiles    - output tile descriptions, at least a_maxTiles elements
+\param a_tileData - output tile pixels; tile i is placed at offset i*a_tileSize*a_tileSize*4 floats, rows are tightly packed with a_tiles[i].w stride
+\param a_maxTiles - max tiles to return; changed tiles that did not fit will be returned by next call
+\param a_layerName - framebuffer layer
+\return number of returned tiles
+
+ First call (and first call after hrRenderResetFrameBufferTiles or w/h/a_tileSize change) returns all tiles.
+ All returned tiles belong to the same accumulation pass. If render process keeps writing frame buffer while tiles are read, 0 is returned 
+ and changed tiles will be returned by next call.
+
+ Changes are found by hashing tile pixels, so only the data copied to the caller is reduced, not the reads from render driver: 
+ every call reads tiles in scanline order until a_maxTiles changed ones are found (line by line if render driver supports 
+ GetFrameBufferLineHDR and a_layerName is "color", otherwise the whole frame at once), and repeats this up to 4 times 
+ if accumulation pass changes meanwhile.
+
+*/
+HAPI int32_t hrRenderGetFrameBufferTilesHDR4f(HRRenderRef pRender, int w, int h, int a_tileSize, HRFrameBufferTile* a_tiles, float* a_tileData, int32_t a_maxTiles,
+                                              const wchar_t* a_layerName = L"color");
+
+/**
+\brief forget what tiles were returned by hrRenderGetFrameBufferTilesHDR4f, so next call will return all of them
+*/
+HAPI void hrRenderResetFrameBufferTiles(HRRenderRef pRender);
+
 /**
 \brief save framebuffer content to imgData (convert it to LDR). Color only.
 */
@@ -1169,6 +1211,26 @@ HAPI HRLightRef hrFindLightByName(const wchar_t *a_lightName);
 */
 HAPI HRCameraRef hrFindCameraByName(const wchar_t *a_cameraName);
 
+/**
+\brief get many HRMaterialRef by names in a single call.
+\param a_names   - array of material names
+\param a_count   - number of names
+\param a_outRefs - output array of a_count references; for names that were not found id = -1 is written
+\return number of found materials
+
+*/
+HAPI int32_t hrFindMaterialsByNames(const wchar_t** a_names, int32_t a_count, HRMaterialRef* a_outRefs);
+
+/**
+\brief get many HRLightRef by names in a single call. Same as hrFindMaterialsByNames, but for lights.
+*/
+HAPI int32_t hrFindLightsByNames(const wchar_t** a_names, int32_t a_count, HRLightRef* a_outRefs);
+
+/**
+\brief get many HRCameraRef by names in a single call. Same as hrFindMaterialsByNames, but for cameras.
+*/
+HAPI int32_t hrFindCamerasByNames(const wchar_t** a_names, int32_t a_count, HRCameraRef* a_outRefs);
+
 /**
 \brief get HRRenderRef by its type name from the library.
 \param a_renderTypeName - render type name
@@ -38,6 +38,7 @@ HAPI HRCameraRef hrCameraCreate(const wchar_t* a_objectName)
 
   g_objManager.scnData.cameras[ref.id].update_next(nodeXml);
   g_objManager.scnData.cameras[ref.id].id = ref.id;
+  g_objManager.scnData.m_cameraIdByName.emplace(cam.name, ref.id);
 
   return ref;
 }
@@ -103,6 +104,10 @@ HAPI void hrCameraClose(HRCameraRef a_pCam)
     return;
   }
 
+  const pugi::xml_attribute nameAttr = pCam->xml_node_immediate().attribute(L"name");
+  if (nameAttr != nullptr && pCam->name != nameAttr.as_string())
+    HR_RenameObject(g_objManager.scnData.m_cameraIdByName, g_objManager.scnData.cameras, *pCam, nameAttr.as_string());
+
   pCam->opened = false;
 }
 
@@ -126,28 +131,61 @@ HAPI pugi::xml_node hrCameraParamNode(HRCameraRef a_camRef)
 
 HAPI HRCameraRef hrFindCameraByName(const wchar_t *a_cameraName)
 {
-  HRCameraRef camera;
+  HRCameraRef ref;
 
   if(a_cameraName != nullptr)
   {
-    for (auto cam : g_objManager.scnData.cameras)
+    const auto& index = g_objManager.scnData.m_cameraIdByName;
+    auto p = index.find(a_cameraName);
+    if (p != index.end())
+      ref.id = p->second;
+  }
+
+  if(ref.id == -1)
+  {
+    std::wstringstream ss;
+    ss << L"hrCameraFindByName: can't find camera \"" << (a_cameraName != nullptr ? a_cameraName : L"") << "\"";
+    HrError(ss.str());
+  }
+
+  return ref;
+}
+
+HAPI int32_t hrFindCamerasByNames(const wchar_t** a_names, int32_t a_count, HRCameraRef* a_outRefs)
+{
+  if (a_names == nullptr || a_outRefs == nullptr)
+  {
+    HrError(L"hrFindCamerasByNames: nullptr input");
+    return 0;
+  }
+
+  const auto& index = g_objManager.scnData.m_cameraIdByName;
+
+  int32_t found = 0;
+  const wchar_t* firstMissing = nullptr;
+
+  for (int32_t i = 0; i < a_count; i++)
+  {
+    a_outRefs[i] = HRCameraRef();
+
+    auto p = (a_names[i] != nullptr) ? index.find(a_names[i]) : index.end();
+    if (p != index.end())
     {
-      if (cam.name == std::wstring(a_cameraName))
-      {
-        camera.id = cam.id;
-        break;
-      }
+      a_outRefs[i].id = p->second;
+      found++;
     }
+    else if (firstMissing == nullptr)
+      firstMissing = (a_names[i] != nullptr) ? a_names[i] : L"";
   }
 
-  if(camera.id == -1)
+  if (found != a_count)
   {
     std::wstringstream ss;
-    ss << L"hrCameraFindByName: can't find camera \"" << a_cameraName << "\"";
+    ss << L"hrFindCamerasByNames: can't find " << (a_count - found) << L" camera(s), first is \"" << firstMissing << "\"";
     HrError(ss.str());
   }
 
-  return camera;
+  return found;
 }
 
 
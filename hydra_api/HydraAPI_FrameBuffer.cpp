@@ -19,6 +19,9 @@ extern HRObjectManager   g_objManager;
 
 #include <FreeImage.h>
 #include <cmath>
+#include <algorithm>
+
+#include "xxhash.h"
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -94,6 +97,134 @@ HAPI bool hrRenderGetFrameBufferLineHDR4f(HRRenderRef a_pRender, int a_begin, in
   return true;
 }
 
+HAPI int32_t hrRenderGetFrameBufferTilesHDR4f(HRRenderRef a_pRender, int w, int h, int a_tileSize, HRFrameBufferTile* a_tiles, float* a_tileData, int32_t a_maxTiles,
+                                              const wchar_t* a_layerName)
+{
+  HRRender* pRender = g_objManager.PtrById(a_pRender);
+  if (pRender == nullptr)
+  {
+    HrError(L"hrRenderGetFrameBufferTilesHDR4f, nullptr Render Driver ");
+    return 0;
+  }
+
+  if (pRender->m_pDriver == nullptr)
+  {
+    HrError(L"hrRenderGetFrameBufferTilesHDR4f, nullptr Render Driver impl ");
+    return 0;
+  }
+
+  if (w <= 0 || h <= 0 || a_tileSize <= 0 || a_tiles == nullptr || a_tileData == nullptr)
+  {
+    HrError(L"hrRenderGetFrameBufferTilesHDR4f, bad input arguments ");
+    return 0;
+  }
+
+  const int tilesX     = (w + a_tileSize - 1) / a_tileSize;
+  const int tilesY     = (h + a_tileSize - 1) / a_tileSize;
+  const int tilesTotal = tilesX*tilesY;
+
+  auto& state = pRender->m_tiles;
+  if (state.width != w || state.height != h || state.tileSize != a_tileSize)
+  {
+    state.width    = w;
+    state.height   = h;
+    state.tileSize = a_tileSize;
+    state.hash.assign(tilesTotal, 0);
+    state.sent.assign(tilesTotal, 0);  // nothing was returned yet
+  }
+
+  // drivers read lines only from color layer; for other layers take single full frame read
+  //
+  const bool readLines = pRender->m_pDriver->Info().supportGetFrameBufferLine && (a_layerName == nullptr || std::wstring(a_layerName) == L"color");
+  const size_t tileFloats = size_t(a_tileSize)*size_t(a_tileSize)*4;
+  const int maxAttempts   = 4;
+
+  std::vector<std::pair<int, uint64_t> > changed; // (tileId, hash) of returned tiles
+  changed.reserve(size_t(std::min(a_maxTiles, tilesTotal)));
+
+  float sppFrame = 0.0f;
+  bool  passOk   = false;
+
+  for (int attempt = 0; attempt < maxAttempts && !passOk; attempt++)
+  {
+    // (1) pixels and spp must belong to the same accumulation pass, so remember the pass before reading tiles ...
+    //
+    float   sppBefore  = 0.0f;
+    int64_t passBefore = 0;
+    const bool havePass = pRender->m_pDriver->GetFrameBufferPassInfo(&sppBefore, &passBefore);
+    if (havePass && passBefore < 0) // frame buffer is being written now
+      continue;
+
+    if (!readLines)
+    {
+      state.frame.resize(size_t(w)*size_t(h)*4);
+      pRender->m_pDriver->GetFrameBufferHDR(w, h, state.frame.data(), a_layerName);
+    }
+
+    // (2) read tiles directly to output slots in scanline order; slot of unchanged tile is reused by the next one
+    //
+    changed.clear();
+    for (int tileId = 0; tileId < tilesTotal && int32_t(changed.size()) < a_maxTiles; tileId++)
+    {
+      const int x0 = (tileId % tilesX)*a_tileSize;
+      const int y0 = (tileId / tilesX)*a_tileSize;
+      const int tw = std::min(a_tileSize, w - x0);
+      const int th = std::min(a_tileSize, h - y0);
+
+      float* out = a_tileData + changed.size()*tileFloats;
+      for (int y = 0; y < th; y++)
+      {
+        if (readLines)
+          pRender->m_pDriver->GetFrameBufferLineHDR(x0, x0 + tw, y0 + y, out + size_t(y)*size_t(tw)*4, a_layerName);
+        else
+          memcpy(out + size_t(y)*size_t(tw)*4, state.frame.data() + (size_t(y0 + y)*size_t(w) + size_t(x0))*4, size_t(tw)*sizeof(float)*4);
+      }
+
+      const uint64_t hash = XXH64(out, size_t(tw)*size_t(th)*sizeof(float)*4, 0);
+      if (state.sent[tileId] != 0 && state.hash[tileId] == hash)
+        continue;
+
+      HRFrameBufferTile& tile = a_tiles[changed.size()];
+      tile.x = x0;
+      tile.y = y0;
+      tile.w = tw;
+      tile.h = th;
+      changed.push_back(std::make_pair(tileId, hash));
+    }
+
+    // (3) ... and check that it is still the same pass after
+    //
+    float   sppAfter  = 0.0f;
+    int64_t passAfter = 0;
+    passOk   = !havePass || (pRender->m_pDriver->GetFrameBufferPassInfo(&sppAfter, &passAfter) && passAfter == passBefore);
+    sppFrame = havePass ? sppBefore : 0.0f;
+  }
+
+  if (!passOk) // render process kept writing frame buffer; return nothing, these tiles will be returned by next call
+    return 0;
+
+  for (size_t i = 0; i < changed.size(); i++)
+  {
+    a_tiles[i].spp = sppFrame;
+    state.hash[changed[i].first] = changed[i].second;
+    state.sent[changed[i].first] = 1;
+  }
+
+  return int32_t(changed.size());
+}
+
+HAPI void hrRenderResetFrameBufferTiles(HRRenderRef a_pRender)
+{
+  HRRender* pRender = g_objManager.PtrById(a_pRender);
+  if (pRender == nullptr)
+  {
+    HrError(L"hrRenderResetFrameBufferTiles, nullptr Render Driver ");
+    return;
+  }
+
+  pRender->m_tiles = HRRender::TilesState();
+}
+
 HAPI bool hrRenderGetFrameBufferLineLDR1i(HRRenderRef a_pRender, int a_begin, int a_end, int a_y, int32_t* imgData)
 {
   HRRender* pRender = g_objManager.PtrById(a_pRender);
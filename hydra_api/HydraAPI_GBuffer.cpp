@@ -5,6 +5,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <algorithm>
 
 #include <sstream>
 #include <fstream>
@@ -273,22 +274,18 @@ HAPI bool hrRenderSaveGBufferLayerLDR(HRRenderRef a_pRender, const wchar_t* a_ou
   HRSceneInstRef scnRef;
   scnRef.id = g_objManager.m_currSceneId;
   HRSceneInst *pScn = g_objManager.PtrById(scnRef);
-  auto scnNode = pScn->xml_node_immediate();
-
   std::vector <int32_t> instanceIdToScnId(pScn->drawList.size(), 0);
 
 
   if(lname == L"scnsid")
   {
-    for (auto node = scnNode.first_child(); node != nullptr; node = node.next_sibling())
-      if (std::wstring(node.name()) == L"instance")
-        instanceIdToScnId[node.attribute(L"id").as_int()] = node.attribute(L"scn_sid").as_int();
+    for (size_t i = 0; i < pScn->drawList.size(); i++) // drawList also holds instances of binary instance tables
+      instanceIdToScnId[i] = std::max(pScn->drawList[i].scene_sid, 0);
   }
   else if(lname == L"scnid")
   {
-    for (auto node = scnNode.first_child(); node != nullptr; node = node.next_sibling())
-      if (std::wstring(node.name()) == L"instance")
-        instanceIdToScnId[node.attribute(L"id").as_int()] = node.attribute(L"scn_id").as_int();
+    for (size_t i = 0; i < pScn->drawList.size(); i++)
+      instanceIdToScnId[i] = std::max(pScn->drawList[i].scene_id, 0);
   }
 
 
@@ -21,6 +21,8 @@ using namespace HydraLiteMath;
 #include "HydraVSGFExport.h"
 #include "HydraXMLHelpers.h"
 #include "HydraTextureUtils.h"
+#include "ssemath.h"
+#include "vfloat4_x64.h"
 
 extern std::wstring      g_lastError;
 extern std::wstring      g_lastErrorCallerPlace;
@@ -248,7 +250,7 @@ HAPI HRMeshRef hrMeshCreateFromFileDL_NoNormals(const wchar_t* a_fileName)
 }
 
 template<typename T>
-static std::vector<T> ReadArrayFromMeshNode(pugi::xml_node meshNode, ChunkPointer a_chunk, const wchar_t* a_arrayName) // pre a_chunk.InMemory()
+static std::vector<T> ReadArrayFromMeshNode(pugi::xml_node meshNode, const char* data, const wchar_t* a_arrayName) // pre data != nullptr
 {
   pugi::xml_node child = meshNode.first_child();
   for (; child != nullptr; child = child.next_sibling())
@@ -257,8 +259,6 @@ static std::vector<T> ReadArrayFromMeshNode(pugi::xml_node meshNode, ChunkPointe
       break;
   }
 
-  const char* data = (const char*)a_chunk.GetMemoryNow();
-
   const size_t offset = size_t(child.attribute(L"offset").as_ullong());
   const size_t bsize  = size_t(child.attribute(L"bytesize").as_ullong());
 
@@ -280,22 +280,26 @@ void OpenHRMesh(HRMesh* pMesh, pugi::xml_node nodeXml)
   auto chunkId = pMesh->pImpl->chunkId();
   auto chunk   = g_objManager.scnData.m_vbCache.chunk_at(chunkId);
 
-  if (chunk.InMemory())
+  ChunkPinScope pin(g_objManager.scnData.m_vbCache);
+  const char* data = (const char*)chunk.GetMemoryNow(); // may swap chunk in if demand paging is enabled
+
+  if (data != nullptr)
   {
     // (1) read common mesh attributes
     //
-    pMesh->m_input.verticesPos      = ReadArrayFromMeshNode<float>   (nodeXml, chunk, L"positions");
-    pMesh->m_input.verticesNorm     = ReadArrayFromMeshNode<float>   (nodeXml, chunk, L"normals");
-    pMesh->m_input.verticesTangent  = ReadArrayFromMeshNode<float>   (nodeXml, chunk, L"tangents");
-    pMesh->m_input.verticesTexCoord = ReadArrayFromMeshNode<float>   (nodeXml, chunk, L"texcoords");
-    pMesh->m_input.triIndices       = ReadArrayFromMeshNode<uint32_t>(nodeXml, chunk, L"indices");
-    pMesh->m_input.matIndices       = ReadArrayFromMeshNode<uint32_t>(nodeXml, chunk, L"matindices");
+    pMesh->m_input.verticesPos      = ReadArrayFromMeshNode<float>   (nodeXml, data, L"positions");
+    pMesh->m_input.verticesNorm     = ReadArrayFromMeshNode<float>   (nodeXml, data, L"normals");
+    pMesh->m_input.verticesTangent  = ReadArrayFromMeshNode<float>   (nodeXml, data, L"tangents");
+    pMesh->m_input.verticesTexCoord = ReadArrayFromMeshNode<float>   (nodeXml, data, L"texcoords");
+    pMesh->m_input.triIndices       = ReadArrayFromMeshNode<uint32_t>(nodeXml, data, L"indices");
+    pMesh->m_input.matIndices       = ReadArrayFromMeshNode<uint32_t>(nodeXml, data, L"matindices");
 
     // (2) #TODO: read custom mesh attributes
     //
   }
   else
   {
+    g_objManager.scnData.m_vbCache.WaitForWrites();
     std::wstring location = ChunkName(chunk);
 
     HydraGeomData data;
@@ -965,106 +969,150 @@ HAPI HROpenedMeshInfo  hrMeshGetInfo(HRMeshRef a_mesh)
 }
 
 
+static inline float hr_acos_approx(float x) ///< Abramowitz and Stegun 4.4.45, absolute error is less than 7e-5
+{
+  const float ax = fminf(fabsf(x), 1.0f);
+  const float r  = sqrtf(1.0f - ax)*(1.5707288f + ax*(-0.2121144f + ax*(0.0742610f - 0.0187293f*ax)));
+  return (x >= 0.0f) ? r : 3.14159265f - r;
+}
+
+static inline cvex::vfloat4 hr_normalize3(const cvex::vfloat4 v) { return _mm_div_ps(v, cvex::splat(sqrtf(cvex::dot3f(v, v)))); }
+
 void hrMeshComputeNormals(HRMeshRef a_mesh, const int indexNum, bool useFaceNormals)
 {
-	HRMesh* pMesh = g_objManager.PtrById(a_mesh);
-	if (pMesh == nullptr)
-	{
-		HrError(L"hrMeshComputeNormals: nullptr input");
-		return;
-	}
+  HRMesh* pMesh = g_objManager.PtrById(a_mesh);
+  if (pMesh == nullptr)
+  {
+    HrError(L"hrMeshComputeNormals: nullptr input");
+    return;
+  }
 
-	HRMesh::InputTriMesh& mesh = pMesh->m_input;
+  HRMesh::InputTriMesh& mesh = pMesh->m_input;
 
-	int faceNum = indexNum / 3;
+  const int  vertNum    = int(mesh.verticesPos.size() / 4);
+  const int  faceNum    = int(std::min(size_t(std::max(indexNum, 0)), mesh.triIndices.size()) / 3);
+  const bool fastAngles = g_objManager.m_fastNormals;
 
-	//std::vector<float3> faceNormals;
-	//faceNormals.reserve(faceNum);
+  const float*    positions = mesh.verticesPos.data();
+  const uint32_t* indices   = mesh.triIndices.data();
 
-	std::vector<float3> vertexNormals(mesh.verticesPos.size() / 4, float3(0.0, 0.0, 0.0));
+  // (1) face normal and angle weights of its corners; triangles are independent, so do it in parallel
+  //
+  std::vector<float3> faceNormals(faceNum);
+  std::vector<float>  cornerWeights(size_t(faceNum)*3);
 
+  #pragma omp parallel for
+  for (int i = 0; i < faceNum; ++i)
+  {
+    const uint32_t iA = indices[3*i + 0];
+    const uint32_t iB = indices[3*i + 1];
+    const uint32_t iC = indices[3*i + 2];
 
-	for (auto i = 0; i < faceNum; ++i)
-	{
-		float3 A = float3(mesh.verticesPos.at(4 * mesh.triIndices.at(3*i)), mesh.verticesPos.at(4 * mesh.triIndices.at(3*i) + 1), mesh.verticesPos.at(4 * mesh.triIndices.at(3*i) + 2));
-		float3 B = float3(mesh.verticesPos.at(4 * mesh.triIndices.at(3*i + 1)), mesh.verticesPos.at(4 * mesh.triIndices.at(3*i + 1) + 1), mesh.verticesPos.at(4 * mesh.triIndices.at(3*i + 1) + 2));
-		float3 C = float3(mesh.verticesPos.at(4 * mesh.triIndices.at(3*i + 2)), mesh.verticesPos.at(4 * mesh.triIndices.at(3*i + 2) + 1), mesh.verticesPos.at(4 * mesh.triIndices.at(3*i + 2) + 2));
-    
-		float3 edge1A = normalize(B - A);
-		float3 edge2A = normalize(C - A);
+    if (iA >= uint32_t(vertNum) || iB >= uint32_t(vertNum) || iC >= uint32_t(vertNum)) // bad triangle does not contribute
+    {
+      faceNormals[i] = float3(0.0f, 0.0f, 0.0f);
+      cornerWeights[3*i + 0] = cornerWeights[3*i + 1] = cornerWeights[3*i + 2] = 0.0f;
+      continue;
+    }
 
-		float3 edge1B = normalize(A - B);
-		float3 edge2B = normalize(C - B);
+    const cvex::vfloat4 A = cvex::load_u(positions + 4*iA);
+    const cvex::vfloat4 B = cvex::load_u(positions + 4*iB);
+    const cvex::vfloat4 C = cvex::load_u(positions + 4*iC);
 
-		float3 edge1C = normalize(A - C);
-		float3 edge2C = normalize(B - C);
-    
-/*
-    float3 edge1A = normalize(A - B);
-    float3 edge2A = normalize(A - C);
-
-    float3 edge1B = normalize(B - A);
-    float3 edge2B = normalize(B - C);
-
-    float3 edge1C = normalize(C - A);
-    float3 edge2C = normalize(C - B);
-    */
-
-		float3 face_normal = normalize(cross(edge1A, edge2A));
-    /*
-    vertexNormals.at(mesh.triIndices.at(3 * i)) += face_normal;
-    vertexNormals.at(mesh.triIndices.at(3 * i + 1)) += face_normal;
-    vertexNormals.at(mesh.triIndices.at(3 * i + 2)) += face_normal;
-    */
-    if(!useFaceNormals)
+    // edges at B and C are the same unit vectors as at A up to a sign, which is exact in floating point
+    //
+    const cvex::vfloat4 edgeAB = hr_normalize3(_mm_sub_ps(B, A));
+    const cvex::vfloat4 edgeAC = hr_normalize3(_mm_sub_ps(C, A));
+    const cvex::vfloat4 edgeBC = hr_normalize3(_mm_sub_ps(C, B));
+    const cvex::vfloat4 minus  = cvex::splat(-1.0f);
+
+    const cvex::vfloat4 edge1A = edgeAB;
+    const cvex::vfloat4 edge2A = edgeAC;
+    const cvex::vfloat4 crossA = cvex::cross3(edge1A, edge2A);
+
+    ALIGN(16) float faceNormal[4];
+    cvex::store(faceNormal, hr_normalize3(crossA));
+    faceNormals[i] = float3(faceNormal[0], faceNormal[1], faceNormal[2]);
+
+    if (useFaceNormals)
     {
-      float dotA = dot(edge1A, edge2A);
-      float dotB = dot(edge1B, edge2B);
-      float dotC = dot(edge1C, edge2C);
-
-      const float lenA = length(cross(edge1A, edge2A));
-      const float lenB = length(cross(edge1B, edge2B));
-      const float lenC = length(cross(edge1C, edge2C));
-      
-      float wA = fmaxf(lenA*fabsf(std::acos(dotA)), 1e-5f);
-      float wB = fmaxf(lenB*fabsf(std::acos(dotB)), 1e-5f);
-      float wC = fmaxf(lenC*fabsf(std::acos(dotC)), 1e-5f);
-
-//      float face_area = 0.5f * sqrtf(powf(edge1A.y * edge2A.z - edge1A.z * edge2A.y, 2) +
-//                                     powf(edge1A.z * edge2A.x - edge1A.x * edge2A.z, 2) +
-//                                     powf(edge1A.x * edge2A.y - edge1A.y * edge2A.x, 2));
-      float face_area = 1.0f;
-
-      float3 normalA = face_normal * wA * face_area;
-      float3 normalB = face_normal * wB * face_area;
-      float3 normalC = face_normal * wC * face_area;
-
-      vertexNormals.at(mesh.triIndices.at(3 * i + 0)) += normalA;
-      vertexNormals.at(mesh.triIndices.at(3 * i + 1)) += normalB;
-      vertexNormals.at(mesh.triIndices.at(3 * i + 2)) += normalC;
+      cornerWeights[3*i + 0] = cornerWeights[3*i + 1] = cornerWeights[3*i + 2] = 1.0f;
+      continue;
     }
-    else
+
+    const cvex::vfloat4 edge1B = _mm_mul_ps(edgeAB, minus);
+    const cvex::vfloat4 edge2B = edgeBC;
+    const cvex::vfloat4 edge1C = _mm_mul_ps(edgeAC, minus);
+    const cvex::vfloat4 edge2C = _mm_mul_ps(edgeBC, minus);
+
+    const cvex::vfloat4 crossB = cvex::cross3(edge1B, edge2B);
+    const cvex::vfloat4 crossC = cvex::cross3(edge1C, edge2C);
+
+    const float dotA = cvex::dot3f(edge1A, edge2A);
+    const float dotB = cvex::dot3f(edge1B, edge2B);
+    const float dotC = cvex::dot3f(edge1C, edge2C);
+
+    const float lenA = sqrtf(cvex::dot3f(crossA, crossA));
+    const float lenB = sqrtf(cvex::dot3f(crossB, crossB));
+    const float lenC = sqrtf(cvex::dot3f(crossC, crossC));
+
+    const float angleA = fastAngles ? hr_acos_approx(dotA) : std::acos(dotA);
+    const float angleB = fastAngles ? hr_acos_approx(dotB) : std::acos(dotB);
+    const float angleC = fastAngles ? hr_acos_approx(dotC) : std::acos(dotC);
+
+    cornerWeights[3*i + 0] = fmaxf(lenA*fabsf(angleA), 1e-5f);
+    cornerWeights[3*i + 1] = fmaxf(lenB*fabsf(angleB), 1e-5f);
+    cornerWeights[3*i + 2] = fmaxf(lenC*fabsf(angleC), 1e-5f);
+  }
+
+  // (2) vertex --> corners adjacency (CSR); corners of each vertex go in triangle order, so sums below are the same as in serial accumulation
+  //
+  const size_t cornersNum = size_t(faceNum)*3;
+
+  std::vector<uint32_t> adjOffsets(size_t(vertNum) + 1, 0);
+  for (size_t c = 0; c < cornersNum; c++)
+  {
+    if (indices[c] < uint32_t(vertNum))
+      adjOffsets[indices[c] + 1]++;
+  }
+
+  for (size_t v = 0; v < size_t(vertNum); v++)
+    adjOffsets[v + 1] += adjOffsets[v];
+
+  std::vector<uint32_t> adjCorners(adjOffsets[vertNum]);
+  {
+    std::vector<uint32_t> cursor(adjOffsets.begin(), adjOffsets.end() - 1);
+    for (size_t c = 0; c < cornersNum; c++)
     {
-      vertexNormals.at(mesh.triIndices.at(3 * i + 0)) += face_normal;
-      vertexNormals.at(mesh.triIndices.at(3 * i + 1)) += face_normal;
-      vertexNormals.at(mesh.triIndices.at(3 * i + 2)) += face_normal;
+      if (indices[c] < uint32_t(vertNum))
+        adjCorners[cursor[indices[c]]++] = uint32_t(c);
     }
-		//faceNormals.push_back(face_normal);
-	}
+  }
 
-	if(mesh.verticesNorm.size() != mesh.verticesPos.size())
-	  mesh.verticesNorm.resize(mesh.verticesPos.size());
+  // (3) each vertex gathers its corners, so there are no write conflicts
+  //
+  if(mesh.verticesNorm.size() != mesh.verticesPos.size())
+    mesh.verticesNorm.resize(mesh.verticesPos.size());
 
-	for (int i = 0; i < vertexNormals.size(); ++i)
-	{
-		float3 N = normalize(vertexNormals.at(i));
+  float* normals = mesh.verticesNorm.data();
 
-    mesh.verticesNorm.at(4 * i + 0) = N.x;
-    mesh.verticesNorm.at(4 * i + 1) = N.y;
-    mesh.verticesNorm.at(4 * i + 2) = N.z;
-    mesh.verticesNorm.at(4 * i + 3) = 1.0f;
+  #pragma omp parallel for
+  for (int i = 0; i < vertNum; ++i)
+  {
+    float3 sum(0.0f, 0.0f, 0.0f);
+    for (uint32_t k = adjOffsets[i]; k < adjOffsets[i + 1]; k++)
+    {
+      const uint32_t c = adjCorners[k];
+      sum += faceNormals[c / 3] * cornerWeights[c];
+    }
 
-	}
+    const float3 N = normalize(sum);
+
+    normals[4 * i + 0] = N.x;
+    normals[4 * i + 1] = N.y;
+    normals[4 * i + 2] = N.z;
+    normals[4 * i + 3] = 1.0f;
+  }
 }
 
 HAPI void hrMeshComputeTangents(HRMeshRef a_mesh, int indexNum)
@@ -17,6 +17,10 @@
 #include <set>
 #include <algorithm>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "LiteMath.h"
 using namespace HydraLiteMath;
 
@@ -34,19 +38,6 @@ extern HRObjectManager   g_objManager;
 
 
 
-struct vertex_cache_eq
-{
-    bool operator()(const vertex_cache & u, const vertex_cache & v) const
-    {
-      return (fabsf(u.pos.x - v.pos.x) < 1e-6) && (fabsf(u.pos.y - v.pos.y) < 1e-6) && (fabsf(u.pos.z - v.pos.z) < 1e-6) && //pos
-             (fabsf(u.normal.x - v.normal.x) < 1e-3) && (fabsf(u.normal.y - v.normal.y) < 1e-3) && (fabsf(u.normal.z - v.normal.z) < 1e-3) && //norm
-             (fabsf(u.uv.x - v.uv.x) < 1e-5) && (fabsf(u.uv.y - v.uv.y) < 1e-5) &&
-             (fabsf(u.tangent.x - v.tangent.x) < 1e-3) && (fabsf(u.tangent.y - v.tangent.y) < 1e-3) && (fabsf(u.tangent.z - v.tangent.z) < 1e-3) &&
-             (fabsf(u.tangent.w - v.tangent.w) < 1e-1); //tangents
-    }
-};
-
-
 void doDisplacement(HRMesh *pMesh, const pugi::xml_node &displaceXMLNode, std::vector<uint3> &triangleList,
                     const HRUtils::BBox &bbox);
 
@@ -87,45 +78,6 @@ bool meshHasDisplacementMat(HRMeshRef a_mesh, pugi::xml_node &displaceXMLNode)
   return false;
 }
 
-bool instanceHasDisplacementMat(HRMeshRef a_meshRef, const std::unordered_map<uint32_t, uint32_t> &remapList,
-                                pugi::xml_node &displaceXMLNode, HRMaterialRef &matRef)
-{
-  HRMesh *pMesh = g_objManager.PtrById(a_meshRef);
-  if (pMesh == nullptr)
-  {
-    HrError(L"meshHasDisplacementMat: nullptr input");
-    return false;
-  }
-
-  HRMesh::InputTriMesh &mesh = pMesh->m_input;
-
-  std::set<int32_t> uniqueMatIndices;
-  for(auto mI : mesh.matIndices)
-  {
-    if(remapList.find(mI) != remapList.end())
-      mI = remapList.at(mI);
-    auto ins = uniqueMatIndices.insert(mI);
-    if (ins.second)
-    {
-      //HRMaterialRef tmpRef;
-      matRef.id = mI;
-      auto mat = g_objManager.PtrById(matRef);
-      if (mat != nullptr)
-      {
-        auto d_node = mat->xml_node_next(HR_OPEN_EXISTING).child(L"displacement");
-
-        if (d_node.attribute(L"type").as_string() == std::wstring(L"true_displacement"))
-        {
-          displaceXMLNode = d_node;
-          return true;
-        }
-      }
-    }
-  }
-
-  return false;
-}
-
 void hrMeshDisplace(HRMeshRef a_mesh, const std::unordered_map<uint32_t, uint32_t> &remapList,
                     pugi::xml_document &stateToProcess, const HRUtils::BBox &bbox)
 {
@@ -208,36 +160,93 @@ float smoothing_coeff(uint32_t valence)
   return (4.0f - 2.0f * cosf((2.0f * 3.14159265358979323846f) / valence )) / 9.0f;
 }
 
-std::vector<uint32_t> find_vertex_neighbours(int vertex_index, const HRMesh::InputTriMesh& mesh)
+/**
+\brief Vertex --> neighbour vertices adjacency in CSR form: neighbours of vertex v are neighbours[offsets[v] .. offsets[v+1]),
+       sorted in ascending order and without duplicates.
+*/
+struct VertexAdjacency
+{
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> neighbours;
+
+  uint32_t valence(uint32_t v) const { return offsets[v + 1] - offsets[v]; }
+};
+
+void build_vertex_adjacency(const std::vector<uint32_t>& triIndices, uint32_t vertexNum, VertexAdjacency& adj)
 {
-  std::set<uint32_t> neighbours;
-  for(int i = 0; i < mesh.triIndices.size(); i += 3)
+  const size_t triNum = triIndices.size() / 3;
+  const uint32_t* indices = triIndices.data();
+
+  auto badTriangle = [indices, vertexNum](size_t t) { return indices[3*t + 0] >= vertexNum || indices[3*t + 1] >= vertexNum || indices[3*t + 2] >= vertexNum; };
+
+  // each corner adds two other vertices of its triangle; count them first
+  //
+  std::vector<uint32_t> counts(size_t(vertexNum) + 1, 0);
+  for (size_t t = 0; t < triNum; t++)
   {
-    uint32_t indA = mesh.triIndices[i + 0];
-    uint32_t indB = mesh.triIndices[i + 1];
-    uint32_t indC = mesh.triIndices[i + 2];
+    if (badTriangle(t))
+      continue;
+    counts[indices[3*t + 0] + 1] += 2;
+    counts[indices[3*t + 1] + 1] += 2;
+    counts[indices[3*t + 2] + 1] += 2;
+  }
 
-    if(vertex_index == indA)
-    {
-      neighbours.insert(indB);
-      neighbours.insert(indB);
-      neighbours.insert(indC);
-    }
-    else if(vertex_index == indB)
-    {
-      neighbours.insert(indA);
-      neighbours.insert(indC);
-    }
-    else if(vertex_index == indC)
+  for (size_t v = 0; v < size_t(vertexNum); v++)
+    counts[v + 1] += counts[v];
+
+  std::vector<uint32_t> raw(counts[vertexNum]);
+  {
+    std::vector<uint32_t> cursor(counts.begin(), counts.end() - 1);
+    for (size_t t = 0; t < triNum; t++)
     {
-      neighbours.insert(indA);
-      neighbours.insert(indB);
+      if (badTriangle(t))
+        continue;
+
+      const uint32_t A = indices[3*t + 0];
+      const uint32_t B = indices[3*t + 1];
+      const uint32_t C = indices[3*t + 2];
+
+      raw[cursor[A]++] = B; raw[cursor[A]++] = C;
+      raw[cursor[B]++] = A; raw[cursor[B]++] = C;
+      raw[cursor[C]++] = A; raw[cursor[C]++] = B;
     }
   }
-  std::vector<uint32_t> res;
-  res.assign(neighbours.begin(), neighbours.end());
 
-  return res;
+  // sort and remove duplicates inside each row (shared edges come twice), then pack rows together
+  //
+  std::vector<uint32_t> uniqueNum(vertexNum, 0);
+
+  #pragma omp parallel for
+  for (int v = 0; v < int(vertexNum); v++)
+  {
+    auto first = raw.begin() + counts[v];
+    auto last  = raw.begin() + counts[v + 1];
+    std::sort(first, last);
+    uniqueNum[v] = uint32_t(std::unique(first, last) - first);
+  }
+
+  adj.offsets.resize(size_t(vertexNum) + 1);
+  adj.offsets[0] = 0;
+  for (size_t v = 0; v < size_t(vertexNum); v++)
+    adj.offsets[v + 1] = adj.offsets[v] + uniqueNum[v];
+
+  adj.neighbours.resize(adj.offsets[vertexNum]);
+
+  #pragma omp parallel for
+  for (int v = 0; v < int(vertexNum); v++)
+    std::copy(raw.begin() + counts[v], raw.begin() + counts[v] + uniqueNum[v], adj.neighbours.begin() + adj.offsets[v]);
+}
+
+static inline float4 attrib_f4(const std::vector<float>& a_attrib, uint32_t vertex_index)
+{
+  const float* p = a_attrib.data() + size_t(vertex_index) * 4;
+  return float4(p[0], p[1], p[2], p[3]);
+}
+
+static inline float2 attrib_f2(const std::vector<float>& a_attrib, uint32_t vertex_index)
+{
+  const float* p = a_attrib.data() + size_t(vertex_index) * 2;
+  return float2(p[0], p[1]);
 }
 
 float4 vertex_attrib_by_index_f4(const std::string &attrib_name, uint32_t vertex_index, const HRMesh::InputTriMesh& mesh)
@@ -287,16 +296,15 @@ void update_vertex_attrib_by_index_f2(float2 new_val, uint32_t vertex_index, std
   attrib_vec.at(vertex_index * 2 + 1) = new_val.y;
 }
 
-void smooth_common_vertex_attributes(uint32_t vertex_index, const HRMesh::InputTriMesh& mesh, float4 &pos, float4 &normal,
-                                     float4 &tangent, float2 &uv)
+void smooth_common_vertex_attributes(uint32_t vertex_index, const HRMesh::InputTriMesh& mesh, const VertexAdjacency& adj,
+                                     float4 &pos, float4 &normal, float4 &tangent, float2 &uv)
 {
-  auto neighbours = find_vertex_neighbours(vertex_index, mesh);
-  uint32_t valence = neighbours.size();
+  const uint32_t valence = adj.valence(vertex_index);
 
-  pos      = vertex_attrib_by_index_f4("pos", vertex_index, mesh);
-  normal   = vertex_attrib_by_index_f4("normal", vertex_index, mesh);
-  tangent  = vertex_attrib_by_index_f4("tangent", vertex_index, mesh);
-  uv       = vertex_attrib_by_index_f2("uv", vertex_index, mesh);
+  pos      = attrib_f4(mesh.verticesPos,      vertex_index);
+  normal   = attrib_f4(mesh.verticesNorm,     vertex_index);
+  tangent  = attrib_f4(mesh.verticesTangent,  vertex_index);
+  uv       = attrib_f2(mesh.verticesTexCoord, vertex_index);
 
   //only handle ordinary vertices for now
   if(valence == 6)
@@ -306,17 +314,14 @@ void smooth_common_vertex_attributes(uint32_t vertex_index, const HRMesh::InputT
     float4 tangent_;
     float2 uv_;
 
-    for (const auto &n : neighbours)
+    for (uint32_t k = adj.offsets[vertex_index]; k < adj.offsets[vertex_index + 1]; ++k)
     {
-      float4 pos_n = vertex_attrib_by_index_f4("pos", n, mesh);
-      float4 norm_n = vertex_attrib_by_index_f4("normal", n, mesh);
-      float4 tan_n = vertex_attrib_by_index_f4("tangent", n, mesh);
-      float2 uv_n = vertex_attrib_by_index_f2("uv", n, mesh);
-
-      pos_ += pos_n;
-      norm_ += norm_n;
-      tangent_ += tan_n;
-      uv_ += uv_n;
+      const uint32_t n = adj.neighbours[k];
+
+      pos_     += attrib_f4(mesh.verticesPos,      n);
+      norm_    += attrib_f4(mesh.verticesNorm,     n);
+      tangent_ += attrib_f4(mesh.verticesTangent,  n);
+      uv_      += attrib_f2(mesh.verticesTexCoord, n);
     }
 
     float alpha = smoothing_coeff(valence);
@@ -329,23 +334,62 @@ void smooth_common_vertex_attributes(uint32_t vertex_index, const HRMesh::InputT
 }
 
 
-void addEdge(uint32_t indA, uint32_t indB, uint32_t faceInd, std::unordered_map<uint2, std::vector<uint32_t>, uint2_hash> &edgeToTris)
+/**
+\brief Directed edge of a triangle. Records are sorted by undirected key (min, max) with stable radix sort,
+       so records of one edge go together in order of faces and the first one keeps orientation of the first face.
+*/
+struct EdgeRecord
 {
-  uint2 edge1(indA, indB);
-  uint2 edge2(indB, indA);
+  uint32_t a;
+  uint32_t b;
+  uint32_t face;
+};
 
-  if(edgeToTris.find(edge1) != edgeToTris.end())
-  {
-    edgeToTris[edge1].push_back(faceInd);
-  }
-  else if(edgeToTris.find(edge2) != edgeToTris.end())
+static inline uint64_t edge_key(const EdgeRecord& e)
+{
+  const uint32_t lo = std::min(e.a, e.b);
+  const uint32_t hi = std::max(e.a, e.b);
+  return (uint64_t(lo) << 32) | uint64_t(hi);
+}
+
+/**
+\brief Stable LSD radix sort of records by 64 bit key; byte passes where all keys have the same digit are skipped.
+*/
+template <typename T, typename KeyFunc>
+void radix_sort_by_key(std::vector<T>& records, KeyFunc key_of)
+{
+  constexpr int DIGITS = 8;
+  constexpr int RADIX  = 256;
+
+  const size_t n = records.size();
+
+  std::vector<size_t> histograms(DIGITS*RADIX, 0); ///< histograms of all digits are counted in one pass
+  for (size_t i = 0; i < n; i++)
   {
-    edgeToTris[edge2].push_back(faceInd);
+    const uint64_t key = key_of(records[i]);
+    for (int d = 0; d < DIGITS; d++)
+      histograms[d*RADIX + ((key >> (8*d)) & 0xFF)]++;
   }
-  else
+
+  std::vector<T> temp(n);
+  for (int d = 0; d < DIGITS; d++)
   {
-    std::vector<uint32_t> tmp = {faceInd};
-    edgeToTris[edge1] = tmp;
+    size_t* hist = histograms.data() + d*RADIX;
+    if (n == 0 || hist[(key_of(records[0]) >> (8*d)) & 0xFF] == n) // all records have the same digit (high bytes of small meshes)
+      continue;
+
+    size_t sum = 0;
+    for (int r = 0; r < RADIX; r++)
+    {
+      const size_t count = hist[r];
+      hist[r] = sum;
+      sum    += count;
+    }
+
+    for (size_t i = 0; i < n; i++)
+      temp[hist[(key_of(records[i]) >> (8*d)) & 0xFF]++] = records[i];
+
+    records.swap(temp);
   }
 }
 
@@ -367,41 +411,36 @@ void hrMeshSubdivideSqrt3(HRMeshRef a_mesh, int a_iterations)
     const auto old_vertex_count = uint32_t(mesh.verticesPos.size() / 4);
     const auto old_tri_count = uint32_t(mesh.triIndices.size() / 3);
 
-    std::vector<uint32_t> indices;
-    indices.reserve(mesh.triIndices.size() * 3);
-    std::vector<uint32_t> mat_indices;
-    mat_indices.reserve(mesh.triIndices.size() * 3 / 3);
+    const uint32_t* triIndices = mesh.triIndices.data();
 
-    std::unordered_map<uint2, std::vector<uint32_t>, uint2_hash> edgeToTris;
+    //insert middle point; each face writes its own new vertex
+    mesh.verticesPos.resize((size_t(old_vertex_count) + old_tri_count) * 4);
+    mesh.verticesNorm.resize((size_t(old_vertex_count) + old_tri_count) * 4);
+    mesh.verticesTangent.resize((size_t(old_vertex_count) + old_tri_count) * 4);
+    mesh.verticesTexCoord.resize((size_t(old_vertex_count) + old_tri_count) * 2);
 
-    uint32_t face_num = 0;
-    //insert middle point
-    for (int j = 0; j < mesh.triIndices.size(); j += 3)
+    #pragma omp parallel for
+    for (int j = 0; j < int(old_tri_count); ++j)
     {
-      uint32_t indA = mesh.triIndices[j + 0];
-      uint32_t indB = mesh.triIndices[j + 1];
-      uint32_t indC = mesh.triIndices[j + 2];
-
-      addEdge(indA, indB, face_num, edgeToTris);
-      addEdge(indB, indC, face_num, edgeToTris);
-      addEdge(indC, indA, face_num, edgeToTris);
-
+      uint32_t indA = triIndices[3 * j + 0];
+      uint32_t indB = triIndices[3 * j + 1];
+      uint32_t indC = triIndices[3 * j + 2];
 
-      float4 A = vertex_attrib_by_index_f4("pos", indA, mesh);
-      float4 B = vertex_attrib_by_index_f4("pos", indB, mesh);
-      float4 C = vertex_attrib_by_index_f4("pos", indC, mesh);
+      float4 A = attrib_f4(mesh.verticesPos, indA);
+      float4 B = attrib_f4(mesh.verticesPos, indB);
+      float4 C = attrib_f4(mesh.verticesPos, indC);
 
-      float4 ANorm = vertex_attrib_by_index_f4("normal", indA, mesh);
-      float4 BNorm = vertex_attrib_by_index_f4("normal", indB, mesh);
-      float4 CNorm = vertex_attrib_by_index_f4("normal", indC, mesh);
+      float4 ANorm = attrib_f4(mesh.verticesNorm, indA);
+      float4 BNorm = attrib_f4(mesh.verticesNorm, indB);
+      float4 CNorm = attrib_f4(mesh.verticesNorm, indC);
 
-      float4 ATan = vertex_attrib_by_index_f4("tangent", indA, mesh);
-      float4 BTan = vertex_attrib_by_index_f4("tangent", indB, mesh);
-      float4 CTan = vertex_attrib_by_index_f4("tangent", indC, mesh);
+      float4 ATan = attrib_f4(mesh.verticesTangent, indA);
+      float4 BTan = attrib_f4(mesh.verticesTangent, indB);
+      float4 CTan = attrib_f4(mesh.verticesTangent, indC);
 
-      float2 Auv = vertex_attrib_by_index_f2("uv", indA, mesh);
-      float2 Buv = vertex_attrib_by_index_f2("uv", indB, mesh);
-      float2 Cuv = vertex_attrib_by_index_f2("uv", indC, mesh);
+      float2 Auv = attrib_f2(mesh.verticesTexCoord, indA);
+      float2 Buv = attrib_f2(mesh.verticesTexCoord, indB);
+      float2 Cuv = attrib_f2(mesh.verticesTexCoord, indC);
 
       float4 P = (A + B + C) / 3.0f;
       float4 PNorm = (ANorm + BNorm + CNorm) / 3.0f;
@@ -412,73 +451,139 @@ void hrMeshSubdivideSqrt3(HRMeshRef a_mesh, int a_iterations)
       float4 PTan = (ATan + BTan + CTan) / 3.0f;
       float2 Puv = (Auv + Buv + Cuv) / 3.0f;
 
-      uint32_t indP = mesh.verticesPos.size() / 4;
-      mesh.verticesPos.push_back(P.x);
-      mesh.verticesPos.push_back(P.y);
-      mesh.verticesPos.push_back(P.z);
-      mesh.verticesPos.push_back(P.w);
+      const uint32_t indP = old_vertex_count + uint32_t(j);
+      update_vertex_attrib_by_index_f4(P,     indP, mesh.verticesPos);
+      update_vertex_attrib_by_index_f4(PNorm, indP, mesh.verticesNorm);
+      update_vertex_attrib_by_index_f4(PTan,  indP, mesh.verticesTangent);
+      update_vertex_attrib_by_index_f2(Puv,   indP, mesh.verticesTexCoord);
+    }
 
-      mesh.verticesNorm.push_back(PNorm.x);
-      mesh.verticesNorm.push_back(PNorm.y);
-      mesh.verticesNorm.push_back(PNorm.z);
-      mesh.verticesNorm.push_back(PNorm.w);
+    // edge --> faces mapping as flat array sorted by edge
+    //
+    std::vector<EdgeRecord> edges(size_t(old_tri_count) * 3);
 
-      mesh.verticesTangent.push_back(PTan.x);
-      mesh.verticesTangent.push_back(PTan.y);
-      mesh.verticesTangent.push_back(PTan.z);
-      mesh.verticesTangent.push_back(PTan.w);
+    #pragma omp parallel for
+    for (int j = 0; j < int(old_tri_count); ++j)
+    {
+      for (int k = 0; k < 3; ++k)
+      {
+        EdgeRecord& e = edges[3 * size_t(j) + k];
+        e.a    = triIndices[3 * j + k];
+        e.b    = triIndices[3 * j + (k + 1) % 3];
+        e.face = uint32_t(j);
+      }
+    }
 
-      mesh.verticesTexCoord.push_back(Puv.x);
-      mesh.verticesTexCoord.push_back(Puv.y);
+    radix_sort_by_key(edges, edge_key);
 
-      face_num++;
-    }
+    //flip edges; edges are split into fixed blocks, each block emits triangles of edges that start in it,
+    //block offsets are found with exclusive scan, so output order does not depend on threads number
+    const int64_t edgesNum  = int64_t(edges.size());
+    const int64_t blockSize = 4096;
+    const int64_t blocksNum = (edgesNum + blockSize - 1) / blockSize;
 
-    //flip edges
-    for (const auto &edge : edgeToTris)
+    auto edgeStart = [&edges](int64_t e) { return e == 0 || edge_key(edges[e]) != edge_key(edges[e - 1]); };
+    auto edgeFaces = [&edges, edgesNum](int64_t e)
     {
-      if (edge.second.size() == 2)
+      const uint64_t key = edge_key(edges[e]);
+      int64_t last = e + 1;
+      while (last < edgesNum && edge_key(edges[last]) == key)
+        last++;
+      return last - e;
+    };
+
+    std::vector<uint32_t> blockOffsets(size_t(blocksNum) + 1, 0);
+
+    #pragma omp parallel for
+    for (int64_t blk = 0; blk < blocksNum; ++blk)
+    {
+      uint32_t trisNum = 0;
+      for (int64_t e = blk * blockSize; e < std::min(edgesNum, (blk + 1) * blockSize); ++e)
       {
-        uint32_t center1 = (old_vertex_count + edge.second[0]);
-        uint32_t center2 = (old_vertex_count + edge.second[1]);
-        uint32_t A = edge.first.x;
-        uint32_t B = edge.first.y;
-
-        indices.push_back(center1);
-        indices.push_back(center2);
-        indices.push_back(B);
-        mat_indices.push_back(mesh.matIndices[edge.second[0]]);
-
-        indices.push_back(center2);
-        indices.push_back(center1);
-        indices.push_back(A);
-        mat_indices.push_back(mesh.matIndices[edge.second[1]]);
-      } else if (edge.second.size() == 1)
+        if (!edgeStart(e))
+          continue;
+        const int64_t faces = edgeFaces(e);
+        if (faces == 2)
+          trisNum += 2;
+        else if (faces == 1)
+          trisNum += 1;
+      }
+      blockOffsets[blk + 1] = trisNum;
+    }
+
+    for (int64_t blk = 0; blk < blocksNum; ++blk)
+      blockOffsets[blk + 1] += blockOffsets[blk];
+
+    std::vector<uint32_t> indices(size_t(blockOffsets[blocksNum]) * 3);
+    std::vector<uint32_t> mat_indices(blockOffsets[blocksNum]);
+
+    #pragma omp parallel for
+    for (int64_t blk = 0; blk < blocksNum; ++blk)
+    {
+      uint32_t tri = blockOffsets[blk];
+      for (int64_t e = blk * blockSize; e < std::min(edgesNum, (blk + 1) * blockSize); ++e)
       {
-        uint32_t center = (old_vertex_count + edge.second[0]);
-        uint32_t A = edge.first.x;
-        uint32_t B = edge.first.y;
-
-        indices.push_back(center);
-        indices.push_back(A);
-        indices.push_back(B);
-        mat_indices.push_back(mesh.matIndices[edge.second[0]]);
+        if (!edgeStart(e))
+          continue;
+
+        const int64_t faces = edgeFaces(e);
+        const uint32_t A = edges[e].a;
+        const uint32_t B = edges[e].b;
+
+        if (faces == 2)
+        {
+          const uint32_t face1   = edges[e + 0].face;
+          const uint32_t face2   = edges[e + 1].face;
+          const uint32_t center1 = (old_vertex_count + face1);
+          const uint32_t center2 = (old_vertex_count + face2);
+
+          indices[3 * tri + 0] = center1;
+          indices[3 * tri + 1] = center2;
+          indices[3 * tri + 2] = B;
+          mat_indices[tri]     = mesh.matIndices[face1];
+          tri++;
+
+          indices[3 * tri + 0] = center2;
+          indices[3 * tri + 1] = center1;
+          indices[3 * tri + 2] = A;
+          mat_indices[tri]     = mesh.matIndices[face2];
+          tri++;
+        }
+        else if (faces == 1)
+        {
+          const uint32_t face   = edges[e].face;
+          const uint32_t center = (old_vertex_count + face);
+
+          indices[3 * tri + 0] = center;
+          indices[3 * tri + 1] = A;
+          indices[3 * tri + 2] = B;
+          mat_indices[tri]     = mesh.matIndices[face];
+          tri++;
+        }
       }
     }
 
+    edges = std::vector<EdgeRecord>();
+
     std::vector<float> pos_new(old_vertex_count * 4, 0.0f);
     std::vector<float> normal_new(old_vertex_count * 4, 0.0f);
     std::vector<float> tangent_new(old_vertex_count * 4, 0.0f);
     std::vector<float> uv_new(old_vertex_count * 2, 0.0f);
 
-    for (uint32_t k = 0; k < old_vertex_count; ++k)
+    // adjacency of old vertices is built once per iteration; each vertex writes only its own output, so smooth in parallel
+    //
+    VertexAdjacency adj;
+    build_vertex_adjacency(mesh.triIndices, old_vertex_count, adj);
+
+    #pragma omp parallel for
+    for (int k = 0; k < int(old_vertex_count); ++k)
     {
       float4 pos;
       float4 normal;
       float4 tangent;
       float2 uv;
 
-      smooth_common_vertex_attributes(k, mesh, pos, normal, tangent, uv);
+      smooth_common_vertex_attributes(uint32_t(k), mesh, adj, pos, normal, tangent, uv);
 
       update_vertex_attrib_by_index_f4(pos, k, pos_new);
       update_vertex_attrib_by_index_f4(normal, k, normal_new);
@@ -496,8 +601,8 @@ void hrMeshSubdivideSqrt3(HRMeshRef a_mesh, int a_iterations)
         mesh.verticesTexCoord.at(ii) = uv_new.at(ii);
     }
 
-    mesh.triIndices = indices;
-    mesh.matIndices = mat_indices;
+    mesh.triIndices.swap(indices);
+    mesh.matIndices.swap(mat_indices);
   }
 }
 
@@ -520,28 +625,30 @@ void hrMeshSubdivide(HRMeshRef a_mesh, int a_iterations)
   std::vector<uint32_t> mat_indices;
   mat_indices.reserve(mesh.triIndices.size() * 3 / 3);
 
+  const int triIndicesNum = int(mesh.triIndices.size());
+
   int face_num = 0;
-  for(int i = 0; i < mesh.triIndices.size(); i += 3)
+  for(int i = 0; i < triIndicesNum; i += 3)
   {
     uint32_t indA = mesh.triIndices[i + 0];
     uint32_t indB = mesh.triIndices[i + 1];
     uint32_t indC = mesh.triIndices[i + 2];
 
-    float4 A = vertex_attrib_by_index_f4("pos", indA, mesh);
-    float4 B = vertex_attrib_by_index_f4("pos", indB, mesh);
-    float4 C = vertex_attrib_by_index_f4("pos", indC, mesh);
+    float4 A = attrib_f4(mesh.verticesPos, indA);
+    float4 B = attrib_f4(mesh.verticesPos, indB);
+    float4 C = attrib_f4(mesh.verticesPos, indC);
 
-    float4 ANorm = vertex_attrib_by_index_f4("normal", indA, mesh);
-    float4 BNorm = vertex_attrib_by_index_f4("normal", indB, mesh);
-    float4 CNorm = vertex_attrib_by_index_f4("normal", indC, mesh);
+    float4 ANorm = attrib_f4(mesh.verticesNorm, indA);
+    float4 BNorm = attrib_f4(mesh.verticesNorm, indB);
+    float4 CNorm = attrib_f4(mesh.verticesNorm, indC);
 
-    float4 ATan = vertex_attrib_by_index_f4("tangent", indA, mesh);
-    float4 BTan = vertex_attrib_by_index_f4("tangent", indB, mesh);
-    float4 CTan = vertex_attrib_by_index_f4("tangent", indC, mesh);
+    float4 ATan = attrib_f4(mesh.verticesTangent, indA);
+    float4 BTan = attrib_f4(mesh.verticesTangent, indB);
+    float4 CTan = attrib_f4(mesh.verticesTangent, indC);
 
-    float2 Auv = vertex_attrib_by_index_f2("uv", indA, mesh);
-    float2 Buv = vertex_attrib_by_index_f2("uv", indB, mesh);
-    float2 Cuv = vertex_attrib_by_index_f2("uv", indC, mesh);
+    float2 Auv = attrib_f2(mesh.verticesTexCoord, indA);
+    float2 Buv = attrib_f2(mesh.verticesTexCoord, indB);
+    float2 Cuv = attrib_f2(mesh.verticesTexCoord, indC);
 
     float4 P = (A + B + C) / 3.0f;
     float4 PNorm = (ANorm + BNorm + CNorm) / 3.0f;
@@ -583,65 +690,101 @@ void hrMeshSubdivide(HRMeshRef a_mesh, int a_iterations)
   mesh.matIndices = mat_indices;
 }
 
-void displaceByNoise(HRMesh *pMesh, const pugi::xml_node &noiseXMLNode, std::vector<uint3> &triangleList)
+/**
+\brief Vertices of triangleList without duplicates in ascending order; each of them is displaced exactly once.
+*/
+static std::vector<uint32_t> displaced_vertices(const std::vector<uint3> &triangleList, size_t vertexNum)
 {
-  HRMesh::InputTriMesh &mesh = pMesh->m_input;
-
-  float mult = noiseXMLNode.attribute(L"amount").as_float();
-  float noise_scale = noiseXMLNode.attribute(L"scale").as_float();
+  std::vector<uint8_t> used(vertexNum, 0);
+  for (const auto& tri : triangleList)
+  {
+    if (tri.x < vertexNum) used[tri.x] = 1;
+    if (tri.y < vertexNum) used[tri.y] = 1;
+    if (tri.z < vertexNum) used[tri.z] = 1;
+  }
 
-  std::set<uint32_t > displaced_indices;
+  std::vector<uint32_t> vertices;
+  for (size_t v = 0; v < vertexNum; v++)
+  {
+    if (used[v])
+      vertices.push_back(uint32_t(v));
+  }
 
-  float4x4 scale_pos = scale4x4(make_float3(noise_scale, noise_scale, noise_scale));
+  return vertices;
+}
 
+static void load_height_map(int32_t a_texId, HRTextureUtils::HeightMap &a_heightMap)
+{
+  HRTextureNodeRef texRef;
+  texRef.id = a_texId;
 
-  for(int i = 0; i < triangleList.size(); i++)
-  {
-    const auto& tri = triangleList[i];
+  int w   = 0;
+  int h   = 0;
+  int bpp = 0;
 
-    float3 attrib1 = mul3x3(scale_pos, make_float3(vertex_attrib_by_index_f4("pos", tri.x, mesh)));
-    float3 attrib2 = mul3x3(scale_pos, make_float3(vertex_attrib_by_index_f4("pos", tri.y, mesh)));
-    float3 attrib3 = mul3x3(scale_pos, make_float3(vertex_attrib_by_index_f4("pos", tri.z, mesh)));
+  std::vector<int>   imageDataLDR;
+  std::vector<float> imageDataHDR;
 
-    float3 offset = float3(10.0f, 10.0f, 10.0f);
-    
-    float3 texHeight(0.0f, 0.0f, 0.0f);
-    auto ins = displaced_indices.insert(tri.x);
-    if(ins.second)
+  #pragma omp critical(hr_displacement_textures) // meshes may be displaced in parallel (HR_PreprocessMeshes), texture objects are shared
+  {
+    hrTexture2DGetSize(texRef, &w, &h, &bpp);
+    if(bpp > 4)
     {
-      texHeight.x = HRTextureUtils::sampleNoise(noiseXMLNode, attrib1 + offset);
-      if (texHeight.x < 0.5) texHeight.x = 0.0f;
+      imageDataHDR.resize(size_t(w) * size_t(h) * 4);
+      hrTextureNodeOpen(texRef, HR_OPEN_READ_ONLY);
+      {
+        hrTexture2DGetDataHDR(texRef, &w, &h, imageDataHDR.data());
+      }
+      hrTextureNodeClose(texRef);
     }
-
-    ins = displaced_indices.insert(tri.y);
-    if(ins.second)
+    else
     {
-      texHeight.y = HRTextureUtils::sampleNoise(noiseXMLNode, attrib2 + offset);
-      if (texHeight.y < 0.5) texHeight.y = 0.0f;
+      imageDataLDR.resize(size_t(w) * size_t(h));
+      hrTextureNodeOpen(texRef, HR_OPEN_READ_ONLY);
+      {
+        hrTexture2DGetDataLDR(texRef, &w, &h, imageDataLDR.data());
+      }
+      hrTextureNodeClose(texRef);
     }
+  }
 
-    ins = displaced_indices.insert(tri.z);
-    if(ins.second)
-    {
-      texHeight.z = HRTextureUtils::sampleNoise(noiseXMLNode, attrib3 + offset);
-      if (texHeight.z < 0.5) texHeight.z = 0.0f;
-    }
+  if(bpp > 4)
+    a_heightMap.initFromHDR(imageDataHDR, w, h);
+  else
+    a_heightMap.initFromLDR(imageDataLDR, w, h);
+}
+
+void displaceByNoise(HRMesh *pMesh, const pugi::xml_node &noiseXMLNode, std::vector<uint3> &triangleList)
+{
+  HRMesh::InputTriMesh &mesh = pMesh->m_input;
 
-    auto normalX = vertex_attrib_by_index_f4("normal", tri.x, mesh);
-    mesh.verticesPos.at(tri.x * 4 + 0) += normalX.x * mult * texHeight.x;
-    mesh.verticesPos.at(tri.x * 4 + 1) += normalX.y * mult * texHeight.x;
-    mesh.verticesPos.at(tri.x * 4 + 2) += normalX.z * mult * texHeight.x;
+  float mult = noiseXMLNode.attribute(L"amount").as_float();
+  float noise_scale = noiseXMLNode.attribute(L"scale").as_float();
+
+  const float base_freq   = noiseXMLNode.attribute(L"base_freq").as_float();
+  const int   num_octaves = noiseXMLNode.attribute(L"octaves").as_int();
+  const float persistence = noiseXMLNode.attribute(L"persistence").as_float();
+  const float lacunarity  = noiseXMLNode.attribute(L"lacunarity").as_float();
+
+  float4x4 scale_pos = scale4x4(make_float3(noise_scale, noise_scale, noise_scale));
+  float3   offset    = float3(10.0f, 10.0f, 10.0f);
+
+  const auto vertices = displaced_vertices(triangleList, mesh.verticesPos.size() / 4);
+
+  #pragma omp parallel for
+  for(int i = 0; i < int(vertices.size()); i++)
+  {
+    const uint32_t v = vertices[i];
 
-    auto normalY = vertex_attrib_by_index_f4("normal", tri.y, mesh);
-    mesh.verticesPos.at(tri.y * 4 + 0) += normalY.x * mult * texHeight.y;
-    mesh.verticesPos.at(tri.y * 4 + 1) += normalY.y * mult * texHeight.y;
-    mesh.verticesPos.at(tri.y * 4 + 2) += normalY.z * mult * texHeight.y;
+    float3 attrib = mul3x3(scale_pos, make_float3(attrib_f4(mesh.verticesPos, v)));
 
-    auto normalZ = vertex_attrib_by_index_f4("normal", tri.z, mesh);
-    mesh.verticesPos.at(tri.z * 4 + 0) += normalZ.x * mult * texHeight.z;
-    mesh.verticesPos.at(tri.z * 4 + 1) += normalZ.y * mult * texHeight.z;
-    mesh.verticesPos.at(tri.z * 4 + 2) += normalZ.z * mult * texHeight.z;
+    float texHeight = HRTextureUtils::sampleNoise(attrib + offset, num_octaves, persistence, base_freq, lacunarity);
+    if (texHeight < 0.5) texHeight = 0.0f;
 
+    const float4 normal = attrib_f4(mesh.verticesNorm, v);
+    mesh.verticesPos[v * 4 + 0] += normal.x * mult * texHeight;
+    mesh.verticesPos[v * 4 + 1] += normal.y * mult * texHeight;
+    mesh.verticesPos[v * 4 + 2] += normal.z * mult * texHeight;
   }
 }
 
@@ -650,61 +793,36 @@ void displaceCustom(HRMesh *pMesh, const pugi::xml_node &customNode, std::vector
   HRMesh::InputTriMesh &mesh = pMesh->m_input;
 
   auto texNode = customNode.child(L"texture");
-  pugi::xml_node texLibNode;
-  HRTextureNode *texture;
+  HRTextureNode *texture = nullptr;
   if(texNode != nullptr)
   {
     auto id = texNode.attribute(L"id").as_int();
-    texture = &g_objManager.scnData.textures[id];
+    if (id >= 0 && id < int(g_objManager.scnData.textures.size()))
+      texture = &g_objManager.scnData.textures[id];
   }
 
-  std::set<uint32_t > displaced_indices;
-  for(int i = 0; i < triangleList.size(); i++)
+  if (texture == nullptr || texture->displaceCallback == nullptr)
   {
-    const auto& tri = triangleList[i];
-
-    float3 pos = make_float3(vertex_attrib_by_index_f4("pos", tri.x, mesh));
-    float3 norm = make_float3(vertex_attrib_by_index_f4("normal", tri.x, mesh));
-    float displace_vec[3] = {0.0f, 0.0f, 0.0f};
+    HrError(L"displaceCustom: no displacement callback");
+    return;
+  }
 
-    auto ins = displaced_indices.insert(tri.x);
-    if(ins.second)
-    {
-      texture->displaceCallback((const float*)&pos, (const float*)&norm, bbox, displace_vec, texture->customData,
-                               texture->customDataSize);
-      mesh.verticesPos.at(tri.x * 4 + 0) += displace_vec[0];
-      mesh.verticesPos.at(tri.x * 4 + 1) += displace_vec[1];
-      mesh.verticesPos.at(tri.x * 4 + 2) += displace_vec[2];
-    }
+  // user callback is not required to be thread safe, so it is called serially
+  //
+  const auto vertices = displaced_vertices(triangleList, mesh.verticesPos.size() / 4);
 
-    pos = make_float3(vertex_attrib_by_index_f4("pos", tri.y, mesh));
-    norm = make_float3(vertex_attrib_by_index_f4("normal", tri.y, mesh));
-    displace_vec[0] = 0.0f, displace_vec[1] = 0.0f, displace_vec[2] = 0.0f;
-    ins = displaced_indices.insert(tri.y);
-    if(ins.second)
-    {
-      texture->displaceCallback((const float *) &pos, (const float *) &norm, bbox, displace_vec, texture->customData,
-                               texture->customDataSize);
-      mesh.verticesPos.at(tri.y * 4 + 0) += displace_vec[0];
-      mesh.verticesPos.at(tri.y * 4 + 1) += displace_vec[1];
-      mesh.verticesPos.at(tri.y * 4 + 2) += displace_vec[2];
-    }
+  for(const uint32_t v : vertices)
+  {
+    float3 pos  = make_float3(attrib_f4(mesh.verticesPos, v));
+    float3 norm = make_float3(attrib_f4(mesh.verticesNorm, v));
+    float displace_vec[3] = {0.0f, 0.0f, 0.0f};
 
-    pos = make_float3(vertex_attrib_by_index_f4("pos", tri.z, mesh));
-    norm = make_float3(vertex_attrib_by_index_f4("normal", tri.z, mesh));
-    displace_vec[0] = 0.0f, displace_vec[1] = 0.0f, displace_vec[2] = 0.0f;
-    ins = displaced_indices.insert(tri.z);
-    if(ins.second)
-    {
-      texture->displaceCallback((const float *) &pos, (const float *) &norm, bbox, displace_vec, texture->customData,
-                               texture->customDataSize);
-      mesh.verticesPos.at(tri.z * 4 + 0) += displace_vec[0];
-      mesh.verticesPos.at(tri.z * 4 + 1) += displace_vec[1];
-      mesh.verticesPos.at(tri.z * 4 + 2) += displace_vec[2];
-    }
+    texture->displaceCallback((const float*)&pos, (const float*)&norm, bbox, displace_vec, texture->customData,
+                              texture->customDataSize);
+    mesh.verticesPos[v * 4 + 0] += displace_vec[0];
+    mesh.verticesPos[v * 4 + 1] += displace_vec[1];
+    mesh.verticesPos[v * 4 + 2] += displace_vec[2];
   }
-
-
 }
 
 void displaceByHeightMap(HRMesh *pMesh, const pugi::xml_node &heightXMLNode, std::vector<uint3> &triangleList)
@@ -721,46 +839,13 @@ void displaceByHeightMap(HRMesh *pMesh, const pugi::xml_node &heightXMLNode, std
     texLibNode = g_objManager.scnData.m_texturesLib.find_child_by_attribute(L"id", id);
   }
 
-  int w = 0;
-  int h = 0;
+  HRTextureUtils::HeightMap heightMap;
   bool sampleTexture = false;
-  bool isLDR = false;
-  bool isHDR = false;
-
-  std::vector<int> imageDataLDR;
-  std::vector<float> imageDataHDR;
   auto location = std::wstring(texLibNode.attribute(L"loc").as_string());
-  float3 texHeight(1.0f, 1.0f, 1.0f);
   float4x4 matrix;
   if(!location.empty())
   {
-    int bpp = 0;
-
-    HRTextureNodeRef texRef;
-    texRef.id = texNode.attribute(L"id").as_int();
-
-    hrTexture2DGetSize(texRef, &w, &h, &bpp);
-    if(bpp > 4)
-    {
-      isHDR = true;
-      imageDataHDR.resize(w * h * 4);
-      hrTextureNodeOpen(texRef, HR_OPEN_READ_ONLY);
-      {
-        hrTexture2DGetDataHDR(texRef, &w, &h, &imageDataHDR[0]);
-      }
-      hrTextureNodeClose(texRef);
-    }
-    else
-    {
-      isLDR = true;
-      imageDataLDR.resize(w * h);
-
-      hrTextureNodeOpen(texRef, HR_OPEN_READ_ONLY);
-      {
-        hrTexture2DGetDataLDR(texRef, &w, &h, &imageDataLDR[0]);
-      }
-      hrTextureNodeClose(texRef);
-    }
+    load_height_map(texNode.attribute(L"id").as_int(), heightMap);
 
     float mat[16];
     HydraXMLHelpers::ReadMatrix4x4(texNode, L"matrix", mat);
@@ -768,62 +853,23 @@ void displaceByHeightMap(HRMesh *pMesh, const pugi::xml_node &heightXMLNode, std
     matrix = float4x4(mat);
 
     sampleTexture = true;
-    texHeight = float3(0.0f, 0.0f, 0.0f);
   }
 
+  if(!sampleTexture) // height map without texture does not displace anything
+    return;
 
-  std::set<uint32_t > displaced_indices;
-  for(int i=0;i<triangleList.size();i++)
-  {
-    const auto& tri = triangleList[i];
-
-    float2 uv1 = vertex_attrib_by_index_f2("uv", tri.x, mesh);
-    float2 uv2 = vertex_attrib_by_index_f2("uv", tri.y, mesh);
-    float2 uv3 = vertex_attrib_by_index_f2("uv", tri.z, mesh);
-
-    if(sampleTexture)
-    {
-      auto ins = displaced_indices.insert(tri.x);
-      if(ins.second)
-      {
-        if(isLDR)
-          texHeight.x = HRTextureUtils::sampleHeightMapLDR(imageDataLDR, w, h, uv1, matrix);
-        if(isHDR)
-          texHeight.x = HRTextureUtils::sampleHeightMapHDR(imageDataHDR, w, h, uv1, matrix);
-      }
-
-      ins = displaced_indices.insert(tri.y);
-      if(ins.second)
-      {
-        if(isLDR)
-          texHeight.y = HRTextureUtils::sampleHeightMapLDR(imageDataLDR, w, h, uv2, matrix);
-        if(isHDR)
-          texHeight.y = HRTextureUtils::sampleHeightMapHDR(imageDataHDR, w, h, uv2, matrix);
-      }
-
-      ins = displaced_indices.insert(tri.z);
-      if(ins.second)
-      {
-        if(isLDR)
-          texHeight.z = HRTextureUtils::sampleHeightMapLDR(imageDataLDR, w, h, uv3, matrix);
-        if(isHDR)
-          texHeight.z = HRTextureUtils::sampleHeightMapHDR(imageDataHDR, w, h, uv3, matrix);
-      }
-    }
-
-    mesh.verticesPos.at(tri.x * 4 + 0) += mesh.verticesNorm.at(tri.x * 4 + 0) * mult * texHeight.x;
-    mesh.verticesPos.at(tri.x * 4 + 1) += mesh.verticesNorm.at(tri.x * 4 + 1) * mult * texHeight.x;
-    mesh.verticesPos.at(tri.x * 4 + 2) += mesh.verticesNorm.at(tri.x * 4 + 2) * mult * texHeight.x;
+  const auto vertices = displaced_vertices(triangleList, mesh.verticesPos.size() / 4);
 
-    mesh.verticesPos.at(tri.y * 4 + 0) += mesh.verticesNorm.at(tri.y * 4 + 0) * mult * texHeight.y;
-    mesh.verticesPos.at(tri.y * 4 + 1) += mesh.verticesNorm.at(tri.y * 4 + 1) * mult * texHeight.y;
-    mesh.verticesPos.at(tri.y * 4 + 2) += mesh.verticesNorm.at(tri.y * 4 + 2) * mult * texHeight.y;
+  #pragma omp parallel for
+  for(int i = 0; i < int(vertices.size()); i++)
+  {
+    const uint32_t v = vertices[i];
 
-    mesh.verticesPos.at(tri.z * 4 + 0) += mesh.verticesNorm.at(tri.z * 4 + 0) * mult * texHeight.z;
-    mesh.verticesPos.at(tri.z * 4 + 1) += mesh.verticesNorm.at(tri.z * 4 + 1) * mult * texHeight.z;
-    mesh.verticesPos.at(tri.z * 4 + 2) += mesh.verticesNorm.at(tri.z * 4 + 2) * mult * texHeight.z;
+    const float texHeight = heightMap.sample(attrib_f2(mesh.verticesTexCoord, v), matrix);
 
-    texHeight = float3(0.0f, 0.0f, 0.0f);
+    mesh.verticesPos[v * 4 + 0] += mesh.verticesNorm[v * 4 + 0] * mult * texHeight;
+    mesh.verticesPos[v * 4 + 1] += mesh.verticesNorm[v * 4 + 1] * mult * texHeight;
+    mesh.verticesPos[v * 4 + 2] += mesh.verticesNorm[v * 4 + 2] * mult * texHeight;
   }
 }
 
@@ -835,84 +881,27 @@ void displaceByHeightMapTriPlanar(HRMesh *pMesh, const pugi::xml_node &heightXML
 
   auto texNode = heightXMLNode.child(L"textures_hexaplanar");
   pugi::xml_node texLibNodes[6];
-  int texIds[6];
+  int texIds[6] = {-1, -1, -1, -1, -1, -1};
   if(texNode != nullptr)
   {
-    auto id = texNode.attribute(L"texX").as_string();
-    texIds[0] = texNode.attribute(L"texX").as_int();
-    texLibNodes[0] = g_objManager.scnData.m_texturesLib.find_child_by_attribute(L"id", id);
-
-    id = texNode.attribute(L"texX2").as_string();
-    texIds[1] = texNode.attribute(L"texX2").as_int();
-    texLibNodes[1] = g_objManager.scnData.m_texturesLib.find_child_by_attribute(L"id", id);
-
-    id = texNode.attribute(L"texY").as_string();
-    texIds[2] = texNode.attribute(L"texY").as_int();
-    texLibNodes[2] = g_objManager.scnData.m_texturesLib.find_child_by_attribute(L"id", id);
-
-    id = texNode.attribute(L"texY2").as_string();
-    texIds[3] = texNode.attribute(L"texY2").as_int();
-    texLibNodes[3] = g_objManager.scnData.m_texturesLib.find_child_by_attribute(L"id", id);
-
-    id = texNode.attribute(L"texZ").as_string();
-    texIds[4] = texNode.attribute(L"texZ").as_int();
-    texLibNodes[4] = g_objManager.scnData.m_texturesLib.find_child_by_attribute(L"id", id);
-
-    id = texNode.attribute(L"texZ2").as_string();
-    texIds[5] = texNode.attribute(L"texZ2").as_int();
-    texLibNodes[5] = g_objManager.scnData.m_texturesLib.find_child_by_attribute(L"id", id);
+    const wchar_t* attrNames[6] = {L"texX", L"texX2", L"texY", L"texY2", L"texZ", L"texZ2"};
+    for (int i = 0; i < 6; ++i)
+    {
+      auto id = texNode.attribute(attrNames[i]).as_string();
+      texIds[i] = texNode.attribute(attrNames[i]).as_int();
+      texLibNodes[i] = g_objManager.scnData.m_texturesLib.find_child_by_attribute(L"id", id);
+    }
   }
 
   bool sampleTexture = false;
-  bool isLDR = false;
-  bool isHDR = false;
-
-  std::vector<std::vector<int> > imageDataLDR(6, std::vector<int>());
-  std::vector<std::vector<float> > imageDataHDR(6, std::vector<float>());
-  std::wstring locations[6] = {std::wstring(texLibNodes[0].attribute(L"loc").as_string()),
-                               std::wstring(texLibNodes[1].attribute(L"loc").as_string()),
-                               std::wstring(texLibNodes[2].attribute(L"loc").as_string()),
-                               std::wstring(texLibNodes[3].attribute(L"loc").as_string()),
-                               std::wstring(texLibNodes[4].attribute(L"loc").as_string()),
-                               std::wstring(texLibNodes[5].attribute(L"loc").as_string())};
-  float3 texHeight(1.0f, 1.0f, 1.0f);
+  HRTextureUtils::HeightMap heightMaps[6];
   float4x4 matrix;
-  int2 texSizes[6];
   for(int i = 0; i < 6; ++i)
   {
-    auto location = locations[i];
+    auto location = std::wstring(texLibNodes[i].attribute(L"loc").as_string());
     if (!location.empty())
     {
-      int bpp = 0;
-
-      HRTextureNodeRef texRef;
-      texRef.id = texIds[i];
-      int w = 0;
-      int h = 0;
-      hrTexture2DGetSize(texRef, &w, &h, &bpp);
-      texSizes[i].x = w;
-      texSizes[i].y = h;
-      if (bpp > 4)
-      {
-        isHDR = true;
-        imageDataHDR.at(i).resize(w * h * 4);
-        hrTextureNodeOpen(texRef, HR_OPEN_READ_ONLY);
-        {
-          hrTexture2DGetDataHDR(texRef, &w, &h, &imageDataHDR.at(i)[0]);
-        }
-        hrTextureNodeClose(texRef);
-      }
-      else
-      {
-        isLDR = true;
-        imageDataLDR.at(i).resize(w * h);
-
-        hrTextureNodeOpen(texRef, HR_OPEN_READ_ONLY);
-        {
-          hrTexture2DGetDataLDR(texRef, &w, &h, &imageDataLDR.at(i)[0]);
-        }
-        hrTextureNodeClose(texRef);
-      }
+      load_height_map(texIds[i], heightMaps[i]);
 
       float mat[16];
       HydraXMLHelpers::ReadMatrix4x4(texNode, L"matrix", mat);
@@ -920,178 +909,47 @@ void displaceByHeightMapTriPlanar(HRMesh *pMesh, const pugi::xml_node &heightXML
       matrix = float4x4(mat);
 
       sampleTexture = true;
-      texHeight = float3(0.0f, 0.0f, 0.0f);
     }
   }
 
-  std::set<uint32_t > displaced_indices;
-  for(int i = 0; i < triangleList.size(); ++i)
-  {
-    const auto& tri = triangleList[i];
-
-    float4 norm1 = vertex_attrib_by_index_f4("normal", tri.x, mesh);
-    float4 norm2 = vertex_attrib_by_index_f4("normal", tri.y, mesh);
-    float4 norm3 = vertex_attrib_by_index_f4("normal", tri.z, mesh);
-
-    float4 pos1 = vertex_attrib_by_index_f4("pos", tri.x, mesh);
-    float4 pos2 = vertex_attrib_by_index_f4("pos", tri.y, mesh);
-    float4 pos3 = vertex_attrib_by_index_f4("pos", tri.z, mesh);
-    float sharpness = 10.0f;
-
-    int2 sampledTexSizes_v1[3];
-    int2 sampledTexSizes_v2[3];
-    int2 sampledTexSizes_v3[3];
-
-    auto& texX_v1_ldr = norm1.x < 0 ? imageDataLDR[0] : imageDataLDR[1];
-    auto& texY_v1_ldr = norm1.y < 0 ? imageDataLDR[2] : imageDataLDR[3];
-    auto& texZ_v1_ldr = norm1.z < 0 ? imageDataLDR[4] : imageDataLDR[5];
-
-    auto& texX_v2_ldr = norm2.x < 0 ? imageDataLDR[0] : imageDataLDR[1];
-    auto& texY_v2_ldr = norm2.y < 0 ? imageDataLDR[2] : imageDataLDR[3];
-    auto& texZ_v2_ldr = norm2.z < 0 ? imageDataLDR[4] : imageDataLDR[5];
-
-    auto& texX_v3_ldr = norm3.x < 0 ? imageDataLDR[0] : imageDataLDR[1];
-    auto& texY_v3_ldr = norm3.y < 0 ? imageDataLDR[2] : imageDataLDR[3];
-    auto& texZ_v3_ldr = norm3.z < 0 ? imageDataLDR[4] : imageDataLDR[5];
-
-    auto& texX_v1_hdr = norm1.x < 0 ? imageDataHDR[0] : imageDataHDR[1];
-    auto& texY_v1_hdr = norm1.y < 0 ? imageDataHDR[2] : imageDataHDR[3];
-    auto& texZ_v1_hdr = norm1.z < 0 ? imageDataHDR[4] : imageDataHDR[5];
-
-    auto& texX_v2_hdr = norm2.x < 0 ? imageDataHDR[0] : imageDataHDR[1];
-    auto& texY_v2_hdr = norm2.y < 0 ? imageDataHDR[2] : imageDataHDR[3];
-    auto& texZ_v2_hdr = norm2.z < 0 ? imageDataHDR[4] : imageDataHDR[5];
-
-    auto& texX_v3_hdr = norm3.x < 0 ? imageDataHDR[0] : imageDataHDR[1];
-    auto& texY_v3_hdr = norm3.y < 0 ? imageDataHDR[2] : imageDataHDR[3];
-    auto& texZ_v3_hdr = norm3.z < 0 ? imageDataHDR[4] : imageDataHDR[5];
-
-
-    sampledTexSizes_v1[0] = norm1.x < 0 ? texSizes[0] : texSizes[1];
-    sampledTexSizes_v1[1] = norm1.y < 0 ? texSizes[2] : texSizes[3];
-    sampledTexSizes_v1[2] = norm1.z < 0 ? texSizes[4] : texSizes[5];
-
-    sampledTexSizes_v2[0] = norm2.x < 0 ? texSizes[0] : texSizes[1];
-    sampledTexSizes_v2[1] = norm2.y < 0 ? texSizes[2] : texSizes[3];
-    sampledTexSizes_v2[2] = norm2.z < 0 ? texSizes[4] : texSizes[5];
-
-    sampledTexSizes_v3[0] = norm3.x < 0 ? texSizes[0] : texSizes[1];
-    sampledTexSizes_v3[1] = norm3.y < 0 ? texSizes[2] : texSizes[3];
-    sampledTexSizes_v3[2] = norm3.z < 0 ? texSizes[4] : texSizes[5];
-
-
-    float3 w_v1 = abs_f3(norm1);
-    float3 w_v2 = abs_f3(norm2);
-    float3 w_v3 = abs_f3(norm3);
-
-    w_v1 = pow_f3(w_v1, sharpness);
-    w_v2 = pow_f3(w_v2, sharpness);
-    w_v3 = pow_f3(w_v3, sharpness);
-
-    w_v1 = max_f3_scalar(w_v1, 0.00001f) / dot(w_v1, w_v1);
-    w_v2 = max_f3_scalar(w_v2, 0.00001f) / dot(w_v2, w_v2);
-    w_v3 = max_f3_scalar(w_v3, 0.00001f) / dot(w_v3, w_v3);
-
-    float b_v1 = (w_v1.x + w_v1.y + w_v1.z);
-    float b_v2 = (w_v2.x + w_v2.y + w_v2.z);
-    float b_v3 = (w_v3.x + w_v3.y + w_v3.z);
-    w_v1 = w_v1 / b_v1;
-    w_v2 = w_v2 / b_v2;
-    w_v3 = w_v3 / b_v3;
-
-    float tex_scale = 1.0f;
-
-    float2 y_uv_v1 = make_float2(pos1.x * tex_scale, pos1.z * tex_scale);
-    float2 x_uv_v1 = make_float2(pos1.z * tex_scale, pos1.y * tex_scale);
-    float2 z_uv_v1 = make_float2(pos1.x * tex_scale, pos1.y * tex_scale);
-
-    float2 y_uv_v2 = make_float2(pos2.x * tex_scale, pos2.z * tex_scale);
-    float2 x_uv_v2 = make_float2(pos2.z * tex_scale, pos2.y * tex_scale);
-    float2 z_uv_v2 = make_float2(pos2.x * tex_scale, pos2.y * tex_scale);
-
-    float2 y_uv_v3 = make_float2(pos3.x * tex_scale, pos3.z * tex_scale);
-    float2 x_uv_v3 = make_float2(pos3.z * tex_scale, pos3.y * tex_scale);
-    float2 z_uv_v3 = make_float2(pos3.x * tex_scale, pos3.y * tex_scale);
-
-    if(sampleTexture)
-    {
-      auto ins = displaced_indices.insert(tri.x);
-      if(ins.second)
-      {
-        if(isLDR)
-        {
-          float texColX = HRTextureUtils::sampleHeightMapLDR(texX_v1_ldr, sampledTexSizes_v1[0].x, sampledTexSizes_v1[0].y, x_uv_v1, matrix);
-          float texColY = HRTextureUtils::sampleHeightMapLDR(texY_v1_ldr, sampledTexSizes_v1[1].x, sampledTexSizes_v1[1].y, y_uv_v1, matrix);
-          float texColZ = HRTextureUtils::sampleHeightMapLDR(texZ_v1_ldr, sampledTexSizes_v1[2].x, sampledTexSizes_v1[2].y, z_uv_v1, matrix);
-
-          texHeight.x = texColX * w_v1.x + texColY * w_v1.y + texColZ * w_v1.z;
-        }
-        if(isHDR)
-        {
-          float texColX = HRTextureUtils::sampleHeightMapHDR(texX_v1_hdr, sampledTexSizes_v1[0].x, sampledTexSizes_v1[0].y, x_uv_v1, matrix);
-          float texColY = HRTextureUtils::sampleHeightMapHDR(texY_v1_hdr, sampledTexSizes_v1[1].x, sampledTexSizes_v1[1].y, y_uv_v1, matrix);
-          float texColZ = HRTextureUtils::sampleHeightMapHDR(texZ_v1_hdr, sampledTexSizes_v1[2].x, sampledTexSizes_v1[2].y, z_uv_v1, matrix);
-
-          texHeight.x = texColX * w_v1.x + texColY * w_v1.y + texColZ * w_v1.z;
-        }
-      }
-
-      ins = displaced_indices.insert(tri.y);
-      if(ins.second)
-      {
-        if(isLDR)
-        {
-          float texColX = HRTextureUtils::sampleHeightMapLDR(texX_v2_ldr, sampledTexSizes_v2[0].x, sampledTexSizes_v2[0].y, x_uv_v2, matrix);
-          float texColY = HRTextureUtils::sampleHeightMapLDR(texY_v2_ldr, sampledTexSizes_v2[1].x, sampledTexSizes_v2[1].y, y_uv_v2, matrix);
-          float texColZ = HRTextureUtils::sampleHeightMapLDR(texZ_v2_ldr, sampledTexSizes_v2[2].x, sampledTexSizes_v2[2].y, z_uv_v2, matrix);
+  if(!sampleTexture) // height map without textures does not displace anything
+    return;
 
-          texHeight.y = texColX * w_v2.x + texColY * w_v2.y + texColZ * w_v2.z;
-        }
-        if(isHDR)
-        {
-          float texColX = HRTextureUtils::sampleHeightMapHDR(texX_v2_hdr, sampledTexSizes_v2[0].x, sampledTexSizes_v2[0].y, x_uv_v2, matrix);
-          float texColY = HRTextureUtils::sampleHeightMapHDR(texY_v2_hdr, sampledTexSizes_v2[1].x, sampledTexSizes_v2[1].y, y_uv_v2, matrix);
-          float texColZ = HRTextureUtils::sampleHeightMapHDR(texZ_v2_hdr, sampledTexSizes_v2[2].x, sampledTexSizes_v2[2].y, z_uv_v2, matrix);
+  const auto vertices = displaced_vertices(triangleList, mesh.verticesPos.size() / 4);
 
-          texHeight.y = texColX * w_v2.x + texColY * w_v2.y + texColZ * w_v2.z;
-        }
-      }
+  #pragma omp parallel for
+  for(int i = 0; i < int(vertices.size()); ++i)
+  {
+    const uint32_t v = vertices[i];
 
-      ins = displaced_indices.insert(tri.z);
-      if(ins.second)
-      {
-        if(isLDR)
-        {
-          float texColX = HRTextureUtils::sampleHeightMapLDR(texX_v3_ldr, sampledTexSizes_v3[0].x, sampledTexSizes_v3[0].y, x_uv_v3, matrix);
-          float texColY = HRTextureUtils::sampleHeightMapLDR(texY_v3_ldr, sampledTexSizes_v3[1].x, sampledTexSizes_v3[1].y, y_uv_v3, matrix);
-          float texColZ = HRTextureUtils::sampleHeightMapLDR(texZ_v3_ldr, sampledTexSizes_v3[2].x, sampledTexSizes_v3[2].y, z_uv_v3, matrix);
+    const float4 norm = attrib_f4(mesh.verticesNorm, v);
+    const float4 pos  = attrib_f4(mesh.verticesPos, v);
+    const float sharpness = 10.0f;
+    const float tex_scale = 1.0f;
 
-          texHeight.z = texColX * w_v3.x + texColY * w_v3.y + texColZ * w_v3.z;
-        }
-        if(isHDR)
-        {
-          float texColX = HRTextureUtils::sampleHeightMapHDR(texX_v3_hdr, sampledTexSizes_v3[0].x, sampledTexSizes_v3[0].y, x_uv_v3, matrix);
-          float texColY = HRTextureUtils::sampleHeightMapHDR(texY_v3_hdr, sampledTexSizes_v3[1].x, sampledTexSizes_v3[1].y, y_uv_v3, matrix);
-          float texColZ = HRTextureUtils::sampleHeightMapHDR(texZ_v3_hdr, sampledTexSizes_v3[2].x, sampledTexSizes_v3[2].y, z_uv_v3, matrix);
+    const auto& texX = norm.x < 0 ? heightMaps[0] : heightMaps[1];
+    const auto& texY = norm.y < 0 ? heightMaps[2] : heightMaps[3];
+    const auto& texZ = norm.z < 0 ? heightMaps[4] : heightMaps[5];
 
-          texHeight.z = texColX * w_v3.x + texColY * w_v3.y + texColZ * w_v3.z;
-        }
-      }
-    }
+    float3 w = abs_f3(norm);
+    w = pow_f3(w, sharpness);
+    w = max_f3_scalar(w, 0.00001f) / dot(w, w);
+    float b = (w.x + w.y + w.z);
+    w = w / b;
 
-    mesh.verticesPos.at(tri.x * 4 + 0) += mesh.verticesNorm.at(tri.x * 4 + 0) * mult * texHeight.x;
-    mesh.verticesPos.at(tri.x * 4 + 1) += mesh.verticesNorm.at(tri.x * 4 + 1) * mult * texHeight.x;
-    mesh.verticesPos.at(tri.x * 4 + 2) += mesh.verticesNorm.at(tri.x * 4 + 2) * mult * texHeight.x;
+    float2 y_uv = make_float2(pos.x * tex_scale, pos.z * tex_scale);
+    float2 x_uv = make_float2(pos.z * tex_scale, pos.y * tex_scale);
+    float2 z_uv = make_float2(pos.x * tex_scale, pos.y * tex_scale);
 
-    mesh.verticesPos.at(tri.y * 4 + 0) += mesh.verticesNorm.at(tri.y * 4 + 0) * mult * texHeight.y;
-    mesh.verticesPos.at(tri.y * 4 + 1) += mesh.verticesNorm.at(tri.y * 4 + 1) * mult * texHeight.y;
-    mesh.verticesPos.at(tri.y * 4 + 2) += mesh.verticesNorm.at(tri.y * 4 + 2) * mult * texHeight.y;
+    float texColX = texX.sample(x_uv, matrix);
+    float texColY = texY.sample(y_uv, matrix);
+    float texColZ = texZ.sample(z_uv, matrix);
 
-    mesh.verticesPos.at(tri.z * 4 + 0) += mesh.verticesNorm.at(tri.z * 4 + 0) * mult * texHeight.z;
-    mesh.verticesPos.at(tri.z * 4 + 1) += mesh.verticesNorm.at(tri.z * 4 + 1) * mult * texHeight.z;
-    mesh.verticesPos.at(tri.z * 4 + 2) += mesh.verticesNorm.at(tri.z * 4 + 2) * mult * texHeight.z;
+    const float texHeight = texColX * w.x + texColY * w.y + texColZ * w.z;
 
-    texHeight = float3(0.0f, 0.0f, 0.0f);
+    mesh.verticesPos[v * 4 + 0] += mesh.verticesNorm[v * 4 + 0] * mult * texHeight;
+    mesh.verticesPos[v * 4 + 1] += mesh.verticesNorm[v * 4 + 1] * mult * texHeight;
+    mesh.verticesPos[v * 4 + 2] += mesh.verticesNorm[v * 4 + 2] * mult * texHeight;
   }
 }
 
@@ -1183,6 +1041,32 @@ void InsertFixedMeshesAndInstancesXML(pugi::xml_document &stateToProcess,
   }
 
 
+  // instances stored in binary tables are patched by writing fixed copy of each affected table
+  //
+  auto sceneNode = stateToProcess.child(L"scenes").find_child_by_attribute(L"scene", L"id", std::to_wstring(sceneId).c_str());
+  for (auto tableNode = sceneNode.child(L"instances_table"); tableNode != nullptr; tableNode = tableNode.next_sibling(L"instances_table"))
+  {
+    const int32_t firstId = tableNode.attribute(L"id").as_int();
+
+    std::vector<HRSceneInst::Instance> instances;
+    if (!HR_LoadInstanceTable(g_objManager.scnData.m_path, tableNode, instances))
+      continue;
+
+    bool tableChanged = false;
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+      auto p = instToFixedMesh.find(uint32_t(firstId + int32_t(i)));
+      if (p != instToFixedMesh.end())
+      {
+        instances[i].meshId = p->second;
+        tableChanged        = true;
+      }
+    }
+
+    if (tableChanged)
+      HR_SaveInstanceTable(instances.data(), instances.size(), firstId, sceneId, tableNode, L"_meshes");
+  }
+
   std::sort(tmp_nodes.begin(), tmp_nodes.end(),
           [&](auto a, auto b) { return a.first < b.first; });
 
@@ -1224,8 +1108,6 @@ std::wstring HR_PreprocessMeshes_old(const wchar_t *state_path)
 
       pugi::xml_node displaceXMLNode;
 
-      //instanceHasDisplacementMat(mesh_ref, remapList, displaceXMLNode);
-
       hrMeshOpen(mesh_ref, HR_TRIANGLE_IND3, HR_OPEN_READ_ONLY);
       if (meshHasDisplacementMat(mesh_ref, displaceXMLNode))
       {
@@ -1296,6 +1178,28 @@ void removeDisplacementFromMaterials(const pugi::xml_document &stateToProcess, s
   }
 }
 
+/**
+\brief Displaced copy of a mesh shared by all instances with the same mesh and the same resolved materials.
+*/
+struct DisplacedMeshGroup
+{
+  int32_t          meshId;
+  int32_t          remapListId;
+  int32_t          firstInstance;  ///< used for the name of new mesh
+  pugi::xml_node   displaceNode;   ///< displacement of the first displaced material, it gives the number of subdivisions
+  HRUtils::BBox    bboxOld;
+  HRMeshRef        meshFixed;
+};
+
+static int MaxOmpThreads() ///< 1 when built without OpenMP
+{
+#ifdef _OPENMP
+  return std::max(omp_get_max_threads(), 1);
+#else
+  return 1;
+#endif
+}
+
 std::wstring HR_PreprocessMeshes(const wchar_t *state_path)
 {
   std::wstring new_state_path;
@@ -1308,18 +1212,26 @@ std::wstring HR_PreprocessMeshes(const wchar_t *state_path)
 
   pugi::xml_document stateToProcess;
 
-  auto loadResult = stateToProcess.load_file(state_path);
-
-  if (!loadResult)
+  if (HydraXMLHelpers::IsBinaryDocumentPath(state_path)) // hrFlush with '-binary_state 1'
   {
-    HrError(L"HR_PreprocessMeshes, pugixml load: ", loadResult.description());
-    return new_state_path;
+    if (!HydraXMLHelpers::LoadBinaryDocument(stateToProcess, state_path))
+      return new_state_path;
+  }
+  else
+  {
+    auto loadResult = stateToProcess.load_file(state_path);
+
+    if (!loadResult)
+    {
+      HrError(L"HR_PreprocessMeshes, pugixml load: ", loadResult.description());
+      return new_state_path;
+    }
   }
 
   bool anyChanges = false;
   if (g_objManager.m_currSceneId < g_objManager.scnInst.size())
   {
-    auto scn = g_objManager.scnInst[g_objManager.m_currSceneId];
+    const auto& scn = g_objManager.scnInst[g_objManager.m_currSceneId];
 
     std::vector<std::unordered_map<uint32_t, uint32_t> > remapLists;
     std::unordered_map<uint32_t, int32_t> instToFixedMesh;
@@ -1350,70 +1262,181 @@ std::wstring HR_PreprocessMeshes(const wchar_t *state_path)
       }
     }
 
+    // (1) group instances by mesh and materials they really get after remap; each group is displaced only once
+    //
+    std::unordered_map<int32_t, std::vector<int32_t> > meshMaterials;    ///< unique material ids of mesh in order of first occurrence
+    std::unordered_map<int32_t, pugi::xml_node>        matDisplacement;  ///< material id --> its true displacement node or empty node
+    std::map<std::vector<int32_t>, int32_t>            groupByKey;       ///< (meshId, resolved material ids) --> group
+    std::vector<DisplacedMeshGroup>                    groups;
+    std::vector<int32_t>                               instToGroup(scn.drawList.size(), -1);
+
+    auto displacementOf = [&matDisplacement](int32_t a_matId)
+    {
+      auto p = matDisplacement.find(a_matId);
+      if (p != matDisplacement.end())
+        return p->second;
+
+      pugi::xml_node displaceNode;
+      HRMaterialRef matRef;
+      matRef.id = a_matId;
+      auto mat = g_objManager.PtrById(matRef);
+      if (mat != nullptr) // xml_node_next is created here, so displacement threads below only read material nodes
+      {
+        auto d_node = mat->xml_node_next(HR_OPEN_EXISTING).child(L"displacement");
+        if (d_node != nullptr && std::wstring(d_node.attribute(L"type").as_string()) == std::wstring(L"true_displacement"))
+          displaceNode = d_node;
+      }
+
+      matDisplacement[a_matId] = displaceNode;
+      return displaceNode;
+    };
+
     std::set<int32_t > displacementMatIDs;
     for(int i = 0; i < scn.drawList.size(); ++i)
     {
-      auto inst = scn.drawList.at(i);
-      HRMeshRef mesh_ref;
-      mesh_ref.id = inst.meshId;
+      const auto& inst = scn.drawList[i];
 
-      auto inst_id = i;
-      auto inst_id_str = std::to_wstring(inst_id);
+      auto pMats = meshMaterials.find(inst.meshId);
+      if (pMats == meshMaterials.end())
+      {
+        HRMeshRef mesh_ref;
+        mesh_ref.id = inst.meshId;
 
-      std::unordered_map<uint32_t, uint32_t> remap_list;
-      if(inst.remapListId >= 0)
-        remap_list = remapLists[inst.remapListId];
+        std::vector<int32_t> mats;
+        hrMeshOpen(mesh_ref, HR_TRIANGLE_IND3, HR_OPEN_READ_ONLY);
+        {
+          HRMesh* pMesh = g_objManager.PtrById(mesh_ref);
+          if (pMesh != nullptr)
+          {
+            std::set<int32_t> uniqueMatIndices;
+            for (auto mI : pMesh->m_input.matIndices)
+            {
+              if (uniqueMatIndices.insert(int32_t(mI)).second)
+                mats.push_back(int32_t(mI));
+            }
+          }
+        }
+        hrMeshClose(mesh_ref);
+        pMats = meshMaterials.emplace(inst.meshId, std::move(mats)).first;
+      }
+
+      const std::unordered_map<uint32_t, uint32_t>* pRemap = (inst.remapListId >= 0 && inst.remapListId < int32_t(remapLists.size())) ? &remapLists[inst.remapListId] : nullptr;
+
+      std::vector<int32_t> key;
+      key.reserve(pMats->second.size() + 1);
+      key.push_back(inst.meshId);
 
       pugi::xml_node displaceXMLNode;
-      HRMaterialRef matRef;
+      int32_t        displaceMatId = -1;
+      for (auto mI : pMats->second)
+      {
+        if (pRemap != nullptr && pRemap->find(mI) != pRemap->end())
+          mI = int32_t(pRemap->at(mI));
+        key.push_back(mI);
 
-      hrMeshOpen(mesh_ref, HR_TRIANGLE_IND3, HR_OPEN_READ_ONLY);
-      if(instanceHasDisplacementMat(mesh_ref, remap_list, displaceXMLNode, matRef))
+        auto d_node = displacementOf(mI);
+        if (d_node != nullptr && displaceXMLNode == nullptr)
+        {
+          displaceXMLNode = d_node;
+          displaceMatId   = mI;
+        }
+      }
+
+      if (displaceXMLNode == nullptr)
+        continue;
+
+      displacementMatIDs.insert(displaceMatId);
+
+      auto p = groupByKey.find(key);
+      if (p == groupByKey.end())
+      {
+        DisplacedMeshGroup group;
+        group.meshId        = inst.meshId;
+        group.remapListId   = (pRemap != nullptr) ? inst.remapListId : -1;
+        group.firstInstance = i;
+        group.displaceNode  = displaceXMLNode;
+        p = groupByKey.emplace(std::move(key), int32_t(groups.size())).first;
+        groups.push_back(group);
+      }
+
+      instToGroup[i] = p->second;
+    }
+
+    // Custom displacement calls user callback that is not required to be thread safe, so then groups go serially
+    //
+    bool customDisplacement = false;
+    for (const auto& d : matDisplacement)
+    {
+      if (d.second != nullptr && d.second.child(L"custom") != nullptr)
+        customDisplacement = true;
+    }
+
+    const std::unordered_map<uint32_t, uint32_t> emptyRemapList;
+
+    // groups go in batches of one group per thread, so only a few subdivided meshes are kept opened at the same time
+    //
+    const int groupsNum = int(groups.size());
+    const int batchSize = customDisplacement ? 1 : MaxOmpThreads();
+
+    for (int batchStart = 0; batchStart < groupsNum; batchStart += batchSize)
+    {
+      const int batchEnd = std::min(batchStart + batchSize, groupsNum);
+
+      // (2) create new meshes; this changes object manager and xml, so it is serial
+      //
+      for (int g = batchStart; g < batchEnd; ++g)
       {
-        //displacementMats.
-        displacementMatIDs.insert(matRef.id);
-        HRMesh& mesh = g_objManager.scnData.meshes[inst.meshId];
-        HRUtils::BBox bbox_old = mesh.pImpl->getBBox();
+        auto& group = groups[g];
+
+        HRMeshRef mesh_ref;
+        mesh_ref.id = group.meshId;
+
+        hrMeshOpen(mesh_ref, HR_TRIANGLE_IND3, HR_OPEN_READ_ONLY);
+        HRMesh& mesh = g_objManager.scnData.meshes[group.meshId];
+        group.bboxOld = mesh.pImpl->getBBox();
         std::vector<float> verticesPos(mesh.m_input.verticesPos);       ///< float4
         std::vector<float> verticesNorm(mesh.m_input.verticesNorm);      ///< float4
         std::vector<float> verticesTexCoord(mesh.m_input.verticesTexCoord);  ///< float2
-        std::vector<float> verticesTangent(mesh.m_input.verticesTangent);   ///< float4
         std::vector<uint32_t> triIndices(mesh.m_input.triIndices);        ///< size of 3*triNum
         std::vector<uint32_t> matIndices(mesh.m_input.matIndices);        ///< size of 1*triNum
         auto mesh_name = mesh.name;
         hrMeshClose(mesh_ref);
 
-        std::wstring new_mesh_name = mesh_name.append(L"_fixed_").append(inst_id_str);
-        HRMeshRef mesh_ref_new = hrMeshCreate(new_mesh_name.c_str());
-        hrMeshOpen(mesh_ref_new, HR_TRIANGLE_IND3, HR_WRITE_DISCARD);
-        hrMeshVertexAttribPointer4f(mesh_ref_new, L"pos", &verticesPos[0]);
-        hrMeshVertexAttribPointer4f(mesh_ref_new, L"norm", &verticesNorm[0]);
-        hrMeshVertexAttribPointer2f(mesh_ref_new, L"texcoord", &verticesTexCoord[0]);
-        hrMeshPrimitiveAttribPointer1i(mesh_ref_new, L"mind", (int *) (&matIndices[0]));
-        hrMeshAppendTriangles3(mesh_ref_new, int(triIndices.size()), (int *) (&triIndices[0]), false);
+        std::wstring new_mesh_name = mesh_name.append(L"_fixed_").append(std::to_wstring(group.firstInstance));
+        group.meshFixed = hrMeshCreate(new_mesh_name.c_str());
+        hrMeshOpen(group.meshFixed, HR_TRIANGLE_IND3, HR_WRITE_DISCARD);
+        hrMeshVertexAttribPointer4f(group.meshFixed, L"pos", &verticesPos[0]);
+        hrMeshVertexAttribPointer4f(group.meshFixed, L"norm", &verticesNorm[0]);
+        hrMeshVertexAttribPointer2f(group.meshFixed, L"texcoord", &verticesTexCoord[0]);
+        hrMeshPrimitiveAttribPointer1i(group.meshFixed, L"mind", (int *) (&matIndices[0]));
+        hrMeshAppendTriangles3(group.meshFixed, int(triIndices.size()), (int *) (&triIndices[0]), false);
+      }
 
-        int subdivs = displaceXMLNode.attribute(L"subdivs").as_int();
+      // (3) subdivide and displace groups of the batch in parallel; meshes are already opened and only their own input is changed
+      //
+      #pragma omp parallel for schedule(dynamic) if(!customDisplacement)
+      for (int g = batchStart; g < batchEnd; ++g)
+      {
+        const auto& group = groups[g];
+        const auto& remap_list = (group.remapListId >= 0) ? remapLists[group.remapListId] : emptyRemapList;
 
-        //std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-        hrMeshSubdivideSqrt3(mesh_ref_new, max(subdivs, 0));
-        //std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-        //std::cout << "Subdivision time = " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << " ms" <<std::endl;
+        int subdivs = group.displaceNode.attribute(L"subdivs").as_int();
 
-        //begin = std::chrono::steady_clock::now();
-        hrMeshDisplace(mesh_ref_new, remap_list, stateToProcess, bbox_old);
-        //end = std::chrono::steady_clock::now();
-        //std::cout << "Displacement time = " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << " ms" <<std::endl;
+        hrMeshSubdivideSqrt3(group.meshFixed, max(subdivs, 0));
+        hrMeshDisplace(group.meshFixed, remap_list, stateToProcess, group.bboxOld);
+      }
 
-        hrMeshClose(mesh_ref_new);
+      for (int g = batchStart; g < batchEnd; ++g)
+        hrMeshClose(groups[g].meshFixed);
+    }
 
-        instToFixedMesh[inst_id] = mesh_ref_new.id;
-        anyChanges = true;
-      }
-      else
-      {
-        hrMeshClose(mesh_ref);
-      }
+    for (int i = 0; i < int(instToGroup.size()); ++i)
+    {
+      if (instToGroup[i] >= 0)
+        instToFixedMesh[i] = groups[instToGroup[i]].meshFixed.id;
     }
+
+    anyChanges = !groups.empty();
     if(anyChanges)
     {
       InsertFixedMeshesAndInstancesXML(stateToProcess, instToFixedMesh, g_objManager.m_currSceneId);
@@ -1428,6 +1451,23 @@ std::wstring HR_PreprocessMeshes(const wchar_t *state_path)
 }
 
 
+/**
+\brief Spatial hash of welding grid cell; cell is bigger than position tolerance, so close vertices are in the same or adjacent cells.
+*/
+static inline uint64_t weld_cell_hash(int64_t x, int64_t y, int64_t z)
+{
+  uint64_t h = uint64_t(x) * 0x9E3779B97F4A7C15ull;
+  h ^= uint64_t(y) * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+  h ^= uint64_t(z) * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+  return h;
+}
+
+struct WeldRecord
+{
+  uint64_t cell; ///< weld_cell_hash of vertex cell
+  uint32_t rank; ///< order of first use of vertex by triangles
+};
+
 void hrMeshWeldVertices(HRMeshRef a_mesh, int &indexNum)
 {
   HRMesh *pMesh = g_objManager.PtrById(a_mesh);
@@ -1445,206 +1485,363 @@ void hrMeshWeldVertices(HRMeshRef a_mesh, int &indexNum)
   }
 
   HRMesh::InputTriMesh &mesh = pMesh->m_input;
-  //const bool hasNormals  = (pMesh->m_inputPointers.normals != nullptr);
 
-  std::vector<uint32_t> indices_new;
-  //std::unordered_map<float3, uint32_t, float3_hash, pos_eq> vertex_hash;
-  std::unordered_map<vertex_cache, uint32_t, vertex_cache_hash, vertex_cache_eq> vertex_hash;
+  const size_t vertexNum = mesh.verticesPos.size() / 4;
+  const size_t triNum    = std::min(mesh.triIndices.size() / 3, mesh.matIndices.size());
 
-  std::vector<float> vertices_new(mesh.verticesPos.size()*2, 0.0f);
-  std::vector<float> normals_new(mesh.verticesNorm.size()*2, 0.0f);
-  std::vector<float> uv_new(mesh.verticesTexCoord.size()*2, 0.0f);
-  std::vector<float> tangents_new(mesh.verticesTangent.size()*2, 0.0f);
-  std::vector<int32_t> mid_new;
-  mid_new.reserve(mesh.matIndices.size());
+  const float posEps    = g_objManager.m_weldPosEps;
+  const float normalEps = g_objManager.m_weldNormalEps;
+  const float uvEps     = g_objManager.m_weldUVEps;
 
-  uint32_t index = 0;
-  for (auto i = 0u; i < mesh.triIndices.size(); i += 3)
+  const bool hasNormals  = (mesh.verticesNorm.size()     >= vertexNum * 4);
+  const bool hasTangents = (mesh.verticesTangent.size()  >= vertexNum * 4);
+  const bool hasTexCoord = (mesh.verticesTexCoord.size() >= vertexNum * 2);
+
+  // (1) drop degenerate triangles and number vertices in order of their first use, as new vertices go in this order
+  //
+  const uint32_t NOT_USED = 0xFFFFFFFF;
+
+  std::vector<uint32_t> keptTris;
+  std::vector<uint32_t> rankOfVertex(vertexNum, NOT_USED);
+  std::vector<uint32_t> vertexOfRank;
+  keptTris.reserve(triNum);
+  vertexOfRank.reserve(vertexNum);
+
+  for (size_t t = 0; t < triNum; t++)
   {
-    uint32_t indA = mesh.triIndices[i + 0];
-    uint32_t indB = mesh.triIndices[i + 1];
-    uint32_t indC = mesh.triIndices[i + 2];
+    const uint32_t indA = mesh.triIndices[3 * t + 0];
+    const uint32_t indB = mesh.triIndices[3 * t + 1];
+    const uint32_t indC = mesh.triIndices[3 * t + 2];
 
     if (indA == indB || indA == indC || indB == indC)
       continue;
 
-    auto old_mid = mesh.matIndices.at(i / 3);
-    mid_new.push_back(old_mid);
+    if (indA >= vertexNum || indB >= vertexNum || indC >= vertexNum)
+    {
+      HrError(L"hrMeshWeldVertices: vertex index out of range, mesh id = ", a_mesh.id);
+      return;
+    }
 
-    float4 tmp = vertex_attrib_by_index_f4("pos", indA, mesh);
-    float3 A(tmp.x, tmp.y, tmp.z);
-    tmp = vertex_attrib_by_index_f4("normal", indA, mesh);
-    float3 A_normal(tmp.x, tmp.y, tmp.z);
-    float2 tmp2 = vertex_attrib_by_index_f2("uv", indA, mesh);
-    float2 A_uv(tmp2.x, tmp2.y);
-    float4 A_tan = vertex_attrib_by_index_f4("tangent", indA, mesh);
+    keptTris.push_back(uint32_t(t));
+    for (const uint32_t v : {indA, indB, indC})
+    {
+      if (rankOfVertex[v] == NOT_USED)
+      {
+        rankOfVertex[v] = uint32_t(vertexOfRank.size());
+        vertexOfRank.push_back(v);
+      }
+    }
+  }
 
-    vertex_cache A_cache;
-    A_cache.pos = A;
-    A_cache.normal = A_normal;
-    A_cache.uv = A_uv;
-    A_cache.tangent = A_tan;
+  const int64_t usedNum = int64_t(vertexOfRank.size());
 
-    auto it = vertex_hash.find(A_cache);
+  // (2) put vertices to buckets of spatial hash grid; cell is several times bigger than tolerance,
+  //     so tolerance box of most vertices is inside their own cell
+  //
+  const double invCell = 1.0 / (8.0 * double(posEps));
 
-    if(it != vertex_hash.end())
-    {
-      indices_new.push_back(it->second);
-    }
-    else
-    {
-      vertex_hash[A_cache] = index;
-      indices_new.push_back(index);
+  auto cellCoord = [invCell](float p) -> int64_t
+  {
+    double q = std::floor(double(p) * invCell);
+    if (!(q == q))
+      q = 0.0;
+    q = std::max(std::min(q, 4.0e18), -4.0e18);
+    return int64_t(q);
+  };
+
+  std::vector<WeldRecord> records(usedNum);
 
-      vertices_new.at(index * 4 + 0) = A.x;
-      vertices_new.at(index * 4 + 1) = A.y;
-      vertices_new.at(index * 4 + 2) = A.z;
-      vertices_new.at(index * 4 + 3) = 1.0f;
+  #pragma omp parallel for
+  for (int64_t k = 0; k < usedNum; k++)
+  {
+    const float* pos = mesh.verticesPos.data() + size_t(vertexOfRank[k]) * 4;
+    records[k].cell  = weld_cell_hash(cellCoord(pos[0]), cellCoord(pos[1]), cellCoord(pos[2]));
+    records[k].rank  = uint32_t(k);
+  }
 
-      normals_new.at(index * 4 + 0) = A_normal.x;
-      normals_new.at(index * 4 + 1) = A_normal.y;
-      normals_new.at(index * 4 + 2) = A_normal.z;
-      normals_new.at(index * 4 + 3) = 1.0f;
+  radix_sort_by_key(records, [](const WeldRecord& r) { return r.cell; });
 
-      uv_new.at(index * 2 + 0) = A_uv.x;
-      uv_new.at(index * 2 + 1) = A_uv.y;
+  std::vector<uint32_t> bucketStart;
+  for (int64_t i = 0; i < usedNum; i++)
+  {
+    if (i == 0 || records[i].cell != records[i - 1].cell)
+      bucketStart.push_back(uint32_t(i));
+  }
+  const int64_t bucketsNum = int64_t(bucketStart.size());
+  bucketStart.push_back(uint32_t(usedNum));
 
-      tangents_new.at(index * 4 + 0) = A_tan.x;
-      tangents_new.at(index * 4 + 1) = A_tan.y;
-      tangents_new.at(index * 4 + 2) = A_tan.z;
-      tangents_new.at(index * 4 + 3) = A_tan.w;
+  // cell hash --> bucket, open addressing
+  //
+  size_t tableSize = 16;
+  while (tableSize < size_t(bucketsNum) * 2)
+    tableSize *= 2;
 
-      index++;
+  std::vector<int64_t> bucketTable(tableSize, -1);
+  for (int64_t b = 0; b < bucketsNum; b++)
+  {
+    size_t slot = size_t(records[bucketStart[b]].cell) & (tableSize - 1);
+    while (bucketTable[slot] >= 0)
+      slot = (slot + 1) & (tableSize - 1);
+    bucketTable[slot] = b;
+  }
+
+  auto findBucket = [&](uint64_t a_cell) -> int64_t
+  {
+    size_t slot = size_t(a_cell) & (tableSize - 1);
+    while (bucketTable[slot] >= 0)
+    {
+      if (records[bucketStart[bucketTable[slot]]].cell == a_cell)
+        return bucketTable[slot];
+      slot = (slot + 1) & (tableSize - 1);
     }
+    return -1;
+  };
 
-    tmp = vertex_attrib_by_index_f4("pos", indB, mesh);
-    float3 B(tmp.x, tmp.y, tmp.z);
-    tmp = vertex_attrib_by_index_f4("normal", indB, mesh);
-    float3 B_normal(tmp.x, tmp.y, tmp.z);
-    tmp2 = vertex_attrib_by_index_f2("uv", indB, mesh);
-    float2 B_uv(tmp2.x, tmp2.y);
-    float4 B_tan = vertex_attrib_by_index_f4("tangent", indB, mesh);
-
-    vertex_cache B_cache;
-    B_cache.pos = B;
-    B_cache.normal = B_normal;
-    B_cache.uv = B_uv;
-    B_cache.tangent = B_tan;
-
-    it = vertex_hash.find(B_cache);
-    if(it != vertex_hash.end())
+  // vertices are the same if all attributes are close; per vertex custom attributes must be equal
+  //
+  auto sameVertex = [&](uint32_t u, uint32_t v) -> bool
+  {
+    for (int c = 0; c < 3; c++)
     {
-      indices_new.push_back(it->second);
+      if (fabsf(mesh.verticesPos[u * 4 + c] - mesh.verticesPos[v * 4 + c]) > posEps)
+        return false;
     }
-    else
+
+    if (hasNormals)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        if (fabsf(mesh.verticesNorm[u * 4 + c] - mesh.verticesNorm[v * 4 + c]) > normalEps)
+          return false;
+      }
+    }
+
+    if (hasTexCoord)
     {
-      vertex_hash[B_cache] = index;
-      indices_new.push_back(index);
+      for (int c = 0; c < 2; c++)
+      {
+        if (fabsf(mesh.verticesTexCoord[u * 2 + c] - mesh.verticesTexCoord[v * 2 + c]) > uvEps)
+          return false;
+      }
+    }
 
-      vertices_new.at(index * 4 + 0) = B.x;
-      vertices_new.at(index * 4 + 1) = B.y;
-      vertices_new.at(index * 4 + 2) = B.z;
-      vertices_new.at(index * 4 + 3) = 1.0f;
+    if (hasTangents)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        if (fabsf(mesh.verticesTangent[u * 4 + c] - mesh.verticesTangent[v * 4 + c]) > normalEps)
+          return false;
+      }
+      if (fabsf(mesh.verticesTangent[u * 4 + 3] - mesh.verticesTangent[v * 4 + 3]) >= 1e-1f) // handedness
+        return false;
+    }
 
-      normals_new.at(index * 4 + 0) = B_normal.x;
-      normals_new.at(index * 4 + 1) = B_normal.y;
-      normals_new.at(index * 4 + 2) = B_normal.z;
-      normals_new.at(index * 4 + 3) = 1.0f;
+    for (const auto& arr : mesh.customArrays)
+    {
+      if (arr.apply != 0)
+        continue;
+
+      const size_t depth = size_t(arr.depth);
+      if (!arr.fdata.empty() && arr.fdata.size() >= vertexNum * depth && !std::equal(arr.fdata.begin() + u * depth, arr.fdata.begin() + (u + 1) * depth, arr.fdata.begin() + v * depth))
+        return false;
+      if (!arr.idata.empty() && arr.idata.size() >= vertexNum * depth && !std::equal(arr.idata.begin() + u * depth, arr.idata.begin() + (u + 1) * depth, arr.idata.begin() + v * depth))
+        return false;
+    }
 
-      uv_new.at(index * 2 + 0) = B_uv.x;
-      uv_new.at(index * 2 + 1) = B_uv.y;
+    return true;
+  };
 
-      tangents_new.at(index * 4 + 0) = B_tan.x;
-      tangents_new.at(index * 4 + 1) = B_tan.y;
-      tangents_new.at(index * 4 + 2) = B_tan.z;
-      tangents_new.at(index * 4 + 3) = B_tan.w;
+  // (3) find pairs of same vertices in parallel over buckets: each vertex is compared with next vertices of its bucket
+  //     and with vertices of other cells that its tolerance box overlaps; pair from other bucket is taken by vertex with smaller rank.
+  //     Pair is stored as (smaller rank, bigger rank)
+  //
+  const int64_t blockSize = 4096;
+  const int64_t blocksNum = (bucketsNum + blockSize - 1) / blockSize;
+  std::vector<std::vector<uint2> > blockPairs(blocksNum);
 
-      index++;
+  #pragma omp parallel for schedule(dynamic)
+  for (int64_t blk = 0; blk < blocksNum; blk++)
+  {
+    auto& pairs = blockPairs[blk];
+
+    for (int64_t b = blk * blockSize; b < std::min(bucketsNum, (blk + 1) * blockSize); b++)
+    {
+      for (uint32_t i = bucketStart[b]; i < bucketStart[b + 1]; i++)
+      {
+        const uint32_t rankU = records[i].rank;
+        const uint32_t u     = vertexOfRank[rankU];
+
+        for (uint32_t j = i + 1; j < bucketStart[b + 1]; j++)
+        {
+          if (sameVertex(u, vertexOfRank[records[j].rank]))
+            pairs.push_back(uint2(std::min(rankU, records[j].rank), std::max(rankU, records[j].rank)));
+        }
+
+        const float* pos = mesh.verticesPos.data() + size_t(u) * 4;
+        int64_t cellMin[3], cellMax[3];
+        for (int c = 0; c < 3; c++)
+        {
+          cellMin[c] = cellCoord(pos[c] - posEps);
+          cellMax[c] = cellCoord(pos[c] + posEps);
+        }
+
+        if (cellMin[0] == cellMax[0] && cellMin[1] == cellMax[1] && cellMin[2] == cellMax[2]) // most vertices are far from cell borders
+          continue;
+
+        for (int64_t cz = cellMin[2]; cz <= cellMax[2]; cz++)
+        {
+          for (int64_t cy = cellMin[1]; cy <= cellMax[1]; cy++)
+          {
+            for (int64_t cx = cellMin[0]; cx <= cellMax[0]; cx++)
+            {
+              const int64_t nb = findBucket(weld_cell_hash(cx, cy, cz));
+              if (nb < 0 || nb == b)
+                continue;
+
+              for (uint32_t j = bucketStart[nb]; j < bucketStart[nb + 1]; j++)
+              {
+                if (records[j].rank > rankU && sameVertex(u, vertexOfRank[records[j].rank]))
+                  pairs.push_back(uint2(rankU, records[j].rank));
+              }
+            }
+          }
+        }
+      }
     }
+  }
 
-    tmp = vertex_attrib_by_index_f4("pos", indC, mesh);
-    float3 C(tmp.x, tmp.y, tmp.z);
-    tmp = vertex_attrib_by_index_f4("normal", indC, mesh);
-    float3 C_normal(tmp.x, tmp.y, tmp.z);
-    tmp2 = vertex_attrib_by_index_f2("uv", indC, mesh);
-    float2 C_uv(tmp2.x, tmp2.y);
-    float4 C_tan = vertex_attrib_by_index_f4("tangent", indC, mesh);
+  // (4) vertices in order of first use either join the first earlier representative they are close to, or become representatives.
+  //     Each vertex is compared with the representative itself, so a chain of close vertices does not collapse into one
+  //     when its ends are far apart, and the result does not depend on threads
+  //
+  std::vector<uint2> allPairs;
+  {
+    size_t pairsNum = 0;
+    for (const auto& pairs : blockPairs)
+      pairsNum += pairs.size();
+    allPairs.reserve(pairsNum);
+    for (const auto& pairs : blockPairs)
+      allPairs.insert(allPairs.end(), pairs.begin(), pairs.end());
+    blockPairs = std::vector<std::vector<uint2> >();
+  }
 
-    vertex_cache C_cache;
-    C_cache.pos = C;
-    C_cache.normal = C_normal;
-    C_cache.uv = C_uv;
-    C_cache.tangent = C_tan;
+  radix_sort_by_key(allPairs, [](const uint2& p) { return (uint64_t(p.y) << 32) | uint64_t(p.x); });
 
+  std::vector<uint32_t> representative(usedNum);
+  size_t pairId = 0;
+  for (int64_t k = 0; k < usedNum; k++)
+  {
+    representative[k] = uint32_t(k);
+    for (; pairId < allPairs.size() && allPairs[pairId].y == uint32_t(k); pairId++)
+    {
+      const uint32_t r = allPairs[pairId].x;
+      if (representative[k] == uint32_t(k) && representative[r] == r)
+        representative[k] = r;
+    }
+  }
+  allPairs = std::vector<uint2>();
 
-    it = vertex_hash.find(C_cache);
-    if(it != vertex_hash.end())
+  std::vector<uint32_t> newIndexOfRank(usedNum);
+  std::vector<uint32_t> newVertexSource; ///< new vertex --> old vertex
+  newVertexSource.reserve(usedNum);
+  for (int64_t k = 0; k < usedNum; k++)
+  {
+    const uint32_t root = representative[k];
+    if (root == uint32_t(k))
     {
-      indices_new.push_back(it->second);
+      newIndexOfRank[k] = uint32_t(newVertexSource.size());
+      newVertexSource.push_back(vertexOfRank[k]);
     }
     else
-    {
-      vertex_hash[C_cache] = index;
-      indices_new.push_back(index);
+      newIndexOfRank[k] = newIndexOfRank[root];
+  }
 
-      vertices_new.at(index * 4 + 0) = C.x;
-      vertices_new.at(index * 4 + 1) = C.y;
-      vertices_new.at(index * 4 + 2) = C.z;
-      vertices_new.at(index * 4 + 3) = 1.0f;
+  const int64_t newVertexNum = int64_t(newVertexSource.size());
+  const int64_t newTriNum    = int64_t(keptTris.size());
 
-      normals_new.at(index * 4 + 0) = C_normal.x;
-      normals_new.at(index * 4 + 1) = C_normal.y;
-      normals_new.at(index * 4 + 2) = C_normal.z;
-      normals_new.at(index * 4 + 3) = 1.0f;
+  // (5) compact vertex attributes, custom arrays and triangles
+  //
+  std::vector<float> vertices_new(newVertexNum * 4);
+  std::vector<float> normals_new(hasNormals   ? newVertexNum * 4 : 0);
+  std::vector<float> uv_new(hasTexCoord       ? newVertexNum * 2 : 0);
+  std::vector<float> tangents_new(hasTangents ? newVertexNum * 4 : 0);
 
-      uv_new.at(index * 2 + 0) = C_uv.x;
-      uv_new.at(index * 2 + 1) = C_uv.y;
+  #pragma omp parallel for
+  for (int64_t i = 0; i < newVertexNum; i++)
+  {
+    const size_t v = newVertexSource[i];
 
-      tangents_new.at(index * 4 + 0) = C_tan.x;
-      tangents_new.at(index * 4 + 1) = C_tan.y;
-      tangents_new.at(index * 4 + 2) = C_tan.z;
-      tangents_new.at(index * 4 + 3) = C_tan.w;
+    vertices_new[i * 4 + 0] = mesh.verticesPos[v * 4 + 0];
+    vertices_new[i * 4 + 1] = mesh.verticesPos[v * 4 + 1];
+    vertices_new[i * 4 + 2] = mesh.verticesPos[v * 4 + 2];
+    vertices_new[i * 4 + 3] = 1.0f;
 
-      index++;
+    if (hasNormals)
+    {
+      normals_new[i * 4 + 0] = mesh.verticesNorm[v * 4 + 0];
+      normals_new[i * 4 + 1] = mesh.verticesNorm[v * 4 + 1];
+      normals_new[i * 4 + 2] = mesh.verticesNorm[v * 4 + 2];
+      normals_new[i * 4 + 3] = 1.0f;
     }
 
-  }
-
-  vertices_new.resize(index * 4);
-  normals_new.resize(index * 4);
-  uv_new.resize(index * 2);
-  tangents_new.resize(index * 4);
-
-  //std::cout << "vert old : " << mesh.verticesPos.size() << "  vert new :" << vertices_new.size() << std::endl;
+    if (hasTexCoord)
+    {
+      uv_new[i * 2 + 0] = mesh.verticesTexCoord[v * 2 + 0];
+      uv_new[i * 2 + 1] = mesh.verticesTexCoord[v * 2 + 1];
+    }
 
-  pMesh->m_inputPointers.normals = nullptr;
-  pMesh->m_inputPointers.tangents = nullptr;
+    if (hasTangents)
+    {
+      for (int c = 0; c < 4; c++)
+        tangents_new[i * 4 + c] = mesh.verticesTangent[v * 4 + c];
+    }
+  }
 
-  mesh.verticesPos.clear();
-  mesh.verticesPos.resize(vertices_new.size());
-  std::copy(vertices_new.begin(), vertices_new.end(), mesh.verticesPos.begin());
+  for (auto& arr : mesh.customArrays)
+  {
+    const size_t depth = size_t(arr.depth);
+    const bool perVertex = (arr.apply == 0);
+    const std::vector<uint32_t>& source = perVertex ? newVertexSource : keptTris;
 
-  mesh.verticesNorm.clear();
-  mesh.verticesNorm.resize(normals_new.size());
-  std::copy(normals_new.begin(), normals_new.end(), mesh.verticesNorm.begin());
+    auto compact = [&](auto& data)
+    {
+      if (data.size() < (perVertex ? vertexNum : triNum) * depth)
+        return;
+
+      typename std::remove_reference<decltype(data)>::type data_new(source.size() * depth);
+      #pragma omp parallel for
+      for (int64_t i = 0; i < int64_t(source.size()); i++)
+        std::copy(data.begin() + source[i] * depth, data.begin() + (source[i] + 1) * depth, data_new.begin() + i * depth);
+      data.swap(data_new);
+    };
+
+    compact(arr.fdata);
+    compact(arr.idata);
+  }
 
-  mesh.verticesTexCoord.clear();
-  mesh.verticesTexCoord.resize(uv_new.size());
-  std::copy(uv_new.begin(), uv_new.end(), mesh.verticesTexCoord.begin());
+  std::vector<uint32_t> indices_new(newTriNum * 3);
+  std::vector<uint32_t> mid_new(newTriNum);
 
-  mesh.verticesTangent.clear();
-  mesh.verticesTangent.resize(tangents_new.size());
-  std::copy(tangents_new.begin(), tangents_new.end(), mesh.verticesTangent.begin());
+  #pragma omp parallel for
+  for (int64_t i = 0; i < newTriNum; i++)
+  {
+    const size_t t = keptTris[i];
+    for (int c = 0; c < 3; c++)
+      indices_new[i * 3 + c] = newIndexOfRank[rankOfVertex[mesh.triIndices[t * 3 + c]]];
+    mid_new[i] = mesh.matIndices[t];
+  }
 
-  mesh.triIndices.clear();
-  mesh.triIndices.resize(indices_new.size());
-  std::copy(indices_new.begin(), indices_new.end(), mesh.triIndices.begin());
+  pMesh->m_inputPointers.normals = nullptr;
+  pMesh->m_inputPointers.tangents = nullptr;
 
-  mesh.matIndices.clear();
-  mesh.matIndices.resize(mid_new.size());
-  std::copy(mid_new.begin(), mid_new.end(), mesh.matIndices.begin());
+  mesh.verticesPos.swap(vertices_new);
+  mesh.verticesNorm.swap(normals_new);
+  mesh.verticesTexCoord.swap(uv_new);
+  mesh.verticesTangent.swap(tangents_new);
+  mesh.triIndices.swap(indices_new);
+  mesh.matIndices.swap(mid_new);
 
-  indexNum = indices_new.size();
+  indexNum = int(mesh.triIndices.size());
 }
 
 
@@ -44,6 +44,7 @@ HAPI HRLightRef hrLightCreate(const wchar_t* a_objectName)
   light.name = std::wstring(a_objectName);
   light.id = ref.id;
   g_objManager.scnData.lights.push_back(light);
+  g_objManager.scnData.m_lightIdByName.emplace(light.name, light.id);
 
 
   pugi::xml_node nodeXml = g_objManager.lights_lib_append_child();
@@ -139,6 +140,11 @@ HAPI void hrLightClose(HRLightRef a_pLight)
   //
   auto lightNode = pLight->xml_node_next(HR_OPEN_EXISTING);
 
+  const pugi::xml_attribute nameAttr = lightNode.attribute(L"name");
+  if (nameAttr != nullptr && pLight->name != nameAttr.as_string())
+    HR_RenameObject(g_objManager.scnData.m_lightIdByName, g_objManager.scnData.lights, *pLight, nameAttr.as_string());
+
+
   if (lightNode.child(L"ies") != nullptr)
   {
     const wchar_t* iesFilePath = lightNode.child(L"ies").attribute(L"data").as_string();
@@ -712,6 +718,10 @@ void HR_UpdateLightsGeometryAndMaterial(pugi::xml_node a_lightLibChanges, pugi::
       if((HR_LightHaveShape(lshape) && !invisiable) || isSkyPortal)
         instToAdd.push_back(LightInstance(matrixStr, meshId, lightId, instId));
     }
+    else if (std::wstring(inst.name()) == L"instances_table")
+    {
+      nextInstId += inst.attribute(L"count").as_int();
+    }
     else
     {
       if (inst.attribute(L"linst_id") != nullptr)
@@ -765,26 +775,59 @@ void HR_UpdateLightsGeometryAndMaterial(pugi::xml_node a_lightLibChanges, pugi::
 
 HAPI HRLightRef hrFindLightByName(const wchar_t *a_lightName)
 {
-  HRLightRef light;
+  HRLightRef ref;
 
   if(a_lightName != nullptr)
   {
-    for (auto lgt : g_objManager.scnData.lights)
+    const auto& index = g_objManager.scnData.m_lightIdByName;
+    auto p = index.find(a_lightName);
+    if (p != index.end())
+      ref.id = p->second;
+  }
+
+  if(ref.id == -1)
+  {
+    std::wstringstream ss;
+    ss << L"hrLightFindByName: can't find light \"" << (a_lightName != nullptr ? a_lightName : L"") << "\"";
+    HrError(ss.str());
+  }
+
+  return ref;
+}
+
+HAPI int32_t hrFindLightsByNames(const wchar_t** a_names, int32_t a_count, HRLightRef* a_outRefs)
+{
+  if (a_names == nullptr || a_outRefs == nullptr)
+  {
+    HrError(L"hrFindLightsByNames: nullptr input");
+    return 0;
+  }
+
+  const auto& index = g_objManager.scnData.m_lightIdByName;
+
+  int32_t found = 0;
+  const wchar_t* firstMissing = nullptr;
+
+  for (int32_t i = 0; i < a_count; i++)
+  {
+    a_outRefs[i] = HRLightRef();
+
+    auto p = (a_names[i] != nullptr) ? index.find(a_names[i]) : index.end();
+    if (p != index.end())
     {
-      if (lgt.name == std::wstring(a_lightName))
-      {
-        light.id = lgt.id;
-        break;
-      }
+      a_outRefs[i].id = p->second;
+      found++;
     }
+    else if (firstMissing == nullptr)
+      firstMissing = (a_names[i] != nullptr) ? a_names[i] : L"";
   }
 
-  if(light.id == -1)
+  if (found != a_count)
   {
     std::wstringstream ss;
-    ss << L"hrLightFindByName: can't find light \"" << a_lightName << "\"";
+    ss << L"hrFindLightsByNames: can't find " << (a_count - found) << L" light(s), first is \"" << firstMissing << "\"";
     HrError(ss.str());
   }
 
-  return light;
+  return found;
 }
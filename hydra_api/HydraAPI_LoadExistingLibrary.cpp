@@ -24,12 +24,21 @@ extern HRObjectManager g_objManager;
 using namespace HydraLiteMath;
 
 
-HRTextureNodeRef _hrTexture2DCreateFromNode(pugi::xml_node a_node)
+static bool _hrTextureInfoIsValid(pugi::xml_node a_node) ///< CreateTextureInfoFromChunkFile will not report error for this node
+{
+  return std::wstring(a_node.attribute(L"type").as_string()) == L"proc" || (a_node.attribute(L"width").as_int() != 0 && a_node.attribute(L"height").as_int() != 0);
+}
+
+static void _hrTexture2DLoadInfo(HRTextureNode& a_texture, pugi::xml_node a_node)
+{
+  const std::wstring loc = g_objManager.GetLoc(a_node);
+  a_texture.pImpl = g_objManager.m_pFactory->CreateTextureInfoFromChunkFile(&a_texture, loc.c_str(), a_node);
+}
+
+HRTextureNodeRef _hrTexture2DCreateFromNode(pugi::xml_node a_node, bool a_loadInfo = true)
 {
   const wchar_t* a_fileName1 = a_node.attribute(L"name").as_string();
   const wchar_t* a_fileName2 = a_node.attribute(L"path").as_string();
-  const std::wstring loc     = g_objManager.GetLoc(a_node);
-  const wchar_t* a_chunkPath = loc.c_str(); 
 
   HRTextureNodeRef ref;
   ref.id = HR_IDType(g_objManager.scnData.textures.size());
@@ -46,8 +55,8 @@ HRTextureNodeRef _hrTexture2DCreateFromNode(pugi::xml_node a_node)
   g_objManager.scnData.textures      [ref.id].update_this(a_node);
   g_objManager.scnData.m_textureCache[a_fileName2] = ref.id; // remember texture id for given file name
 
-  if (a_chunkPath != L"")
-    texture.pImpl = g_objManager.m_pFactory->CreateTextureInfoFromChunkFile(&texture, a_chunkPath, a_node);
+  if (a_loadInfo)
+    _hrTexture2DLoadInfo(texture, a_node);
 
   return ref;
 }
@@ -64,38 +73,40 @@ HRMaterialRef _hrMaterialCreateFromNode(pugi::xml_node a_node)
   mat.id = ref.id;
   g_objManager.scnData.materials.push_back(mat);
   g_objManager.scnData.materials[ref.id].update_this(a_node);
+  g_objManager.scnData.m_materialIdByName.emplace(mat.name, mat.id);
 
   return ref;
 }
 
-HAPI HRMeshRef _hrMeshCreateFromNode(pugi::xml_node a_node)
+static std::wstring _hrMeshFileName(pugi::xml_node a_node)
 {
-  const std::wstring dl       = a_node.attribute(L"dl").as_string();
-  const std::wstring loc      = g_objManager.GetLoc(a_node);
-  const wchar_t* a_objectName = a_node.attribute(L"name").as_string();
-  const wchar_t* a_fileName   = (dl == L"1") ? a_node.attribute(L"path").as_string() : loc.c_str();
-
-  HRMeshRef ref;
-
-  ref.id = a_node.attribute(L"id").as_int();//HR_IDType(g_objManager.scnData.meshes.size());
-
-  if(ref.id == 43)
-    std::cout <<"1";
+  const std::wstring dl = a_node.attribute(L"dl").as_string();
+  return (dl == L"1") ? std::wstring(a_node.attribute(L"path").as_string()) : g_objManager.GetLoc(a_node);
+}
 
+static HRMesh _hrMeshObjectFromNode(pugi::xml_node a_node)
+{
   HRMesh mesh;
-  mesh.name = std::wstring(a_objectName);
-  mesh.id   = ref.id;
+  mesh.name = std::wstring(a_node.attribute(L"name").as_string());
+  mesh.id   = a_node.attribute(L"id").as_int();
   mesh.update_this(a_node);
-  g_objManager.scnData.meshes.push_back(mesh);
-//  g_objManager.scnData.meshes[ref.id].update_this(a_node);
-//  g_objManager.scnData.meshes[ref.id].id = ref.id;
+  return mesh;
+}
+
+HAPI HRMeshRef _hrMeshCreateFromNode(pugi::xml_node a_node)
+{
+  const std::wstring fileName = _hrMeshFileName(a_node);
+
+  g_objManager.scnData.meshes.push_back(_hrMeshObjectFromNode(a_node));
 
   HRMesh* pMesh = &g_objManager.scnData.meshes.back();
-  pMesh->pImpl  = g_objManager.m_pFactory->CreateVSGFFromFile(pMesh, a_fileName, a_node); //#TODO: load custom attributes somewhere inside
+  pMesh->pImpl  = g_objManager.m_pFactory->CreateVSGFFromFile(pMesh, fileName, a_node); //#TODO: load custom attributes somewhere inside
 
   if (pMesh->pImpl == nullptr)
-    HrError(L"LoadExistingLibrary, _hrMeshCreateFromNode can't load mesh from location = ", a_fileName);
+    HrError(L"LoadExistingLibrary, _hrMeshCreateFromNode can't load mesh from location = ", fileName.c_str());
 
+  HRMeshRef ref;
+  ref.id = pMesh->id;
   return ref;
 }
 
@@ -113,6 +124,7 @@ HRLightRef _hrLightCreateFromNode(pugi::xml_node a_node)
 
   g_objManager.scnData.lights[ref.id].update_this(a_node);
   g_objManager.scnData.lights[ref.id].id = ref.id;
+  g_objManager.scnData.m_lightIdByName.emplace(light.name, light.id);
 
   return ref;
 }
@@ -132,6 +144,7 @@ HAPI HRCameraRef _hrCameraCreateFromNode(pugi::xml_node a_node)
 
   g_objManager.scnData.cameras[ref.id].update_this(a_node);
   g_objManager.scnData.cameras[ref.id].id = ref.id;
+  g_objManager.scnData.m_cameraIdByName.emplace(cam.name, cam.id);
 
   return ref;
 }
@@ -142,16 +155,16 @@ HAPI HRCameraRef _hrCameraCreateFromNode(pugi::xml_node a_node)
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
-HAPI void _hrMeshInstanceFromNode(HRSceneInstRef a_pScn, pugi::xml_node a_node)
+static void _hrReadInstanceMatrix(pugi::xml_node a_node, float a_mat[16])
 {
-  HRSceneInst* pScn = g_objManager.PtrById(a_pScn);
-  if (pScn == nullptr)
-  {
-    HrError(L"hrMeshInstance: nullptr input");
-    return;
-  }
+  const wchar_t* matString = a_node.attribute(L"matrix").as_string();
+  std::wstringstream matStream(matString);
+  for (int i = 0; i < 16; i++)
+    matStream >> a_mat[i];
+}
 
-  HRSceneInst::Instance model;
+static void _hrReadMeshInstance(pugi::xml_node a_node, HRSceneInst::Instance& model)
+{
   model.meshId = a_node.attribute(L"mesh_id").as_int();
 
   if (a_node.attribute(L"linst_id") == nullptr)
@@ -170,19 +183,24 @@ HAPI void _hrMeshInstanceFromNode(HRSceneInstRef a_pScn, pugi::xml_node a_node)
   else
     model.remapListId = a_node.attribute(L"rmap_id").as_int();
 
-  /////////////////////////////////////////////////////////////////////////////////////////////
-  const wchar_t* matString = a_node.attribute(L"matrix").as_string();
-  std::wstringstream matStream(matString);
-  float a_mat[16];
-  for (int i = 0; i < 16; i++)
-    matStream >> a_mat[i];
-  /////////////////////////////////////////////////////////////////////////////////////////////
+  model.scene_id  = a_node.attribute(L"scn_id").as_int(-1);
+  model.scene_sid = a_node.attribute(L"scn_sid").as_int(0);
 
-  memcpy(model.m, a_mat, 16 * sizeof(float));
-  pScn->drawList.push_back(model);
+  _hrReadInstanceMatrix(a_node, model.m);
 }
 
-HAPI void _hrLightInstanceFromNode(HRSceneInstRef a_pScn, pugi::xml_node a_node)
+static void _hrReadLightInstance(pugi::xml_node a_node, HRSceneInst::Instance& model)
+{
+  model.lightId          = a_node.attribute(L"light_id").as_int();
+  model.lightGroupInstId = a_node.attribute(L"lgroup_id").as_int();
+  model.meshId           = -1;
+  model.remapListId      = -1;
+
+  _hrReadInstanceMatrix(a_node, model.m);
+  model.node = a_node;
+}
+
+HAPI void _hrMeshInstanceFromNode(HRSceneInstRef a_pScn, pugi::xml_node a_node)
 {
   HRSceneInst* pScn = g_objManager.PtrById(a_pScn);
   if (pScn == nullptr)
@@ -192,21 +210,21 @@ HAPI void _hrLightInstanceFromNode(HRSceneInstRef a_pScn, pugi::xml_node a_node)
   }
 
   HRSceneInst::Instance model;
-  model.lightId          = a_node.attribute(L"light_id").as_int();
-  model.lightGroupInstId = a_node.attribute(L"lgroup_id").as_int();
-  model.meshId           = -1;
-  model.remapListId      = -1;
+  _hrReadMeshInstance(a_node, model);
+  pScn->drawList.push_back(model);
+}
 
-  /////////////////////////////////////////////////////////////////////////////////////////////
-  const wchar_t* matString = a_node.attribute(L"matrix").as_string();
-  std::wstringstream matStream(matString);
-  float a_mat[16];
-  for (int i = 0; i < 16; i++)
-    matStream >> a_mat[i];
-  /////////////////////////////////////////////////////////////////////////////////////////////
+HAPI void _hrLightInstanceFromNode(HRSceneInstRef a_pScn, pugi::xml_node a_node)
+{
+  HRSceneInst* pScn = g_objManager.PtrById(a_pScn);
+  if (pScn == nullptr)
+  {
+    HrError(L"hrMeshInstance: nullptr input");
+    return;
+  }
 
-  memcpy(model.m, a_mat, 16 * sizeof(float));
-  model.node = a_node;
+  HRSceneInst::Instance model;
+  _hrReadLightInstance(a_node, model);
   pScn->drawListLights.push_back(model);
 }
 
@@ -247,6 +265,23 @@ std::string ws2s(const std::wstring& s);
 std::wstring s2ws(const std::string& s);
 
 
+/**
+\brief Count 'statex_XXXXX.xml' and binary 'statex_XXXXX.bxml' of the same state once.
+When both exist (library was flushed with and without '-binary_state 1'), binary one is taken.
+*/
+static void _hrAppendStateFile(const std::wstring& a_file, std::wstring& a_lastState, std::wstring& fileName, int& stateId)
+{
+  const std::wstring state = a_file.substr(0, a_file.find_last_of(L'.'));
+  if (state != a_lastState)
+  {
+    a_lastState = state;
+    fileName    = a_file;
+    stateId++;
+  }
+  else if (HydraXMLHelpers::IsBinaryDocumentPath(a_file))
+    fileName = a_file;
+}
+
 void _hrFindTargetOrLastState(const wchar_t* a_libPath, int32_t a_stateId,
                               std::wstring& fileName, int& stateId)
 {
@@ -264,18 +299,17 @@ void _hrFindTargetOrLastState(const wchar_t* a_libPath, int32_t a_stateId,
     
     std::sort(fileList.begin(), fileList.end());
     
+    std::wstring lastState;
     for (auto p : fileList)
     {
       const std::string& currFile = p;
       
       if (currFile.find("statex") != std::string::npos)
-      {
-        fileName = s2ws(currFile);
-        stateId++;
-      }
+        _hrAppendStateFile(s2ws(currFile), lastState, fileName, stateId);
     }
 #elif defined WIN32
     auto fileList = hr_listfiles(a_libPath);
+    std::wstring lastState;
 
     //for (auto p : std_fs::directory_iterator(a_libPath))
     for (auto p : fileList)
@@ -285,15 +319,49 @@ void _hrFindTargetOrLastState(const wchar_t* a_libPath, int32_t a_stateId,
       const std::wstring& currFile = p;
 
       if (currFile.find(L"statex") != std::wstring::npos)
-      {
-        fileName = currFile;
-        stateId++;
-      }
+        _hrAppendStateFile(currFile, lastState, fileName, stateId);
     }
 #endif
   }
 }
 
+void _hrRegisterExistingChunks()
+{
+  auto& vb = g_objManager.scnData.m_vbCache;
+
+  for (auto& mesh : g_objManager.scnData.meshes)
+  {
+    if (mesh.pImpl == nullptr || mesh.pImpl->chunkId() == uint64_t(-1))
+      continue;
+
+    pugi::xml_node node = mesh.xml_node_immediate();
+    if (node.attribute(L"dl").as_int() == 1)
+      continue;
+
+    vb.RegisterChunkOnDisk(size_t(mesh.pImpl->chunkId()), node.attribute(L"bytesize").as_ullong(), CHUNK_TYPE_VSGF);
+  }
+
+  for (auto& tex : g_objManager.scnData.textures)
+  {
+    if (tex.pImpl == nullptr || tex.pImpl->chunkId() == uint64_t(-1))
+      continue;
+
+    pugi::xml_node node = tex.xml_node_immediate();
+    const std::wstring loc = node.attribute(L"loc").as_string();
+    
+    CHUNK_TYPE type = CHUNK_TYPE_UNKNOWN; // chunk file name then ends with '.bin'
+    if (loc.find(L".image4ub") != std::wstring::npos)
+      type = CHUNK_TYPE_IMAGE4UB;
+    else if (loc.find(L".image4f") != std::wstring::npos)
+      type = CHUNK_TYPE_IMAGE4F;
+    else if (loc.find(L".image4hf") != std::wstring::npos)
+      type = CHUNK_TYPE_IMAGE4HF;
+
+    const uint64_t sizeInBytes = node.attribute(L"bytesize").as_ullong() + uint64_t(2 * sizeof(int)); // (w,h) header goes first
+    vb.RegisterChunkOnDisk(size_t(tex.pImpl->chunkId()), sizeInBytes, type);
+  }
+}
+
 int32_t _hrSceneLibraryLoad(const wchar_t* a_libPath, int a_stateId, const std::wstring& a_stateFileName)
 {
   // (0) (a_stateId == -1) => find last state in folder
@@ -325,12 +393,20 @@ int32_t _hrSceneLibraryLoad(const wchar_t* a_libPath, int a_stateId, const std::
   if (g_objManager.m_attachMode)
     HrPrint(HR_SEVERITY_INFO, L"HydraAPI, loading xml ... ");
 
-  auto loadResult = g_objManager.scnData.m_xmlDoc.load_file(fileName.c_str());
-
-  if (!loadResult)
+  if (HydraXMLHelpers::IsBinaryDocumentPath(fileName))
   {
-    HrError(L"_hrSceneLibraryLoad, pugixml load: ", loadResult.description());
-    return -1;
+    if (!HydraXMLHelpers::LoadBinaryDocument(g_objManager.scnData.m_xmlDoc, fileName))
+      return -1;
+  }
+  else
+  {
+    auto loadResult = g_objManager.scnData.m_xmlDoc.load_file(fileName.c_str());
+
+    if (!loadResult)
+    {
+      HrError(L"_hrSceneLibraryLoad, pugixml load: ", loadResult.description());
+      return -1;
+    }
   }
 
   if (g_objManager.m_attachMode)
@@ -360,8 +436,32 @@ int32_t _hrSceneLibraryLoad(const wchar_t* a_libPath, int a_stateId, const std::
   if (g_objManager.m_attachMode)
     HrPrint(HR_SEVERITY_INFO, L"HydraAPI, loading objects from xml ... ");
 
+  // objects are created serially to keep ids; then chunk infos and VSGF headers are read in parallel
+  //
+  std::vector<pugi::xml_node> texNodes;
   for (pugi::xml_node node = g_objManager.scnData.m_texturesLib.first_child(); node != nullptr; node = node.next_sibling())
-    _hrTexture2DCreateFromNode(node);
+  {
+    _hrTexture2DCreateFromNode(node, false);
+    texNodes.push_back(node);
+  }
+
+  {
+    auto& textures = g_objManager.scnData.textures;
+    const int texFirst = int(textures.size() - texNodes.size());
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < int(texNodes.size()); i++)
+    {
+      if (_hrTextureInfoIsValid(texNodes[i]))
+        _hrTexture2DLoadInfo(textures[texFirst + i], texNodes[i]);
+    }
+
+    for (int i = 0; i < int(texNodes.size()); i++) // let factory report bad textures from main thread
+    {
+      if (!_hrTextureInfoIsValid(texNodes[i]))
+        _hrTexture2DLoadInfo(textures[texFirst + i], texNodes[i]);
+    }
+  }
 
   // (4) load materials
   //
@@ -370,12 +470,35 @@ int32_t _hrSceneLibraryLoad(const wchar_t* a_libPath, int a_stateId, const std::
 
   // (5) load geom
   //
+  // meshes are kept in id order; sort nodes instead of HRMesh objects
+  //
+  std::vector<std::pair<int32_t, pugi::xml_node> > meshNodes;
   for (pugi::xml_node node = g_objManager.scnData.m_geometryLib.first_child(); node != nullptr; node = node.next_sibling())
-    _hrMeshCreateFromNode(node);
+    meshNodes.push_back(std::make_pair(node.attribute(L"id").as_int(), node));
 
-  std::sort(
-          g_objManager.scnData.meshes.begin(), g_objManager.scnData.meshes.end(),
-          [&](auto a, auto b) { return a.id < b.id; });
+  std::stable_sort(meshNodes.begin(), meshNodes.end(),
+                   [](const std::pair<int32_t, pugi::xml_node>& a, const std::pair<int32_t, pugi::xml_node>& b) { return a.first < b.first; });
+
+  {
+    auto& meshes = g_objManager.scnData.meshes;
+    const int meshFirst = int(meshes.size());
+
+    for (const auto& p : meshNodes)
+      meshes.push_back(_hrMeshObjectFromNode(p.second));
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int i = 0; i < int(meshNodes.size()); i++)
+    {
+      HRMesh* pMesh = &meshes[meshFirst + i];
+      pMesh->pImpl  = g_objManager.m_pFactory->CreateVSGFFromFile(pMesh, _hrMeshFileName(meshNodes[i].second), meshNodes[i].second);
+    }
+
+    for (int i = 0; i < int(meshNodes.size()); i++)
+    {
+      if (meshes[meshFirst + i].pImpl == nullptr)
+        HrError(L"LoadExistingLibrary, _hrMeshCreateFromNode can't load mesh from location = ", _hrMeshFileName(meshNodes[i].second).c_str());
+    }
+  }
 
   // (6) load lights
   //
@@ -414,13 +537,37 @@ int32_t _hrSceneLibraryLoad(const wchar_t* a_libPath, int a_stateId, const std::
     HRSceneInstRef a_pScn;
     a_pScn.id = HR_IDType(g_objManager.scnInst.size()-1);*/
 
+    // reserve slots in xml order first, then parse instance matrices in parallel
+    //
+    auto& drawList       = g_objManager.scnInst[a_pScn.id].drawList;
+    auto& drawListLights = g_objManager.scnInst[a_pScn.id].drawListLights;
+
+    std::vector<std::pair<pugi::xml_node, size_t> > meshInst, lightInst;
+
     for (pugi::xml_node nodeInst = node.first_child(); nodeInst != nullptr; nodeInst = nodeInst.next_sibling())
     {
-      if (std::wstring(nodeInst.name()) == L"instance")
-        _hrMeshInstanceFromNode(a_pScn, nodeInst);
-      else if (std::wstring(nodeInst.name()) == L"instance_light")
-        _hrLightInstanceFromNode(a_pScn, nodeInst);
+      const std::wstring name = nodeInst.name();
+      if (name == L"instance")
+      {
+        meshInst.push_back(std::make_pair(nodeInst, drawList.size()));
+        drawList.emplace_back();
+      }
+      else if (name == L"instance_light")
+      {
+        lightInst.push_back(std::make_pair(nodeInst, drawListLights.size()));
+        drawListLights.emplace_back();
+      }
+      else if (name == L"instances_table")
+        HR_LoadInstanceTable(g_objManager.scnData.m_path, nodeInst, drawList);
     }
+
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < int(meshInst.size()); i++)
+      _hrReadMeshInstance(meshInst[i].first, drawList[meshInst[i].second]);
+
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < int(lightInst.size()); i++)
+      _hrReadLightInstance(lightInst[i].first, drawListLights[lightInst[i].second]);
     
     g_objManager.scnInst[a_pScn.id].driverDirtyFlag = true; // driver need to Update this scene
     g_objManager.scnInst[a_pScn.id].update_this(node);
@@ -437,6 +584,8 @@ int32_t _hrSceneLibraryLoad(const wchar_t* a_libPath, int a_stateId, const std::
   {
     size_t chunks = size_t(g_objManager.scnData.m_geometryLib.attribute(L"total_chunks").as_llong());
     g_objManager.scnData.m_vbCache.ResizeAndAllocEmptyChunks(chunks);
+
+    _hrRegisterExistingChunks(); // chunk type gives file name of chunk; with demand paging chunks are also swapped in on access
   }
   
   return 0;
@@ -797,6 +946,26 @@ HRSceneInstRef HRUtils::MergeLibraryIntoLibrary(const wchar_t* a_libPath, bool m
           }*/
         }
       }
+      else if(node.name() == std::wstring(L"instances_table"))
+      {
+        std::vector<HRSceneInst::Instance> instances;
+        HR_LoadInstanceTable(a_libPath, node, instances);
+
+        for(auto& inst : instances)
+        {
+          if(inst.lightId != -1) // light geometry will be created by lights of merged library
+            continue;
+
+          HRMeshRef ref;
+          ref.id = inst.meshId + numMeshesPreMerge;
+
+          if (inst.remapListId == -1)
+            hrMeshInstance(mergedScn, ref, inst.m);
+          else
+            hrMeshInstance(mergedScn, ref, inst.m, &remap_lists.at((unsigned long) inst.remapListId)[0],
+                           int32_t(remap_lists.at((unsigned long) inst.remapListId).size()));
+        }
+      }
       else
       {
         _hrInstanceMergeFromNode(mergedScn, node, numMeshesPreMerge, remap_lists, mergeLights, numLightsPreMerge);
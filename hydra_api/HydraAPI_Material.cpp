@@ -39,6 +39,7 @@ HAPI HRMaterialRef hrMaterialCreate(const wchar_t* a_objectName)
   mat.name = std::wstring(a_objectName);
   mat.id = ref.id;
   g_objManager.scnData.materials.push_back(mat);
+  g_objManager.scnData.m_materialIdByName.emplace(mat.name, mat.id);
 
   pugi::xml_node matNodeXml = g_objManager.materials_lib_append_child();
 
@@ -80,6 +81,7 @@ HAPI HRMaterialRef hrMaterialCreateBlend(const wchar_t* a_objectName, HRMaterial
   mat.name = std::wstring(a_objectName);
   mat.id = ref.id;
   g_objManager.scnData.materials.push_back(mat);
+  g_objManager.scnData.m_materialIdByName.emplace(mat.name, mat.id);
 
 
   pugi::xml_node matNodeXml = g_objManager.materials_lib_append_child();
@@ -250,6 +252,10 @@ HAPI void hrMaterialClose(HRMaterialRef a_pMat)
 
   auto matNode = pMat->xml_node_immediate();
   VerifyTex(a_pMat.id, matNode);
+
+  const pugi::xml_attribute nameAttr = matNode.attribute(L"name");
+  if (nameAttr != nullptr && pMat->name != nameAttr.as_string())
+    HR_RenameObject(g_objManager.scnData.m_materialIdByName, g_objManager.scnData.materials, *pMat, nameAttr.as_string());
   
   pMat->opened = false;
   pMat->pImpl  = nullptr;
@@ -276,26 +282,59 @@ HAPI pugi::xml_node hrMaterialParamNode(HRMaterialRef a_matRef)
 
 HAPI HRMaterialRef hrFindMaterialByName(const wchar_t *a_matName)
 {
-  HRMaterialRef material;
+  HRMaterialRef ref;
 
   if(a_matName != nullptr)
   {
-    for (auto mat : g_objManager.scnData.materials)
+    const auto& index = g_objManager.scnData.m_materialIdByName;
+    auto p = index.find(a_matName);
+    if (p != index.end())
+      ref.id = p->second;
+  }
+
+  if(ref.id == -1)
+  {
+    std::wstringstream ss;
+    ss << L"hrMaterialFindByName: can't find material \"" << (a_matName != nullptr ? a_matName : L"") << "\"";
+    HrError(ss.str());
+  }
+
+  return ref;
+}
+
+HAPI int32_t hrFindMaterialsByNames(const wchar_t** a_names, int32_t a_count, HRMaterialRef* a_outRefs)
+{
+  if (a_names == nullptr || a_outRefs == nullptr)
+  {
+    HrError(L"hrFindMaterialsByNames: nullptr input");
+    return 0;
+  }
+
+  const auto& index = g_objManager.scnData.m_materialIdByName;
+
+  int32_t found = 0;
+  const wchar_t* firstMissing = nullptr;
+
+  for (int32_t i = 0; i < a_count; i++)
+  {
+    a_outRefs[i] = HRMaterialRef();
+
+    auto p = (a_names[i] != nullptr) ? index.find(a_names[i]) : index.end();
+    if (p != index.end())
     {
-      if (mat.name == std::wstring(a_matName))
-      {
-        material.id = mat.id;
-        break;
-      }
+      a_outRefs[i].id = p->second;
+      found++;
     }
+    else if (firstMissing == nullptr)
+      firstMissing = (a_names[i] != nullptr) ? a_names[i] : L"";
   }
 
-  if(material.id == -1)
+  if (found != a_count)
   {
     std::wstringstream ss;
-    ss << L"hrMaterialFindByName: can't find material \"" << a_matName << "\"";
+    ss << L"hrFindMaterialsByNames: can't find " << (a_count - found) << L" material(s), first is \"" << firstMissing << "\"";
     HrError(ss.str());
   }
 
-  return material;
+  return found;
 }
\ No newline at end of file
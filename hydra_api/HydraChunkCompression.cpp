@@ -0,0 +1,413 @@
+#include "HydraChunkCompression.h"
+
+#include <cstring>
+#include <algorithm>
+
+struct HRChunkCompressionHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t rawSize;
+  uint32_t blockSize;
+  uint32_t blocksNum;
+  uint32_t shuffleStride;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(HRChunkCompressionHeader) == 32, "HRChunkCompressionHeader: unexpected size");
+
+constexpr uint32_t LZ_MIN_MATCH   = 4;
+constexpr uint32_t LZ_MAX_OFFSET  = 65535;
+constexpr int      LZ_HASH_BITS   = 16;
+constexpr uint32_t SHUFFLE_STRIDE = 4;
+
+static inline uint32_t read32(const uint8_t* p) { uint32_t x; memcpy(&x, p, sizeof(x)); return x; }
+
+static void ShuffleBytes(const uint8_t* a_in, size_t a_size, uint32_t a_stride, uint8_t* a_out)
+{
+  const size_t elems = a_size / a_stride;
+  for (uint32_t k = 0; k < a_stride; k++)
+  {
+    uint8_t* out = a_out + k*elems;
+    for (size_t i = 0; i < elems; i++)
+      out[i] = a_in[i*a_stride + k];
+  }
+  memcpy(a_out + elems*a_stride, a_in + elems*a_stride, a_size - elems*a_stride); // tail that is not multiple of stride
+}
+
+static void UnshuffleBytes(const uint8_t* a_in, size_t a_size, uint32_t a_stride, uint8_t* a_out)
+{
+  const size_t elems = a_size / a_stride;
+  for (uint32_t k = 0; k < a_stride; k++)
+  {
+    const uint8_t* in = a_in + k*elems;
+    for (size_t i = 0; i < elems; i++)
+      a_out[i*a_stride + k] = in[i];
+  }
+  memcpy(a_out + elems*a_stride, a_in + elems*a_stride, a_size - elems*a_stride);
+}
+
+static inline void PutLength(std::vector<uint8_t>& a_out, size_t a_len)
+{
+  while (a_len >= 255)
+  {
+    a_out.push_back(255);
+    a_len -= 255;
+  }
+  a_out.push_back(uint8_t(a_len));
+}
+
+static void PutSequence(std::vector<uint8_t>& a_out, const uint8_t* a_literals, size_t a_litLen, size_t a_offset, size_t a_matchLen)
+{
+  const size_t matchCode = (a_matchLen == 0) ? 0 : a_matchLen - LZ_MIN_MATCH;
+  a_out.push_back(uint8_t((std::min<size_t>(a_litLen, 15) << 4) | std::min<size_t>(matchCode, 15)));
+
+  if (a_litLen >= 15)
+    PutLength(a_out, a_litLen - 15);
+  a_out.insert(a_out.end(), a_literals, a_literals + a_litLen);
+
+  if (a_matchLen == 0) // last sequence has literals only
+    return;
+
+  a_out.push_back(uint8_t(a_offset & 0xFF));
+  a_out.push_back(uint8_t(a_offset >> 8));
+  if (matchCode >= 15)
+    PutLength(a_out, matchCode - 15);
+}
+
+/**
+\brief Greedy LZ77 with single entry hash table of 4 byte sequences. Sequence is (token, literals, offset, match length);
+       token keeps literals length and (match length - 4) in 4 bits each, longer lengths are continued with 255-bytes.
+\return false if coded block is not smaller than input
+*/
+static bool LZCompressBlock(const uint8_t* a_src, size_t a_size, std::vector<uint8_t>& a_out)
+{
+  a_out.clear();
+  a_out.reserve(a_size);
+
+  std::vector<uint32_t> table(size_t(1) << LZ_HASH_BITS, uint32_t(-1));
+
+  size_t ip     = 0;
+  size_t anchor = 0;
+
+  while (ip + LZ_MIN_MATCH <= a_size)
+  {
+    const uint32_t seq  = read32(a_src + ip);
+    const uint32_t h    = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+    const uint32_t cand = table[h];
+    table[h] = uint32_t(ip);
+
+    if (cand != uint32_t(-1) && ip - cand <= LZ_MAX_OFFSET && read32(a_src + cand) == seq)
+    {
+      size_t len = LZ_MIN_MATCH;
+      while (ip + len < a_size && a_src[cand + len] == a_src[ip + len])
+        len++;
+
+      PutSequence(a_out, a_src + anchor, ip - anchor, ip - cand, len);
+      ip    += len;
+      anchor = ip;
+
+      if (a_out.size() >= a_size)
+        return false;
+    }
+    else
+      ip += 1 + ((ip - anchor) >> 6); // skip faster through data that does not compress
+  }
+
+  PutSequence(a_out, a_src + anchor, a_size - anchor, 0, 0);
+  return a_out.size() < a_size;
+}
+
+static bool LZDecompressBlock(const uint8_t* a_src, size_t a_srcSize, uint8_t* a_dst, size_t a_dstSize)
+{
+  size_t ip = 0;
+  size_t op = 0;
+
+  auto getLength = [&](size_t& a_len) -> bool
+  {
+    uint8_t b = 255;
+    while (b == 255)
+    {
+      if (ip >= a_srcSize)
+        return false;
+      b      = a_src[ip++];
+      a_len += b;
+    }
+    return true;
+  };
+
+  while (true)
+  {
+    if (ip >= a_srcSize)
+      return false;
+
+    const uint8_t token = a_src[ip++];
+
+    size_t litLen = token >> 4;
+    if (litLen == 15 && !getLength(litLen))
+      return false;
+
+    if (litLen > a_srcSize - ip || litLen > a_dstSize - op)
+      return false;
+
+    memcpy(a_dst + op, a_src + ip, litLen);
+    ip += litLen;
+    op += litLen;
+
+    if (op == a_dstSize)
+      return (ip == a_srcSize);
+
+    if (ip + 2 > a_srcSize)
+      return false;
+
+    const size_t offset = size_t(a_src[ip]) | (size_t(a_src[ip + 1]) << 8);
+    ip += 2;
+
+    size_t matchLen = token & 15;
+    if (matchLen == 15 && !getLength(matchLen))
+      return false;
+    matchLen += LZ_MIN_MATCH;
+
+    if (offset == 0 || offset > op || matchLen > a_dstSize - op)
+      return false;
+
+    const uint8_t* match = a_dst + op - offset;
+    if (offset >= matchLen)
+      memcpy(a_dst + op, match, matchLen);
+    else
+    {
+      for (size_t i = 0; i < matchLen; i++) // overlapped copy repeats last 'offset' bytes
+        a_dst[op + i] = match[i];
+    }
+    op += matchLen;
+  }
+}
+
+static bool ReadHeader(const char* a_src, uint64_t a_srcSize, HRChunkCompressionHeader& a_header)
+{
+  if (a_src == nullptr || a_srcSize < sizeof(HRChunkCompressionHeader))
+    return false;
+
+  memcpy(&a_header, a_src, sizeof(HRChunkCompressionHeader));
+
+  if (a_header.magic != HR_CHUNK_COMPRESSION_MAGIC || a_header.version != 1 || a_header.rawSize == 0)
+    return false;
+
+  if (a_header.blockSize == 0 || a_header.blockSize % SHUFFLE_STRIDE != 0 || a_header.shuffleStride == 0)
+    return false;
+
+  return (a_header.rawSize + a_header.blockSize - 1) / a_header.blockSize == uint64_t(a_header.blocksNum);
+}
+
+uint64_t CompressedChunkRawSize(const char* a_src, uint64_t a_srcSize)
+{
+  HRChunkCompressionHeader header;
+  return ReadHeader(a_src, a_srcSize, header) ? header.rawSize : 0;
+}
+
+bool CompressChunkData(const char* a_data, uint64_t a_sizeInBytes, std::vector<char>& a_out)
+{
+  const uint64_t blockSize  = HR_CHUNK_COMPRESSION_BLOCK_SIZE;
+  const uint64_t blocksNum  = (a_sizeInBytes + blockSize - 1) / blockSize;
+  const uint64_t headerSize = sizeof(HRChunkCompressionHeader) + blocksNum*sizeof(uint32_t);
+
+  if (a_data == nullptr || a_sizeInBytes <= headerSize || blocksNum > uint64_t(0x7FFFFFFF))
+    return false;
+
+  // (1) code blocks independently
+  //
+  std::vector<std::vector<uint8_t> > blocks(blocksNum);
+
+  #pragma omp parallel for schedule(dynamic)
+  for (int b = 0; b < int(blocksNum); b++)
+  {
+    const uint8_t* src  = (const uint8_t*)a_data + uint64_t(b)*blockSize;
+    const size_t   size = size_t(std::min(blockSize, a_sizeInBytes - uint64_t(b)*blockSize));
+
+    std::vector<uint8_t> shuffled(size);
+    ShuffleBytes(src, size, SHUFFLE_STRIDE, shuffled.data());
+
+    if (!LZCompressBlock(shuffled.data(), size, blocks[b]))
+      blocks[b].assign(src, src + size); // stored block; it's size is equal to raw size
+  }
+
+  // (2) put header, sizes and blocks together
+  //
+  uint64_t totalSize = headerSize;
+  for (const auto& block : blocks)
+    totalSize += block.size();
+
+  if (totalSize >= a_sizeInBytes)
+    return false;
+
+  HRChunkCompressionHeader header;
+  header.magic         = HR_CHUNK_COMPRESSION_MAGIC;
+  header.version       = 1;
+  header.rawSize       = a_sizeInBytes;
+  header.blockSize     = uint32_t(blockSize);
+  header.blocksNum     = uint32_t(blocksNum);
+  header.shuffleStride = SHUFFLE_STRIDE;
+  header.reserved      = 0;
+
+  a_out.resize(size_t(totalSize));
+  char* out = a_out.data();
+  memcpy(out, &header, sizeof(header));
+  out += sizeof(header);
+
+  for (const auto& block : blocks)
+  {
+    const uint32_t size = uint32_t(block.size());
+    memcpy(out, &size, sizeof(size));
+    out += sizeof(size);
+  }
+
+  for (const auto& block : blocks)
+  {
+    memcpy(out, block.data(), block.size());
+    out += block.size();
+  }
+
+  return true;
+}
+
+bool DecompressChunkData(const char* a_src, uint64_t a_srcSize, char* a_out, uint64_t a_outSize)
+{
+  HRChunkCompressionHeader header;
+  if (!ReadHeader(a_src, a_srcSize, header) || header.rawSize != a_outSize)
+    return false;
+
+  const uint64_t headerSize = sizeof(HRChunkCompressionHeader) + uint64_t(header.blocksNum)*sizeof(uint32_t);
+  if (a_srcSize < headerSize)
+    return false;
+
+  std::vector<uint64_t> offsets(header.blocksNum + 1);
+  offsets[0] = headerSize;
+  for (uint32_t b = 0; b < header.blocksNum; b++)
+  {
+    uint32_t size;
+    memcpy(&size, a_src + sizeof(HRChunkCompressionHeader) + b*sizeof(uint32_t), sizeof(size));
+    offsets[b + 1] = offsets[b] + size;
+  }
+
+  if (offsets.back() > a_srcSize)
+    return false;
+
+  int failed = 0;
+
+  #pragma omp parallel for schedule(dynamic) reduction(+:failed)
+  for (int b = 0; b < int(header.blocksNum); b++)
+  {
+    const uint64_t begin   = uint64_t(b)*header.blockSize;
+    const size_t   rawSize = size_t(std::min<uint64_t>(header.blockSize, header.rawSize - begin));
+    const size_t   srcSize = size_t(offsets[b + 1] - offsets[b]);
+    const uint8_t* src     = (const uint8_t*)a_src + offsets[b];
+    uint8_t*       dst     = (uint8_t*)a_out + begin;
+
+    if (srcSize == rawSize)
+    {
+      memcpy(dst, src, rawSize);
+      continue;
+    }
+
+    std::vector<uint8_t> shuffled(rawSize);
+    if (LZDecompressBlock(src, srcSize, shuffled.data(), rawSize))
+      UnshuffleBytes(shuffled.data(), rawSize, header.shuffleStride, dst);
+    else
+      failed++;
+  }
+
+  return (failed == 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+HydraChunkStream::HydraChunkStream() : std::istream(nullptr), m_open(false)
+{
+
+}
+
+HydraChunkStream::HydraChunkStream(const std::wstring& a_fileName) : std::istream(nullptr), m_open(false)
+{
+  open(a_fileName);
+}
+
+void HydraChunkStream::close()
+{
+  if (m_file.is_open())
+    m_file.close();
+  rdbuf(&m_file);
+  m_decoded.clear();
+  m_open = false;
+}
+
+void HydraChunkStream::open(const std::wstring& a_fileName)
+{
+  close();
+
+#if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
+  std::string s2(a_fileName.begin(), a_fileName.end());
+  m_file.open(s2.c_str(), std::ios::in | std::ios::binary);
+#elif defined WIN32
+  m_file.open(a_fileName.c_str(), std::ios::in | std::ios::binary);
+#endif
+
+  rdbuf(&m_file);
+  if (!m_file.is_open())
+  {
+    setstate(std::ios::failbit);
+    return;
+  }
+  m_open = true;
+
+  // (1) raw chunk file is read as is
+  //
+  char head[sizeof(HRChunkCompressionHeader)];
+  const std::streamsize headSize = m_file.sgetn(head, std::streamsize(sizeof(head)));
+  const uint64_t rawSize         = CompressedChunkRawSize(head, uint64_t(headSize));
+
+  m_file.pubseekpos(0, std::ios::in);
+  if (rawSize == 0)
+    return;
+
+  // (2) compressed chunk is decoded to memory
+  //
+  const std::streamoff fileSize = m_file.pubseekoff(0, std::ios::end, std::ios::in);
+  m_file.pubseekpos(0, std::ios::in);
+
+  std::vector<char> packed(size_t(fileSize > 0 ? fileSize : 0));
+  const bool readOk = (fileSize > 0) && m_file.sgetn(packed.data(), std::streamsize(fileSize)) == std::streamsize(fileSize);
+  m_file.close();
+
+  m_decoded.resize(size_t(rawSize));
+  if (!readOk || !DecompressChunkData(packed.data(), uint64_t(packed.size()), m_decoded.data(), rawSize))
+  {
+    m_decoded.clear();
+    setstate(std::ios::failbit);
+    return;
+  }
+
+  m_memory.assign(m_decoded.data(), m_decoded.size());
+  rdbuf(&m_memory);
+}
+
+std::streambuf::pos_type HydraChunkStream::MemoryBuf::seekoff(off_type a_off, std::ios_base::seekdir a_dir, std::ios_base::openmode a_which)
+{
+  off_type base = 0;
+  if (a_dir == std::ios_base::cur)
+    base = off_type(gptr() - eback());
+  else if (a_dir == std::ios_base::end)
+    base = off_type(egptr() - eback());
+
+  const off_type pos = base + a_off;
+  if (!(a_which & std::ios_base::in) || pos < 0 || pos > off_type(egptr() - eback()))
+    return pos_type(off_type(-1));
+
+  setg(eback(), eback() + pos, egptr());
+  return pos_type(pos);
+}
+
+std::streambuf::pos_type HydraChunkStream::MemoryBuf::seekpos(pos_type a_pos, std::ios_base::openmode a_which)
+{
+  return seekoff(off_type(a_pos), std::ios_base::beg, a_which);
+}
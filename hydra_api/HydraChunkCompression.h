@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <istream>
+#include <fstream>
+#include <cstdint>
+
+/**
+\brief Compressed chunk file ('HRCZ'): header, table of compressed block sizes and independently coded blocks.
+       Each block is byte shuffled with stride 4 (same bytes of floats and ints go together) and then coded with simple LZ77 (LZ4 like tokens).
+       Block that does not become smaller is stored as is. Blocks are coded and decoded in parallel.
+
+*/
+
+constexpr uint32_t HR_CHUNK_COMPRESSION_MAGIC      = 0x5A435248; ///< 'HRCZ'
+constexpr uint32_t HR_CHUNK_COMPRESSION_BLOCK_SIZE = 1024*1024;  ///< raw bytes per block, must be multiple of 4
+
+bool     CompressChunkData(const char* a_data, uint64_t a_sizeInBytes, std::vector<char>& a_out); ///< return false if data can't be compressed (a_out is not valid then)
+bool     DecompressChunkData(const char* a_src, uint64_t a_srcSize, char* a_out, uint64_t a_outSize); ///< a_outSize must be equal to CompressedChunkRawSize(a_src, a_srcSize)
+uint64_t CompressedChunkRawSize(const char* a_src, uint64_t a_srcSize);                          ///< 0 if a_src is not a compressed chunk
+
+/**
+\brief Drop-in replacement of std::ifstream for reading chunk files: compressed chunk is decoded to memory on open, so seekg/read work as for raw file.
+*/
+class HydraChunkStream : public std::istream
+{
+public:
+
+  HydraChunkStream();
+  explicit HydraChunkStream(const std::wstring& a_fileName);
+
+  void open(const std::wstring& a_fileName);
+  void close();
+  bool is_open()    const { return m_open; }
+  bool compressed() const { return !m_decoded.empty(); }
+
+protected:
+
+  struct MemoryBuf : public std::streambuf
+  {
+    void assign(char* a_data, size_t a_size) { setg(a_data, a_data, a_data + a_size); }
+
+  protected:
+    pos_type seekoff(off_type a_off, std::ios_base::seekdir a_dir, std::ios_base::openmode a_which) override;
+    pos_type seekpos(pos_type a_pos, std::ios_base::openmode a_which) override;
+  };
+
+  std::filebuf      m_file;
+  MemoryBuf         m_memory;
+  std::vector<char> m_decoded;
+  bool              m_open;
+};
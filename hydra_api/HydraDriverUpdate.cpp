@@ -18,9 +18,15 @@
 #include <algorithm>
 
 #include "HydraVSGFExport.h"
+#include "HydraChunkCompression.h"
+#include "HydraXMLHelpers.h"
 #include "RenderDriverOpenGL3_Utility.h"
+#include "RenderDriverCPU_Utility.h"
 
 #include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 extern HRObjectManager g_objManager;
 extern HR_INFO_CALLBACK  g_pInfoCallback;
@@ -31,8 +37,7 @@ struct ChangeList
 {
   ChangeList() = default;
   ChangeList(ChangeList&& a_list) : meshUsed(std::move(a_list.meshUsed)), matUsed(std::move(a_list.matUsed)), 
-                                    lightUsed(std::move(a_list.lightUsed)), texturesUsed(std::move(a_list.texturesUsed)),
-                                    drawSeq(std::move(a_list.drawSeq))
+                                    lightUsed(std::move(a_list.lightUsed)), texturesUsed(std::move(a_list.texturesUsed))
   {
     
   }
@@ -43,7 +48,6 @@ struct ChangeList
     matUsed          = std::move(a_list.matUsed);
     lightUsed        = std::move(a_list.lightUsed);
     texturesUsed     = std::move(a_list.texturesUsed);
-    drawSeq          = std::move(a_list.drawSeq);
     return *this;
   }
 
@@ -52,16 +56,7 @@ struct ChangeList
   std::unordered_set<int32_t> lightUsed;
   std::unordered_set<int32_t> texturesUsed;
 
-  struct InstancesInfo
-  {
-    std::vector<float>    matrices;
-    std::vector<int32_t>  linstid;
-    std::vector<int32_t>  remapid;
-    std::vector<int32_t>  instIdReal;
-  };
-
-  std::unordered_map<int32_t, InstancesInfo > drawSeq;
-
+  typedef HRSceneInst::InstancesInfo InstancesInfo;
 };
 
 void ScanXmlNodeRecursiveAndAppendTexture(pugi::xml_node a_node, std::unordered_set<int32_t>& a_outSet)
@@ -128,71 +123,114 @@ void AddUsedMaterialChildrenRecursive(ChangeList& objects, int32_t matId)
 void AddInstanceToDrawSequence(const HRSceneInst::Instance &instance,
                                std::unordered_map<int32_t, ChangeList::InstancesInfo> &drawSeq, int a_instId)
 {
-
   auto p = drawSeq.find(instance.meshId);
   if (p == drawSeq.end())
   {
-    drawSeq[instance.meshId].matrices   = std::vector<float>  (instance.m, instance.m + 16);
-    drawSeq[instance.meshId].linstid    = std::vector<int32_t>(&instance.lightInstId, &instance.lightInstId + 1);
-    drawSeq[instance.meshId].remapid    = std::vector<int32_t>(&instance.remapListId, &instance.remapListId + 1);
-    drawSeq[instance.meshId].instIdReal = std::vector<int32_t>(&a_instId, &a_instId + 1);
-
     const int RESERVE_SIZE = 100;
 
-    drawSeq[instance.meshId].matrices.reserve(RESERVE_SIZE);
-    drawSeq[instance.meshId].linstid.reserve(RESERVE_SIZE);
-    drawSeq[instance.meshId].remapid.reserve(RESERVE_SIZE);
-    drawSeq[instance.meshId].instIdReal.reserve(RESERVE_SIZE);
+    p = drawSeq.insert(std::make_pair(instance.meshId, ChangeList::InstancesInfo())).first;
+    p->second.matrices.reserve(RESERVE_SIZE*16);
+    p->second.linstid.reserve(RESERVE_SIZE);
+    p->second.remapid.reserve(RESERVE_SIZE);
+    p->second.instIdReal.reserve(RESERVE_SIZE);
+  }
+
+  auto& seq = p->second;
 
+  if (seq.instIdReal.empty() || seq.instIdReal.back() < a_instId)
+  {
+    seq.matrices.insert(seq.matrices.end(), instance.m, instance.m + 16);
+    seq.linstid.push_back(instance.lightInstId);
+    seq.remapid.push_back(instance.remapListId);
+    seq.instIdReal.push_back(a_instId);
   }
-  else
+  else // instance that waited for its mesh; keep drawList order inside sequence
   {
-    std::vector<float> data(instance.m, instance.m + 16);
-    p->second.matrices.insert(p->second.matrices.end(), data.begin(), data.end());
-    p->second.linstid.push_back(instance.lightInstId);
-    p->second.remapid.push_back(instance.remapListId);
-    p->second.instIdReal.push_back(a_instId);
+    const size_t pos = size_t(std::lower_bound(seq.instIdReal.begin(), seq.instIdReal.end(), a_instId) - seq.instIdReal.begin());
+    seq.matrices.insert(seq.matrices.begin() + pos*16, instance.m, instance.m + 16);
+    seq.linstid.insert(seq.linstid.begin() + pos, instance.lightInstId);
+    seq.remapid.insert(seq.remapid.begin() + pos, instance.remapListId);
+    seq.instIdReal.insert(seq.instIdReal.begin() + pos, a_instId);
   }
+}
 
+static inline bool MeshIdIsValid(int32_t a_meshId) { return a_meshId >= 0 && size_t(a_meshId) < g_objManager.scnData.meshes.size(); }
+
+/**
+\brief append instances that were added after previous update to persistent scn.m_drawSeq.
+       Instances of meshes that don't exist yet wait in scn.m_pendingInstances and are added when mesh is created.
+
+*/
+void UpdateDrawSequence(HRSceneInst& scn)
+{
+  if (scn.m_drawSeqEnd > scn.drawList.size()) // drawList was rewritten without clearChangeTracker, rebuild index
+  {
+    scn.m_drawSeq.clear();
+    scn.m_pendingInstances.clear();
+    scn.m_drawSeqEnd = 0;
+  }
+
+  auto& pending = scn.m_pendingInstances;
+  pending.erase(std::remove_if(pending.begin(), pending.end(), [&scn](size_t a_instId)
+  {
+    const auto& instance = scn.drawList[a_instId];
+    if (!MeshIdIsValid(instance.meshId))
+      return false;
+    AddInstanceToDrawSequence(instance, scn.m_drawSeq, int(a_instId));
+    return true;
+  }), pending.end());
+
+  for (size_t i = scn.m_drawSeqEnd; i < scn.drawList.size(); i++)
+  {
+    const auto& instance = scn.drawList[i];
+    if (MeshIdIsValid(instance.meshId))
+      AddInstanceToDrawSequence(instance, scn.m_drawSeq, int(i));
+    else if (instance.meshId >= 0)
+      pending.push_back(i);
+  }
+
+  scn.m_drawSeqEnd = scn.drawList.size();
 }
 
 void FindNewObjects(ChangeList& objects, HRSceneInst& scn)
 {
-  // (1.1) loop through all scene instances to define what meshes used in scene  --> ~ok
+  // (1.1) loop through meshes and lights of this scene (not through instances) to define what we need to update --> ~ok
+  //       mesh is updated if it is new for driver or was changed (wasChanged is per object dirty bit of hrMeshClose/hrLightClose)
   //
   //std::cout << "##FindNewObjects, scnlib.meshUsedByDrv.size() = " << scnlib.meshUsedByDrv.size() << std::endl;
 
-  for (size_t i = 0; i < scn.drawList.size(); i++)
-  {
-    auto instance = scn.drawList[i];
-    if (instance.meshId >= g_objManager.scnData.meshes.size()) //#TODO: ? add log message if need to debug some thiing here
-      continue;
+  UpdateDrawSequence(scn);
 
-    auto& mesh = g_objManager.scnData.meshes[instance.meshId];
+  for (const auto& seq : scn.m_drawSeq)
+  {
+    auto& mesh = g_objManager.scnData.meshes[seq.first];
 
-    if (scn.meshUsedByDrv.find(instance.meshId) == scn.meshUsedByDrv.end() || mesh.wasChanged)
+    if (mesh.wasChanged || scn.meshUsedByDrv.find(seq.first) == scn.meshUsedByDrv.end())
     {
-      objects.meshUsed.insert(instance.meshId);
+      objects.meshUsed.insert(seq.first);
       mesh.wasChanged = false;
     }
-    
-    // form draw sequence for each mesh
-    //
-    AddInstanceToDrawSequence(instance, objects.drawSeq, int(i));
   }
 
-  for (size_t i = 0; i < scn.drawListLights.size(); i++)
+  if (scn.m_lightSeqEnd > scn.drawListLights.size())
   {
-    auto instance = scn.drawListLights[i];
+    scn.m_lightsInScene.clear();
+    scn.m_lightSeqEnd = 0;
+  }
+
+  for (size_t i = scn.m_lightSeqEnd; i < scn.drawListLights.size(); i++)
+    scn.m_lightsInScene.insert(scn.drawListLights[i].lightId);
+  scn.m_lightSeqEnd = scn.drawListLights.size();
 
-    auto& light = g_objManager.scnData.lights[instance.lightId];
+  for (int32_t lightId : scn.m_lightsInScene)
+  {
+    auto& light = g_objManager.scnData.lights[lightId];
 
-    if (scn.lightUsedByDrv.find(instance.lightId) == scn.lightUsedByDrv.end() || light.wasChanged)
+    if (light.wasChanged || scn.lightUsedByDrv.find(lightId) == scn.lightUsedByDrv.end())
     {
-      objects.lightUsed.insert(instance.lightId);
+      objects.lightUsed.insert(lightId);
       light.wasChanged = false;
     }
-    
   }
 
   // (1.2) loop through needed meshed to define what material used in scene      --> ?
@@ -292,31 +330,42 @@ void FindOldObjectsThatWeNeedToUpdate(ChangeList& objects, HRSceneInst& scn)
   InsertChangedIds(objects.texturesUsed, scn.texturesUsedByDrv, texturesChanges, L"texture");
   InsertChangedIds(objects.texturesUsed, scn.texturesUsedByDrv, texturesChanges, L"texture_advanced");
 
-  // AddMaterialsFromSceneRemapList
+  // AddMaterialsFromSceneRemapList; remap lists are parsed only when scene node was changed
   //
-  pugi::xml_node scnRemLists = scn.xml_node_immediate().child(L"remap_lists");
-
-  for (auto remapList : scnRemLists.children())
+  if (scn.m_remapListsChanged)
   {
-    const wchar_t* inputStr = remapList.attribute(L"val").as_string();
-    const int listSize = remapList.attribute(L"size").as_int();
-    std::wstringstream inStrStream(inputStr);
+    pugi::xml_node scnRemLists = scn.xml_node_immediate().child(L"remap_lists");
 
-    for (int i = 0; i < listSize; i++)
+    std::unordered_set<int32_t> remapMaterials;
+    for (auto remapList : scnRemLists.children())
     {
-      if (inStrStream.eof())
-        break;
-
-      int matId = 0;
-      inStrStream >> matId;
+      const wchar_t* inputStr = remapList.attribute(L"val").as_string();
+      const int listSize      = remapList.attribute(L"size").as_int();
 
-      if (objects.matUsed.find(matId)  == objects.matUsed.end() && // we don't add this object to list yet
-          scn.matUsedByDrv.find(matId) == scn.matUsedByDrv.end())  // and it was not added in previous updates
+      for (int i = 0; i < listSize; i++)
       {
-        objects.matUsed.insert(matId);
-        AddUsedMaterialChildrenRecursive(objects, matId);
+        wchar_t* endPtr = nullptr;
+        const long matId = wcstol(inputStr, &endPtr, 10);
+        if (endPtr == inputStr)
+          break;
+        remapMaterials.insert(int32_t(matId));
+        inputStr = endPtr;
       }
     }
+
+    scn.m_remapMaterials.assign(remapMaterials.begin(), remapMaterials.end());
+    std::sort(scn.m_remapMaterials.begin(), scn.m_remapMaterials.end());
+    scn.m_remapListsChanged = false;
+  }
+
+  for (int matId : scn.m_remapMaterials)
+  {
+    if (objects.matUsed.find(matId)  == objects.matUsed.end() && // we don't add this object to list yet
+        scn.matUsedByDrv.find(matId) == scn.matUsedByDrv.end())  // and it was not added in previous updates
+    {
+      objects.matUsed.insert(matId);
+      AddUsedMaterialChildrenRecursive(objects, matId);
+    }
   }
 
   // now we must add to change list all textures that are presented in the materials of matUsed 
@@ -398,66 +447,241 @@ ChangeList FindChangedObjects(HRSceneInst& scn, IHRRenderDriver* a_pDriver)
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
-void UpdateImageFromFileOrChunk(int32_t a_id, HRTextureNode& img, IHRRenderDriver* a_pDriver) // #TODO: debug and test this
+/**
+\brief Staging data of image or mesh that was read (and decoded) from file. In pipelined update mode it is filled by worker threads.
+*/
+struct HRStagingData
 {
-  pugi::xml_node node = img.xml_node_immediate();
+  std::vector<int> buffer;
+  HydraMappedFile  mapped;   ///< used instead of buffer when file was mapped to memory
+  HRMessageSink    messages; ///< HrError/HrPrint of worker (image tool prints errors itself); passed on by API thread in Acquire
+  int  width  = 0;
+  int  height = 0;
+  int  bpp    = 0;
+  bool loaded = false;
+};
 
-  bool delayedLoad = (node.attribute(L"dl").as_int() == 1);
+/**
+\brief Fixed pool of a_workers threads ('-update_workers n') loads the next requests while calling thread consumes current one. 
+       At most a_workers requests are loaded ahead of consumer, so staging memory is bounded.
+       Requests must be acquired in the same order they were passed, so the driver sees the same update order as in serial mode.
+*/
+template<typename Request>
+struct HRStagingPipeline
+{
+  typedef void (*LoadFunc)(const Request&, HRStagingData&);
+
+  HRStagingPipeline(int a_workers, LoadFunc a_load) : m_workers(size_t(a_workers)), m_load(a_load), m_next(0), m_launched(0), m_stop(false) {}
 
-  if (delayedLoad && img.m_loadedFromFile) // load external image from file 
+  ~HRStagingPipeline()
   {
-    const wchar_t* filename = node.attribute(L"path").as_string();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cond.notify_all();
+    for (auto& worker : m_threads)
+      worker.join();
+  }
 
-    int width, height, bpp;
-    bool loaded = g_objManager.m_pImgTool->LoadImageFromFile(filename, 
-                                                             width, height, bpp, g_objManager.m_tempBuffer);
+  void Push(size_t a_index, const Request& a_req) { m_requests.push_back(std::make_pair(a_index, a_req)); }
 
-    if(loaded)
-      a_pDriver->UpdateImage(a_id, width, height, bpp, (char*)g_objManager.m_tempBuffer.data(), node);
-    else
-      a_pDriver->UpdateImage(a_id, 0, 0, 0, nullptr, node);
+  void Start()
+  {
+    m_results.resize(m_requests.size());
+    m_ready.resize(m_requests.size(), 0);
 
-    if (g_objManager.m_tempBuffer.size() > TEMP_BUFFER_MAX_SIZE_DONT_FREE)
-      g_objManager.m_tempBuffer = g_objManager.EmptyBuffer();
+    const size_t threadsNum = std::min(m_workers, m_requests.size());
+    for (size_t i = 0; i < threadsNum; i++)
+      m_threads.push_back(std::thread(&HRStagingPipeline::WorkerLoop, this));
   }
-  else // load chunk
+
+  bool Acquire(size_t a_index, Request& a_req, HRStagingData& a_data) ///< return false if object with a_index was not prefetched
   {
-    auto w           = node.attribute(L"width").as_int();
-    auto h           = node.attribute(L"height").as_int();
-    auto sizeInBytes = node.attribute(L"bytesize").as_llong();
+    if (m_next >= m_requests.size() || m_requests[m_next].first != a_index)
+      return false;
 
-    if(w == 0 || h == 0 || sizeInBytes == 0)
     {
-      HrError(L"UpdateImageFromFileOrChunk: zero or unknown image size/resolution");
-      return;
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [this]() { return m_ready[m_next] != 0; });
+      a_req  = m_requests[m_next].second;
+      a_data = std::move(m_results[m_next]);
+      m_next++;
     }
+    m_cond.notify_all(); // consumer moved forward, so workers may load next request
 
-    auto bpp = sizeInBytes / (w*h);
+    HrFlushMessages(a_data.messages);
+    return true;
+  }
 
-    sizeInBytes += size_t(sizeof(int) * 2);
+  void Release(HRStagingData& a_data) ///< give staging buffer back to the pool
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_freeBuffers.push_back(std::move(a_data.buffer)); 
+  } 
 
-    g_objManager.m_tempBuffer.resize(sizeInBytes / uint64_t(sizeof(int)) + uint64_t(sizeof(int) * 16));
-    char* data = (char*)&g_objManager.m_tempBuffer[0];
+protected:
 
-    const std::wstring path = g_objManager.GetLoc(node);
-#if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
-    std::wstring s1(path);
-    std::string  s2(s1.begin(), s1.end());
-    std::ifstream fin(s2.c_str(), std::ios::binary);
-#elif defined WIN32
-    std::ifstream fin(path.c_str(), std::ios::binary);
-#endif
-    if (fin.is_open())
+  void WorkerLoop()
+  {
+    while (true)
     {
-      fin.read(data, sizeInBytes);
-      uint64_t dataOffset = node.attribute(L"offset").as_ullong();
-      a_pDriver->UpdateImage(a_id, w, h, bpp, data + dataOffset, node);
-      fin.close();
+      size_t id = 0;
+      HRStagingData data;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]() { return m_stop || m_launched >= m_requests.size() || m_launched < m_next + m_workers; });
+        if (m_stop || m_launched >= m_requests.size())
+          return;
+
+        id = m_launched++;
+        if (!m_freeBuffers.empty())
+        {
+          data.buffer = std::move(m_freeBuffers.back());
+          m_freeBuffers.pop_back();
+        }
+      }
+
+      HrSetThreadMessageSink(&data.messages);
+      m_load(m_requests[id].second, data);
+      HrSetThreadMessageSink(nullptr);
+
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_results[id] = std::move(data);
+        m_ready[id]   = 1;
+      }
+      m_cond.notify_all();
     }
+  }
+
+  size_t   m_workers;
+  LoadFunc m_load;
+  size_t   m_next;     ///< next request for Acquire
+  size_t   m_launched; ///< next request for workers
+  bool     m_stop;
+
+  std::vector<std::pair<size_t, Request> > m_requests; ///< is not changed after Start
+  std::vector<HRStagingData>               m_results;
+  std::vector<char>                        m_ready;
+  std::vector<std::vector<int> >           m_freeBuffers;
+  std::vector<std::thread>                 m_threads;
+  std::mutex                               m_mutex;
+  std::condition_variable                  m_cond;
+};
+
+static bool ChunkIsResident(uint64_t a_chunkId) ///< data can be taken from virtual buffer without reading chunk file
+{
+  auto& vb = g_objManager.scnData.m_vbCache;
+  if (a_chunkId == uint64_t(-1) || a_chunkId >= vb.size())
+    return false;
+
+  const ChunkPointer& chunk = vb.chunk_at(a_chunkId);
+  return chunk.InMemory() || (vb.DemandPagingEnabled() && chunk.wasSaved && chunk.sizeInBytes != 0);
+}
+
+struct HRImageStagingRequest
+{
+  std::wstring path;
+  bool     fromFile;    ///< decode external image file with image tool; otherwise read chunk file as is
+  int      width;
+  int      height;
+  int64_t  sizeInBytes;
+  uint64_t dataOffset;
+};
+
+static HRImageStagingRequest MakeImageStagingRequest(HRTextureNode& img)
+{
+  pugi::xml_node node = img.xml_node_immediate();
+
+  HRImageStagingRequest req;
+  req.fromFile    = (node.attribute(L"dl").as_int() == 1) && img.m_loadedFromFile;
+  req.path        = req.fromFile ? std::wstring(node.attribute(L"path").as_string()) : g_objManager.GetLoc(node);
+  req.width       = node.attribute(L"width").as_int();
+  req.height      = node.attribute(L"height").as_int();
+  req.sizeInBytes = node.attribute(L"bytesize").as_llong();
+  req.dataOffset  = node.attribute(L"offset").as_ullong();
+  return req;
+}
+
+static void LoadStagingImage(const HRImageStagingRequest& a_req, HRStagingData& a_data) ///< thread safe, don't touch xml or g_objManager here except image tool
+{
+  if (a_req.fromFile) // load external image from file 
+  {
+    static std::mutex imageToolMutex; // FreeImage loaders are not documented as reentrant, so workers decode one image at a time
+    std::lock_guard<std::mutex> lock(imageToolMutex);
+    a_data.loaded = g_objManager.m_pImgTool->LoadImageFromFile(a_req.path.c_str(), 
+                                                               a_data.width, a_data.height, a_data.bpp, a_data.buffer);
+    return;
+  }
+  
+  if(a_req.width == 0 || a_req.height == 0 || a_req.sizeInBytes == 0)
+    return;
+  
+  a_data.width  = a_req.width;
+  a_data.height = a_req.height;
+  a_data.bpp    = int(a_req.sizeInBytes / (a_req.width*a_req.height));
+
+  const uint64_t sizeInBytes = uint64_t(a_req.sizeInBytes) + uint64_t(sizeof(int) * 2);
+
+  a_data.buffer.resize(sizeInBytes / uint64_t(sizeof(int)) + uint64_t(sizeof(int) * 16));
+
+  HydraChunkStream fin(a_req.path);
+  if (fin.is_open())
+  {
+    fin.read((char*)a_data.buffer.data(), sizeInBytes);
+    a_data.loaded = true;
+  }
+}
+
+static void UpdateImageFromStaging(int32_t a_id, const HRImageStagingRequest& a_req, const HRStagingData& a_data, pugi::xml_node a_node, IHRRenderDriver* a_pDriver)
+{
+  const char* data = (const char*)a_data.buffer.data();
+
+  if (a_req.fromFile)
+  {
+    if(a_data.loaded)
+      a_pDriver->UpdateImage(a_id, a_data.width, a_data.height, a_data.bpp, data, a_node);
     else
-      a_pDriver->UpdateImage(a_id, w, h, bpp, nullptr, node);
+      a_pDriver->UpdateImage(a_id, 0, 0, 0, nullptr, a_node);
   }
+  else if (a_data.width == 0 || a_data.height == 0)
+    HrError(L"UpdateImageFromFileOrChunk: zero or unknown image size/resolution");
+  else if (a_data.loaded)
+    a_pDriver->UpdateImage(a_id, a_data.width, a_data.height, a_data.bpp, data + a_req.dataOffset, a_node);
+  else
+    a_pDriver->UpdateImage(a_id, a_data.width, a_data.height, a_data.bpp, nullptr, a_node);
+}
+
+void UpdateImageFromFileOrChunk(int32_t a_id, HRTextureNode& img, IHRRenderDriver* a_pDriver) // #TODO: debug and test this
+{
+  const HRImageStagingRequest req = MakeImageStagingRequest(img);
 
+  HRStagingData data;
+  data.buffer.swap(g_objManager.m_tempBuffer);
+  LoadStagingImage(req, data);
+  UpdateImageFromStaging(a_id, req, data, img.xml_node_immediate(), a_pDriver);
+  data.buffer.swap(g_objManager.m_tempBuffer);
+
+  if (g_objManager.m_tempBuffer.size() > TEMP_BUFFER_MAX_SIZE_DONT_FREE)
+    g_objManager.m_tempBuffer = g_objManager.EmptyBuffer();
+}
+
+static bool TextureWillBeLoadedFromFileOrChunk(HRTextureNode& texNode, const HRDriverInfo& info) ///< same decision as in HR_DriverUpdateTextures, but without touching chunk data 
+{
+  if (texNode.pImpl != nullptr && ChunkIsResident(texNode.pImpl->chunkId()))
+    return false;
+
+  pugi::xml_node texNodeXML = texNode.xml_node_immediate();
+  bool delayedLoad = (texNodeXML.attribute(L"dl").as_int() == 1);
+  bool isProc      = (texNodeXML.attribute(L"loc").as_string() == std::wstring(L"") && !delayedLoad);
+
+  if (info.supportImageLoadFromExternalFormat && texNode.m_loadedFromFile)
+    return false;
+  else if (info.supportImageLoadFromInternalFormat && !delayedLoad)
+    return false;
+  
+  return !isProc;
 }
 
 /////
@@ -477,12 +701,28 @@ int32_t HR_DriverUpdateTextures(HRSceneInst& scn, ChangeList& objList, IHRRender
   texturesUsed.assign(objList.texturesUsed.begin(), objList.texturesUsed.end());
   std::sort(texturesUsed.begin(), texturesUsed.end());
 
-  for (auto texId : texturesUsed)
+  // in pipelined mode images that will be read from files are loaded by workers ahead of driver
+  //
+  HRStagingPipeline<HRImageStagingRequest> pipeline(g_objManager.m_updateWorkers, &LoadStagingImage);
+  if (g_objManager.m_updateWorkers > 0)
   {
+    for (size_t i = 0; i < texturesUsed.size(); i++)
+    {
+      const int32_t texId = texturesUsed[i];
+      if (texId >= 0 && texId < int32_t(g_objManager.scnData.textures.size()) && TextureWillBeLoadedFromFileOrChunk(g_objManager.scnData.textures[texId], info))
+        pipeline.Push(i, MakeImageStagingRequest(g_objManager.scnData.textures[texId]));
+    }
+    pipeline.Start();
+  }
+
+  for (size_t i = 0; i < texturesUsed.size(); i++)
+  {
+    const int32_t texId = texturesUsed[i];
     if (texId < 0)
       continue;
 
     HRTextureNode& texNode = g_objManager.scnData.textures[texId];
+    ChunkPinScope  pin(g_objManager.scnData.m_vbCache); // dataPtr must stay valid until driver took the image
 
     int32_t w     = 0;
     int32_t h     = 0;
@@ -527,7 +767,17 @@ int32_t HR_DriverUpdateTextures(HRSceneInst& scn, ChangeList& objList, IHRRender
         a_pDriver->UpdateImage(texId, -1, -1, 4, nullptr, texNodeXML);
       }
       else
-        UpdateImageFromFileOrChunk(texId, texNode, a_pDriver);
+      {
+        HRImageStagingRequest req;
+        HRStagingData         staged;
+        if (pipeline.Acquire(i, req, staged))
+        {
+          UpdateImageFromStaging(texId, req, staged, texNodeXML, a_pDriver);
+          pipeline.Release(staged);
+        }
+        else
+          UpdateImageFromFileOrChunk(texId, texNode, a_pDriver);
+      }
     }
     else
     {
@@ -692,21 +942,45 @@ HRMeshDriverInput HR_GetMeshDataPointers(size_t a_meshId)
   return input;
 }
 
-void UpdateMeshFromChunk(int32_t a_id, HRMesh& mesh, const std::vector<HRBatchInfo>& a_batches, IHRRenderDriver* a_pDriver, const wchar_t* path, int64_t a_byteSize)
+struct HRMeshStagingRequest
 {
-  pugi::xml_node nodeXML    = mesh.xml_node_immediate();
-  //uint64_t       dataOffset = nodeXML.attribute(L"offset").as_ullong();
-
-#if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
-  std::wstring s1(path);
-  std::string  s2(s1.begin(), s1.end());
-  std::ifstream fin(s2.c_str(), std::ios::binary);
-#elif defined WIN32
-  std::ifstream fin(path, std::ios::binary);
-#endif 
-  g_objManager.m_tempBuffer.resize(a_byteSize / sizeof(int) + sizeof(int) * 16);
-  char* dataPtr = (char*)g_objManager.m_tempBuffer.data();
-  fin.read(dataPtr, a_byteSize);
+  std::wstring path;
+  int64_t      byteSize;
+};
+
+static void LoadStagingMesh(const HRMeshStagingRequest& a_req, HRStagingData& a_data) ///< thread safe
+{
+  // map file and give driver pointers directly to it; VSGF is little endian as is in memory, so nothing to convert 
+  //
+  if (HostIsLittleEndian() && a_data.mapped.open(a_req.path))
+  {
+    const uint64_t rawSize = CompressedChunkRawSize(a_data.mapped.data(), a_data.mapped.size());
+    if (rawSize == 0 && int64_t(a_data.mapped.size()) >= a_req.byteSize)
+    {
+      a_data.loaded = true;
+      return;
+    }
+    
+    if (rawSize != 0 && int64_t(rawSize) >= a_req.byteSize) // compressed chunk, decode directly from mapped file
+    {
+      a_data.buffer.resize(rawSize / sizeof(int) + sizeof(int) * 16);
+      a_data.loaded = DecompressChunkData(a_data.mapped.data(), a_data.mapped.size(), (char*)a_data.buffer.data(), rawSize);
+      a_data.mapped.close();
+      return;
+    }
+    a_data.mapped.close();
+  }
+
+  HydraChunkStream fin(a_req.path);
+  a_data.buffer.resize(a_req.byteSize / sizeof(int) + sizeof(int) * 16);
+  fin.read((char*)a_data.buffer.data(), a_req.byteSize);
+  a_data.loaded = fin.is_open();
+}
+
+static void UpdateMeshFromStaging(int32_t a_id, HRMesh& mesh, const std::vector<HRBatchInfo>& a_batches, IHRRenderDriver* a_pDriver, const HRStagingData& a_data)
+{
+  pugi::xml_node nodeXML = mesh.xml_node_immediate();
+  const char* dataPtr    = a_data.mapped.isOpen() ? a_data.mapped.data() : (const char*)a_data.buffer.data();
 
   HRMeshDriverInput input;
 
@@ -720,19 +994,43 @@ void UpdateMeshFromChunk(int32_t a_id, HRMesh& mesh, const std::vector<HRBatchIn
   input.vertNum       = nodeXML.attribute(L"vertNum").as_int();
   input.triNum        = nodeXML.attribute(L"triNum").as_int();
 
-  input.pos4f         = (float*)(dataPtr + offsetPos);
-  input.norm4f        = (float*)(dataPtr + offsetNorm);
-  input.tan4f         = (float*)(dataPtr + offsetTang);
-  input.texcoord2f    = (float*)(dataPtr + offsetTexc);
-  input.indices       = (int*)  (dataPtr + offsetInd);
-  input.triMatIndices = (int*)  (dataPtr + offsetMInd);
+  input.pos4f         = (const float*)(dataPtr + offsetPos);
+  input.norm4f        = (const float*)(dataPtr + offsetNorm);
+  input.tan4f         = (const float*)(dataPtr + offsetTang);
+  input.texcoord2f    = (const float*)(dataPtr + offsetTexc);
+  input.indices       = (const int*)  (dataPtr + offsetInd);
+  input.triMatIndices = (const int*)  (dataPtr + offsetMInd);
   input.allData       = dataPtr;
 
   a_pDriver->UpdateMesh(a_id, nodeXML, input, &a_batches[0], int32_t(a_batches.size()));
+}
+
+void UpdateMeshFromChunk(int32_t a_id, HRMesh& mesh, const std::vector<HRBatchInfo>& a_batches, IHRRenderDriver* a_pDriver, const wchar_t* path, int64_t a_byteSize)
+{
+  HRMeshStagingRequest req;
+  req.path     = path;
+  req.byteSize = a_byteSize;
+
+  HRStagingData data;
+  data.buffer.swap(g_objManager.m_tempBuffer);
+  LoadStagingMesh(req, data);
+  UpdateMeshFromStaging(a_id, mesh, a_batches, a_pDriver, data);
+  data.buffer.swap(g_objManager.m_tempBuffer);
+}
 
-  fin.close();
+static bool MeshWillBeLoadedFromChunk(HRMesh& mesh, const HRDriverInfo& info) ///< same decision as in HR_DriverUpdateMeshes, but without touching chunk data
+{
+  if (mesh.pImpl == nullptr || info.supportMeshLoadFromInternalFormat)
+    return false;
+  const uint64_t chunkId = mesh.pImpl->chunkId();
+  return chunkId != uint64_t(-1) && !ChunkIsResident(chunkId);
 }
 
+static std::wstring MeshPath(pugi::xml_node a_meshNode)
+{
+  const std::wstring delayedLoad = a_meshNode.attribute(L"dl").as_string();
+  return (delayedLoad == L"1") ? std::wstring(a_meshNode.attribute(L"path").as_string()) : g_objManager.GetLoc(a_meshNode);
+}
 
 /////
 //
@@ -751,15 +1049,38 @@ int32_t HR_DriverUpdateMeshes(HRSceneInst& scn, ChangeList& objList, IHRRenderDr
 
   int32_t updatedMeshes = 0;
 
-  for (auto id : objList.meshUsed)
+  // keep the order of serial mode; in pipelined mode chunk files are read by workers ahead of driver
+  //
+  std::vector<int32_t> meshUsed(objList.meshUsed.begin(), objList.meshUsed.end());
+
+  HRStagingPipeline<HRMeshStagingRequest> pipeline(g_objManager.m_updateWorkers, &LoadStagingMesh);
+  if (g_objManager.m_updateWorkers > 0)
+  {
+    for (size_t i = 0; i < meshUsed.size(); i++)
+    {
+      HRMesh& mesh = g_objManager.scnData.meshes[meshUsed[i]];
+      if (!MeshWillBeLoadedFromChunk(mesh, info))
+        continue;
+
+      pugi::xml_node meshNode = mesh.xml_node_immediate();
+      HRMeshStagingRequest req;
+      req.path     = MeshPath(meshNode);
+      req.byteSize = meshNode.attribute(L"bytesize").as_llong();
+      pipeline.Push(i, req);
+    }
+    pipeline.Start();
+  }
+
+  for (size_t i = 0; i < meshUsed.size(); i++)
   {
+    const int32_t id        = meshUsed[i];
+    ChunkPinScope pin(g_objManager.scnData.m_vbCache); // pointers of 'input' must stay valid until driver took the mesh
     HRMesh& mesh            = g_objManager.scnData.meshes[id];
     HRMeshDriverInput input = HR_GetMeshDataPointers(id);
     pugi::xml_node meshNode = mesh.xml_node_immediate();
 
-    const std::wstring delayedLoad = meshNode.attribute(L"dl").as_string();
-    const std::wstring locStr      = g_objManager.GetLoc(meshNode);
-    const wchar_t* path            = (delayedLoad == L"1") ? meshNode.attribute(L"path").as_string() : locStr.c_str();
+    const std::wstring pathStr = MeshPath(meshNode);
+    const wchar_t* path        = pathStr.c_str();
 
     if (mesh.pImpl != nullptr)
     {
@@ -776,9 +1097,18 @@ int32_t HR_DriverUpdateMeshes(HRSceneInst& scn, ChangeList& objList, IHRRenderDr
         {
           scn.meshUsedByDrv.insert(id);
 
-          int64_t byteSize = meshNode.attribute(L"bytesize").as_llong();
-
-          UpdateMeshFromChunk(int32_t(id), mesh, mlist, a_pDriver, path, byteSize);
+          HRMeshStagingRequest req;
+          HRStagingData        staged;
+          if (pipeline.Acquire(i, req, staged))
+          {
+            UpdateMeshFromStaging(int32_t(id), mesh, mlist, a_pDriver, staged);
+            pipeline.Release(staged);
+          }
+          else
+          {
+            int64_t byteSize = meshNode.attribute(L"bytesize").as_llong();
+            UpdateMeshFromChunk(int32_t(id), mesh, mlist, a_pDriver, path, byteSize);
+          }
         }
       }
       else
@@ -809,6 +1139,7 @@ int32_t _hr_UtilityDriverUpdateMeshes(HRSceneInst& scn, IHRRenderDriver* a_pDriv
 
   for(auto p : scn.meshUsedByDrv)
   {
+    ChunkPinScope pin(g_objManager.scnData.m_vbCache);
     HRMesh& mesh            = g_objManager.scnData.meshes[p];
     HRMeshDriverInput input = HR_GetMeshDataPointers(p);
     pugi::xml_node meshNode = mesh.xml_node_immediate();
@@ -1119,6 +1450,8 @@ void HR_DriverUpdate(HRSceneInst& scn, IHRRenderDriver* a_pDriver)
   if (a_pDriver == nullptr)
     return;
 
+  g_objManager.scnData.m_vbCache.WaitForWrites(); // driver and update workers read chunk files directly
+
   ChangeList objList = FindChangedObjects(scn, a_pDriver);
 
   auto p = g_objManager.driverAllocated.find(a_pDriver);
@@ -1230,7 +1563,7 @@ void HR_DriverUpdate(HRSceneInst& scn, IHRRenderDriver* a_pDriver)
     //
     a_pDriver->BeginScene(scn.xml_node_immediate());
 
-    for (auto p1 = objList.drawSeq.begin(); p1 != objList.drawSeq.end(); p1++)
+    for (auto p1 = scn.m_drawSeq.begin(); p1 != scn.m_drawSeq.end(); p1++)
     {
       const auto& seq = p1->second;
       a_pDriver->InstanceMeshes(p1->first, &seq.matrices[0], int32_t(seq.matrices.size() / 16), &seq.linstid[0], &seq.remapid[0], &seq.instIdReal[0]);
@@ -1301,25 +1634,13 @@ void _hr_UtilityDriverUpdate(HRSceneInst& scn, IHRRenderDriver* a_pDriver)
 
   ///////////////////////////////
 
-  std::unordered_map<int32_t, ChangeList::InstancesInfo > drawSeq;
-
-
-  for (size_t i = 0; i < scn.drawList.size(); i++)
-  {
-    auto instance = scn.drawList[i];
-    if (instance.meshId >= g_objManager.scnData.meshes.size())
-      continue;
-
-    // form draw sequence for each mesh
-    //
-    AddInstanceToDrawSequence(instance, drawSeq, int(i));
-  }
+  UpdateDrawSequence(scn);
 
   ////////////////////////
   a_pDriver->BeginScene(scn.xml_node_immediate());
   {
     // draw/add instances to scene
-    for (auto p = drawSeq.begin(); p != drawSeq.end(); p++)
+    for (auto p = scn.m_drawSeq.begin(); p != scn.m_drawSeq.end(); p++)
     {
       const auto& seq = p->second;
       a_pDriver->InstanceMeshes(p->first, &seq.matrices[0], int32_t(seq.matrices.size() / 16), &seq.linstid[0], &seq.remapid[0], &seq.instIdReal[0]);
@@ -1505,7 +1826,7 @@ resolution_dict InsertMipLevelInfoIntoXML(pugi::xml_document &stateToProcess, co
 std::wstring SaveFixedStateXML(pugi::xml_document &doc, const std::wstring &oldPath, const std::wstring &suffix)
 {
   std::wstringstream ss;
-  ss << std::wstring(oldPath.begin(), oldPath.end() - 4) << suffix << L".xml"; //cut ".xml" from initial path and append new suffix
+  ss << oldPath.substr(0, oldPath.find_last_of(L'.')) << suffix << L".xml"; //cut ".xml" (or ".bxml") from initial path and append new suffix
   std::wstring new_state_path = ss.str();
   doc.save_file(new_state_path.c_str(), L"  ");
   return new_state_path;
@@ -1529,35 +1850,50 @@ std::wstring HR_UtilityDriverStart(const wchar_t* state_path)
 
   pugi::xml_document stateToProcess;
 
-  auto loadResult = stateToProcess.load_file(state_path);
-
-  if (!loadResult)
+  if (HydraXMLHelpers::IsBinaryDocumentPath(state_path)) // hrFlush with '-binary_state 1'
   {
-    HrError(L"HR_UtilityDriverStart, pugixml load: ", loadResult.description());
-    return new_state_path;
+    if (!HydraXMLHelpers::LoadBinaryDocument(stateToProcess, state_path))
+      return new_state_path;
+  }
+  else
+  {
+    auto loadResult = stateToProcess.load_file(state_path);
+
+    if (!loadResult)
+    {
+      HrError(L"HR_UtilityDriverStart, pugixml load: ", loadResult.description());
+      return new_state_path;
+    }
   }
 
   stateToProcess.child(L"textures_lib").force_attribute(L"resize_textures") = 1;
 
-#ifdef WIN32
-  bool windowCreated = HydraCreateHiddenWindow(1024, 1024, 3, 3, 0);
-  if (!windowCreated)
-  {
-    HrError(L"HydraCreateHiddenWindow FAILED!");
-    return new_state_path;
-  }
+  // use OpenGL LOD buffer if we can; headless nodes (or '-cpu_prepass 1') estimate mip levels on CPU
+  //
+  bool haveGLContext = false;
 
-  gladLoadGLLoader((GLADloadproc)GetProcAddress);
-  if (!gladLoadGL())
+  if (!g_objManager.m_cpuPrepass)
   {
-    HrError(L"gladLoadGL FAILED!");
-    return new_state_path;
-  }
+#ifdef WIN32
+    haveGLContext = HydraCreateHiddenWindow(1024, 1024, 3, 3, 0);
+    if (haveGLContext)
+    {
+      gladLoadGLLoader((GLADloadproc)GetProcAddress);
+      if (!gladLoadGL())
+      {
+        HydraDestroyHiddenWindow();
+        haveGLContext = false;
+      }
+    }
 #else
-  auto offscreen_context = InitGLForUtilityDriver();               //#TODO: refactor this
+    auto offscreen_context = InitGLForUtilityDriver();               //#TODO: refactor this
+    haveGLContext = (offscreen_context != nullptr);
 #endif
+    if (!haveGLContext)
+      HrPrint(HR_SEVERITY_WARNING, L"HR_UtilityDriverStart: can't create OpenGL context, mip levels will be estimated on CPU");
+  }
 
-  std::unique_ptr<IHRRenderDriver> utilityDriver = CreateRenderFromString(L"opengl3Utility", L"");
+  std::unique_ptr<IHRRenderDriver> utilityDriver = CreateRenderFromString(haveGLContext ? L"opengl3Utility" : L"cpuUtility", L"");
 
   if (utilityDriver != nullptr && g_objManager.m_currSceneId < g_objManager.scnInst.size())
   {
@@ -1565,29 +1901,19 @@ std::wstring HR_UtilityDriverStart(const wchar_t* state_path)
 
     _hr_UtilityDriverUpdate(g_objManager.scnInst[g_objManager.m_currSceneId], utilityDriver.get());
 
-    auto mipLevelsDict = getMipLevelsFromUtilityDriver(utilityDriver.get());
-//
-//#ifdef IN_DEBUG
-//    auto pImgTool = g_objManager.m_pImgTool;
-//    auto& imgData = g_objManager.m_tempBuffer;
-//    if (imgData.size() < 1024*1024)
-//      imgData.resize(1024*1024);
-//
-//    utilityDriver->GetFrameBufferLDR(1024, 1024, imgData.data());
-//    pImgTool->SaveLDRImageToFileLDR(L"tests_images/z_out.png", 1024, 1024, imgData.data());
-//
-//    if (imgData.size() > TEMP_BUFFER_MAX_SIZE_DONT_FREE) // free temp buffer if it's too large
-//      imgData = g_objManager.EmptyBuffer();
-//#endif
+    auto mipLevelsDict = haveGLContext ? getMipLevelsFromUtilityDriver(utilityDriver.get()) : getMipLevelsFromCPUUtilityDriver(utilityDriver.get());
 
 //    for (auto elem : mipLevelsDict)
 //      std::cout << " " << elem.first << ":" << elem.second << std::endl;
 
+    if (haveGLContext)
+    {
 #ifdef WIN32
-    HydraDestroyHiddenWindow();
+      HydraDestroyHiddenWindow();
 #else
-    glfwSetWindowShouldClose(offscreen_context, GL_TRUE);         //#TODO: refactor this
+      glfwSetWindowShouldClose(glfwGetCurrentContext(), GL_TRUE);    //#TODO: refactor this
 #endif
+    }
 
     int winWidthRender  = 1024;
     int winHeightRender = 1024;
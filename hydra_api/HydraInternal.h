@@ -15,6 +15,8 @@
 #include <unordered_map>
 #include <iostream>
 #include <memory>
+#include <atomic>
+#include <thread>
 
 #if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
 #include <experimental/filesystem>
@@ -211,15 +213,40 @@ enum CHUNK_TYPE { CHUNK_TYPE_UNKNOWN  = 0,
 
 struct VirtualBuffer;
 
+#define CHUNK_MAX_USE_COUNTER 3
+
+/**
+\brief CLOCK reference counter of chunk. GetMemoryNow may be called from worker threads (parallel mesh loading, displacement), 
+       so counter is incremented with relaxed atomic; it is only a hint for collector, which reads it from API thread.
+*/
+struct ChunkUseCounter
+{
+  ChunkUseCounter(uint32_t a_val = 0) : m_val(a_val) {}
+  ChunkUseCounter(const ChunkUseCounter& a_other) : m_val(uint32_t(a_other)) {}
+
+  ChunkUseCounter& operator=(const ChunkUseCounter& a_other) { m_val.store(uint32_t(a_other), std::memory_order_relaxed); return *this; }
+  ChunkUseCounter& operator=(uint32_t a_val)                 { m_val.store(a_val, std::memory_order_relaxed); return *this; }
+  operator uint32_t() const                                  { return m_val.load(std::memory_order_relaxed); }
+
+  void touch() ///< increment up to CHUNK_MAX_USE_COUNTER
+  {
+    uint32_t val = m_val.load(std::memory_order_relaxed);
+    while (val < CHUNK_MAX_USE_COUNTER && !m_val.compare_exchange_weak(val, val + 1, std::memory_order_relaxed)) { }
+  }
+
+protected:
+  std::atomic<uint32_t> m_val;
+};
+
 /**
 \brief This is like a smarp pointer, well, may be not so smart ... just a pointer to chunk )
 */
 struct ChunkPointer
 {
-  ChunkPointer()                              : localAddress(-1), sizeInBytes(0), id(0), inUse(true), wasSaved(false), pVB(nullptr), useCounter(0), type(CHUNK_TYPE_UNKNOWN) {}
-  explicit ChunkPointer(VirtualBuffer* a_pVB) : localAddress(-1), sizeInBytes(0), id(0), inUse(true), wasSaved(false), pVB(a_pVB), useCounter(0), type(CHUNK_TYPE_UNKNOWN) {}
+  ChunkPointer()                              : localAddress(-1), sizeInBytes(0), id(0), useCounter(0), type(CHUNK_TYPE_UNKNOWN), inUse(true), wasSaved(false), pagedIn(false), pinned(false), pVB(nullptr) {}
+  explicit ChunkPointer(VirtualBuffer* a_pVB) : localAddress(-1), sizeInBytes(0), id(0), useCounter(0), type(CHUNK_TYPE_UNKNOWN), inUse(true), wasSaved(false), pagedIn(false), pinned(false), pVB(a_pVB) {}
 
-  void* GetMemoryNow();
+  void* GetMemoryNow();             ///< if demand paging is enabled, swapped out chunk will be loaded back to cache here; see ChunkPinScope for how long the pointer is valid
   const void* GetMemoryNow() const;
   
   //void SwapToMemory();
@@ -229,11 +256,13 @@ struct ChunkPointer
   uint64_t localAddress; ///< an offset in shmem to this chunk
   uint64_t sizeInBytes;
   uint64_t id;
-  uint32_t useCounter;
+  ChunkUseCounter useCounter; ///< CLOCK reference counter: incremented on access (up to CHUNK_MAX_USE_COUNTER), decremented when collector passes by
   
   CHUNK_TYPE type;
   bool       inUse;
   bool       wasSaved;
+  bool       pagedIn;  ///< chunk was loaded back from disk by demand paging, so it is counted in residency budget
+  bool       pinned;   ///< GetMemoryNow was called inside ChunkPinScope; collector does not move or evict chunk until the scope ends
 
 protected:
 
@@ -247,17 +276,28 @@ protected:
 #endif
 
 struct HRSystemMutex;
+struct ChunkWriteBehind;
 #define VB_LOCK_WAIT_TIME_MS 60000
 
 /**
 \brief Infinite linear memory space that stored on disk and cached in shmem with some strategy (copying collector currently ... ).
        The VirtualBuffer is an allocator or a pool. It is infinite and addressed with uint64_t;
 
+       Collector policy (CLOCK, see RunCollector): 
+       
+       1) when there is no room for new chunk, cold chunks are evicted until the requested size plus 1/64 of cache is free 
+          (instead of freeing 7/8 of cache at once as it was before);
+       2) with demand paging, paged in chunks are evicted until they fit residency budget; other chunks are not touched for that;
+       3) survivors are slid down to the bottom of cache, so a pointer from GetMemoryNow is valid only until the next allocation 
+          in cache or demand paging fault. Chunks accessed inside ChunkPinScope are pinned: they are never moved or evicted, 
+          so several pointers may be held at once. If pinned chunks leave no room for new one, allocation fails.
+
 */
 struct VirtualBuffer
 {
   VirtualBuffer() : m_data(nullptr), m_chunkTable(nullptr), m_dataHalfCurr(nullptr), m_dataHalfFree(nullptr),
-                    m_currTop(0), m_currSize(0), m_totalSize(0), m_totalSizeAllocated(0), m_pTempBuffer(nullptr), m_owner(false), m_pVBMutex(nullptr)
+                    m_currTop(0), m_currSize(0), m_totalSize(0), m_totalSizeAllocated(0), m_pTempBuffer(nullptr), m_owner(false), m_pVBMutex(nullptr),
+                    m_demandPaging(false), m_residentBudget(0), m_pagedInBytes(0), m_dedup(false), m_clockHand(0), m_pWriter(nullptr), m_compress(false), m_pinScopes(0)
   {
   #ifdef WIN32
     m_fileHandle = 0;
@@ -278,6 +318,24 @@ struct VirtualBuffer
   size_t AllocChunk(uint64_t a_dataSizeInBytes, uint64_t a_objId); ///< 
 
   void   ResizeAndAllocEmptyChunks(uint64_t a_ckunksNum);
+  void   RegisterChunkOnDisk(size_t a_id, uint64_t a_sizeInBytes, CHUNK_TYPE a_type); ///< for chunks of existing scene library that are stored in 'data' folder
+
+  void   SetDemandPaging(bool a_enable, uint64_t a_residentBudget); ///< a_residentBudget is max bytes of paged in chunks that stay in cache; 0 means half of the cache
+  bool   DemandPagingEnabled() const { return m_demandPaging; }
+  void*  SwapToMemory(size_t a_id);                                 ///< load chunk from disk to cache; return nullptr if can't
+
+  uint64_t PagedInBytes() const { return m_pagedInBytes; }          ///< bytes of paged in chunks that are in cache now; SwapToMemory keeps it within residency budget
+
+  size_t BeginPinScope() { m_pinScopes++; return m_pinnedChunks.size(); } ///< use ChunkPinScope instead of calling this directly
+  void   EndPinScope(size_t a_mark);                                        ///< unpins chunks that were pinned after BeginPinScope returned a_mark
+
+  void   SetWriteBehind(uint64_t a_maxQueuedBytes); ///< evicted chunks are written to disk by background thread; a_maxQueuedBytes bounds data waiting in queue; 0 means synchronous writes
+  void   WaitForWrites();                           ///< barrier: returns when all chunks passed to SwapToDisk are actually on disk
+
+  void   SetCompression(bool a_enable) { m_compress = a_enable; } ///< mesh and image chunks are written to disk in compressed form (see HydraChunkCompression.h)
+
+  void   SetDeduplication(bool a_enable) { m_dedup = a_enable; }
+  size_t DeduplicateChunk(size_t a_id); ///< if just filled chunk a_id has same content as some previous one, free a_id and return id of previous chunk
 
   // 
   //
@@ -299,7 +357,10 @@ protected:
   char* AllocInCacheNow(uint64_t a_sizeInBytes);
   void* AllocInCache(uint64_t a_sizeInBytes); ///< Always alloc aligned 16 byte memory;
   void  RunCopyingCollector();
-  void  RunCollector(int a_divisor);
+  void  RunCollector(uint64_t a_bytesToFree, uint64_t a_pagedInBytesToEvict); ///< evict cold chunks (CLOCK) until at least a_bytesToFree are free at the top of cache and at least a_pagedInBytesToEvict of paged in chunks are evicted
+  void  RunCollectorLocked(uint64_t a_bytesToFree, uint64_t a_pagedInBytesToEvict = 0);
+  void  TouchChunk(size_t a_id) { if (a_id < m_allChunks.size()) m_allChunks[a_id].useCounter.touch(); }
+  void  PinChunk(size_t a_id);   ///< does nothing outside of ChunkPinScope
 
   inline uint64_t maxAccumulatedSize() const { return m_currSize / 2; }
 
@@ -327,6 +388,39 @@ protected:
   
   bool m_owner;
   HRSystemMutex* m_pVBMutex;
+
+  bool     m_demandPaging;
+  uint64_t m_residentBudget;
+  uint64_t m_pagedInBytes; ///< sum of sizes of chunks in cache that have 'pagedIn' flag
+
+  bool                                       m_dedup;
+  std::unordered_multimap<uint64_t, size_t>  m_chunkByContent; ///< xxhash64 of (type, size, data) --> chunk id
+
+  size_t   m_clockHand;  ///< position of CLOCK hand in m_chunksIdInMemory (which is always sorted by address)
+
+  ChunkWriteBehind* m_pWriter; ///< background chunk writer; nullptr if chunks are written synchronously
+  bool              m_compress;
+
+  int                 m_pinScopes;    ///< depth of nested ChunkPinScope
+  std::vector<size_t> m_pinnedChunks; ///< ids of chunks with 'pinned' flag
+};
+
+/**
+\brief Pointers returned by GetMemoryNow inside this scope stay valid until the scope ends, even if other chunks are swapped in meanwhile.
+       Scopes may be nested; chunks that were already pinned by outer scope stay pinned until outer scope ends.
+       Open it only from API thread; chunks are pinned by GetMemoryNow, which workers must not call while scope is alive.
+*/
+struct ChunkPinScope
+{
+  explicit ChunkPinScope(VirtualBuffer& a_vb) : m_vb(a_vb), m_mark(a_vb.BeginPinScope()) { }
+  ~ChunkPinScope() { m_vb.EndPinScope(m_mark); }
+
+  ChunkPinScope(const ChunkPinScope&)            = delete;
+  ChunkPinScope& operator=(const ChunkPinScope&) = delete;
+
+protected:
+  VirtualBuffer& m_vb;
+  size_t         m_mark;
 };
 
 std::wstring ChunkName(const ChunkPointer& a_chunk);
@@ -362,7 +456,7 @@ void HR_DriverDraw(HRSceneInst& scn, IHRRenderDriver* a_pDriver);
 std::wstring HR_UtilityDriverStart(const wchar_t* state_path);
 std::wstring SaveFixedStateXML(pugi::xml_document &doc, const std::wstring &oldPath, const std::wstring &suffix);
 
-HRMeshDriverInput HR_GetMeshDataPointers(size_t a_meshId);
+HRMeshDriverInput HR_GetMeshDataPointers(size_t a_meshId); ///< pointers are valid until next allocation in virtual buffer cache; call it inside ChunkPinScope to hold them longer
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -390,7 +484,13 @@ struct HRSharedBufferHeader
   float avgImageB;
   float sppDL;
   int   dummy2;
-  int   dummy1;
+  int   frameSeq;  // seqlock word: render process makes it odd before it writes image and even after; stays 0 if render process does not support it
+};
+
+enum HR_SHARED_READ_STATUS { HR_SHARED_READ_EMPTY      = 0,  ///< image is still empty (no passes or zero spp); output is not touched
+                             HR_SHARED_READ_OK         = 1,  ///< consistent copy of single frame
+                             HR_SHARED_READ_TORN       = 2,  ///< render process passed new frame during every attempt; output holds the last copy, which may mix two frames
+                             HR_SHARED_READ_UNVERIFIED = 3,  ///< render process does not write frameSeq; counterRcv and spp did not change during copy, but it still may mix two frames
 };
 
 struct IHRSharedAccumImage
@@ -411,8 +511,25 @@ struct IHRSharedAccumImage
   virtual char*   MessageSendData()       = 0;
   virtual char*   MessageRcvData()        = 0;
   virtual float*  ImageData(int layerNum) = 0; /// guarantee that returned pointer is aligned16 !!!
+
+  /**
+  \brief copy whole image layer multiplied by 1/spp to a_out without blocking render process.
+  \param a_layerId     - image layer
+  \param a_out         - output of width*height*4 floats
+  \param a_pSpp        - spp of copied frame (may be nullptr)
+  \param a_maxAttempts - how many times copy is repeated if render process passed new frame during copy
+
+   The copy is accepted if frameSeq was even and frameSeq, counterRcv and spp did not change while we copied the image.
+   frameSeq is written by external render process; if it does not support it, frameSeq stays 0, only counterRcv and spp can be checked 
+   and accepted copy is returned as HR_SHARED_READ_UNVERIFIED.
+
+  \return HR_SHARED_READ_OK for consistent copy; see HR_SHARED_READ_STATUS for other cases
+  */
+  HR_SHARED_READ_STATUS ReadLayerNormalized(int a_layerId, float* a_out, float* a_pSpp = nullptr, int a_maxAttempts = 4);
 };
 
+template<typename T> static inline T hr_read_shared(const T& a_val) { return *((const volatile T*)&a_val); }
+
 IHRSharedAccumImage* CreateImageAccum();
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
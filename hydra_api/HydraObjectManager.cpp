@@ -1,5 +1,10 @@
 #include "HydraObjectManager.h"
 
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
 HRObjectManager g_objManager;
 
 std::wstring      g_lastErrorCallerPlace = L"";
@@ -8,8 +13,30 @@ HR_ERROR_CALLBACK g_pErrorCallback = nullptr;
 HR_INFO_CALLBACK  g_pInfoCallback  = nullptr;
 
 
+static thread_local HRMessageSink* g_pThreadSink = nullptr; ///< see HRMessageSink
+
+void HrSetThreadMessageSink(HRMessageSink* a_pSink) { g_pThreadSink = a_pSink; }
+
+void HrFlushMessages(HRMessageSink& a_sink)
+{
+  for (const auto& msg : a_sink.messages)
+  {
+    if (msg.lastError)
+      HrError(msg.text);
+    else
+      _HrPrint(msg.level, msg.text.c_str());
+  }
+  a_sink.messages.clear();
+}
+
 void HrError(std::wstring a_str) 
 { 
+  if (g_pThreadSink != nullptr)
+  {
+    g_pThreadSink->messages.push_back({HR_SEVERITY_ERROR, a_str, true});
+    return;
+  }
+
   if (g_pInfoCallback != nullptr)
     g_pInfoCallback(a_str.c_str(), g_lastErrorCallerPlace.c_str(), HR_SEVERITY_ERROR);
   else if (g_pErrorCallback != nullptr)
@@ -20,6 +47,12 @@ void HrError(std::wstring a_str)
 
 void _HrPrint(HR_SEVERITY_LEVEL a_level, const wchar_t* a_str)
 {
+  if (g_pThreadSink != nullptr)
+  {
+    g_pThreadSink->messages.push_back({a_level, std::wstring(a_str), false});
+    return;
+  }
+
   if (g_pInfoCallback != nullptr)
     g_pInfoCallback(a_str, g_lastErrorCallerPlace.c_str(), a_level);
   
@@ -54,6 +87,19 @@ void HRObjectManager::init(const wchar_t* a_className)
   m_sortTriIndices             = false;
   m_attachMode                    = false;
   m_computeBBoxes              = false;
+  m_demandPaging               = false;
+  m_demandPagingBudgetMB       = 0;
+  m_binaryInstances            = false;
+  m_updateWorkers              = 0;
+  m_cpuPrepass                 = false;
+  m_binaryState                = false;
+  m_dedupChunks                = false;
+  m_writeBehindMB              = 0;
+  m_compressChunks             = false;
+  m_fastNormals                = false;
+  m_weldPosEps                 = 1e-6f;
+  m_weldNormalEps              = 1e-3f;
+  m_weldUVEps                  = 1e-5f;
 
   std::wistringstream instr(a_className);
 
@@ -74,6 +120,32 @@ void HRObjectManager::init(const wchar_t* a_className)
       m_attachMode = true;
     else if (std::wstring(name) == L"-compute_bboxes" && val != 0)
       m_computeBBoxes = true;
+    else if (std::wstring(name) == L"-demand_paging" && val != 0)
+      m_demandPaging = true;
+    else if (std::wstring(name) == L"-demand_paging_budget_mb" && val > 0)
+      m_demandPagingBudgetMB = val;
+    else if (std::wstring(name) == L"-binary_instances" && val != 0)
+      m_binaryInstances = true;
+    else if (std::wstring(name) == L"-update_workers" && val > 0)
+      m_updateWorkers = val;
+    else if (std::wstring(name) == L"-cpu_prepass" && val != 0)
+      m_cpuPrepass = true;
+    else if (std::wstring(name) == L"-binary_state" && val != 0)
+      m_binaryState = true;
+    else if (std::wstring(name) == L"-dedup_chunks" && val != 0)
+      m_dedupChunks = true;
+    else if (std::wstring(name) == L"-write_behind_mb" && val > 0)
+      m_writeBehindMB = val;
+    else if (std::wstring(name) == L"-compress_chunks" && val != 0)
+      m_compressChunks = true;
+    else if (std::wstring(name) == L"-fast_normals" && val != 0)
+      m_fastNormals = true;
+    else if (std::wstring(name) == L"-weld_pos_tolerance" && val > 0)
+      m_weldPosEps = float(std::pow(10.0, -std::min(val, 9)));
+    else if (std::wstring(name) == L"-weld_normal_tolerance" && val > 0)
+      m_weldNormalEps = float(std::pow(10.0, -std::min(val, 9)));
+    else if (std::wstring(name) == L"-weld_uv_tolerance" && val > 0)
+      m_weldUVEps = float(std::pow(10.0, -std::min(val, 9)));
   }
   
   m_pFactory = new HydraFactoryCommon;
@@ -101,6 +173,7 @@ void HRObjectManager::destroy()
 
   scnData.clear(); // for all scnData --> .clear()
   scnInst.clear();
+  m_commitList.clear();
   _hrDestroyPostProcess();
 
 	scnData.m_xmlDoc.reset();
@@ -236,30 +309,49 @@ HRRender* HRObjectManager::PtrById(HRRenderRef a_ref)
 
 
 
-void HRObjectManager::CommitChanges(pugi::xml_document& a_from, pugi::xml_document& a_to)
+/**
+\brief commit objects from a_ids list in ascending id order (as the old full loop did), so new nodes are appended to library in the same order.
+*/
+template<typename ObjectType>
+static void HR_CommitObjects(std::vector<ObjectType>& a_objects, std::vector<int32_t>& a_ids)
 {
-  // copy 'a_from' to 'a_to' #TODO: optimize this brute force Update loop
-  //
-  for (size_t i = 0; i < g_objManager.scnData.lights.size(); i++)
-    g_objManager.scnData.lights[i].commit();
+  std::sort(a_ids.begin(), a_ids.end());
 
-  for (size_t i = 0; i < g_objManager.scnData.materials.size(); i++)
-    g_objManager.scnData.materials[i].commit();
+  for (const int32_t id : a_ids)
+  {
+    if (id >= 0 && id < int32_t(a_objects.size()))
+      a_objects[id].commit();
+  }
 
-	for (size_t i = 0; i < g_objManager.scnData.textures.size(); i++)
-		g_objManager.scnData.textures[i].commit();
+  a_ids.clear();
+}
 
-  for (size_t i = 0; i < g_objManager.scnData.cameras.size(); i++)
-    g_objManager.scnData.cameras[i].commit();
+template<typename ObjectType>
+static void HR_ResetNextNodes(std::vector<ObjectType>& a_objects, std::vector<int32_t>& a_ids)
+{
+  for (const int32_t id : a_ids)
+  {
+    if (id >= 0 && id < int32_t(a_objects.size()))
+      a_objects[id].update_next(pugi::xml_node());
+  }
 
-  for (size_t i = 0; i < g_objManager.scnData.meshes.size(); i++)
-    g_objManager.scnData.meshes[i].commit();
+  a_ids.clear();
+}
 
-  for (size_t i = 0; i < g_objManager.scnInst.size(); i++)
-    g_objManager.scnInst[i].commit();
+void HRObjectManager::CommitChanges(pugi::xml_document& a_from, pugi::xml_document& a_to)
+{
+  // copy 'a_from' to 'a_to'; only objects that were opened after previous commit have something to copy
+  //
+  if (!m_commitList.empty())
+    scnData.m_stateSaved = false;
 
-  for (size_t i = 0; i < g_objManager.renderSettings.size(); i++)
-    g_objManager.renderSettings[i].commit();
+  HR_CommitObjects(scnData.lights,    m_commitList.lights);
+  HR_CommitObjects(scnData.materials, m_commitList.materials);
+  HR_CommitObjects(scnData.textures,  m_commitList.textures);
+  HR_CommitObjects(scnData.cameras,   m_commitList.cameras);
+  HR_CommitObjects(scnData.meshes,    m_commitList.meshes);
+  HR_CommitObjects(scnInst,           m_commitList.scenes);
+  HR_CommitObjects(renderSettings,    m_commitList.renders);
 
   // ...
   //
@@ -271,23 +363,27 @@ void HRObjectManager::CommitChanges(pugi::xml_document& a_from, pugi::xml_docume
   scnData.m_settingsNode        = a_to.child(L"render_lib");
   scnData.m_sceneNode           = a_to.child(L"scenes");
 
-	scnData.m_texturesLibChanges  = a_from.child(L"textures_lib");
-	scnData.m_materialsLibChanges = a_from.child(L"materials_lib");
-  scnData.m_lightsLibChanges    = a_from.child(L"lights_lib");
-  scnData.m_geometryLibChanges  = a_from.child(L"geometry_lib");
-  scnData.m_cameraLibChanges    = a_from.child(L"cam_lib");
-  scnData.m_settingsNodeChanges = a_from.child(L"render_lib");
-  scnData.m_sceneNodeChanges    = a_from.child(L"scenes");
-
-
-  // clear changes
+  // clear changes; all 'next' nodes were copied back and reset by commit() above, so nothing refers to 'a_from' any more
   //
-  clear_node_childs(scnData.m_texturesLibChanges);
-  clear_node_childs(scnData.m_materialsLibChanges);
-  clear_node_childs(scnData.m_lightsLibChanges);
-  clear_node_childs(scnData.m_geometryLibChanges);
-  clear_node_childs(scnData.m_settingsNodeChanges);
-  clear_node_childs(scnData.m_sceneNodeChanges);
+  if (&a_from == &scnData.m_xmlDocChanges)
+    scnData.reset_changes();
+  else
+  {
+    scnData.m_texturesLibChanges  = a_from.child(L"textures_lib");
+    scnData.m_materialsLibChanges = a_from.child(L"materials_lib");
+    scnData.m_lightsLibChanges    = a_from.child(L"lights_lib");
+    scnData.m_geometryLibChanges  = a_from.child(L"geometry_lib");
+    scnData.m_cameraLibChanges    = a_from.child(L"cam_lib");
+    scnData.m_settingsNodeChanges = a_from.child(L"render_lib");
+    scnData.m_sceneNodeChanges    = a_from.child(L"scenes");
+
+    clear_node_childs(scnData.m_texturesLibChanges);
+    clear_node_childs(scnData.m_materialsLibChanges);
+    clear_node_childs(scnData.m_lightsLibChanges);
+    clear_node_childs(scnData.m_geometryLibChanges);
+    clear_node_childs(scnData.m_settingsNodeChanges);
+    clear_node_childs(scnData.m_sceneNodeChanges);
+  }
 }
 
 
@@ -576,6 +672,72 @@ inline pugi::xml_node copy_node_to(pugi::xml_node a_proto, pugi::xml_node libNod
   return resNode;
 }
 
+/**
+\brief (node type, id) -> node table for scene children (instance, instance_light, remap_lists, ...).
+
+There are only a few distinct child types, so the type is found by a short linear search of names.
+Ids of instances are dense, so per type nodes are stored in a plain array indexed by id; only ids that
+are negative or too large go to the hash map. No strings are formatted and no allocations are done per node.
+
+*/
+struct HRSceneChildTable
+{
+  explicit HRSceneChildTable(size_t a_denseLimit) : m_denseLimit(a_denseLimit) {}
+
+  pugi::xml_node find(pugi::xml_node a_node)
+  {
+    const int32_t type = typeIndex(a_node.name());
+    const int32_t id   = a_node.attribute(L"id").as_int();
+
+    if (id >= 0 && size_t(id) < m_denseLimit)
+    {
+      const auto& nodes = m_nodes[type];
+      return (size_t(id) < nodes.size()) ? nodes[id] : pugi::xml_node();
+    }
+
+    const auto p = m_sparse.find(sparseKey(type, id));
+    return (p == m_sparse.end()) ? pugi::xml_node() : p->second;
+  }
+
+  void insert(pugi::xml_node a_node)
+  {
+    const int32_t type = typeIndex(a_node.name());
+    const int32_t id   = a_node.attribute(L"id").as_int();
+
+    if (id >= 0 && size_t(id) < m_denseLimit)
+    {
+      auto& nodes = m_nodes[type];
+      if (size_t(id) >= nodes.size())
+        nodes.resize(size_t(id) + 1);
+      nodes[id] = a_node;
+    }
+    else
+      m_sparse[sparseKey(type, id)] = a_node;
+  }
+
+private:
+
+  int32_t typeIndex(const pugi::char_t* a_name)
+  {
+    for (size_t i = 0; i < m_names.size(); i++)
+    {
+      if (wcscmp(m_names[i], a_name) == 0)
+        return int32_t(i);
+    }
+
+    m_names.push_back(a_name);
+    m_nodes.emplace_back();
+    return int32_t(m_names.size() - 1);
+  }
+
+  static uint64_t sparseKey(int32_t a_type, int32_t a_id) { return (uint64_t(uint32_t(a_type)) << 32) | uint64_t(uint32_t(a_id)); }
+
+  size_t m_denseLimit;
+  std::vector<const pugi::char_t*>               m_names;
+  std::vector<std::vector<pugi::xml_node> >      m_nodes;
+  std::unordered_map<uint64_t, pugi::xml_node>   m_sparse;
+};
+
 pugi::xml_node HRSceneInst::append_instances_back(pugi::xml_node a_node)
 {
   const wchar_t* sceneId     = a_node.attribute(L"id").value();
@@ -584,21 +746,19 @@ pugi::xml_node HRSceneInst::append_instances_back(pugi::xml_node a_node)
   if (sceneToCopy == nullptr)
     sceneToCopy = g_objManager.scnData.m_sceneNode.append_copy(a_node);
 
-  // #TODO: optimize this with special two-list scanning algorithm
-  //
-  std::unordered_map<std::wstring, pugi::xml_node> nodeByIdAndType;
+  size_t childNum = 0;
   for (pugi::xml_node inst = sceneToCopy.first_child(); inst != nullptr; inst = inst.next_sibling())
-  {
-    std::wstringstream ss;
-    ss << inst.attribute(L"id").as_int() << inst.name();
-    nodeByIdAndType[ss.str()] = inst;
-  }
+    childNum++;
+  for (pugi::xml_node inst = a_node.first_child(); inst != nullptr; inst = inst.next_sibling())
+    childNum++;
+
+  HRSceneChildTable nodeByIdAndType(childNum*4 + 1024);
+  for (pugi::xml_node inst = sceneToCopy.first_child(); inst != nullptr; inst = inst.next_sibling())
+    nodeByIdAndType.insert(inst);
 
   for (pugi::xml_node inst = a_node.first_child(); inst != nullptr; inst = inst.next_sibling())
   {
-    std::wstringstream ss;
-    ss << inst.attribute(L"id").as_int() << inst.name();
-    pugi::xml_node& nodeCopyTo = nodeByIdAndType[ss.str()];
+    pugi::xml_node nodeCopyTo = nodeByIdAndType.find(inst);
     //lite_copy_node_to(inst, sceneToCopy, nodeCopyTo);
     copy_node_to(inst, sceneToCopy, nodeCopyTo);
   }
@@ -606,6 +766,93 @@ pugi::xml_node HRSceneInst::append_instances_back(pugi::xml_node a_node)
   return sceneToCopy; 
 }
 
+bool HR_SaveInstanceTable(const HRSceneInst::Instance* a_instances, size_t a_count, int32_t a_firstId, int32_t a_sceneId, pugi::xml_node a_tableNode,
+                          const wchar_t* a_suffix)
+{
+  std::vector<HRInstanceRecord> records(a_count);
+  for (size_t i = 0; i < a_count; i++)
+  {
+    const auto& inst = a_instances[i];
+    memcpy(records[i].m, inst.m, sizeof(inst.m));
+    records[i].meshId      = inst.meshId;
+    records[i].remapListId = inst.remapListId;
+    records[i].scene_id    = inst.scene_id;
+    records[i].scene_sid   = inst.scene_sid;
+    records[i].lightId     = inst.lightId;
+    records[i].lightInstId = inst.lightInstId;
+  }
+
+  std::wstringstream namestream;
+  namestream << L"data/instances_s" << std::setfill(L'0') << std::setw(3) << a_sceneId << L"_" << std::setw(8) << a_firstId
+             << L"_c" << std::setw(5) << g_objManager.scnData.m_commitId << a_suffix << L".bin";
+
+  const std::wstring loc  = namestream.str();
+  const std::wstring path = g_objManager.scnData.m_path + L"/" + loc;
+  const size_t bytesize   = records.size()*sizeof(HRInstanceRecord);
+
+#if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
+  std::string s2(path.begin(), path.end());
+  std::ofstream fout(s2.c_str(), std::ios::binary);
+#elif defined WIN32
+  std::ofstream fout(path.c_str(), std::ios::binary);
+#endif
+  if (!fout.is_open())
+  {
+    HrError(L"HR_SaveInstanceTable, can't create file ", path.c_str());
+    return false;
+  }
+
+  fout.write((const char*)records.data(), bytesize);
+  fout.close();
+
+  a_tableNode.force_attribute(L"id").set_value(a_firstId);
+  a_tableNode.force_attribute(L"count").set_value(uint64_t(a_count));
+  a_tableNode.force_attribute(L"bytesize").set_value(uint64_t(bytesize));
+  a_tableNode.force_attribute(L"loc").set_value(loc.c_str());
+  return true;
+}
+
+bool HR_LoadInstanceTable(const std::wstring& a_libPath, pugi::xml_node a_tableNode, std::vector<HRSceneInst::Instance>& a_drawList)
+{
+  const size_t count = size_t(a_tableNode.attribute(L"count").as_ullong());
+  if (count == 0)
+    return true;
+
+  const std::wstring path = a_libPath + L"/" + a_tableNode.attribute(L"loc").as_string();
+
+#if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
+  std::string s2(path.begin(), path.end());
+  std::ifstream fin(s2.c_str(), std::ios::binary);
+#elif defined WIN32
+  std::ifstream fin(path.c_str(), std::ios::binary);
+#endif
+
+  std::vector<HRInstanceRecord> records(count);
+  fin.read((char*)records.data(), count*sizeof(HRInstanceRecord));
+  if (!fin.is_open() || uint64_t(fin.gcount()) != count*sizeof(HRInstanceRecord))
+  {
+    HrError(L"HR_LoadInstanceTable, can't read instances from ", path.c_str());
+    return false;
+  }
+
+  const size_t oldSize = a_drawList.size();
+  a_drawList.resize(oldSize + count);
+
+  for (size_t i = 0; i < count; i++)
+  {
+    auto& inst = a_drawList[oldSize + i];
+    memcpy(inst.m, records[i].m, sizeof(inst.m));
+    inst.meshId      = records[i].meshId;
+    inst.remapListId = records[i].remapListId;
+    inst.scene_id    = records[i].scene_id;
+    inst.scene_sid   = records[i].scene_sid;
+    inst.lightId     = records[i].lightId;
+    inst.lightInstId = records[i].lightInstId;
+  }
+
+  return true;
+}
+
 
 pugi::xml_node HRRender::copy_node_back(pugi::xml_node a_proto)
 {
@@ -619,6 +866,14 @@ pugi::xml_node HRRender::copy_node_back(pugi::xml_node a_proto)
   return replace_copy(a_proto, nodeCopyTo, libNodeTo, false);
 }
 
+void HRMesh::add_to_commit_list()        { g_objManager.m_commitList.meshes.push_back(id); }
+void HRLight::add_to_commit_list()       { g_objManager.m_commitList.lights.push_back(id); }
+void HRMaterial::add_to_commit_list()    { g_objManager.m_commitList.materials.push_back(id); }
+void HRCamera::add_to_commit_list()      { g_objManager.m_commitList.cameras.push_back(id); }
+void HRTextureNode::add_to_commit_list() { g_objManager.m_commitList.textures.push_back(id); }
+void HRSceneInst::add_to_commit_list()   { g_objManager.m_commitList.scenes.push_back(id); }
+void HRRender::add_to_commit_list()      { g_objManager.m_commitList.renders.push_back(id); }
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -635,15 +890,7 @@ void HRSceneData::init(bool a_attachMode, HRSystemMutex* a_pVBSysMutexLock)
   m_settingsNode = m_xmlDoc.append_child(L"render_lib");
   m_sceneNode    = m_xmlDoc.append_child(L"scenes");
 
-  m_texturesLibChanges  = m_xmlDocChanges.append_child(L"textures_lib");
-  m_materialsLibChanges = m_xmlDocChanges.append_child(L"materials_lib");
-  m_lightsLibChanges    = m_xmlDocChanges.append_child(L"lights_lib");
-  m_cameraLibChanges    = m_xmlDocChanges.append_child(L"cam_lib");
-  m_geometryLibChanges  = m_xmlDocChanges.append_child(L"geometry_lib");
-  m_settingsNodeChanges = m_xmlDocChanges.append_child(L"render_lib");
-  m_sceneNodeChanges    = m_xmlDocChanges.append_child(L"scenes");
-
-  m_trashNode = m_xmlDocChanges.append_child(L"trash");
+  reset_changes();
   
   if(!a_attachMode)                                       // will do this init later inside HRSceneData::init_existing when open scene
     init_virtual_buffer(false, a_pVBSysMutexLock);
@@ -688,7 +935,13 @@ void HRSceneData::init_virtual_buffer(bool a_attachMode, HRSystemMutex* a_pVBSys
       m_vbCache.Init(4096, "NOSUCHSHMEM", &g_objManager.m_tempBuffer, a_pVBSysMutexLock);
   }
   else
+  {
     m_vbCache.Init(VIRTUAL_BUFFER_SIZE, "HYDRAAPISHMEM2", &g_objManager.m_tempBuffer, a_pVBSysMutexLock);
+    m_vbCache.SetDemandPaging(g_objManager.m_demandPaging, uint64_t(g_objManager.m_demandPagingBudgetMB)*uint64_t(1024*1024));
+    m_vbCache.SetDeduplication(g_objManager.m_dedupChunks);
+    m_vbCache.SetCompression(g_objManager.m_compressChunks);
+    m_vbCache.SetWriteBehind(uint64_t(g_objManager.m_writeBehindMB)*uint64_t(1024*1024));
+  }
 }
 
 void HRSceneData::clear()
@@ -715,37 +968,58 @@ void HRSceneData::clear()
   clear_node(m_settingsNodeChanges);
   clear_node(m_sceneNodeChanges);
 
-  m_commitId = 0;
+  m_commitId   = 0;
+  m_stateSaved = false;
   m_vbCache.Clear();
   m_textureCache.clear();
   m_iesCache.clear();
 
   m_materialToMeshDependency.clear();
   m_shadowCatchers.clear();
+
+  m_materialIdByName.clear();
+  m_lightIdByName.clear();
+  m_cameraIdByName.clear();
+}
+
+void HRSceneData::reset_changes()
+{
+  // change list lives only until commit, so instead of removing nodes one by one we release all document pages at once
+  //
+  m_xmlDocChanges.reset();
+
+  m_texturesLibChanges  = m_xmlDocChanges.append_child(L"textures_lib");
+  m_materialsLibChanges = m_xmlDocChanges.append_child(L"materials_lib");
+  m_lightsLibChanges    = m_xmlDocChanges.append_child(L"lights_lib");
+  m_cameraLibChanges    = m_xmlDocChanges.append_child(L"cam_lib");
+  m_geometryLibChanges  = m_xmlDocChanges.append_child(L"geometry_lib");
+  m_settingsNodeChanges = m_xmlDocChanges.append_child(L"render_lib");
+  m_sceneNodeChanges    = m_xmlDocChanges.append_child(L"scenes");
+
+  m_trashNode = m_xmlDocChanges.append_child(L"trash");
 }
 
 void HRSceneData::clear_changes()
 {
-  for(size_t i=0;i<textures.size();i++)
-    textures[i].update_next(pugi::xml_node());
+  // only objects from commit list may have 'next' node
+  //
+  auto& changed = g_objManager.m_commitList;
+
+  HR_ResetNextNodes(textures, changed.textures);
   clear_node_childs(m_texturesLibChanges);
-  
-  for(size_t i=0;i<materials.size();i++)
-    materials[i].update_next(pugi::xml_node());
+
+  HR_ResetNextNodes(materials, changed.materials);
   clear_node_childs(m_materialsLibChanges);
-  
-  for(size_t i=0;i<lights.size();i++)
-    lights[i].update_next(pugi::xml_node());
+
+  HR_ResetNextNodes(lights, changed.lights);
   clear_node_childs(m_lightsLibChanges);
-  
-  for(size_t i=0;i<cameras.size();i++)
-    cameras[i].update_next(pugi::xml_node());
+
+  HR_ResetNextNodes(cameras, changed.cameras);
   clear_node_childs(m_cameraLibChanges);
-  
-  for(size_t i=0;i<meshes.size();i++)
-    meshes[i].update_next(pugi::xml_node());
+
+  HR_ResetNextNodes(meshes, changed.meshes);
   clear_node_childs(m_geometryLibChanges);
-  
+
   //clear_node_childs(m_settingsNodeChanges);
   //clear_node_childs(m_sceneNodeChanges);
 }
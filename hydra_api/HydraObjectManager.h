@@ -51,6 +51,8 @@ struct HRObject
 
   virtual void update_next(pugi::xml_node a_newNode)
   {
+    if (m_xmlNodeNext == nullptr && a_newNode != nullptr)
+      add_to_commit_list();
     m_xmlNodeNext = a_newNode;
   }
 
@@ -77,6 +79,7 @@ struct HRObject
         m_xmlNodeNext = copy_node(m_xmlNode, true);
       else if (a_openMode == HR_OPEN_READ_ONLY)
         m_xmlNodeNext = copy_node_trash(m_xmlNode);
+      add_to_commit_list();
     }
     
     return m_xmlNodeNext;
@@ -95,6 +98,7 @@ struct HRObject
 
   virtual pugi::xml_node copy_node(pugi::xml_node a_node, bool a_lite) = 0;
   virtual pugi::xml_node copy_node_back(pugi::xml_node a_node)         = 0;
+  virtual void           add_to_commit_list() {}                          ///< called once when object gets m_xmlNodeNext; see HRObjectManager::CommitList
 
   virtual pugi::xml_node copy_node_trash(pugi::xml_node a_node) ///< copy node to temporaray trash node that will be cleared further
   {
@@ -125,6 +129,7 @@ struct HRMesh : public HRObject<IHRMesh>
 
   pugi::xml_node copy_node(pugi::xml_node a_node, bool a_lite) override;
   pugi::xml_node copy_node_back(pugi::xml_node a_node) override;
+  void           add_to_commit_list() override;
 
 //protected:
 
@@ -249,6 +254,7 @@ struct HRLight : public HRObject<IHRLight>
 
   pugi::xml_node copy_node(pugi::xml_node a_node, bool a_lite) override;
   pugi::xml_node copy_node_back(pugi::xml_node a_node) override;
+  void           add_to_commit_list() override;
 };
 
 struct HRMaterial : public HRObject<IHRMat>
@@ -259,6 +265,7 @@ struct HRMaterial : public HRObject<IHRMat>
 
   pugi::xml_node copy_node(pugi::xml_node a_node, bool a_lite) override;
   pugi::xml_node copy_node_back(pugi::xml_node a_node) override;
+  void           add_to_commit_list() override;
 };
 
 struct HRCamera : public HRObject<IHRCam>
@@ -269,6 +276,7 @@ struct HRCamera : public HRObject<IHRCam>
 
   pugi::xml_node copy_node(pugi::xml_node a_node, bool a_lite) override;
   pugi::xml_node copy_node_back(pugi::xml_node a_node) override;
+  void           add_to_commit_list() override;
 };
 
 /**
@@ -308,6 +316,7 @@ struct HRTextureNode : public HRObject<IHRTextureNode>
 
   pugi::xml_node copy_node(pugi::xml_node a_node, bool a_lite) override;
   pugi::xml_node copy_node_back(pugi::xml_node a_node) override;
+  void           add_to_commit_list() override;
 
   bool m_loadedFromFile;
 
@@ -332,7 +341,7 @@ struct HRSceneData : public HRObject<IHRSceneData>
   static const int CAMERAS_RESERVE  = 100;
   static const int MESHES_RESERVE   = 10000;
 
-  HRSceneData() : pImpl(nullptr), m_commitId(0) {}
+  HRSceneData() : pImpl(nullptr), m_commitId(0), m_stateSaved(false) {}
 
   std::shared_ptr<IHRSceneData> pImpl;
 
@@ -374,14 +383,22 @@ struct HRSceneData : public HRObject<IHRSceneData>
   std::unordered_multimap<int32_t, int32_t> m_materialToMeshDependency;
   std::unordered_set<int32_t>               m_shadowCatchers;
 
+  // name --> id indices for hrFind***ByName; if several objects have the same name, the one with smallest id is stored
+  //
+  std::unordered_map<std::wstring, int32_t> m_materialIdByName;
+  std::unordered_map<std::wstring, int32_t> m_lightIdByName;
+  std::unordered_map<std::wstring, int32_t> m_cameraIdByName;
+
   ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
   
   void init(bool a_emptyvb, HRSystemMutex* a_pVBSysMutexLock);
   void init_existing(bool a_attachMode, HRSystemMutex* a_pVBSysMutexLock);
   void clear();
   void clear_changes();
+  void reset_changes(); ///< drop the whole m_xmlDocChanges (all its pages are freed at once) and recreate empty libs; no object may have 'next' node at this point
 
   int32_t m_commitId;
+  bool    m_stateSaved; ///< m_xmlDoc was not changed after it was saved to 'statex_{m_commitId}' by hrFlush
   std::wstring m_path;
   std::wstring m_pathState;
   std::wstring m_fileState;
@@ -395,10 +412,13 @@ protected:
 
 struct HRSceneInst : public HRObject<IHRSceneInst>
 {
-  HRSceneInst() : pImpl(nullptr), drawBegin(0), drawBeginLight(0), driverDirtyFlag(true), lightGroupCounter(0), instancedScenesCounter(0) {}
+  HRSceneInst() : pImpl(nullptr), drawBegin(0), drawBeginLight(0), m_drawSeqEnd(0), m_lightSeqEnd(0), m_remapListsChanged(true),
+                  driverDirtyFlag(true), lightGroupCounter(0), instancedScenesCounter(0) {}
 
   void update(pugi::xml_node a_newNode)
   {
+    if (m_xmlNodeNext == nullptr && a_newNode != nullptr)
+      add_to_commit_list();
     m_xmlNodeNext = a_newNode;
   }
 
@@ -413,13 +433,17 @@ struct HRSceneInst : public HRObject<IHRSceneInst>
     else
       m_xmlNode = append_instances_back(m_xmlNodeNext);
 
-    m_xmlNodeNext = pugi::xml_node();
+    m_xmlNodeNext       = pugi::xml_node();
+    m_remapListsChanged = true;
   }
 
   pugi::xml_node xml_node_next(HR_OPEN_MODE a_openMode) override
   {
      if (m_xmlNodeNext == nullptr)
+     {
        m_xmlNodeNext = copy_node(m_xmlNode, true); // don't copy all scene instances ! :) 
+       add_to_commit_list();
+     }
     return m_xmlNodeNext;
   }
 
@@ -440,12 +464,25 @@ struct HRSceneInst : public HRObject<IHRSceneInst>
     lightGroupCounter = 0;
     instancedScenesCounter = 0;
     m_bbox = BBox();
+    clearChangeTracker();
+  }
+
+  void clearChangeTracker() ///< call this if drawList or drawListLights were cleared or rewritten
+  {
+    m_drawSeq.clear();
+    m_pendingInstances.clear();
+    m_lightsInScene.clear();
+    m_remapMaterials.clear();
+    m_drawSeqEnd        = 0;
+    m_lightSeqEnd       = 0;
+    m_remapListsChanged = true;
   }
 
   std::shared_ptr<IHRSceneInst> pImpl;
 
   pugi::xml_node copy_node(pugi::xml_node a_node, bool a_lite) override;
   pugi::xml_node copy_node_back(pugi::xml_node a_node) override;
+  void           add_to_commit_list() override;
   pugi::xml_node append_instances_back(pugi::xml_node a_node);
 
   struct Instance
@@ -485,6 +522,25 @@ struct HRSceneInst : public HRObject<IHRSceneInst>
   std::vector< std::vector<int32_t> >   m_remapList;
   std::unordered_map<uint64_t, int32_t> m_remapCache;
 
+  struct InstancesInfo ///< all instances of single mesh in drawList order, as render driver wants them in InstanceMeshes
+  {
+    std::vector<float>    matrices;
+    std::vector<int32_t>  linstid;
+    std::vector<int32_t>  remapid;
+    std::vector<int32_t>  instIdReal;
+  };
+
+  // change tracker; drawList and drawListLights are only appended between hrSceneOpen(HR_WRITE_DISCARD) calls,
+  // so only the tail [m_drawSeqEnd, drawList.size()) have to be processed on next update.
+  //
+  std::unordered_map<int32_t, InstancesInfo> m_drawSeq;           ///< persistent per-mesh instance index
+  std::vector<size_t>                        m_pendingInstances;  ///< drawList ids of instances which mesh was not created yet; they are added to m_drawSeq later
+  size_t                                     m_drawSeqEnd;        ///< drawList[0, m_drawSeqEnd) is already in m_drawSeq
+  size_t                                     m_lightSeqEnd;       ///< drawListLights[0, m_lightSeqEnd) is already in m_lightsInScene
+  std::unordered_set<int32_t>                m_lightsInScene;
+  std::vector<int32_t>                       m_remapMaterials;    ///< unique ids from parsed "remap_lists" of scene node
+  bool                                       m_remapListsChanged; ///< scene node was committed, m_remapMaterials must be parsed again
+
   BBox m_bbox;
 
   bool driverDirtyFlag;  // if true, driver need to Update this scene.
@@ -492,6 +548,61 @@ struct HRSceneInst : public HRObject<IHRSceneInst>
   int32_t instancedScenesCounter;
 };
 
+/**
+\brief Binary instance table. When hrInit got '-binary_instances 1', instances of hrSceneClose are stored in 'data' folder as
+       plain array of records and scene xml node keeps only <instances_table id="first_instance_id" count="..." loc="..."> reference.
+       Only HydraAPI itself reads this table (HR_LoadInstanceTable), so scenes for external 'HydraModern' render process still get <instance> nodes.
+       If such render is created after hrSceneClose, the external process sees a scene without instances.
+
+*/
+struct HRInstanceRecord
+{
+  float   m[16];
+  int32_t meshId;
+  int32_t remapListId;
+  int32_t scene_id;
+  int32_t scene_sid;
+  int32_t lightId;
+  int32_t lightInstId;
+};
+
+bool HR_SaveInstanceTable(const HRSceneInst::Instance* a_instances, size_t a_count, int32_t a_firstId, int32_t a_sceneId, pugi::xml_node a_tableNode,
+                          const wchar_t* a_suffix = L"");
+bool HR_LoadInstanceTable(const std::wstring& a_libPath, pugi::xml_node a_tableNode, std::vector<HRSceneInst::Instance>& a_drawList); ///< append instances to a_drawList
+
+/**
+\brief change name of object and keep name index (HRSceneData::m_materialIdByName and e.t.c.) consistent.
+\param a_index   - name index of object type
+\param a_objects - all objects of this type, ordered by id
+\param a_obj     - object to rename
+\param a_newName - new name
+
+*/
+template<typename T>
+void HR_RenameObject(std::unordered_map<std::wstring, int32_t>& a_index, const std::vector<T>& a_objects, T& a_obj, const std::wstring& a_newName)
+{
+  const std::wstring oldName = a_obj.name;
+  a_obj.name = a_newName;
+
+  auto p = a_index.find(oldName);
+  if (p != a_index.end() && p->second == a_obj.id)
+  {
+    a_index.erase(p);
+    for (const auto& other : a_objects) // other object with old name now should be found by it
+    {
+      if (other.name == oldName)
+      {
+        a_index[oldName] = other.id;
+        break;
+      }
+    }
+  }
+
+  auto q = a_index.find(a_newName);
+  if (q == a_index.end() || q->second > a_obj.id)
+    a_index[a_newName] = a_obj.id;
+}
+
 struct HRRender : public HRObject<IHRRender>
 {
   HRRender() : m_pDriver(nullptr), maxRaysPerPixel(0) {}
@@ -500,15 +611,31 @@ struct HRRender : public HRObject<IHRRender>
 
   pugi::xml_node copy_node(pugi::xml_node a_node, bool a_lite) override;
   pugi::xml_node copy_node_back(pugi::xml_node a_node) override;
+  void           add_to_commit_list() override;
 
   int maxRaysPerPixel;
 
+  struct TilesState ///< what was returned by hrRenderGetFrameBufferTilesHDR4f last time
+  {
+    TilesState() : width(0), height(0), tileSize(0) {}
+
+    int32_t width;
+    int32_t height;
+    int32_t tileSize;
+    std::vector<uint64_t> hash;  ///< content hash of each tile
+    std::vector<uint8_t>  sent;  ///< was tile returned at least once
+    std::vector<float>    frame; ///< full frame for drivers that can't read lines
+  };
+
+  TilesState m_tiles;
+
   void clear()
   {
     if (m_pDriver != nullptr)
       m_pDriver->ClearAll();
     m_pDriver = nullptr;
     maxRaysPerPixel = 0;
+    m_tiles = TilesState();
   }
 };
 
@@ -523,7 +650,9 @@ struct HRRender : public HRObject<IHRRender>
 struct HRObjectManager
 {
   HRObjectManager() : m_pFactory(nullptr), m_pDriver(nullptr), m_pImgTool(nullptr), m_currSceneId(0), m_currRenderId(0), m_currCamId(0), m_pVBSysMutex(nullptr),
-                      m_copyTexFilesToLocalStorage(false), m_useLocalPath(true), m_attachMode(false), m_sortTriIndices(false), m_computeBBoxes(false) {}
+                      m_copyTexFilesToLocalStorage(false), m_useLocalPath(true), m_attachMode(false), m_sortTriIndices(false), m_computeBBoxes(false),
+                      m_demandPaging(false), m_demandPagingBudgetMB(0), m_binaryInstances(false), m_updateWorkers(0), m_cpuPrepass(false), m_binaryState(false), m_dedupChunks(false), m_writeBehindMB(0), m_compressChunks(false), m_fastNormals(false),
+                      m_weldPosEps(1e-6f), m_weldNormalEps(1e-3f), m_weldUVEps(1e-5f) {}
  
   /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////// 
 
@@ -559,6 +688,38 @@ struct HRObjectManager
   std::vector<int> EmptyBuffer() { return std::vector<int>(); }
 
   void CommitChanges(pugi::xml_document& a_from, pugi::xml_document& a_to);
+
+  /**
+  \brief Ids of objects that were opened (got their 'xml_node_next') since last hrCommit.
+  CommitChanges commits only these objects, so commit cost depends on the size of the edit, not on the size of the library.
+  */
+  struct CommitList
+  {
+    std::vector<int32_t> meshes;
+    std::vector<int32_t> lights;
+    std::vector<int32_t> materials;
+    std::vector<int32_t> cameras;
+    std::vector<int32_t> textures;
+    std::vector<int32_t> scenes;
+    std::vector<int32_t> renders;
+
+    void clear()
+    {
+      meshes.clear();
+      lights.clear();
+      materials.clear();
+      cameras.clear();
+      textures.clear();
+      scenes.clear();
+      renders.clear();
+    }
+
+    bool empty() const
+    {
+      return meshes.empty() && lights.empty() && materials.empty() && cameras.empty() && textures.empty() && scenes.empty() && renders.empty();
+    }
+  } m_commitList;
+
   IHydraFactory* m_pFactory; // actual Factory
 
   std::shared_ptr<IHRRenderDriver>     m_pDriver;
@@ -586,11 +747,42 @@ struct HRObjectManager
   bool m_sortTriIndices;
   bool m_attachMode;
   bool m_computeBBoxes;
+  bool m_demandPaging;         ///< swap chunks back from disk to virtual buffer on access instead of reading them to m_tempBuffer
+  int  m_demandPagingBudgetMB;
+  bool m_binaryInstances;      ///< store scene instances in binary table instead of <instance> xml nodes; ignored if 'HydraModern' render was created before hrSceneClose, because external hydra process reads instances from state xml
+  int  m_updateWorkers;        ///< number of threads that read textures and meshes from disk ahead of render driver in HR_DriverUpdate; 0 means serial update
+  bool m_cpuPrepass;           ///< estimate texture mip levels for 'scenePrepass' on CPU (RD_CPU_Utility) instead of OpenGL utility driver
+  bool m_binaryState;          ///< hrFlush saves states before and after commit as binary 'statex_XXXXX.bxml' (see HydraXMLHelpers::SaveBinaryDocument); text if 'HydraModern' render is created
+  bool m_dedupChunks;          ///< meshes and textures with byte-identical data share single chunk (VirtualBuffer::DeduplicateChunk)
+  int  m_writeBehindMB;        ///< if > 0, evicted chunks are written by background thread with at most this amount of data in queue (VirtualBuffer::SetWriteBehind)
+  bool m_compressChunks;       ///< mesh and image chunk files are compressed; only for render drivers that take data through HydraAPI, external processes that read 'data' folder themselves can't decode it
+  bool m_fastNormals;          ///< hrMeshComputeNormals uses polynomial approximation of acos for angle weights
+  float m_weldPosEps;          ///< hrMeshWeldVertices merges vertex into the first used one that is closer than this in each coordinate; '-weld_pos_tolerance n' sets 1e-n (n <= 9)
+  float m_weldNormalEps;       ///< same for normal and tangent components ('-weld_normal_tolerance n')
+  float m_weldUVEps;           ///< same for texture coordinates ('-weld_uv_tolerance n')
 };
 
 void HrError(std::wstring a_str);
 void _HrPrint(HR_SEVERITY_LEVEL a_level, const wchar_t* a_str);
 
+/**
+\brief Messages of HrError/HrPrint that were called from worker thread. While thread has a sink, its messages are stored here 
+       instead of calling user callbacks and changing global error string; API thread passes them on with HrFlushMessages.
+*/
+struct HRMessageSink
+{
+  struct Message
+  {
+    HR_SEVERITY_LEVEL level;
+    std::wstring      text;
+    bool              lastError; ///< message came from HrError(std::wstring), which also sets global error string
+  };
+  std::vector<Message> messages;
+};
+
+void HrSetThreadMessageSink(HRMessageSink* a_pSink); ///< nullptr restores direct output for calling thread
+void HrFlushMessages(HRMessageSink& a_sink);          ///< call from API thread only
+
 template <typename HEAD>
 void _HrPrint(std::wstringstream& out, HEAD head)
 {
@@ -298,6 +298,16 @@ struct IHRRenderDriver
   virtual void    GetFrameBufferLineHDR(int32_t a_xBegin, int32_t a_xEnd, int32_t y, float* a_out, const wchar_t* a_layerName) {}
   virtual void    GetFrameBufferLineLDR(int32_t a_xBegin, int32_t a_xEnd, int32_t y, int32_t* a_out)                           {}
 
+  /**
+  \brief identify accumulation pass that is in frame buffer now. hrRenderGetFrameBufferTilesHDR4f calls it before and after it reads tiles 
+         and reads them again if pass was changed, so all returned tiles and their spp belong to the same pass.
+  \param a_pSpp    - output samples per pixel of the whole frame buffer (render drivers don't track samples per tile)
+  \param a_pPassId - output pass identifier; negative if frame buffer is being written right now
+  \return false if render driver does not accumulate samples (real-time drivers)
+
+  */
+  virtual bool    GetFrameBufferPassInfo(float* /*a_pSpp*/, int64_t* /*a_pPassId*/) { return false; }
+
 
   virtual void    EvalGBuffer() { } ///< run gbuffer evaluation (which can be async in general).
 
@@ -352,6 +362,7 @@ IHRRenderDriver* CreateOpenGL32Forward_RenderDriver();
 IHRRenderDriver* CreateOpenGL32Deferred_RenderDriver();
 
 IHRRenderDriver* CreateOpenGL3_Utilty_RenderDriver();
+IHRRenderDriver* CreateCPU_Utility_RenderDriver();
 
 static constexpr uint32_t MAX_TEXTURE_RESOLUTION = 16384;
 
@@ -318,113 +318,81 @@ namespace HRTextureUtils
     }
 
 
-    float sampleHeightMapLDR(const std::vector<int> &imageData, int w, int h, float2 uv, float4x4 matrix)
+    float sampleNoise(pugi::xml_node noiseXMLNode, float3 attrib)
     {
-      float acc = 0.0f;
-      int samples = 0;
-      for (int i = 0; i <= 1; i += 1)
-      {
-        for (int j = 0; j <= 1; j += 1)
-        {
-          float4 uv_ = float4(uv.x, uv.y, 0.0f, 1.0f);
-          uv_ = mul(matrix, uv_);
-
-          uv_.x = uv_.x - floorf(uv_.x);
-          uv_.y = uv_.y - floorf(uv_.y);
-
-          uv_.x = uv_.x > 1.0f ? 1.0f - uv_.x : uv_.x;
-          uv_.x = uv_.x < 0.0f ? 1.0f + uv_.x : uv_.x;
-
-          uv_.y = uv_.y > 1.0f ? 1.0f - uv_.y : uv_.y;
-          uv_.y = uv_.y < 0.0f ? 1.0f + uv_.y : uv_.y;
 
-          int x = int(uv_.x * (w - 1)) + i;
-          int y = int(uv_.y * (h - 1)) + j;
-
-          x = x > (w - 1) ? w - 1 : x;
-          x = x < 0 ? 0 : x;
-
-          y = y > (h - 1) ? h - 1 : y;
-          y = y < 0 ? 0 : y;
-
-          int ind = y * w + x;
-          if (ind < w * h)
-          {
-            int val = imageData.at(ind);
-            unsigned char ch1 = (val & 0x00FF0000) >> 16;
-            unsigned char ch2 = (val & 0x0000FF00) >> 8;
-            unsigned char ch3 = (val & 0x000000FF);
-
-            float gray = 0.2126f * (ch3 / 255.0f) + 0.7152f * (ch2 / 255.0f) + 0.0722f * (ch1 / 255.0f);
+      if (noiseXMLNode != nullptr)
+      {
+        auto base_freq = noiseXMLNode.attribute(L"base_freq").as_float();
+        auto num_octaves = noiseXMLNode.attribute(L"octaves").as_int();
+        auto persistence = noiseXMLNode.attribute(L"persistence").as_float();
+        auto lacunarity = noiseXMLNode.attribute(L"lacunarity").as_float();
 
-            acc += gray;
-            samples++;
-          }
-        }
+        return sampleNoise(attrib, num_octaves, persistence, base_freq, lacunarity);
+      } else
+      {
+        return 0.0f;
       }
-      return acc / samples;
     }
 
-    float sampleHeightMapHDR(const std::vector<float> &imageData, int w, int h, float2 uv, float4x4 matrix)
+    float sampleNoise(float3 attrib, int octaves, float persistence, float base_freq, float lacunarity)
     {
-      float acc = 0.0f;
-      int samples = 0;
-      for (int i = 0; i <= 1; i += 1)
-      {
-        for (int j = 0; j <= 1; j += 1)
-        {
-          float4 uv_ = float4(uv.x, uv.y, 0.0f, 1.0f);
-          uv_ = mul(matrix, uv_);
-
-          uv_.x = uv_.x - floorf(uv_.x);
-          uv_.y = uv_.y - floorf(uv_.y);
+      return 0.5f * (octave(attrib, octaves, persistence, base_freq, lacunarity) + 1.0f);
+    }
 
-          uv_.x = uv_.x > 1.0f ? 1.0f - uv_.x : uv_.x;
-          uv_.x = uv_.x < 0.0f ? 1.0f + uv_.x : uv_.x;
+    void HeightMap::initFromLDR(const std::vector<int> &imageData, int w, int h)
+    {
+      width  = (imageData.size() >= size_t(w)*size_t(h)) ? w : 0;
+      height = (width > 0) ? h : 0;
+      data.resize(size_t(width)*size_t(height));
 
-          uv_.y = uv_.y > 1.0f ? 1.0f - uv_.y : uv_.y;
-          uv_.y = uv_.y < 0.0f ? 1.0f + uv_.y : uv_.y;
+      for (size_t i = 0; i < data.size(); i++)
+      {
+        const int val = imageData[i];
+        unsigned char ch1 = (val & 0x00FF0000) >> 16;
+        unsigned char ch2 = (val & 0x0000FF00) >> 8;
+        unsigned char ch3 = (val & 0x000000FF);
 
-          int x = int(uv_.x * (w - 1)) + i;
-          int y = int(uv_.y * (h - 1)) + j;
+        data[i] = 0.2126f * (ch3 / 255.0f) + 0.7152f * (ch2 / 255.0f) + 0.0722f * (ch1 / 255.0f);
+      }
+    }
 
-          x = x > (w - 1) ? w - 1 : x;
-          x = x < 0 ? 0 : x;
+    void HeightMap::initFromHDR(const std::vector<float> &imageData, int w, int h)
+    {
+      width  = (imageData.size() >= size_t(w)*size_t(h)*4) ? w : 0;
+      height = (width > 0) ? h : 0;
+      data.resize(size_t(width)*size_t(height));
 
-          y = y > (h - 1) ? h - 1 : y;
-          y = y < 0 ? 0 : y;
+      for (size_t i = 0; i < data.size(); i++)
+        data[i] = 0.2126f * imageData[i*4 + 0] + 0.7152f * imageData[i*4 + 1] + 0.0722f * imageData[i*4 + 2];
+    }
 
-          int ind = y * w + x;
-          if (ind < w * h)
-          {
-            float ch1 = imageData.at(ind * 4 + 0);
-            float ch2 = imageData.at(ind * 4 + 1);
-            float ch3 = imageData.at(ind * 4 + 2);
+    float HeightMap::sample(float2 uv, const float4x4 &matrix) const
+    {
+      if (data.empty())
+        return 0.0f;
 
-            float gray = 0.2126f * ch1 + 0.7152f * ch2 + 0.0722f * ch3;
+      float4 uv_ = float4(uv.x, uv.y, 0.0f, 1.0f);
+      uv_ = mul(matrix, uv_);
 
-            acc += gray;
-            samples++;
-          }
-        }
-      }
-      return acc / samples;
-    }
+      uv_.x = uv_.x - floorf(uv_.x);
+      uv_.y = uv_.y - floorf(uv_.y);
 
-    float sampleNoise(pugi::xml_node noiseXMLNode, float3 attrib)
-    {
+      // 2x2 box; neighbours of the last texel are clamped to the edge
+      //
+      const int x0 = int(uv_.x * (width  - 1));
+      const int y0 = int(uv_.y * (height - 1));
+      const int x1 = (x0 < width  - 1) ? x0 + 1 : x0;
+      const int y1 = (y0 < height - 1) ? y0 + 1 : y0;
 
-      if (noiseXMLNode != nullptr)
-      {
-        auto base_freq = noiseXMLNode.attribute(L"base_freq").as_float();
-        auto num_octaves = noiseXMLNode.attribute(L"octaves").as_int();
-        auto persistence = noiseXMLNode.attribute(L"persistence").as_float();
-        auto lacunarity = noiseXMLNode.attribute(L"lacunarity").as_float();
+      const float* row0 = data.data() + size_t(y0) * size_t(width);
+      const float* row1 = data.data() + size_t(y1) * size_t(width);
 
-        return 0.5f * (octave(attrib, num_octaves, persistence, base_freq, lacunarity) + 1.0f);
-      } else
-      {
-        return 0.0f;
-      }
+      float acc = 0.0f;
+      acc += row0[x0];
+      acc += row1[x0];
+      acc += row0[x1];
+      acc += row1[x1];
+      return acc / 4;
     }
 }
\ No newline at end of file
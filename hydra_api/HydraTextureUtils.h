@@ -8,15 +8,37 @@
 #include "LiteMath.h"
 #include "pugixml.hpp"
 
+#include <vector>
+
 using namespace HydraLiteMath;
 
 namespace HRTextureUtils
 {
-    float sampleHeightMapLDR(const std::vector<int> &imageData, int w, int h, float2 uv, float4x4 matrix);
+    float sampleNoise(pugi::xml_node noiseXMLNode, float3 attrib);
 
-    float sampleHeightMapHDR(const std::vector<float> &imageData, int w, int h, float2 uv, float4x4 matri);
+    float sampleNoise(float3 attrib, int octaves, float persistence, float base_freq, float lacunarity); ///< same as above with parameters already read from xml
 
-    float sampleNoise(pugi::xml_node noiseXMLNode, float3 attrib);
+    /**
+    \brief Height map for displacement: texture is converted to luminance once, then it is sampled with 2x2 box filter clamped to the edge.
+           Sampling does not change the object, so it can be done from many threads.
+
+           Filter is intentionally the same as in the old per-triangle displacement code, not bilinear: 
+           bilinear sampling would change displaced geometry of existing scenes.
+    */
+    struct HeightMap
+    {
+      HeightMap() : width(0), height(0) {}
+
+      void initFromLDR(const std::vector<int>   &imageData, int w, int h);
+      void initFromHDR(const std::vector<float> &imageData, int w, int h);
+
+      float sample(float2 uv, const float4x4 &matrix) const; ///< 0 if map is empty
+      bool  empty() const { return data.empty(); }
+
+      std::vector<float> data;
+      int width;
+      int height;
+    };
 
     float noise(float3 p, float distortion, float detail);
 
@@ -1,8 +1,136 @@
 #include "HydraVSGFExport.h"
+#include "HydraChunkCompression.h"
 
 #include <fstream>
 #include <sstream>
 
+#if defined(WIN32)
+#include <windows.h>
+#undef min
+#undef max
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+HydraMappedFile::HydraMappedFile() : m_data(nullptr), m_size(0), m_fileHandle(nullptr), m_mappingHandle(nullptr) {}
+
+HydraMappedFile::~HydraMappedFile()
+{
+  close();
+}
+
+HydraMappedFile::HydraMappedFile(HydraMappedFile&& a_other) : m_data(a_other.m_data), m_size(a_other.m_size),
+                                                              m_fileHandle(a_other.m_fileHandle), m_mappingHandle(a_other.m_mappingHandle)
+{
+  a_other.m_data          = nullptr;
+  a_other.m_size          = 0;
+  a_other.m_fileHandle    = nullptr;
+  a_other.m_mappingHandle = nullptr;
+}
+
+HydraMappedFile& HydraMappedFile::operator=(HydraMappedFile&& a_other)
+{
+  if (this == &a_other)
+    return *this;
+
+  close();
+  m_data          = a_other.m_data;          a_other.m_data          = nullptr;
+  m_size          = a_other.m_size;          a_other.m_size          = 0;
+  m_fileHandle    = a_other.m_fileHandle;    a_other.m_fileHandle    = nullptr;
+  m_mappingHandle = a_other.m_mappingHandle; a_other.m_mappingHandle = nullptr;
+  return *this;
+}
+
+bool HydraMappedFile::open(const std::wstring& a_fileName)
+{
+  close();
+
+#if defined(WIN32)
+  HANDLE file = CreateFileW(a_fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping == NULL)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  const void* ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (ptr == nullptr)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  m_data          = (const char*)ptr;
+  m_size          = uint64_t(fileSize.QuadPart);
+  m_fileHandle    = file;
+  m_mappingHandle = mapping;
+#else
+  const std::string fileName(a_fileName.begin(), a_fileName.end());
+  const int fd = ::open(fileName.c_str(), O_RDONLY);
+  if (fd == -1)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  void* ptr = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // mapping keeps the file referenced
+  if (ptr == MAP_FAILED)
+    return false;
+
+  madvise(ptr, size_t(st.st_size), MADV_SEQUENTIAL);
+
+  m_data = (const char*)ptr;
+  m_size = uint64_t(st.st_size);
+#endif
+
+  return true;
+}
+
+void HydraMappedFile::close()
+{
+  if (m_data == nullptr)
+    return;
+
+#if defined(WIN32)
+  UnmapViewOfFile(m_data);
+  CloseHandle((HANDLE)m_mappingHandle);
+  CloseHandle((HANDLE)m_fileHandle);
+#else
+  munmap((void*)m_data, size_t(m_size));
+#endif
+
+  m_data          = nullptr;
+  m_size          = 0;
+  m_fileHandle    = nullptr;
+  m_mappingHandle = nullptr;
+}
+
+bool HostIsLittleEndian()
+{
+  const uint32_t one = 1;
+  return *((const unsigned char*)&one) == 1;
+}
+
 HydraGeomData::HydraGeomData()
 {
   m_ownMemory = false;
@@ -34,7 +162,10 @@ HydraGeomData::~HydraGeomData()
 void HydraGeomData::freeMemIfNeeded()
 {
   if(m_ownMemory)
-    free(m_data);
+    delete [] m_data;
+  m_ownMemory = false;
+  m_data      = nullptr;
+  m_file.close();
 }
 
 uint32_t HydraGeomData::getVerticesNumber() const { return verticesNum; }
@@ -242,7 +373,21 @@ void HydraGeomData::read(std::istream& a_input)
 
   // std::cout << "[HydraGeomData] data was read" << std::endl;
 
-  char* ptr = m_data;
+  setPointers(m_data);
+
+  if (HostIsLittleEndian()) // file is always little endian
+    return;
+
+  convertLittleBigEndian((unsigned int*)m_positions, verticesNum*4);
+  convertLittleBigEndian((unsigned int*)m_normals, verticesNum*4);
+  convertLittleBigEndian((unsigned int*)m_texcoords, verticesNum*2);
+  convertLittleBigEndian((unsigned int*)m_triVertIndices, indicesNum);
+  convertLittleBigEndian((unsigned int*)m_triMaterialIndices, (indicesNum/3));
+}
+
+void HydraGeomData::setPointers(char* a_data)
+{
+  char* ptr = a_data;
 
   m_positions = (float*)ptr; ptr += sizeof(float)*4*verticesNum;
   m_normals   = (float*)ptr; ptr += sizeof(float)*4*verticesNum;
@@ -252,17 +397,56 @@ void HydraGeomData::read(std::istream& a_input)
     m_tangents = (float*)ptr;
     ptr += sizeof(float)*4*verticesNum;
   }
+  else
+    m_tangents = nullptr;
 
   m_texcoords   = (float*)ptr; ptr += sizeof(float)*2*verticesNum;
 
   m_triVertIndices     = (uint32_t*)ptr; ptr += sizeof(uint32_t)*indicesNum;
   m_triMaterialIndices = (uint32_t*)ptr; ptr += sizeof(uint32_t)*(indicesNum / 3);
+}
 
-  convertLittleBigEndian((unsigned int*)m_positions, verticesNum*4);
-  convertLittleBigEndian((unsigned int*)m_normals, verticesNum*4);
-  convertLittleBigEndian((unsigned int*)m_texcoords, verticesNum*2);
-  convertLittleBigEndian((unsigned int*)m_triVertIndices, indicesNum);
-  convertLittleBigEndian((unsigned int*)m_triMaterialIndices, (indicesNum/3));
+bool HydraGeomData::readMapped(const std::wstring& a_fileName)
+{
+  freeMemIfNeeded();
+
+  if (!HostIsLittleEndian() || !m_file.open(a_fileName))
+    return false;
+
+  if (m_file.size() < sizeof(Header))
+  {
+    m_file.close();
+    return false;
+  }
+
+  if (CompressedChunkRawSize(m_file.data(), m_file.size()) != 0) // compressed chunk, let caller decode it
+  {
+    m_file.close();
+    return false;
+  }
+
+  const unsigned char* header = (const unsigned char*)m_file.data();
+
+  fileSizeInBytes = readInt64(&header[0]);
+  verticesNum     = readInt32(&header[8]);
+  indicesNum      = readInt32(&header[12]);
+  materialsNum    = readInt32(&header[16]);
+  flags           = readInt32(&header[20]);
+
+  uint64_t bodySize = uint64_t(verticesNum)*(sizeof(float)*4*2 + sizeof(float)*2) + uint64_t(indicesNum / 3)*4*sizeof(uint32_t);
+  if (flags & HAS_TANGENT)
+    bodySize += uint64_t(verticesNum)*sizeof(float)*4;
+
+  if (m_file.size() < sizeof(Header) + bodySize) // truncated file, let caller read it in usual way
+  {
+    m_file.close();
+    verticesNum = 0;
+    indicesNum  = 0;
+    return false;
+  }
+
+  setPointers((char*)m_file.data() + sizeof(Header));
+  return true;
 }
 
 void HydraGeomData::read(const std::string& a_fileName)
@@ -279,21 +463,15 @@ void HydraGeomData::read(const std::string& a_fileName)
 
 void HydraGeomData::read(const std::wstring& a_fileName)
 {
+  if (readMapped(a_fileName))
+    return;
 
-#if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
-  std::wstring s1(a_fileName);
-  std::string  s2(s1.begin(), s1.end());
-  std::ifstream fin(s2.c_str(), std::ios::binary);
-#elif defined WIN32
-  std::ifstream fin(a_fileName.c_str(), std::ios::binary);
-#endif
+  HydraChunkStream fin(a_fileName);
 
   if (!fin.is_open())
     return;
 
   read(fin);
-
-  fin.close();
 }
 
 
@@ -7,6 +7,37 @@
 #include <cstdint>
 
 
+/**
+\brief Read-only memory mapped file. Used to get mesh data without copying whole file to memory.
+*/
+struct HydraMappedFile
+{
+  HydraMappedFile();
+  ~HydraMappedFile();
+
+  HydraMappedFile(HydraMappedFile&& a_other);
+  HydraMappedFile& operator=(HydraMappedFile&& a_other);
+
+  HydraMappedFile(const HydraMappedFile&)            = delete;
+  HydraMappedFile& operator=(const HydraMappedFile&) = delete;
+
+  bool open(const std::wstring& a_fileName);
+  void close();
+
+  const char* data() const { return m_data; }
+  uint64_t    size() const { return m_size; }
+  bool        isOpen() const { return m_data != nullptr; }
+
+protected:
+
+  const char* m_data;
+  uint64_t    m_size;
+  void*       m_fileHandle;    ///< only for windows
+  void*       m_mappingHandle; ///< only for windows
+};
+
+bool HostIsLittleEndian();
+
 struct HydraGeomData
 {
   HydraGeomData();
@@ -17,9 +48,10 @@ struct HydraGeomData
   void write(const std::string& a_fileName);
   void write(std::ostream& a_out);
 
-  void read(const std::wstring& a_fileName);
+  void read(const std::wstring& a_fileName); ///< map file to memory if possible, data pointers then point directly to the file
   void read(const std::string& a_fileName);
   void read(std::istream& a_input);
+  bool readMapped(const std::wstring& a_fileName);
 
   void writeToMemory(char* a);
   size_t sizeInBytes();
@@ -91,7 +123,10 @@ protected:
   //
   //
   void freeMemIfNeeded();
+  void setPointers(char* a_data);
   bool m_ownMemory;
+
+  HydraMappedFile m_file;
   
   // HashMapI                      m_matIndexByName;
   // std::vector<std::string>      m_matNameByIndex;
@@ -7,6 +7,11 @@
 #include "HydraLegacyUtils.h"
 
 #include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cwchar>
+#include <unordered_map>
 
 extern HRObjectManager g_objManager;
 
@@ -52,6 +57,308 @@ namespace HydraXMLHelpers
       return remap_lists;
     }
 
+    ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    struct BinaryDocHeader
+    {
+      char     magic[4];     ///< 'HRBX'
+      uint32_t version;
+      uint32_t charSize;     ///< sizeof(pugi::char_t) of the build that saved the file
+      uint32_t namesNum;
+      uint64_t namesBytes;
+      uint64_t nodesBytes;
+    };
+
+    static const uint32_t BINARY_DOC_VERSION = 1;
+    static const uint32_t BINARY_DOC_NO_NAME = 0xFFFFFFFF;
+
+    // strings are stored as (length, chars, terminating zero) padded to 4 bytes, so that they may be used directly from the file buffer
+    //
+    static inline void PutU32(std::vector<char>& a_out, uint32_t a_val)
+    {
+      const size_t oldSize = a_out.size();
+      a_out.resize(oldSize + sizeof(uint32_t));
+      memcpy(a_out.data() + oldSize, &a_val, sizeof(uint32_t));
+    }
+
+    static inline void PutString(std::vector<char>& a_out, const pugi::char_t* a_str)
+    {
+      const size_t len     = wcslen(a_str);
+      const size_t bytes   = (len + 1)*sizeof(pugi::char_t);
+      const size_t padded  = (bytes + 3) & ~size_t(3);
+      PutU32(a_out, uint32_t(len));
+      const size_t oldSize = a_out.size();
+      a_out.resize(oldSize + padded, 0);
+      memcpy(a_out.data() + oldSize, a_str, bytes);
+    }
+
+    struct BinaryDocReader
+    {
+      const char* ptr;
+      const char* end;
+      bool        ok;
+
+      uint32_t GetU32()
+      {
+        uint32_t val = 0;
+        if (end - ptr < ptrdiff_t(sizeof(uint32_t)))
+          ok = false;
+        else
+        {
+          memcpy(&val, ptr, sizeof(uint32_t));
+          ptr += sizeof(uint32_t);
+        }
+        return val;
+      }
+
+      const pugi::char_t* GetString()
+      {
+        const size_t len    = GetU32();
+        const size_t bytes  = (len + 1)*sizeof(pugi::char_t);
+        const size_t padded = (bytes + 3) & ~size_t(3);
+        if (!ok || size_t(end - ptr) < padded)
+        {
+          ok = false;
+          return L"";
+        }
+        const pugi::char_t* str = (const pugi::char_t*)ptr;
+        ptr += padded;
+        if (str[len] != 0)
+          ok = false;
+        return ok ? str : L"";
+      }
+    };
+
+    struct NamePtrHash
+    {
+      size_t operator()(const pugi::char_t* a_str) const
+      {
+        size_t h = 2166136261u;
+        for (; *a_str != 0; a_str++)
+          h = (h ^ size_t(*a_str)) * 16777619u;
+        return h;
+      }
+    };
+
+    struct NamePtrEqual
+    {
+      bool operator()(const pugi::char_t* a, const pugi::char_t* b) const { return wcscmp(a, b) == 0; }
+    };
+
+    bool SaveBinaryDocument(const pugi::xml_document& a_doc, const std::wstring& a_path)
+    {
+      std::unordered_map<const pugi::char_t*, uint32_t, NamePtrHash, NamePtrEqual> nameIds; // pointers stay valid while a_doc is not changed
+      std::vector<const pugi::char_t*> names;
+      std::vector<char> nodes;
+      nodes.reserve(size_t(1024*1024));
+
+      auto internName = [&](const pugi::char_t* a_name) -> uint32_t
+      {
+        if (a_name[0] == 0)
+          return BINARY_DOC_NO_NAME;
+        auto p = nameIds.find(a_name);
+        if (p != nameIds.end())
+          return p->second;
+        const uint32_t id = uint32_t(names.size());
+        nameIds[a_name] = id;
+        names.push_back(a_name);
+        return id;
+      };
+
+      // node record: (type, nameId, value, attribNum, (nameId, value)*, childNum); children follow in pre-order
+      //
+      std::vector<pugi::xml_node> stack;
+      for (pugi::xml_node child = a_doc.last_child(); child != nullptr; child = child.previous_sibling())
+        stack.push_back(child);
+
+      PutU32(nodes, uint32_t(stack.size()));
+
+      while (!stack.empty())
+      {
+        const pugi::xml_node node = stack.back();
+        stack.pop_back();
+
+        PutU32(nodes, uint32_t(node.type()));
+        PutU32(nodes, internName(node.name()));
+        PutString(nodes, node.value());
+
+        const size_t attrCountPos = nodes.size();
+        uint32_t     attrCount    = 0;
+        PutU32(nodes, 0);
+        for (pugi::xml_attribute attr = node.first_attribute(); attr != nullptr; attr = attr.next_attribute())
+        {
+          PutU32(nodes, internName(attr.name()));
+          PutString(nodes, attr.value());
+          attrCount++;
+        }
+        memcpy(nodes.data() + attrCountPos, &attrCount, sizeof(uint32_t));
+
+        const size_t childCountPos = stack.size();
+        for (pugi::xml_node child = node.last_child(); child != nullptr; child = child.previous_sibling())
+          stack.push_back(child);
+        PutU32(nodes, uint32_t(stack.size() - childCountPos));
+      }
+
+      std::vector<char> namesData;
+      for (auto name : names)
+        PutString(namesData, name);
+
+      BinaryDocHeader header;
+      memcpy(header.magic, "HRBX", 4);
+      header.version    = BINARY_DOC_VERSION;
+      header.charSize   = uint32_t(sizeof(pugi::char_t));
+      header.namesNum   = uint32_t(names.size());
+      header.namesBytes = namesData.size();
+      header.nodesBytes = nodes.size();
+
+#if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
+      std::string s2(a_path.begin(), a_path.end());
+      std::ofstream fout(s2.c_str(), std::ios::binary);
+#elif defined WIN32
+      std::ofstream fout(a_path.c_str(), std::ios::binary);
+#endif
+      if (!fout.is_open())
+      {
+        HrError(L"SaveBinaryDocument, can't create file ", a_path.c_str());
+        return false;
+      }
+
+      fout.write((const char*)&header, sizeof(header));
+      fout.write(namesData.data(), namesData.size());
+      fout.write(nodes.data(), nodes.size());
+      fout.flush();
+
+      const bool written = fout.good();
+      fout.close();
+
+      if (!written || fout.fail()) // don't leave truncated file, state search prefers '.bxml' to '.xml'
+      {
+#if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
+        std::remove(s2.c_str());
+#elif defined WIN32
+        _wremove(a_path.c_str());
+#endif
+        HrError(L"SaveBinaryDocument, can't write file ", a_path.c_str());
+        return false;
+      }
+
+      return true;
+    }
+
+    bool LoadBinaryDocument(pugi::xml_document& a_doc, const std::wstring& a_path)
+    {
+#if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
+      std::string s2(a_path.begin(), a_path.end());
+      std::ifstream fin(s2.c_str(), std::ios::binary | std::ios::ate);
+#elif defined WIN32
+      std::ifstream fin(a_path.c_str(), std::ios::binary | std::ios::ate);
+#endif
+      if (!fin.is_open())
+      {
+        HrError(L"LoadBinaryDocument, can't open file ", a_path.c_str());
+        return false;
+      }
+
+      const size_t fileSize = size_t(fin.tellg());
+      fin.seekg(0, std::ios::beg);
+
+      std::vector<uint32_t> data((fileSize + 3) / sizeof(uint32_t)); // keep strings aligned for pugi::char_t
+      fin.read((char*)data.data(), fileSize);
+
+      BinaryDocHeader header;
+      if (uint64_t(fin.gcount()) != fileSize || fileSize < sizeof(header))
+      {
+        HrError(L"LoadBinaryDocument, can't read file ", a_path.c_str());
+        return false;
+      }
+
+      memcpy(&header, data.data(), sizeof(header));
+      if (memcmp(header.magic, "HRBX", 4) != 0 || header.version != BINARY_DOC_VERSION || header.charSize != sizeof(pugi::char_t) ||
+          sizeof(header) + header.namesBytes + header.nodesBytes > fileSize)
+      {
+        HrError(L"LoadBinaryDocument, bad header or incompatible build: ", a_path.c_str());
+        return false;
+      }
+
+      const char* begin = (const char*)data.data();
+      BinaryDocReader namesIn = { begin + sizeof(header), begin + sizeof(header) + header.namesBytes, true };
+      BinaryDocReader nodesIn = { namesIn.end, namesIn.end + header.nodesBytes, true };
+
+      std::vector<const pugi::char_t*> names(header.namesNum);
+      for (auto& name : names)
+        name = namesIn.GetString();
+
+      auto nameById = [&](uint32_t a_id) -> const pugi::char_t*
+      {
+        if (a_id == BINARY_DOC_NO_NAME)
+          return L"";
+        if (a_id >= names.size())
+        {
+          nodesIn.ok = false;
+          return L"";
+        }
+        return names[a_id];
+      };
+
+      a_doc.reset();
+
+      // (parent, children left) pairs; node records go in pre-order
+      //
+      std::vector<std::pair<pugi::xml_node, uint32_t> > stack;
+      stack.push_back(std::make_pair(pugi::xml_node(a_doc), nodesIn.GetU32()));
+
+      while (!stack.empty() && namesIn.ok && nodesIn.ok)
+      {
+        if (stack.back().second == 0)
+        {
+          stack.pop_back();
+          continue;
+        }
+        stack.back().second--;
+
+        const auto type           = pugi::xml_node_type(nodesIn.GetU32());
+        const pugi::char_t* name  = nameById(nodesIn.GetU32());
+        const pugi::char_t* value = nodesIn.GetString();
+
+        pugi::xml_node node = stack.back().first.append_child(type);
+        if (node == nullptr)
+        {
+          nodesIn.ok = false;
+          break;
+        }
+
+        if (name[0] != 0)
+          node.set_name(name);
+        if (value[0] != 0)
+          node.set_value(value);
+
+        const uint32_t attrNum = nodesIn.GetU32();
+        for (uint32_t i = 0; i < attrNum && nodesIn.ok; i++)
+        {
+          const pugi::char_t* attrName  = nameById(nodesIn.GetU32());
+          const pugi::char_t* attrValue = nodesIn.GetString();
+          node.append_attribute(attrName).set_value(attrValue);
+        }
+
+        stack.push_back(std::make_pair(node, nodesIn.GetU32()));
+      }
+
+      if (!namesIn.ok || !nodesIn.ok)
+      {
+        HrError(L"LoadBinaryDocument, file is damaged: ", a_path.c_str());
+        a_doc.reset();
+        return false;
+      }
+
+      return true;
+    }
+
+    bool IsBinaryDocumentPath(const std::wstring& a_path)
+    {
+      const std::wstring ext = L".bxml";
+      return a_path.size() > ext.size() && a_path.compare(a_path.size() - ext.size(), ext.size(), ext) == 0;
+    }
+
 }
 
 /*
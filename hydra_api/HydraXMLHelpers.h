@@ -318,5 +318,15 @@ namespace HydraXMLHelpers
 
   std::vector<std::vector<int> > ReadRemapLists(pugi::xml_node a_node);
 
+  /**
+  \brief Compact binary snapshot of xml document ('.bxml'): interned element/attribute names and a flat pre-order node stream.
+  
+  Saving is a single pass over the tree with memcpy of strings, without text escaping and formatting of pugixml writer.
+  The format stores wchar_t as is, so it can be loaded back only by the build with the same sizeof(wchar_t).
+  */
+  bool SaveBinaryDocument(const pugi::xml_document& a_doc, const std::wstring& a_path); ///< false if file was not completely written (it is removed then)
+  bool LoadBinaryDocument(pugi::xml_document& a_doc, const std::wstring& a_path);  ///< replaces a_doc content
+  bool IsBinaryDocumentPath(const std::wstring& a_path);                             ///< true for '.bxml' extension
+
  
 };
@@ -0,0 +1,514 @@
+#include "RenderDriverCPU_Utility.h"
+#include "HydraXMLHelpers.h"
+
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+using HydraLiteMath::float2;
+using HydraLiteMath::float3;
+
+RD_CPU_Utility::RD_CPU_Utility()
+{
+  camFov       = 45.0f;
+  camNearPlane = 0.05f;
+
+  camPos[0]    = 0.0f; camPos[1]    = 0.0f; camPos[2]    = 0.0f;
+  camLookAt[0] = 0.0f; camLookAt[1] = 0.0f; camLookAt[2] = -1.0f;
+  camUp[0]     = 0.0f; camUp[1]     = 1.0f; camUp[2]     = 0.0f;
+
+  m_settingsWidth  = 1024;
+  m_settingsHeight = 1024;
+
+  m_focalX = m_focalY = 1.0f;
+}
+
+void RD_CPU_Utility::ClearAll()
+{
+  m_materials.clear();
+  m_meshes.clear();
+  m_instances.clear();
+  m_remapLists.clear();
+  m_texMipLevels.clear();
+  m_mipLevelDict.clear();
+}
+
+HRDriverAllocInfo RD_CPU_Utility::AllocAll(HRDriverAllocInfo a_info)
+{
+  MaterialTextures emptyMaterial;
+  for (int slot = 0; slot < MATERIAL_TEX_SLOTS; slot++)
+  {
+    emptyMaterial.texId[slot]     = -1;
+    emptyMaterial.matrix[slot][0] = 1.0f; emptyMaterial.matrix[slot][1] = 0.0f;
+    emptyMaterial.matrix[slot][2] = 0.0f; emptyMaterial.matrix[slot][3] = 1.0f;
+  }
+
+  m_materials.resize(size_t(a_info.matNum), emptyMaterial);
+  m_texMipLevels.resize(size_t(a_info.imgNum), uint8_t(0xFF));
+
+  return a_info;
+}
+
+HRDriverInfo RD_CPU_Utility::Info()
+{
+  HRDriverInfo info;
+
+  info.supportHDRFrameBuffer        = false;
+  info.supportHDRTextures           = true;
+  info.supportMultiMaterialInstance = false;
+
+  info.supportImageLoadFromInternalFormat = false;
+  info.supportImageLoadFromExternalFormat = false;
+  info.supportMeshLoadFromInternalFormat  = false;
+  info.supportLighting                    = false;
+
+  info.memTotal = int64_t(8) * int64_t(1024 * 1024 * 1024);
+
+  return info;
+}
+
+bool RD_CPU_Utility::UpdateMaterial(int32_t a_matId, pugi::xml_node a_materialNode)
+{
+  if (a_matId < 0 || a_matId >= int32_t(m_materials.size()))
+    return false;
+
+  // must be in the same order as RD_OGL32_Utility::UpdateMaterial puts them to LOD buffer
+  //
+  const wchar_t* slotPath[MATERIAL_TEX_SLOTS][2] = { {L"emission",     L"color"},
+                                                     {L"diffuse",      L"color"},
+                                                     {L"reflectivity", L"color"},
+                                                     {L"reflectivity", L"glossiness"},
+                                                     {L"transparency", L"color"},
+                                                     {L"opacity",      nullptr},
+                                                     {L"translucency", L"color"},
+                                                     {L"displacement", L"normal_map"} };
+
+  MaterialTextures& mat = m_materials[a_matId];
+
+  for (int slot = 0; slot < MATERIAL_TEX_SLOTS; slot++)
+  {
+    pugi::xml_node node = a_materialNode.child(slotPath[slot][0]);
+    if (slotPath[slot][1] != nullptr)
+      node = node.child(slotPath[slot][1]);
+
+    const pugi::xml_node texNode = node.child(L"texture");
+
+    mat.texId[slot] = -1;
+    mat.matrix[slot][0] = 1.0f; mat.matrix[slot][1] = 0.0f;
+    mat.matrix[slot][2] = 0.0f; mat.matrix[slot][3] = 1.0f;
+
+    if (texNode != nullptr)
+    {
+      mat.texId[slot] = texNode.attribute(L"id").as_int();
+      if (texNode.attribute(L"matrix") != nullptr)
+        HydraXMLHelpers::ReadMatrix2x2From4x4(texNode, L"matrix", mat.matrix[slot]);
+    }
+  }
+
+  return true;
+}
+
+bool RD_CPU_Utility::UpdateMesh(int32_t a_meshId, pugi::xml_node /*a_meshNode*/, const HRMeshDriverInput& a_input, const HRBatchInfo* a_batchList, int32_t a_listSize)
+{
+  if (a_input.triNum == 0 || a_input.texcoord2f == nullptr)
+    return true;
+
+  MeshData& mesh = m_meshes[a_meshId];
+
+  mesh.pos.resize(a_input.vertNum);
+  mesh.texCoord.resize(a_input.vertNum);
+
+  for (int i = 0; i < a_input.vertNum; i++)
+  {
+    mesh.pos[i]      = float3(a_input.pos4f[i * 4 + 0], a_input.pos4f[i * 4 + 1], a_input.pos4f[i * 4 + 2]);
+    mesh.texCoord[i] = float2(a_input.texcoord2f[i * 2 + 0], a_input.texcoord2f[i * 2 + 1]);
+  }
+
+  mesh.indices.assign(a_input.indices, a_input.indices + size_t(a_input.triNum) * 3);
+  mesh.batches.assign(a_batchList, a_batchList + a_listSize);
+
+  for (auto& batch : mesh.batches) // indices are checked against vertNum in EndScene, triangle ranges here
+  {
+    batch.triBegin = std::max(batch.triBegin, 0);
+    batch.triEnd   = std::min(batch.triEnd, a_input.triNum);
+  }
+
+  return true;
+}
+
+bool RD_CPU_Utility::UpdateCamera(pugi::xml_node a_camNode)
+{
+  if (a_camNode == nullptr)
+    return true;
+
+  const std::wstring camPosStr = a_camNode.child(L"position").text().as_string();
+  const std::wstring camLAtStr = a_camNode.child(L"look_at").text().as_string();
+  const std::wstring camUpStr  = a_camNode.child(L"up").text().as_string();
+
+  if (!a_camNode.child(L"fov").text().empty())
+    camFov = a_camNode.child(L"fov").text().as_float();
+
+  if (!a_camNode.child(L"nearClipPlane").text().empty())
+    camNearPlane = std::max(a_camNode.child(L"nearClipPlane").text().as_float(), 1e-4f);
+
+  if (!camPosStr.empty())
+  {
+    std::wstringstream input(camPosStr);
+    input >> camPos[0] >> camPos[1] >> camPos[2];
+  }
+
+  if (!camLAtStr.empty())
+  {
+    std::wstringstream input(camLAtStr);
+    input >> camLookAt[0] >> camLookAt[1] >> camLookAt[2];
+  }
+
+  if (!camUpStr.empty())
+  {
+    std::wstringstream input(camUpStr);
+    input >> camUp[0] >> camUp[1] >> camUp[2];
+  }
+
+  return true;
+}
+
+bool RD_CPU_Utility::UpdateSettings(pugi::xml_node a_settingsNode)
+{
+  if (a_settingsNode.child(L"width") != nullptr)
+    m_settingsWidth = std::max(a_settingsNode.child(L"width").text().as_int(), 1);
+
+  if (a_settingsNode.child(L"height") != nullptr)
+    m_settingsHeight = std::max(a_settingsNode.child(L"height").text().as_int(), 1);
+
+  return true;
+}
+
+void RD_CPU_Utility::BeginScene(pugi::xml_node a_sceneNode)
+{
+  m_instances.clear();
+  m_remapLists.clear();
+
+  if (a_sceneNode.child(L"remap_lists") != nullptr)
+  {
+    for (auto listNode = a_sceneNode.child(L"remap_lists").first_child(); listNode != nullptr; listNode = listNode.next_sibling())
+    {
+      const int listSize = listNode.attribute(L"size").as_int();
+
+      std::unordered_map<int32_t, int32_t> remapList;
+      const wchar_t* listStr = listNode.attribute(L"val").as_string();
+      if (listStr != nullptr)
+      {
+        std::wstringstream inputStream(listStr);
+        for (int i = 0; i < listSize; i += 2)
+        {
+          int32_t a = 0;
+          int32_t b = 0;
+
+          inputStream >> a;
+          inputStream >> b;
+
+          remapList[a] = b;
+        }
+      }
+      m_remapLists.emplace_back(remapList);
+    }
+  }
+
+  const float3 eye(camPos[0], camPos[1], camPos[2]);
+  const float3 center(camLookAt[0], camLookAt[1], camLookAt[2]);
+  const float3 up(camUp[0], camUp[1], camUp[2]);
+
+  m_camForward = normalize(center - eye);
+  m_camRight   = normalize(cross(m_camForward, up));
+  m_camUp      = cross(m_camRight, m_camForward);
+
+  // camFov is vertical as in projectionMatrixTransposed; focal length is in pixels of final render resolution,
+  // so estimated derivatives don't need (rasterization_res / render_res) scale of the GL LOD buffer
+  //
+  const float tanHalfFov = tanf(0.5f*camFov*3.14159265358979f / 180.0f);
+
+  m_focalY = 0.5f*float(m_settingsHeight) / tanHalfFov;
+  m_focalX = m_focalY;
+}
+
+void RD_CPU_Utility::InstanceMeshes(int32_t a_mesh_id, const float* a_matrices, int32_t a_instNum, const int* /*a_lightInstId*/, const int* a_remapId, const int* /*a_realInstId*/)
+{
+  auto p = m_meshes.find(a_mesh_id);
+  if (p == m_meshes.end())
+    return;
+
+  const float3 eye(camPos[0], camPos[1], camPos[2]);
+  const float3 axis[3] = { m_camRight, m_camUp, m_camForward };
+
+  for (int32_t i = 0; i < a_instNum; i++)
+  {
+    const float* m = a_matrices + i * 16;
+
+    InstanceRecord inst;
+    inst.pMesh   = &p->second;
+    inst.remapId = (a_remapId == nullptr) ? -1 : a_remapId[i];
+
+    // toView = [R | -R*eye] * M, where R rows are camera axis (z looks forward)
+    //
+    for (int row = 0; row < 3; row++)
+    {
+      const float3 r = axis[row];
+      for (int col = 0; col < 4; col++)
+        inst.toView[row * 4 + col] = r.x*m[0 * 4 + col] + r.y*m[1 * 4 + col] + r.z*m[2 * 4 + col];
+      inst.toView[row * 4 + 3] -= dot(r, eye);
+    }
+
+    m_instances.push_back(inst);
+  }
+}
+
+static inline float3 HR_TransformToView(const float* m, const float3& p)
+{
+  return float3(m[0] * p.x + m[1] * p.y + m[2]  * p.z + m[3],
+                m[4] * p.x + m[5] * p.y + m[6]  * p.z + m[7],
+                m[8] * p.x + m[9] * p.y + m[10] * p.z + m[11]);
+}
+
+/**
+\brief screen space derivatives of texture coordinates (dUV/dx, dUV/dy) at point a_p that lies on triangle plane.
+\param a_e1, a_e2   - triangle edges in view space
+\param a_d1, a_d2   - texture coordinates differences along the same edges
+\param a_focal      - focal length in pixels
+\return false if triangle is seen edge-on at this point
+
+*/
+static inline bool HR_ScreenUVDerivatives(const float3& a_p, const float3& a_e1, const float3& a_e2, const float2& a_d1, const float2& a_d2, float a_focal,
+                                          float2* a_dx, float2* a_dy)
+{
+  const float invZ2 = a_focal / (a_p.z*a_p.z);
+
+  const float sax = (a_e1.x*a_p.z - a_p.x*a_e1.z)*invZ2;
+  const float say = (a_e1.y*a_p.z - a_p.y*a_e1.z)*invZ2;
+  const float sbx = (a_e2.x*a_p.z - a_p.x*a_e2.z)*invZ2;
+  const float sby = (a_e2.y*a_p.z - a_p.y*a_e2.z)*invZ2;
+
+  const float det = sax*sby - sbx*say;
+  if (std::abs(det) < 1e-20f)
+    return false;
+
+  const float invDet = 1.0f / det;
+
+  a_dx->x = ( a_d1.x*sby - a_d2.x*say)*invDet;
+  a_dx->y = ( a_d1.y*sby - a_d2.y*say)*invDet;
+  a_dy->x = (-a_d1.x*sbx + a_d2.x*sax)*invDet;
+  a_dy->y = (-a_d1.y*sbx + a_d2.y*sax)*invDet;
+
+  return true;
+}
+
+/**
+\brief the same as 'mip_map_level' of LOD buffer shader, but derivatives are given per pixel of final render resolution.
+*/
+static inline int HR_MipLevel(const float2& a_dx, const float2& a_dy, const float a_matrix[4])
+{
+  const float texRes   = float(MAX_TEXTURE_RESOLUTION);
+  const float maxClamp = float(1 << (2 * RD_CPU_Utility::MAX_MIP_LEVEL));
+
+  const float dxu = (a_matrix[0] * a_dx.x + a_matrix[1] * a_dx.y)*texRes;
+  const float dxv = (a_matrix[2] * a_dx.x + a_matrix[3] * a_dx.y)*texRes;
+  const float dyu = (a_matrix[0] * a_dy.x + a_matrix[1] * a_dy.y)*texRes;
+  const float dyv = (a_matrix[2] * a_dy.x + a_matrix[3] * a_dy.y)*texRes;
+
+  float deltaMaxSqr = std::max(dxu*dxu + dxv*dxv, dyu*dyu + dyv*dyv);
+  deltaMaxSqr       = std::min(std::max(deltaMaxSqr, 1.0f), maxClamp);
+
+  return int(floorf(0.5f*log2f(deltaMaxSqr)));
+}
+
+void RD_CPU_Utility::EndScene()
+{
+  constexpr int32_t TRIANGLES_PER_JOB = 4096;
+
+  struct Job
+  {
+    const InstanceRecord*   pInst;
+    const MaterialTextures* pMat;
+    int32_t triBegin;
+    int32_t triEnd;
+  };
+
+  // split all (instance, batch) pairs that have textured material into jobs of nearly equal size
+  //
+  std::vector<Job> jobs;
+
+  for (const auto& inst : m_instances)
+  {
+    for (const auto& batch : inst.pMesh->batches)
+    {
+      int32_t matId = batch.matId;
+
+      if (inst.remapId >= 0 && inst.remapId < int32_t(m_remapLists.size()))
+      {
+        const auto& remapList = m_remapLists[inst.remapId];
+        const auto p          = remapList.find(matId);
+        if (p != remapList.end())
+          matId = p->second;
+      }
+
+      if (matId < 0 || matId >= int32_t(m_materials.size()))
+        continue;
+
+      const MaterialTextures& mat = m_materials[matId];
+
+      bool haveTextures = false;
+      for (int slot = 0; slot < MATERIAL_TEX_SLOTS; slot++)
+        haveTextures = haveTextures || (mat.texId[slot] >= 0 && mat.texId[slot] < int32_t(m_texMipLevels.size()));
+
+      if (!haveTextures)
+        continue;
+
+      for (int32_t triBegin = batch.triBegin; triBegin < batch.triEnd; triBegin += TRIANGLES_PER_JOB)
+      {
+        Job job;
+        job.pInst    = &inst;
+        job.pMat     = &mat;
+        job.triBegin = triBegin;
+        job.triEnd   = std::min(triBegin + TRIANGLES_PER_JOB, batch.triEnd);
+        jobs.push_back(job);
+      }
+    }
+  }
+
+  std::fill(m_texMipLevels.begin(), m_texMipLevels.end(), uint8_t(0xFF));
+
+  const float nearPlane = camNearPlane;
+  const float halfW     = 0.5f*float(m_settingsWidth);
+  const float halfH     = 0.5f*float(m_settingsHeight);
+  const float focal     = m_focalY;
+  const int   texNum    = int(m_texMipLevels.size());
+
+  #pragma omp parallel
+  {
+    std::vector<uint8_t> texMipLevels(m_texMipLevels.size(), uint8_t(0xFF));
+
+    #pragma omp for schedule(dynamic)
+    for (int jobId = 0; jobId < int(jobs.size()); jobId++)
+    {
+      const Job& job              = jobs[jobId];
+      const MeshData& mesh        = *(job.pInst->pMesh);
+      const MaterialTextures& mat = *(job.pMat);
+      const float* toView         = job.pInst->toView;
+      const uint32_t vertNum      = uint32_t(mesh.pos.size());
+
+      for (int32_t triId = job.triBegin; triId < job.triEnd; triId++)
+      {
+        const int i0 = mesh.indices[triId * 3 + 0];
+        const int i1 = mesh.indices[triId * 3 + 1];
+        const int i2 = mesh.indices[triId * 3 + 2];
+
+        if (uint32_t(i0) >= vertNum || uint32_t(i1) >= vertNum || uint32_t(i2) >= vertNum) // malformed mesh
+          continue;
+
+        const float3 p[3]  = { HR_TransformToView(toView, mesh.pos[i0]), HR_TransformToView(toView, mesh.pos[i1]), HR_TransformToView(toView, mesh.pos[i2]) };
+        const float2 uv[3] = { mesh.texCoord[i0], mesh.texCoord[i1], mesh.texCoord[i2] };
+
+        // frustum culling
+        //
+        const int inFront = int(p[0].z > nearPlane) + int(p[1].z > nearPlane) + int(p[2].z > nearPlane);
+        if (inFront == 0)
+          continue;
+
+        if (inFront == 3)
+        {
+          int left = 0, right = 0, bottom = 0, top = 0;
+          for (int k = 0; k < 3; k++)
+          {
+            const float sx = focal*p[k].x / p[k].z;
+            const float sy = focal*p[k].y / p[k].z;
+            left   += int(sx < -halfW);
+            right  += int(sx >  halfW);
+            bottom += int(sy < -halfH);
+            top    += int(sy >  halfH);
+          }
+
+          if (left == 3 || right == 3 || bottom == 3 || top == 3)
+            continue;
+        }
+
+        // the finest mip level over triangle is reached at its closest visible points: vertices and near plane intersections
+        //
+        float3 points[4];
+        int pointsNum = 0;
+
+        for (int k = 0; k < 3; k++)
+        {
+          const float3& a = p[k];
+          const float3& b = p[(k + 1) % 3];
+
+          if (a.z > nearPlane)
+            points[pointsNum++] = a;
+
+          if ((a.z > nearPlane) != (b.z > nearPlane) && pointsNum < 4)
+          {
+            const float t = (nearPlane - a.z) / (b.z - a.z);
+            points[pointsNum++] = a + (b - a)*t;
+          }
+        }
+
+        const float3 e1 = p[1] - p[0];
+        const float3 e2 = p[2] - p[0];
+        const float2 d1(uv[1].x - uv[0].x, uv[1].y - uv[0].y);
+        const float2 d2(uv[2].x - uv[0].x, uv[2].y - uv[0].y);
+
+        for (int k = 0; k < pointsNum; k++)
+        {
+          float2 dx, dy;
+          if (!HR_ScreenUVDerivatives(points[k], e1, e2, d1, d2, focal, &dx, &dy))
+            continue;
+
+          for (int slot = 0; slot < MATERIAL_TEX_SLOTS; slot++)
+          {
+            const int32_t texId = mat.texId[slot];
+            if (texId < 0 || texId >= texNum || texMipLevels[texId] == 0)
+              continue;
+
+            const int mipLevel = HR_MipLevel(dx, dy, mat.matrix[slot]);
+            if (mipLevel < int(texMipLevels[texId]))
+              texMipLevels[texId] = uint8_t(mipLevel);
+          }
+        }
+      }
+    }
+
+    #pragma omp critical
+    {
+      for (size_t texId = 0; texId < texMipLevels.size(); texId++)
+        m_texMipLevels[texId] = std::min(m_texMipLevels[texId], texMipLevels[texId]);
+    }
+  }
+
+  m_mipLevelDict.clear();
+  for (size_t texId = 0; texId < m_texMipLevels.size(); texId++)
+  {
+    if (m_texMipLevels[texId] != 0xFF)
+      m_mipLevelDict[uint32_t(texId)] = m_texMipLevels[texId];
+  }
+}
+
+HRRenderUpdateInfo RD_CPU_Utility::HaveUpdateNow(int /*a_maxRaysPerPixel*/)
+{
+  HRRenderUpdateInfo res;
+  res.finalUpdate  = true;
+  res.haveUpdateFB = true;
+  res.progress     = 100.0f;
+  return res;
+}
+
+IHRRenderDriver* CreateCPU_Utility_RenderDriver()
+{
+  return new RD_CPU_Utility;
+}
+
+std::unordered_map<uint32_t, uint32_t> getMipLevelsFromCPUUtilityDriver(IHRRenderDriver* driver)
+{
+  RD_CPU_Utility* utilityDrvRef = dynamic_cast<RD_CPU_Utility*>(driver);
+  if (utilityDrvRef == nullptr)
+    return std::unordered_map<uint32_t, uint32_t>();
+
+  return utilityDrvRef->GetMipLevelsDict();
+}
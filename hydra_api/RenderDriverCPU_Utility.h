@@ -0,0 +1,112 @@
+#ifndef HYDRAAPI_EX_RENDERDRIVERCPU_UTILITY_H
+#define HYDRAAPI_EX_RENDERDRIVERCPU_UTILITY_H
+
+#include "HydraRenderDriverAPI.h"
+#include "LiteMath.h"
+
+#include <vector>
+#include <unordered_map>
+
+/**
+\brief Headless replacement of RD_OGL32_Utility. Computes the same texId -> mipLevel dictionary without OpenGL context.
+
+Instead of rasterizing LOD buffer, for each instanced triangle we evaluate analytic (perspective correct) screen space derivatives
+of texture coordinates at its closest visible points (vertices and near plane intersections) and take the finest mip level over
+all triangles that use the texture. Occlusion is not taken into account, so the estimation is conservative (never coarser than GPU one).
+
+*/
+struct RD_CPU_Utility : IHRRenderDriver
+{
+  RD_CPU_Utility();
+
+  void ClearAll() override;
+  HRDriverAllocInfo AllocAll(HRDriverAllocInfo a_info) override;
+
+  bool UpdateImage(int32_t /*a_texId*/, int32_t /*w*/, int32_t /*h*/, int32_t /*bpp*/, const void* /*a_data*/, pugi::xml_node /*a_texNode*/) override { return true; }
+  bool UpdateMaterial(int32_t a_matId, pugi::xml_node a_materialNode) override;
+  bool UpdateLight(int32_t /*a_lightIdId*/, pugi::xml_node /*a_lightNode*/) override { return true; }
+
+  bool UpdateMesh(int32_t a_meshId, pugi::xml_node a_meshNode, const HRMeshDriverInput &a_input, const HRBatchInfo *a_batchList, int32_t a_listSize) override;
+
+  bool UpdateImageFromFile(int32_t /*a_texId*/, const wchar_t* /*a_fileName*/, pugi::xml_node /*a_texNode*/) override {return false;}
+  bool UpdateMeshFromFile(int32_t /*a_meshId*/, pugi::xml_node /*a_meshNode*/, const wchar_t* /*a_fileName*/) override {return false;}
+
+  bool UpdateCamera(pugi::xml_node a_camNode) override;
+  bool UpdateSettings(pugi::xml_node a_settingsNode) override;
+
+  /////////////////////////////////////////////////////////////////////////////////////////////
+
+  void BeginScene(pugi::xml_node a_sceneNode) override;
+  void EndScene() override;
+  void InstanceMeshes(int32_t a_mesh_id, const float* a_matrices, int32_t a_instNum, const int* a_lightInstId, const int* a_remapId, const int* a_realInstId) override;
+  void InstanceLights(int32_t /*a_light_id*/, const float* /*a_matrix*/, pugi::xml_node* /*a_custAttrArray*/, int32_t /*a_instNum*/, int32_t /*a_lightGroupId*/) override {}
+
+  void Draw() override {}
+
+  HRRenderUpdateInfo HaveUpdateNow(int a_maxRaysPerPixel) override;
+
+  void GetFrameBufferHDR(int32_t /*w*/, int32_t /*h*/, float*   /*a_out*/, const wchar_t* /*a_layerName*/) override {}
+  void GetFrameBufferLDR(int32_t /*w*/, int32_t /*h*/, int32_t* /*a_out*/) override {}
+
+  void GetGBufferLine(int32_t /*a_lineNumber*/, HRGBufferPixel* /*a_lineData*/, int32_t /*a_startX*/, int32_t /*a_endX*/, const std::unordered_set<int32_t>& /*a_shadowCatchers*/) override {}
+
+  HRDriverInfo Info() override;
+  const HRRenderDeviceInfoListElem* DeviceList() const override { return nullptr; }
+  bool EnableDevice(int32_t /*id*/, bool /*a_enable*/) override { return true; }
+
+  std::unordered_map<uint32_t, uint32_t> GetMipLevelsDict() const { return m_mipLevelDict; };
+
+  static constexpr int MATERIAL_TEX_SLOTS = 8; ///< same slots as in LOD buffer of RD_OGL32_Utility
+  static constexpr int MAX_MIP_LEVEL      = 4;
+
+protected:
+
+  struct MaterialTextures
+  {
+    int32_t texId [MATERIAL_TEX_SLOTS]; ///< -1 if slot is empty
+    float   matrix[MATERIAL_TEX_SLOTS][4];
+  };
+
+  struct MeshData
+  {
+    std::vector<HydraLiteMath::float3> pos;
+    std::vector<HydraLiteMath::float2> texCoord;
+    std::vector<int>                   indices;
+    std::vector<HRBatchInfo>           batches;
+  };
+
+  struct InstanceRecord
+  {
+    const MeshData* pMesh;
+    float           toView[12]; ///< 3x4 row-major (world to view) * (instance matrix)
+    int32_t         remapId;
+  };
+
+  std::vector<MaterialTextures>                          m_materials;
+  std::unordered_map<int32_t, MeshData>                  m_meshes;
+  std::vector<InstanceRecord>                            m_instances;
+  std::vector<std::unordered_map<int32_t, int32_t> >     m_remapLists;
+  std::vector<uint8_t>                                   m_texMipLevels;      ///< texId -> mipLevel; 0xFF if texture was not seen
+  std::unordered_map<uint32_t, uint32_t>                 m_mipLevelDict;      ///< texId -> mipLevel
+
+  // camera parameters
+  //
+  float camPos[3];
+  float camLookAt[3];
+  float camUp[3];
+
+  float camFov;
+  float camNearPlane;
+
+  int   m_settingsWidth;
+  int   m_settingsHeight;
+
+  // view basis and projection scale, evaluated in BeginScene
+  //
+  HydraLiteMath::float3 m_camRight, m_camUp, m_camForward;
+  float m_focalX, m_focalY;
+};
+
+std::unordered_map<uint32_t, uint32_t> getMipLevelsFromCPUUtilityDriver(IHRRenderDriver* driver);
+
+#endif //HYDRAAPI_EX_RENDERDRIVERCPU_UTILITY_H
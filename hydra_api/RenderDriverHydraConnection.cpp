@@ -85,6 +85,7 @@ struct RD_HydraConnection : public IHRRenderDriver
   void GetFrameBufferLDR(int32_t w, int32_t h, int32_t* a_out)                             override;
 
   void GetFrameBufferLineHDR(int32_t a_xBegin, int32_t a_xEnd, int32_t y, float* a_out, const wchar_t* a_layerName) override;
+  bool GetFrameBufferPassInfo(float* a_pSpp, int64_t* a_pPassId) override;
   void GetFrameBufferLineLDR(int32_t a_xBegin, int32_t a_xEnd, int32_t y, int32_t* a_out)                           override;
 
   void GetGBufferLine(int32_t a_lineNumber, HRGBufferPixel* a_lineData, int32_t a_startX, int32_t a_endX, const std::unordered_set<int32_t>& a_shadowCatchers) override;
@@ -139,6 +140,8 @@ protected:
   bool m_enableMLT = false;
   bool m_hideCmd   = false;
   bool m_needGbuff = false;
+  bool m_reportedTornFrame       = false; ///< warn about torn frame snapshot only once
+  bool m_reportedUnverifiedFrame = false; ///< warn only once that render process does not write frameSeq
 
   struct RenderPresets
   {
@@ -835,19 +838,22 @@ HRRenderUpdateInfo RD_HydraConnection::HaveUpdateNow(int a_maxRaysPerPixel)
   if(pHeader == nullptr)
     return result;
 
-  if (pHeader->counterRcv == m_oldCounter)
+  const int   counterRcv = hr_read_shared(pHeader->counterRcv); // read shared values once, render process may change them any time
+  const float spp        = hr_read_shared(pHeader->spp);
+
+  if (counterRcv == m_oldCounter)
   {
     result.haveUpdateFB  = false;
     result.haveUpdateMSG = false;
   }
   else
   {
-    result.haveUpdateFB = fabs(m_oldSPP - m_pSharedImage->Header()->spp) > 1e-5f;
-    result.progress     = 100.0f*m_pSharedImage->Header()->spp / float(a_maxRaysPerPixel);
+    result.haveUpdateFB = fabs(m_oldSPP - spp) > 1e-5f;
+    result.progress     = 100.0f*spp / float(a_maxRaysPerPixel);
     if(m_enableMLT)
       result.progress *= (2.0f); // MMLT sample indirect light 2 times more than direct light.
-    m_oldCounter        = pHeader->counterRcv;
-    m_oldSPP            = m_pSharedImage->Header()->spp;
+    m_oldCounter        = counterRcv;
+    m_oldSPP            = spp;
   }
 
   result.finalUpdate = (result.progress >= 100.0f);
@@ -965,12 +971,15 @@ void RD_HydraConnection::GetFrameBufferLineHDR(int32_t a_xBegin, int32_t a_xEnd,
   if (data == nullptr)
     return;
 
-  if (m_pSharedImage->Header()->counterRcv == 0 || m_pSharedImage->Header()->spp < 1e-5f)
+  if (m_pSharedImage->Header()->counterRcv == 0 || m_pSharedImage->Header()->spp < 1e-5f) // image is still empty, don't leave old content in a_out
+  {
+    memset(a_out, 0, size_t(a_xEnd - a_xBegin)*4*sizeof(float));
     return;
+  }
 
   data = data + y*m_width*4;
 
-  const float invSpp = m_enableMLT ? 1.0f : 1.0f / m_pSharedImage->Header()->spp;
+  const float invSpp = m_enableMLT ? 1.0f : 1.0f / m_pSharedImage->Header()->spp; // single line may be torn; use GetFrameBufferHDR for whole frame snapshot
   const __m128 mult  = _mm_set_ps1(invSpp);
   auto intptr        = reinterpret_cast<std::uintptr_t>(data);
 
@@ -1069,13 +1078,105 @@ void RD_HydraConnection::GetFrameBufferLineLDR(int32_t a_xBegin, int32_t a_xEnd,
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+HR_SHARED_READ_STATUS IHRSharedAccumImage::ReadLayerNormalized(int a_layerId, float* a_out, float* a_pSpp, int a_maxAttempts)
+{
+  HRSharedBufferHeader* pHeader = Header();
+  if (pHeader == nullptr || a_out == nullptr || a_maxAttempts <= 0)
+    return HR_SHARED_READ_EMPTY;
+
+  const int width  = pHeader->width;
+  const int height = pHeader->height;
+
+  for (int attempt = 0; attempt < a_maxAttempts; attempt++)
+  {
+    const int   seq0     = hr_read_shared(pHeader->frameSeq);
+    const int   counter0 = hr_read_shared(pHeader->counterRcv);
+    const float spp      = hr_read_shared(pHeader->spp);
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (counter0 == 0 || spp < 1e-5f)
+      return HR_SHARED_READ_EMPTY;
+
+    if (a_pSpp != nullptr)
+      (*a_pSpp) = spp;
+
+    const bool lastAttempt = (attempt == a_maxAttempts - 1);
+    if ((seq0 & 1) != 0 && !lastAttempt) // render process is writing image now
+    {
+      std::this_thread::yield();
+      continue;
+    }
+
+    const float* data  = ImageData(a_layerId);
+    const float  scale = 1.0f / spp;
+
+    #pragma omp parallel for
+    for (int y = 0; y < height; y++)
+    {
+      const float* lineIn  = data  + int64_t(y)*int64_t(width)*4;
+      float*       lineOut = a_out + int64_t(y)*int64_t(width)*4;
+      for (int x = 0; x < width*4; x++)
+        lineOut[x] = lineIn[x]*scale;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if ((seq0 & 1) == 0 && hr_read_shared(pHeader->frameSeq) == seq0 && hr_read_shared(pHeader->counterRcv) == counter0 && hr_read_shared(pHeader->spp) == spp)
+      return (seq0 == 0) ? HR_SHARED_READ_UNVERIFIED : HR_SHARED_READ_OK; // frameSeq is still 0 after first pass => render process does not write it
+  }
+
+  return HR_SHARED_READ_TORN;
+}
+
 void RD_HydraConnection::GetFrameBufferHDR(int32_t w, int32_t h, float* a_out, const wchar_t* a_layerName)
 {
+  if (m_pSharedImage == nullptr)
+    return;
+
+  // whole frame snapshot that is consistent with single spp value; render process is not blocked
+  //
+  if (!m_enableMLT && w == m_width && h == m_height)
+  {
+    const HR_SHARED_READ_STATUS status = m_pSharedImage->ReadLayerNormalized(0, a_out);  // index depends on a_layerName
+    if (status == HR_SHARED_READ_EMPTY)
+      memset(a_out, 0, size_t(w)*size_t(h)*4*sizeof(float));
+    else if (status == HR_SHARED_READ_TORN && !m_reportedTornFrame)
+    {
+      std::cerr << "RD_HydraConnection::GetFrameBufferHDR, render process updates image faster than it can be copied; frame may mix two passes" << std::endl;
+      m_reportedTornFrame = true;
+    }
+    else if (status == HR_SHARED_READ_UNVERIFIED && !m_reportedUnverifiedFrame)
+    {
+      std::cerr << "RD_HydraConnection::GetFrameBufferHDR, render process does not mark frame writes (frameSeq); frame consistency can't be checked" << std::endl;
+      m_reportedUnverifiedFrame = true;
+    }
+    return;
+  }
+
   #pragma omp parallel for
   for (int y = 0; y < h; y++)
     GetFrameBufferLineHDR(0, w, y, a_out + y * w * 4, a_layerName);
 }
 
+bool RD_HydraConnection::GetFrameBufferPassInfo(float* a_pSpp, int64_t* a_pPassId)
+{
+  if (m_pSharedImage == nullptr || m_pSharedImage->Header() == nullptr || m_enableMLT) // MLT image is not normalized by spp
+    return false;
+
+  // same words as ReadLayerNormalized checks; render process accumulates whole frame passes, so there is no per tile spp.
+  // if render process does not write frameSeq, it stays 0 and only counterRcv tells passes apart
+  //
+  const HRSharedBufferHeader* pHeader = m_pSharedImage->Header();
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const int seq     = hr_read_shared(pHeader->frameSeq);
+  const int counter = hr_read_shared(pHeader->counterRcv);
+  (*a_pSpp)         = hr_read_shared(pHeader->spp);
+  std::atomic_thread_fence(std::memory_order_acquire);
+
+  (*a_pPassId) = ((seq & 1) != 0) ? int64_t(-1) : (int64_t(uint32_t(counter)) << 32) | int64_t(uint32_t(seq));
+  return true;
+}
+
 void RD_HydraConnection::GetFrameBufferLDR(int32_t w, int32_t h, int32_t* a_out)
 {
   #pragma omp parallel for
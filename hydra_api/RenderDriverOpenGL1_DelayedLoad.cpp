@@ -2,6 +2,7 @@
 #include <iostream>
 
 #include "HydraObjectManager.h"
+#include "HydraChunkCompression.h"
 
 #pragma warning(disable:4996)
 
@@ -66,13 +67,7 @@ bool RD_OGL1_Plain_DelayedLoad::UpdateImageFromFile(int32_t a_texId, const wchar
 
   if (fname2.find(L".image4ub") != std::wstring::npos)
   {
-#if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
-    std::wstring s1(a_fileName);
-    std::string  s2(s1.begin(), s1.end());
-    std::ifstream fin(s2.c_str(), std::ios::binary);
-#elif defined WIN32
-    std::ifstream fin(a_fileName, std::ios::binary);
-#endif
+    HydraChunkStream fin(a_fileName);
     if (fin.is_open())
     {
       int32_t wh[2];
@@ -3,8 +3,9 @@
 
 #include <algorithm>
 #include <fstream>
-#include <sstream>
-#include <iomanip>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 #if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
 #include <sys/mman.h>
@@ -15,6 +16,9 @@
 
 #include <cmath>
 
+#include "xxhash.h"
+#include "HydraChunkCompression.h"
+
 static constexpr bool gDebugMode     = true;
 static constexpr bool gCopyCollector = false;
 
@@ -42,6 +46,176 @@ inline uint64_t roundBlocks(uint64_t elems, int threadsPerBlock)
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+static bool WriteChunkFile(const std::wstring& a_path, const char* a_data, uint64_t a_sizeInBytes, bool a_compress)
+{
+  std::vector<char> packed;
+  if (a_compress && CompressChunkData(a_data, a_sizeInBytes, packed)) // write raw data if it does not compress
+  {
+    a_data        = packed.data();
+    a_sizeInBytes = packed.size();
+  }
+
+#if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
+  std::string s2(a_path.begin(), a_path.end());
+  std::ofstream fout(s2.c_str(), std::ios::binary);
+#elif defined WIN32
+  std::ofstream fout(a_path.c_str(), std::ios::binary);
+#endif
+  fout.write(a_data, a_sizeInBytes);
+  fout.close();
+  return !fout.fail();
+}
+
+static bool ChunkTypeIsCompressible(CHUNK_TYPE a_type)
+{
+  return (a_type == CHUNK_TYPE_VSGF || a_type == CHUNK_TYPE_IMAGE4UB || a_type == CHUNK_TYPE_IMAGE4F || a_type == CHUNK_TYPE_IMAGE4HF);
+}
+
+/**
+\brief Write-behind for chunks that leave the cache. SwapToDisk only copies chunk data to the queue and returns; 
+       the copy is released when the writer thread has put it to file. Until then SwapToMemory takes chunk data from here.
+       The queue is bounded by bytes, so when disk can't keep up, SwapToDisk waits instead of eating memory.
+
+*/
+struct ChunkWriteBehind
+{
+  explicit ChunkWriteBehind(uint64_t a_maxQueuedBytes) : m_maxQueuedBytes(a_maxQueuedBytes), m_queuedBytes(0), m_jobsNum(0), m_stop(false)
+  {
+    m_thread = std::thread(&ChunkWriteBehind::Run, this);
+  }
+
+  ~ChunkWriteBehind()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_workCV.notify_all();
+    m_thread.join(); // Run writes everything that is left in queue before exit
+  }
+
+  void Push(size_t a_id, const std::wstring& a_path, const char* a_data, uint64_t a_sizeInBytes, bool a_copy, bool a_compress); ///< a_copy == false only if caller waits for writes before cache is changed
+  bool IsPending(size_t a_id);
+  bool ReadPending(size_t a_id, char* a_out, uint64_t a_sizeInBytes);                                         ///< false if chunk is not in queue (already on disk)
+  void Wait(std::vector<std::wstring>& a_failed);                                                               ///< wait for empty queue; a_failed gets files that were not written
+
+protected:
+
+  struct Job
+  {
+    size_t            id;
+    std::wstring      path;
+    std::vector<char> copy;
+    const char*       data; ///< points to 'copy' or directly to cache memory
+    uint64_t          sizeInBytes;
+    bool              compress;
+  };
+
+  void Run();
+
+  std::mutex              m_mutex;
+  std::condition_variable m_workCV;  ///< job was pushed or m_stop is set
+  std::condition_variable m_doneCV;  ///< job was finished
+
+  std::deque<std::shared_ptr<Job> >                 m_queue;
+  std::unordered_map<size_t, std::shared_ptr<Job> > m_pending; ///< chunk id --> last job that writes this chunk (queued or being written)
+  std::vector<std::wstring>                         m_failed;
+
+  uint64_t    m_maxQueuedBytes;
+  uint64_t    m_queuedBytes; ///< bytes of queued jobs and job that is being written
+  size_t      m_jobsNum;
+  bool        m_stop;
+  std::thread m_thread;
+};
+
+void ChunkWriteBehind::Push(size_t a_id, const std::wstring& a_path, const char* a_data, uint64_t a_sizeInBytes, bool a_copy, bool a_compress)
+{
+  auto job         = std::make_shared<Job>();
+  job->id          = a_id;
+  job->path        = a_path;
+  job->sizeInBytes = a_sizeInBytes;
+  job->data        = a_data;
+  job->compress    = a_compress;
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCV.wait(lock, [&]() { return m_queuedBytes == 0 || m_queuedBytes + a_sizeInBytes <= m_maxQueuedBytes; });
+    m_queuedBytes += a_sizeInBytes; // reserve place in queue; there is single producer (API thread), so copy can be done without lock
+    m_jobsNum++;
+  }
+
+  if (a_copy)
+  {
+    job->copy.assign(a_data, a_data + a_sizeInBytes);
+    job->data = job->copy.data();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.push_back(job);
+    m_pending[a_id] = job;
+  }
+  m_workCV.notify_one();
+}
+
+bool ChunkWriteBehind::IsPending(size_t a_id)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_pending.find(a_id) != m_pending.end();
+}
+
+bool ChunkWriteBehind::ReadPending(size_t a_id, char* a_out, uint64_t a_sizeInBytes)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto p = m_pending.find(a_id);
+  if (p == m_pending.end() || p->second->sizeInBytes != a_sizeInBytes)
+    return false;
+  memcpy(a_out, p->second->data, size_t(a_sizeInBytes));
+  return true;
+}
+
+void ChunkWriteBehind::Wait(std::vector<std::wstring>& a_failed)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_doneCV.wait(lock, [this]() { return m_jobsNum == 0; });
+  a_failed.swap(m_failed);
+  m_failed.clear();
+}
+
+void ChunkWriteBehind::Run()
+{
+  while (true)
+  {
+    std::shared_ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_workCV.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+      if (m_queue.empty())
+        return;
+      job = m_queue.front();
+      m_queue.pop_front();
+    }
+
+    const bool written = WriteChunkFile(job->path, job->data, job->sizeInBytes, job->compress);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto p = m_pending.find(job->id);
+      if (p != m_pending.end() && p->second == job)
+        m_pending.erase(p);
+      if (!written)
+        m_failed.push_back(job->path);
+      m_queuedBytes -= job->sizeInBytes;
+      m_jobsNum--;
+    }
+    m_doneCV.notify_all();
+    // chunk copy is released here, after it is on disk
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 
 bool VirtualBuffer::Init(uint64_t a_sizeInBytes, const char* a_shmemName, std::vector<int>* a_pTempBuffer, HRSystemMutex* a_mutex)
 {
@@ -256,6 +430,8 @@ void VirtualBuffer::RestoreChunks()
 
 void VirtualBuffer::Destroy()
 {
+  SetWriteBehind(0);
+
   if (m_data == nullptr)
     return;
 
@@ -283,6 +459,8 @@ void VirtualBuffer::Destroy()
 
 void VirtualBuffer::Clear()
 {
+  WaitForWrites(); // queued chunks belong to previous scene library and their ids will be reused
+
   m_dataHalfCurr = (char*)m_data;
   m_dataHalfFree = m_dataHalfCurr + m_totalSize/2;
 
@@ -292,6 +470,10 @@ void VirtualBuffer::Clear()
 
   m_allChunks.clear();
   m_chunksIdInMemory.clear();
+  m_chunkByContent.clear();
+  m_pinnedChunks.clear();
+  m_pagedInBytes = 0;
+  m_clockHand    = 0;
 }
 
 char* VirtualBuffer::AllocInCacheNow(uint64_t a_sizeInBytes)
@@ -334,7 +516,7 @@ void* VirtualBuffer::AllocInCache(uint64_t a_sizeInBytes)
     }
     else // this object is too big. We can not allocate memory here. Need to store it on disk.
     {
-      std::cerr << "VirtualBuffer::AllocInCache : the object is too big! gCopyCollector = " << int(gCopyCollector) << std::endl;
+      HrError(L"VirtualBuffer::AllocInCache : the object is too big! gCopyCollector = ", int(gCopyCollector));
       return nullptr;
     }
   }
@@ -345,26 +527,17 @@ void* VirtualBuffer::AllocInCache(uint64_t a_sizeInBytes)
     
     if (a_sizeInBytes < maxAllowedSize) // swap old objects to disc and put a new object to free memory 
     {
-      if(m_pVBMutex!=nullptr)
-        hr_lock_system_mutex(m_pVBMutex, VB_LOCK_WAIT_TIME_MS);
-      
-      RunCollector(div);
-  
-      int64_t* chunkTable = ChunksTablePtr(); // we need to clear table right after collector works, because old data is invalid!
-      if(chunkTable != nullptr)               // we can do better of cource here, but clearing should be enought to work corretcly
+      RunCollectorLocked(a_sizeInBytes + 1, 0);
+      if (a_sizeInBytes >= m_totalSize - m_currTop) // pinned chunks may hold the space
       {
-        for(size_t i=0;i<size();i++)
-          chunkTable[i] = int64_t(-1);
+        HrError(L"VirtualBuffer::AllocInCache : no room for the object, pinned chunks = ", m_pinnedChunks.size());
+        return nullptr;
       }
-      
-      if(m_pVBMutex!=nullptr)
-        hr_unlock_system_mutex(m_pVBMutex);
-
       return AllocInCacheNow(a_sizeInBytes);
     }
     else // this object is too big. We can not allocate memory here. Need to store it on disk.
     {
-      std::cerr << "VirtualBuffer::AllocInCache : the object is too big! gCopyCollector = " << int(gCopyCollector) << std::endl;
+      HrError(L"VirtualBuffer::AllocInCache : the object is too big! gCopyCollector = ", int(gCopyCollector));
       return nullptr;
     }
     
@@ -373,6 +546,17 @@ void* VirtualBuffer::AllocInCache(uint64_t a_sizeInBytes)
 
 }
 
+void VirtualBuffer::RunCollectorLocked(uint64_t a_bytesToFree, uint64_t a_pagedInBytesToEvict)
+{
+  if(m_pVBMutex!=nullptr)
+    hr_lock_system_mutex(m_pVBMutex, VB_LOCK_WAIT_TIME_MS);
+
+  RunCollector(a_bytesToFree, a_pagedInBytesToEvict); // updates chunk table entries of moved and evicted chunks itself
+
+  if(m_pVBMutex!=nullptr)
+    hr_unlock_system_mutex(m_pVBMutex);
+}
+
 void VirtualBuffer::ResizeAndAllocEmptyChunks(uint64_t a_ckunksNum)
 {
   m_allChunks.resize(a_ckunksNum);
@@ -384,10 +568,146 @@ void VirtualBuffer::ResizeAndAllocEmptyChunks(uint64_t a_ckunksNum)
     m_allChunks[i].sizeInBytes  = 0;
     m_allChunks[i].useCounter   = 0;
     m_allChunks[i].inUse        = false;
+    m_allChunks[i].pagedIn      = false;
+    m_allChunks[i].pinned       = false;
   }
+  m_pinnedChunks.clear();
 
 }
 
+void VirtualBuffer::RegisterChunkOnDisk(size_t a_id, uint64_t a_sizeInBytes, CHUNK_TYPE a_type)
+{
+  if (a_id >= m_allChunks.size())
+    return;
+
+  ChunkPointer& chunk = m_allChunks[a_id];
+  chunk.pVB          = this;
+  chunk.localAddress = uint64_t(-1);
+  chunk.sizeInBytes  = a_sizeInBytes;
+  chunk.type         = a_type;
+  chunk.wasSaved     = true;
+}
+
+void VirtualBuffer::SetDemandPaging(bool a_enable, uint64_t a_residentBudget)
+{
+  m_demandPaging   = a_enable;
+  m_residentBudget = a_residentBudget;
+  m_pagedInBytes   = 0;
+
+  for (auto& chunk : m_allChunks)
+    chunk.pagedIn = false;
+}
+
+void VirtualBuffer::PinChunk(size_t a_id)
+{
+  if (m_pinScopes == 0 || a_id >= m_allChunks.size() || m_allChunks[a_id].pinned)
+    return;
+  m_allChunks[a_id].pinned = true;
+  m_pinnedChunks.push_back(a_id);
+}
+
+void VirtualBuffer::EndPinScope(size_t a_mark)
+{
+  if (m_pinScopes > 0)
+    m_pinScopes--;
+
+  for (size_t i = a_mark; i < m_pinnedChunks.size(); i++) // Clear() may have emptied the list meanwhile
+  {
+    const size_t id = m_pinnedChunks[i];
+    if (id < m_allChunks.size())
+      m_allChunks[id].pinned = false;
+  }
+
+  if (a_mark < m_pinnedChunks.size())
+    m_pinnedChunks.resize(a_mark);
+}
+
+void VirtualBuffer::SetWriteBehind(uint64_t a_maxQueuedBytes)
+{
+  WaitForWrites();
+  delete m_pWriter;
+  m_pWriter = (a_maxQueuedBytes != 0) ? new ChunkWriteBehind(a_maxQueuedBytes) : nullptr;
+}
+
+void VirtualBuffer::WaitForWrites()
+{
+  if (m_pWriter == nullptr)
+    return;
+
+  std::vector<std::wstring> failed;
+  m_pWriter->Wait(failed);
+
+  for (const auto& path : failed)
+    HrError(L"VirtualBuffer::WaitForWrites, failed to write chunk file ", path.c_str());
+}
+
+void* VirtualBuffer::SwapToMemory(size_t a_id)
+{
+  if (!m_demandPaging || !m_owner || a_id >= m_allChunks.size())
+    return nullptr;
+
+  if (m_allChunks[a_id].InMemory())
+    return m_dataHalfCurr + m_allChunks[a_id].localAddress;
+
+  if (!m_allChunks[a_id].wasSaved || m_allChunks[a_id].sizeInBytes == 0) // nothing to read back
+    return nullptr;
+
+  const uint64_t sizeInBytes = m_allChunks[a_id].sizeInBytes;
+  const std::wstring name    = ChunkName(m_allChunks[a_id]);
+  const bool pendingWrite    = (m_pWriter != nullptr) && m_pWriter->IsPending(a_id); // chunk file may be incomplete yet
+
+  HydraChunkStream fin; // compressed chunk file is decoded here
+  if (!pendingWrite)
+  {
+    fin.open(name);
+    if (!fin.is_open())
+      return nullptr;
+  }
+
+  // (1) if paged in chunks would exceed residency budget, evict paged in chunks (CLOCK decides which of them) until new one fits;
+  //     this does not depend on free space in cache
+  //
+  const uint64_t budget = (m_residentBudget == 0) ? m_totalSize / 2 : m_residentBudget;
+  if (m_pagedInBytes + sizeInBytes > budget && m_pagedInBytes != 0)
+    RunCollectorLocked(0, m_pagedInBytes + sizeInBytes - budget);
+
+  // (2) alloc memory for chunk; note that collector may run inside AllocInCache
+  //
+  char* memory = (char*)AllocInCache(sizeInBytes);
+  if (memory == nullptr)
+    return nullptr;
+
+  bool readOk = pendingWrite && m_pWriter->ReadPending(a_id, memory, sizeInBytes);
+  if (!readOk)
+  {
+    if (!fin.is_open())
+      fin.open(name); // write was finished after IsPending
+    fin.read(memory, sizeInBytes);
+    readOk = (uint64_t(fin.gcount()) == sizeInBytes);
+  }
+
+  if (!readOk)
+  {
+    m_currTop            -= sizeInBytes; // chunk was the last allocation, so just roll it back
+    m_totalSizeAllocated -= sizeInBytes;
+    HrError(L"VirtualBuffer::SwapToMemory, failed to read chunk from file ", name.c_str());
+    return nullptr;
+  }
+
+  ChunkPointer& chunk = m_allChunks[a_id];
+  chunk.localAddress  = uint64_t(memory - m_dataHalfCurr);
+  chunk.useCounter    = 1;                                 // chunk was just accessed
+  chunk.pagedIn       = true;
+  m_chunksIdInMemory.push_back(a_id);
+  m_pagedInBytes += sizeInBytes;
+
+  int64_t* chunkTable = ChunksTablePtr();
+  if (chunkTable != nullptr && a_id < VB_CHUNK_TABLE_SIZE/sizeof(int64_t))
+    chunkTable[a_id] = int64_t(chunk.localAddress);
+
+  return memory;
+}
+
 size_t VirtualBuffer::AllocChunk(uint64_t a_dataSizeInBytes, uint64_t a_objId)
 {
   ChunkPointer result(this);
@@ -401,11 +721,9 @@ size_t VirtualBuffer::AllocChunk(uint64_t a_dataSizeInBytes, uint64_t a_objId)
     return size_t(-1);
   }
 
-  float startCounter   = fmaxf(100.0f/fmax(log(float(a_dataSizeInBytes)), 1.0f), 0.0f); // we want small objects to be mostly in cache
-
   result.localAddress  = ((char*)memory) - m_dataHalfCurr;
   result.sizeInBytes   = a_dataSizeInBytes;
-  result.useCounter    = (uint32_t)(startCounter*100.0f);
+  result.useCounter    = 1; // new chunk is going to be filled right now
   result.inUse         = true;
 
   m_chunksIdInMemory.push_back(result.id);
@@ -414,6 +732,55 @@ size_t VirtualBuffer::AllocChunk(uint64_t a_dataSizeInBytes, uint64_t a_objId)
   return result.id;
 }
 
+size_t VirtualBuffer::DeduplicateChunk(size_t a_id)
+{
+  if (!m_dedup || a_id >= m_allChunks.size() || !m_allChunks[a_id].InMemory())
+    return a_id;
+
+  const ChunkPointer chunk = m_allChunks[a_id];
+  const char* data         = m_dataHalfCurr + chunk.localAddress;
+
+  XXH64_state_t hashState;
+  XXH64_reset (&hashState, 0);
+  XXH64_update(&hashState, &chunk.type, sizeof(chunk.type));
+  XXH64_update(&hashState, &chunk.sizeInBytes, sizeof(chunk.sizeInBytes));
+  XXH64_update(&hashState, data, size_t(chunk.sizeInBytes));
+  const uint64_t hash = XXH64_digest(&hashState);
+
+  // compare data only with chunks that are in cache now; we must not swap anything here because 'a_id' may be moved by collector
+  //
+  auto range = m_chunkByContent.equal_range(hash);
+  for (auto p = range.first; p != range.second; ++p)
+  {
+    const ChunkPointer& other = m_allChunks[p->second];
+    if (other.type != chunk.type || other.sizeInBytes != chunk.sizeInBytes || !other.InMemory())
+      continue;
+
+    if (memcmp(m_dataHalfCurr + other.localAddress, data, size_t(chunk.sizeInBytes)) != 0)
+      continue;
+
+    // chunk was the last allocation, so just roll it back; otherwise leave it unused, so it will never be saved
+    //
+    if (a_id + 1 == m_allChunks.size() && chunk.localAddress + chunk.sizeInBytes == m_currTop)
+    {
+      m_currTop            -= chunk.sizeInBytes;
+      m_totalSizeAllocated -= chunk.sizeInBytes;
+      m_allChunks.pop_back();
+      auto pos = std::find(m_chunksIdInMemory.begin(), m_chunksIdInMemory.end(), a_id);
+      if (pos != m_chunksIdInMemory.end())
+        m_chunksIdInMemory.erase(pos);
+    }
+    else
+      m_allChunks[a_id].inUse = false;
+
+    TouchChunk(p->second); // shared chunk is more valuable for cache
+    return p->second;
+  }
+
+  m_chunkByContent.emplace(hash, a_id);
+  return a_id;
+}
+
 void VirtualBuffer::RunCopyingCollector()
 {
   // (1)  we must decide wich objects we can handle in memory
@@ -464,6 +831,11 @@ void VirtualBuffer::RunCopyingCollector()
     size_t id = currChunksInMemory[i];
     m_allChunks[id].SwapToDisk();
     m_allChunks[id].localAddress = uint64_t(-1);
+    if (m_allChunks[id].pagedIn)
+    {
+      m_allChunks[id].pagedIn = false;
+      m_pagedInBytes         -= m_allChunks[id].sizeInBytes;
+    }
   }
 
 
@@ -475,74 +847,125 @@ void VirtualBuffer::RunCopyingCollector()
   m_currTop      = top;
 }
 
-void VirtualBuffer::RunCollector(int a_divisor)
+void VirtualBuffer::RunCollector(uint64_t a_bytesToFree, uint64_t a_pagedInBytesToEvict)
 {
-  // (1)  we must decide wich objects we can handle in memory
-  // sort currChunksInMemory by m_allChunks[i].useCounter
+  // (1) CLOCK: sweep through chunks in cache; recently used chunks lose one reference and survive, others are evicted.
+  //     Two independent goals: evicted bytes together with free space at the top are enough for a_bytesToFree (plus some slack to not run collector on every allocation),
+  //     and at least a_pagedInBytesToEvict bytes of paged in chunks are evicted (residency budget); while only the second goal is left, only paged in chunks are candidates.
+  //     Pinned chunks are never candidates.
   //
-  struct CompareIds
-  {
-    CompareIds(VirtualBuffer* a_pVB) : pVB(a_pVB) { }
-    bool operator()(size_t a, size_t b) const { return pVB->chunk_at(a).useCounter > pVB->chunk_at(b).useCounter; }
-    VirtualBuffer* pVB;
-  };
+  auto byAddress = [this](size_t a, size_t b) { return m_allChunks[a].localAddress < m_allChunks[b].localAddress; };
+  if (!std::is_sorted(m_chunksIdInMemory.begin(), m_chunksIdInMemory.end(), byAddress)) // new chunks are appended at the top, so it is sorted almost always
+    std::sort(m_chunksIdInMemory.begin(), m_chunksIdInMemory.end(), byAddress);
 
-  std::sort(m_chunksIdInMemory.begin(), m_chunksIdInMemory.end(), CompareIds(this));
+  const size_t   chunksNum   = m_chunksIdInMemory.size();
+  const uint64_t freeNow     = m_totalSize - m_currTop;
+  const uint64_t spaceTarget = (a_bytesToFree == 0) ? 0 : a_bytesToFree + m_totalSize/64;
 
-  std::vector<size_t> currChunksInMemory = m_chunksIdInMemory;
-  m_chunksIdInMemory.clear();
+  std::vector<char> evict(chunksNum, 0);
+  uint64_t evictedBytes   = 0;
+  uint64_t evictedPagedIn = 0;
+  size_t   evictedNum     = 0;
+  size_t   hand           = (m_clockHand < chunksNum) ? m_clockHand : 0;
 
-  // (2) sweep throught currChunksInMemory to copy 1/8 of the buffer size to tempBuffer
-  //
-  size_t top = 0;
-  size_t curAccumulatedMemory = 0;
-  size_t maxAccumulatedMemory = m_totalSize / a_divisor;
-
-  if (m_pTempBuffer->size() < maxAccumulatedMemory)
-    m_pTempBuffer->resize( maxAccumulatedMemory/sizeof(int) + 1);
-
-  char* dataTemp = (char*)m_pTempBuffer->data();
+  const size_t maxSteps = chunksNum*(CHUNK_MAX_USE_COUNTER + 2); // after that every candidate has lost all references and was evicted
 
-  size_t i = 0;
-  for (; i < currChunksInMemory.size(); i++)
+  for (size_t step = 0; step < maxSteps && evictedNum < chunksNum; step++)
   {
-    size_t id = currChunksInMemory[i];
-    uint64_t totalSizeInBytes = m_allChunks[id].sizeInBytes;
-
-    curAccumulatedMemory += totalSizeInBytes; 
-    if (curAccumulatedMemory > maxAccumulatedMemory)
+    const bool needSpace  = (freeNow + evictedBytes < spaceTarget);
+    const bool needBudget = (evictedPagedIn < a_pagedInBytesToEvict);
+    if (!needSpace && !needBudget)
       break;
-    
-    memcpy(dataTemp + top, m_dataHalfCurr + m_allChunks[id].localAddress, totalSizeInBytes);  // copy chunk from m_dataHalfCurr to m_dataHalfFree
-    
-    m_allChunks[id].localAddress = top; // alternate it's address because now this chunk is in different location;
-    m_chunksIdInMemory.push_back(id);
-    top += totalSizeInBytes;
+
+    ChunkPointer& chunk = m_allChunks[m_chunksIdInMemory[hand]];
+    if (!evict[hand] && !chunk.pinned && (needSpace || chunk.pagedIn))
+    {
+      if (chunk.useCounter > 0 && chunk.inUse)
+        chunk.useCounter = chunk.useCounter - 1;
+      else
+      {
+        evict[hand]   = 1;
+        evictedBytes += chunk.sizeInBytes;
+        evictedNum++;
+        if (chunk.pagedIn)
+          evictedPagedIn += chunk.sizeInBytes;
+      }
+    }
+    hand = (hand + 1) % chunksNum;
   }
 
-  // (3) swap other chunks to disk
+  // (2) swap evicted chunks to disk and slide survivors down (m_chunksIdInMemory is sorted by address, so memmove never overwrites survivor);
+  //     pinned chunks stay where they are and survivors after them are slid down only to their end;
+  //     chunk table entries are updated only for chunks that were actually moved or evicted
   //
-  for (; i < currChunksInMemory.size(); i++)
+  int64_t* chunkTable  = ChunksTablePtr();
+  const size_t tableSize = VB_CHUNK_TABLE_SIZE/sizeof(int64_t);
+
+  std::vector<size_t> survivors;
+  survivors.reserve(chunksNum - evictedNum);
+
+  uint64_t top     = 0;
+  size_t   newHand = 0;
+
+  for (size_t i = 0; i < chunksNum; i++)
   {
-    size_t id = currChunksInMemory[i];
-    m_allChunks[id].SwapToDisk();
-    m_allChunks[id].localAddress = uint64_t(-1);
-  }
+    const size_t id     = m_chunksIdInMemory[i];
+    ChunkPointer& chunk = m_allChunks[id];
 
-  // (4) copy chunks from tempBuffer to 
-  //
-  memcpy(m_dataHalfCurr, dataTemp, top);
+    if (i == hand)
+      newHand = survivors.size();
 
-  if (m_pTempBuffer->size() > maxAccumulatedMemory) // free unneccesary memory of tempBuffer it it was allocated previously too much
-    (*m_pTempBuffer) = std::vector<int>();
+    if (evict[i])
+    {
+      chunk.SwapToDisk();
+      chunk.localAddress = uint64_t(-1);
+      chunk.pagedIn      = false;
+      if (chunkTable != nullptr && id < tableSize)
+        chunkTable[id] = int64_t(-1);
+      continue;
+    }
+
+    if (chunk.pinned)
+      top = chunk.localAddress;
+    else if (chunk.localAddress != top)
+    {
+      memmove(m_dataHalfCurr + top, m_dataHalfCurr + chunk.localAddress, size_t(chunk.sizeInBytes));
+      chunk.localAddress = top;
+      if (chunkTable != nullptr && id < tableSize)
+        chunkTable[id] = int64_t(top);
+    }
 
-  m_currTop = top;
+    top += chunk.sizeInBytes;
+    survivors.push_back(id);
+  }
+
+  m_chunksIdInMemory = survivors;
+  m_clockHand        = newHand;
+  m_currTop          = top;
+  m_pagedInBytes    -= evictedPagedIn;
 }
 
 void VirtualBuffer::FlushToDisc()
 {
+  if (m_pWriter == nullptr)
+  {
+    for (size_t id : m_chunksIdInMemory)
+      m_allChunks[id].SwapToDisk();
+    return;
+  }
+
+  // cache is not changed until WaitForWrites returns, so writer can take data directly from cache without copy
+  //
   for (size_t id : m_chunksIdInMemory)
-    m_allChunks[id].SwapToDisk();
+  {
+    ChunkPointer& chunk = m_allChunks[id];
+    if (!chunk.inUse || chunk.wasSaved)
+      continue;
+    m_pWriter->Push(id, ChunkName(chunk), m_dataHalfCurr + chunk.localAddress, chunk.sizeInBytes, false, m_compress && ChunkTypeIsCompressible(chunk.type));
+    chunk.wasSaved = true;
+  }
+
+  WaitForWrites();
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -551,26 +974,26 @@ void VirtualBuffer::FlushToDisc()
 
 void* ChunkPointer::GetMemoryNow()
 {
-  if (InMemory())
-  {
-    return pVB->m_dataHalfCurr + localAddress;
-  }
-  else
-  {
-    return nullptr; // #TODO: Swap chunk to memory (m_tempBuffer) and get fucking pointer
-  }
+  return (void*)((const ChunkPointer*)this)->GetMemoryNow();
 }
 
 const void* ChunkPointer::GetMemoryNow() const
 {
   if (InMemory())
   {
+    pVB->TouchChunk(size_t(id));
+    pVB->PinChunk(size_t(id));
     return pVB->m_dataHalfCurr + localAddress;
   }
-  else
+  else if (pVB != nullptr)
   {
-    return nullptr; // #TODO: Swap chunk to memory (m_tempBuffer) and get fucking pointer
+    void* memory = pVB->SwapToMemory(size_t(id)); // return nullptr if demand paging is disabled
+    if (memory != nullptr)
+      pVB->PinChunk(size_t(id));
+    return memory;
   }
+  else
+    return nullptr;
 }
 
 extern HRObjectManager g_objManager;
@@ -580,26 +1003,34 @@ std::wstring LocalDataPathOfCurrentSceneLibrary()
   return g_objManager.scnData.m_path + L"/data/";
 }
 
-std::wstring ChunkName(const ChunkPointer& a_chunk)
+static const wchar_t* ChunkExtension(CHUNK_TYPE a_type)
 {
-  std::wstringstream namestream;
-  namestream << g_objManager.scnData.m_path.c_str() << L"/data/chunk_" << std::setfill(L"0"[0]) << std::setw(5) << a_chunk.id;
-
-  switch (a_chunk.type)
-  {
-  case CHUNK_TYPE_UNKNOWN:   namestream << L".bin";      break;
-  case CHUNK_TYPE_ARRAY1F:   namestream << L".array1f";  break;
-  case CHUNK_TYPE_ARRAY1UI:  namestream << L".array1ui"; break;
-  case CHUNK_TYPE_ARRAY2F:   namestream << L".array2f";  break;
-  case CHUNK_TYPE_ARRAY4F:   namestream << L".array4f";  break;
-  case CHUNK_TYPE_IMAGE4UB:  namestream << L".image4ub"; break;
-  case CHUNK_TYPE_IMAGE4F:   namestream << L".image4f";  break;
-  case CHUNK_TYPE_IMAGE4HF:  namestream << L".image4hf"; break;
-  case CHUNK_TYPE_VSGF:      namestream << L".vsgf";     break;
-  default:                   namestream << L".bin";      break;
+  switch (a_type)
+  {
+  case CHUNK_TYPE_UNKNOWN:   return L".bin";
+  case CHUNK_TYPE_ARRAY1F:   return L".array1f";
+  case CHUNK_TYPE_ARRAY1UI:  return L".array1ui";
+  case CHUNK_TYPE_ARRAY2F:   return L".array2f";
+  case CHUNK_TYPE_ARRAY4F:   return L".array4f";
+  case CHUNK_TYPE_IMAGE4UB:  return L".image4ub";
+  case CHUNK_TYPE_IMAGE4F:   return L".image4f";
+  case CHUNK_TYPE_IMAGE4HF:  return L".image4hf";
+  case CHUNK_TYPE_VSGF:      return L".vsgf";
+  default:                   return L".bin";
   };
+}
 
-  return namestream.str();
+std::wstring ChunkName(const ChunkPointer& a_chunk)
+{
+  const std::wstring& path = g_objManager.scnData.m_path;
+  std::wstring idStr       = std::to_wstring(a_chunk.id);
+  if (idStr.size() < 5)
+    idStr.insert(size_t(0), 5 - idStr.size(), L'0');
+
+  std::wstring name;
+  name.reserve(path.size() + idStr.size() + 24);
+  name.append(path).append(L"/data/chunk_").append(idStr).append(ChunkExtension(a_chunk.type));
+  return name;
 }
 
 
@@ -614,16 +1045,15 @@ void ChunkPointer::SwapToDisk()
   if (wasSaved)
     return;
 
-  const std::wstring name = ChunkName(*this);
-#if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600)
-  std::wstring s1(name);
-  std::string  s2(s1.begin(), s1.end());
-  std::ofstream fout(s2.c_str(), std::ios::binary);
-#elif defined WIN32
-  std::ofstream fout(name.c_str(), std::ios::binary);
-#endif
-  fout.write(pVB->m_dataHalfCurr + localAddress, sizeInBytes);
-  fout.close();
+  const std::wstring name     = ChunkName(*this);
+  const char*        data     = pVB->m_dataHalfCurr + localAddress;
+  const bool         compress = pVB->m_compress && ChunkTypeIsCompressible(type);
+
+  if (pVB->m_pWriter != nullptr)
+    pVB->m_pWriter->Push(size_t(id), name, data, sizeInBytes, true, compress); // chunk memory will be reused right after return, so writer gets a copy
+  else if (!WriteChunkFile(name, data, sizeInBytes, compress))
+    HrError(L"ChunkPointer::SwapToDisk, failed to write chunk file ", name.c_str());
+
   wasSaved = true;
 }
 
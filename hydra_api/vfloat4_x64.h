@@ -161,6 +161,8 @@ namespace cvex
   static inline vfloat4 dot3v(const vfloat4 a, const vfloat4 b) { return sse_dot3(a, b); } // _mm_dp_ps(a, b, 0x7f);
   static inline float   dot3f(const vfloat4 a, const vfloat4 b) { return _mm_cvtss_f32(sse_dot3(a, b)); }
 
+  static inline vfloat4 cross3(const vfloat4 a, const vfloat4 b) { return _mm_sub_ps(_mm_mul_ps(shuffle_yzxw(a), shuffle_zxyw(b)), _mm_mul_ps(shuffle_zxyw(a), shuffle_yzxw(b))); } // w = 0
+
   //static inline bool cmpgt_all_xyzw(const vfloat4 a, const vfloat4 b) { return (_mm_movemask_ps(_mm_cmpgt_ps(a, b)) & 15) == 15; } // #TODO: UNTESTED!
   static inline bool cmpgt_all_xyz (const vfloat4 a, const vfloat4 b) { return (_mm_movemask_ps(_mm_cmpgt_ps(a, b)) & 7)  == 7; }
   static inline bool cmpgt_all_x   (const vfloat4 a, const vfloat4 b) { return (_mm_movemask_ps(_mm_cmpgt_ss(a, b)) & 1)  == 1; }
@@ -207,6 +207,13 @@ bool test98_motion_blur();                // not implemented
 bool test99_triplanar();
 
 bool test100_dummy_hydra_exec();          // not used
+bool test101_demand_paging_small_budget();
+bool test102_demand_paging_pinned_chunks();
+bool test103_frame_buffer_tiles();
+bool test104_find_objects_by_names();
+bool test105_compressed_chunks_round_trip();
+bool test106_fast_normals_tolerance();
+bool test107_weld_tolerance_custom_arrays();
 
 namespace GEO_TESTS
 {
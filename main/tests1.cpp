@@ -1674,6 +1674,14 @@ void run_all_api_tests(const int startTestId)
                        &test97_camera_from_matrices,
                        &dummy_test,                  // correct implementation of motion blur is not yet finished
                        &test99_triplanar,
+                       &dummy_test,                  // 100 test100_dummy_hydra_exec
+                       &test101_demand_paging_small_budget,
+                       &test102_demand_paging_pinned_chunks,
+                       &test103_frame_buffer_tiles,
+                       &test104_find_objects_by_names,
+                       &test105_compressed_chunks_round_trip,
+                       &test106_fast_normals_tolerance,
+                       &test107_weld_tolerance_custom_arrays,
   };
 
 
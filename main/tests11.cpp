@@ -0,0 +1,676 @@
+#include "tests.h"
+#include <iomanip>
+#include <cstring>
+#include <sstream>
+#include <fstream>
+
+#include "../hydra_api/HydraInternal.h"
+#include "../hydra_api/HydraRenderDriverAPI.h"
+
+using namespace TEST_UTILS;
+
+bool test101_demand_paging_small_budget()
+{
+  hrErrorCallerPlace(L"test101");
+
+  hrSceneLibraryOpen(L"tests/test_101", HR_WRITE_DISCARD); // chunk files of test buffers go to 'data' folder of this library
+
+  constexpr int      chunksNum = 64;
+  constexpr int      chunkSize = 64*1024;
+  constexpr int      hotChunks = 4;
+  constexpr uint64_t cacheSize = 8*1024*1024;
+  constexpr uint64_t budget    = 1024*1024;
+
+  std::vector<int> tempBuffer;
+
+  // (1) put chunks with different content to disk
+  //
+  {
+    VirtualBuffer vb;
+    if (!vb.Init(cacheSize, "NOSUCHSHMEM", &tempBuffer, nullptr))
+      return false;
+
+    for (int i = 0; i < chunksNum; i++)
+    {
+      const size_t id = vb.AllocChunk(chunkSize, uint64_t(i));
+      memset(vb.chunk_at(id).GetMemoryNow(), i, chunkSize);
+    }
+
+    vb.FlushToDisc();
+    vb.Destroy();
+  }
+
+  // (2) read them back in scrambled order; cache has room for all of them, but only 1 MB of paged in chunks may stay resident
+  //
+  VirtualBuffer vb;
+  if (!vb.Init(cacheSize, "NOSUCHSHMEM", &tempBuffer, nullptr))
+    return false;
+
+  vb.ResizeAndAllocEmptyChunks(chunksNum);
+  vb.SetDemandPaging(true, budget);
+  for (int i = 0; i < chunksNum; i++)
+    vb.RegisterChunkOnDisk(size_t(i), chunkSize, CHUNK_TYPE_UNKNOWN);
+
+  bool     contentOk  = true;
+  uint64_t maxPagedIn = 0;
+
+  for (int pass = 0; pass < 3; pass++)
+  {
+    for (int i = 0; i < chunksNum; i++)
+    {
+      const int id = (i*7 + pass) % chunksNum;
+
+      const unsigned char* data = (const unsigned char*)vb.chunk_at(size_t(id)).GetMemoryNow();
+      if (data == nullptr || data[0] != (unsigned char)id || data[chunkSize - 1] != (unsigned char)id)
+        contentOk = false;
+
+      for (int hot = 0; hot < hotChunks; hot++) // frequently used chunks should survive evictions
+      {
+        const unsigned char* hotData = (const unsigned char*)vb.chunk_at(size_t(hot)).GetMemoryNow();
+        if (hotData == nullptr || hotData[chunkSize/2] != (unsigned char)hot)
+          contentOk = false;
+      }
+
+      maxPagedIn = std::max(maxPagedIn, vb.PagedInBytes());
+    }
+  }
+
+  bool hotOk    = true;
+  int  resident = 0;
+  for (int i = 0; i < chunksNum; i++)
+  {
+    if (vb.chunk_at(size_t(i)).InMemory())
+      resident++;
+    else if (i < hotChunks)
+      hotOk = false;
+  }
+
+  vb.Destroy();
+
+  std::cout << "test101: max paged in bytes = " << maxPagedIn << ", resident chunks = " << resident << std::endl;
+
+  return contentOk && hotOk && maxPagedIn <= budget && uint64_t(resident)*chunkSize <= budget;
+}
+
+bool test102_demand_paging_pinned_chunks()
+{
+  hrErrorCallerPlace(L"test102");
+
+  hrSceneLibraryOpen(L"tests/test_102", HR_WRITE_DISCARD);
+
+  constexpr int      chunksNum = 64;
+  constexpr int      chunkSize = 64*1024;
+  constexpr int      pinnedNum = 3;
+  constexpr uint64_t cacheSize = 2*1024*1024;
+  constexpr uint64_t budget    = 512*1024;
+
+  std::vector<int> tempBuffer;
+
+  {
+    VirtualBuffer vb;
+    if (!vb.Init(cacheSize, "NOSUCHSHMEM", &tempBuffer, nullptr))
+      return false;
+
+    for (int i = 0; i < chunksNum; i++)
+    {
+      const size_t id = vb.AllocChunk(chunkSize, uint64_t(i));
+      memset(vb.chunk_at(id).GetMemoryNow(), i + 1, chunkSize);
+    }
+
+    vb.FlushToDisc();
+    vb.Destroy();
+  }
+
+  VirtualBuffer vb;
+  if (!vb.Init(cacheSize, "NOSUCHSHMEM", &tempBuffer, nullptr))
+    return false;
+
+  vb.ResizeAndAllocEmptyChunks(chunksNum);
+  vb.SetDemandPaging(true, budget);
+  for (int i = 0; i < chunksNum; i++)
+    vb.RegisterChunkOnDisk(size_t(i), chunkSize, CHUNK_TYPE_UNKNOWN);
+
+  bool pinnedOk = true;
+  bool otherOk  = true;
+
+  {
+    ChunkPinScope pin(vb);
+
+    // (1) hold several pointers at once, like mesh and texture updates do
+    //
+    const unsigned char* pinned[pinnedNum];
+    for (int i = 0; i < pinnedNum; i++)
+      pinned[i] = (const unsigned char*)vb.chunk_at(size_t(i*20)).GetMemoryNow();
+
+    // (2) page in other chunks many times, so collector has to evict and compact the cache
+    //
+    for (int pass = 0; pass < 2; pass++)
+    {
+      for (int i = 0; i < chunksNum; i++)
+      {
+        if (i % 20 == 0)
+          continue;
+
+        ChunkPinScope nested(vb); // releases only its own pins, outer ones stay
+        const unsigned char* data = (const unsigned char*)vb.chunk_at(size_t(i)).GetMemoryNow();
+        if (data == nullptr || data[0] != (unsigned char)(i + 1) || data[chunkSize - 1] != (unsigned char)(i + 1))
+          otherOk = false;
+      }
+    }
+
+    for (int i = 0; i < pinnedNum; i++)
+    {
+      const unsigned char* data = (const unsigned char*)vb.chunk_at(size_t(i*20)).GetMemoryNow();
+      if (pinned[i] == nullptr || data != pinned[i] || pinned[i][0] != (unsigned char)(i*20 + 1) || pinned[i][chunkSize - 1] != (unsigned char)(i*20 + 1))
+        pinnedOk = false;
+    }
+  }
+
+  const uint64_t pagedInAfterScope = vb.PagedInBytes();
+
+  // (3) after the scope ends previously pinned chunks may be evicted as usual
+  //
+  for (int i = 1; i < chunksNum; i += 2)
+    vb.chunk_at(size_t(i)).GetMemoryNow();
+
+  const bool budgetOk = (vb.PagedInBytes() <= budget);
+
+  vb.Destroy();
+
+  std::cout << "test102: paged in bytes after scope = " << pagedInAfterScope << std::endl;
+
+  return pinnedOk && otherOk && budgetOk;
+}
+
+/**
+\brief accumulating render driver without render; frame buffer content and passes are set by test
+*/
+struct RD_TilesTest : public IHRRenderDriver
+{
+  RD_TilesTest(int w, int h) : m_width(w), m_height(h), m_spp(1.0f), m_pass(0), m_lines(true), m_concurrentPasses(0), m_passInfoCalls(0)
+  {
+    m_image.resize(size_t(w)*size_t(h)*4);
+    for (size_t i = 0; i < m_image.size(); i++)
+      m_image[i] = float(i % 1024);
+  }
+
+  void              ClearAll() override {}
+  HRDriverAllocInfo AllocAll(HRDriverAllocInfo a_info) override { return a_info; }
+
+  bool UpdateImage(int32_t a_texId, int32_t w, int32_t h, int32_t bpp, const void* a_data, pugi::xml_node a_texNode) override { return true; }
+  bool UpdateMaterial(int32_t a_matId, pugi::xml_node a_materialNode) override { return true; }
+  bool UpdateLight(int32_t a_lightIdId, pugi::xml_node a_lightNode) override { return true; }
+  bool UpdateMesh(int32_t a_meshId, pugi::xml_node a_meshNode, const HRMeshDriverInput& a_input, const HRBatchInfo* a_batchList, int32_t listSize) override { return true; }
+  bool UpdateImageFromFile(int32_t a_texId, const wchar_t* a_fileName, pugi::xml_node a_texNode) override { return false; }
+  bool UpdateMeshFromFile(int32_t a_meshId, pugi::xml_node a_meshNode, const wchar_t* a_fileName) override { return false; }
+  bool UpdateCamera(pugi::xml_node a_camNode) override { return true; }
+  bool UpdateSettings(pugi::xml_node a_settingsNode) override { return true; }
+
+  void BeginScene(pugi::xml_node a_sceneNode) override {}
+  void EndScene() override {}
+  void InstanceMeshes(int32_t a_mesh_id, const float* a_matrices, int32_t a_instNum, const int* a_lightInstId, const int* a_remapId, const int* a_realInstId) override {}
+  void InstanceLights(int32_t a_light_id, const float* a_matrix, pugi::xml_node* a_lightNodes, int32_t a_instNum, int32_t a_lightGroupId) override {}
+
+  void Draw() override {}
+
+  HRRenderUpdateInfo HaveUpdateNow(int a_maxRaysPerPixel) override { return HRRenderUpdateInfo(); }
+
+  void GetFrameBufferHDR(int32_t w, int32_t h, float* a_out, const wchar_t* a_layerName) override
+  {
+    memcpy(a_out, m_image.data(), m_image.size()*sizeof(float));
+  }
+
+  void GetFrameBufferLDR(int32_t w, int32_t h, int32_t* a_out) override {}
+
+  void GetFrameBufferLineHDR(int32_t a_xBegin, int32_t a_xEnd, int32_t y, float* a_out, const wchar_t* a_layerName) override
+  {
+    memcpy(a_out, m_image.data() + (size_t(y)*size_t(m_width) + size_t(a_xBegin))*4, size_t(a_xEnd - a_xBegin)*sizeof(float)*4);
+  }
+
+  bool GetFrameBufferPassInfo(float* a_pSpp, int64_t* a_pPassId) override
+  {
+    if (m_concurrentPasses > 0 && (m_passInfoCalls % 2) == 1) // render process finished next pass while tiles were read
+    {
+      NextPass(1.0f);
+      m_concurrentPasses--;
+    }
+    m_passInfoCalls++;
+
+    (*a_pSpp)    = m_spp;
+    (*a_pPassId) = m_pass;
+    return true;
+  }
+
+  void GetGBufferLine(int32_t a_lineNumber, HRGBufferPixel* a_lineData, int32_t a_startX, int32_t a_endX, const std::unordered_set<int32_t>& a_shadowCatchers) override {}
+
+  HRDriverInfo Info() override
+  {
+    HRDriverInfo info;
+    info.supportHDRFrameBuffer     = true;
+    info.supportGetFrameBufferLine = m_lines;
+    return info;
+  }
+
+  const HRRenderDeviceInfoListElem* DeviceList() const override { return nullptr; }
+  bool EnableDevice(int32_t id, bool a_enable) override { return true; }
+
+  void NextPass(float a_add)
+  {
+    for (auto& x : m_image)
+      x += a_add;
+    m_spp += 1.0f;
+    m_pass++;
+  }
+
+  void ChangeRect(int x0, int y0, int x1, int y1)
+  {
+    for (int y = y0; y < y1; y++)
+      for (int x = x0; x < x1; x++)
+        m_image[(size_t(y)*size_t(m_width) + size_t(x))*4 + 1] += 0.5f;
+    m_spp += 1.0f;
+    m_pass++;
+  }
+
+  int                m_width;
+  int                m_height;
+  std::vector<float> m_image;
+  float              m_spp;
+  int64_t            m_pass;
+  bool               m_lines;
+  int                m_concurrentPasses;
+  int                m_passInfoCalls;
+};
+
+static bool CheckReturnedTiles(const RD_TilesTest& a_drv, const std::vector<HRFrameBufferTile>& a_tiles, const std::vector<float>& a_data, int a_tilesNum, int a_tileSize,
+                               const std::vector<int>& a_expectedIds, int a_tilesX)
+{
+  if (a_tilesNum != int(a_expectedIds.size()))
+    return false;
+
+  for (int i = 0; i < a_tilesNum; i++)
+  {
+    const HRFrameBufferTile& tile = a_tiles[i];
+    if (tile.x != (a_expectedIds[i] % a_tilesX)*a_tileSize || tile.y != (a_expectedIds[i] / a_tilesX)*a_tileSize || tile.spp != a_drv.m_spp)
+      return false;
+
+    const float* data = a_data.data() + size_t(i)*size_t(a_tileSize)*size_t(a_tileSize)*4;
+    for (int y = 0; y < tile.h; y++)
+    {
+      const float* line = a_drv.m_image.data() + (size_t(tile.y + y)*size_t(a_drv.m_width) + size_t(tile.x))*4;
+      if (memcmp(data + size_t(y)*size_t(tile.w)*4, line, size_t(tile.w)*sizeof(float)*4) != 0)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+bool test103_frame_buffer_tiles()
+{
+  hrErrorCallerPlace(L"test103");
+
+  constexpr int w        = 100;
+  constexpr int h        = 70;
+  constexpr int tileSize = 32;
+  constexpr int tilesX   = 4;
+  constexpr int tilesNum = 12;
+
+  std::vector<HRFrameBufferTile> tiles(tilesNum);
+  std::vector<float>             data(size_t(tilesNum)*tileSize*tileSize*4);
+  const std::vector<int>         allTiles = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+  bool ok = true;
+
+  for (int lines = 0; lines < 2; lines++)
+  {
+    auto pDriver = std::make_shared<RD_TilesTest>(w, h);
+    pDriver->m_lines = (lines == 1);
+    HRRenderRef renderRef = hrRenderCreateFromExistingDriver(L"TilesTest", pDriver);
+
+    // (1) first call returns all tiles, then unchanged frame returns nothing even if more samples were accumulated
+    //
+    int n = hrRenderGetFrameBufferTilesHDR4f(renderRef, w, h, tileSize, tiles.data(), data.data(), tilesNum);
+    ok = ok && CheckReturnedTiles(*pDriver, tiles, data, n, tileSize, allTiles, tilesX);
+
+    pDriver->m_spp += 1.0f;
+    pDriver->m_pass++;
+    n = hrRenderGetFrameBufferTilesHDR4f(renderRef, w, h, tileSize, tiles.data(), data.data(), tilesNum);
+    ok = ok && (n == 0);
+
+    // (2) changed region covers 4 tiles; those that did not fit go to the next call
+    //
+    pDriver->ChangeRect(60, 30, 70, 40);
+    n = hrRenderGetFrameBufferTilesHDR4f(renderRef, w, h, tileSize, tiles.data(), data.data(), 3);
+    ok = ok && CheckReturnedTiles(*pDriver, tiles, data, n, tileSize, {1, 2, 5}, tilesX);
+    n = hrRenderGetFrameBufferTilesHDR4f(renderRef, w, h, tileSize, tiles.data(), data.data(), tilesNum);
+    ok = ok && CheckReturnedTiles(*pDriver, tiles, data, n, tileSize, {6}, tilesX);
+    n = hrRenderGetFrameBufferTilesHDR4f(renderRef, w, h, tileSize, tiles.data(), data.data(), tilesNum);
+    ok = ok && (n == 0);
+
+    // (3) passes finished while tiles were read; all tiles and spp must be from the last one
+    //
+    pDriver->m_concurrentPasses = 2;
+    n = hrRenderGetFrameBufferTilesHDR4f(renderRef, w, h, tileSize, tiles.data(), data.data(), tilesNum);
+    ok = ok && (pDriver->m_concurrentPasses == 0) && CheckReturnedTiles(*pDriver, tiles, data, n, tileSize, allTiles, tilesX);
+
+    // (4) render process never stops writing; nothing is returned until it does
+    //
+    pDriver->m_concurrentPasses = 100;
+    n = hrRenderGetFrameBufferTilesHDR4f(renderRef, w, h, tileSize, tiles.data(), data.data(), tilesNum);
+    ok = ok && (n == 0);
+
+    pDriver->m_concurrentPasses = 0;
+    n = hrRenderGetFrameBufferTilesHDR4f(renderRef, w, h, tileSize, tiles.data(), data.data(), tilesNum);
+    ok = ok && CheckReturnedTiles(*pDriver, tiles, data, n, tileSize, allTiles, tilesX);
+
+    // (5) reset returns all tiles again
+    //
+    hrRenderResetFrameBufferTiles(renderRef);
+    n = hrRenderGetFrameBufferTilesHDR4f(renderRef, w, h, tileSize, tiles.data(), data.data(), tilesNum);
+    ok = ok && CheckReturnedTiles(*pDriver, tiles, data, n, tileSize, allTiles, tilesX);
+
+    std::cout << "test103: lines = " << lines << ", ok = " << ok << std::endl;
+  }
+
+  return ok;
+}
+
+static const wchar_t* DEFAULT_TEST_INIT_FLAGS = L"-copy_textures_to_local_folder 0 -local_data_path 1 -sort_indices 1 -compute_bboxes 1";
+
+bool test104_find_objects_by_names()
+{
+  hrErrorCallerPlace(L"test104");
+
+  hrSceneLibraryOpen(L"tests/test_104", HR_WRITE_DISCARD);
+
+  HRMaterialRef mats[3] = { hrMaterialCreate(L"mat0"), hrMaterialCreate(L"mat1"), hrMaterialCreate(L"mat2") };
+  HRLightRef    lgts[2] = { hrLightCreate(L"light0"), hrLightCreate(L"light1") };
+  HRCameraRef   cams[2] = { hrCameraCreate(L"cam0"), hrCameraCreate(L"cam1") };
+
+  // (1) hits in any order, misses give -1 and are not counted
+  //
+  const wchar_t* matNames[5] = { L"mat2", L"no_such_mat", L"mat0", L"light0", L"mat1" };
+  HRMaterialRef  matRefs[5];
+  const int32_t  matsFound = hrFindMaterialsByNames(matNames, 5, matRefs);
+
+  const bool matsOk = (matsFound == 3) && (matRefs[0].id == mats[2].id) && (matRefs[1].id == -1) && (matRefs[2].id == mats[0].id) &&
+                      (matRefs[3].id == -1) && (matRefs[4].id == mats[1].id);
+
+  const wchar_t* lightNames[3] = { L"light1", L"mat0", L"light0" };
+  HRLightRef     lightRefs[3];
+  const int32_t  lightsFound = hrFindLightsByNames(lightNames, 3, lightRefs);
+
+  const bool lightsOk = (lightsFound == 2) && (lightRefs[0].id == lgts[1].id) && (lightRefs[1].id == -1) && (lightRefs[2].id == lgts[0].id);
+
+  const wchar_t* camNames[3] = { L"", L"cam1", L"cam" };
+  HRCameraRef    camRefs[3];
+  const int32_t  camsFound = hrFindCamerasByNames(camNames, 3, camRefs);
+
+  const bool camsOk = (camsFound == 1) && (camRefs[0].id == -1) && (camRefs[1].id == cams[1].id) && (camRefs[2].id == -1);
+
+  // (2) batch lookup agrees with single lookups
+  //
+  bool singleOk = true;
+  for (int i = 0; i < 5; i++)
+    singleOk = singleOk && (hrFindMaterialByName(matNames[i]).id == matRefs[i].id);
+  for (int i = 0; i < 3; i++)
+    singleOk = singleOk && (hrFindLightByName(lightNames[i]).id == lightRefs[i].id) && (hrFindCameraByName(camNames[i]).id == camRefs[i].id);
+
+  // (3) zero names is not an error
+  //
+  const bool emptyOk = (hrFindMaterialsByNames(matNames, 0, matRefs) == 0);
+
+  return matsOk && lightsOk && camsOk && singleOk && emptyOk;
+}
+
+static void CreateTestGrid(int a_size, float a_bump, std::vector<float>& a_pos, std::vector<float>& a_norm, std::vector<float>& a_texCoord, std::vector<int>& a_indices)
+{
+  a_pos.clear(); a_norm.clear(); a_texCoord.clear(); a_indices.clear();
+
+  for (int y = 0; y <= a_size; y++)
+  {
+    for (int x = 0; x <= a_size; x++)
+    {
+      const float height = a_bump*sinf(0.7f*float(x))*cosf(0.45f*float(y));
+      a_pos.insert(a_pos.end(), { float(x), height, float(y), 1.0f });
+      a_norm.insert(a_norm.end(), { 0.0f, 1.0f, 0.0f, 0.0f });
+      a_texCoord.insert(a_texCoord.end(), { float(x)/float(a_size), float(y)/float(a_size) });
+    }
+  }
+
+  for (int y = 0; y < a_size; y++)
+  {
+    for (int x = 0; x < a_size; x++)
+    {
+      const int v = y*(a_size + 1) + x;
+      a_indices.insert(a_indices.end(), { v, v + a_size + 1, v + 1, v + 1, v + a_size + 1, v + a_size + 2 });
+    }
+  }
+}
+
+bool test105_compressed_chunks_round_trip()
+{
+  hrErrorCallerPlace(L"test105");
+
+  hrInit((std::wstring(DEFAULT_TEST_INIT_FLAGS) + L" -compress_chunks 1").c_str());
+
+  hrSceneLibraryOpen(L"tests/test_105", HR_WRITE_DISCARD);
+
+  std::vector<float> pos, norm, texCoord;
+  std::vector<int>   indices;
+  CreateTestGrid(64, 0.0f, pos, norm, texCoord, indices); // flat grid data compresses well
+
+  HRMeshRef meshRef = hrMeshCreate(L"grid");
+  hrMeshOpen(meshRef, HR_TRIANGLE_IND3, HR_WRITE_DISCARD);
+  {
+    hrMeshVertexAttribPointer4f(meshRef, L"pos",      &pos[0]);
+    hrMeshVertexAttribPointer4f(meshRef, L"norm",     &norm[0]);
+    hrMeshVertexAttribPointer2f(meshRef, L"texcoord", &texCoord[0]);
+    hrMeshMaterialId(meshRef, 0);
+    hrMeshAppendTriangles3(meshRef, int(indices.size()), &indices[0], false);
+  }
+  hrMeshClose(meshRef);
+
+  HRSceneInstRef scnRef = hrSceneCreate(L"scene");
+  hrSceneOpen(scnRef, HR_WRITE_DISCARD);
+  {
+    const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    hrMeshInstance(scnRef, meshRef, identity);
+  }
+  hrSceneClose(scnRef);
+
+  hrFlush(scnRef);
+
+  // (1) chunk file on disk is compressed
+  //
+  std::wstring location;
+  hrMeshOpen(meshRef, HR_TRIANGLE_IND3, HR_OPEN_READ_ONLY);
+  location = hrMeshParamNode(meshRef).attribute(L"loc").as_string();
+  hrMeshClose(meshRef);
+
+  const std::string locationS(location.begin(), location.end());
+
+  uint32_t magic = 0;
+  {
+    std::ifstream fin(("tests/test_105/" + locationS).c_str(), std::ios::binary);
+    fin.read((char*)&magic, sizeof(magic));
+  }
+
+  // (2) reopened library decodes the same data
+  //
+  hrSceneLibraryOpen(L"tests/test_105", HR_OPEN_EXISTING);
+
+  bool dataOk = false;
+  hrMeshOpen(meshRef, HR_TRIANGLE_IND3, HR_OPEN_READ_ONLY);
+  {
+    const HROpenedMeshInfo info = hrMeshGetInfo(meshRef);
+    const float* pos2      = (const float*)hrMeshGetAttribPointer(meshRef, L"pos");
+    const float* norm2     = (const float*)hrMeshGetAttribPointer(meshRef, L"norm");
+    const float* texCoord2 = (const float*)hrMeshGetAttribPointer(meshRef, L"uv");
+
+    dataOk = (info.vertNum == int(pos.size()/4)) && (info.indicesNum == int(indices.size())) && pos2 != nullptr && norm2 != nullptr && texCoord2 != nullptr &&
+             memcmp(pos2, pos.data(), pos.size()*sizeof(float)) == 0 && memcmp(texCoord2, texCoord.data(), texCoord.size()*sizeof(float)) == 0;
+
+    for (size_t i = 0; dataOk && i < norm.size(); i += 4) // w of normal is not kept
+      dataOk = (norm2[i + 0] == norm[i + 0]) && (norm2[i + 1] == norm[i + 1]) && (norm2[i + 2] == norm[i + 2]);
+  }
+  hrMeshClose(meshRef);
+
+  hrInit(DEFAULT_TEST_INIT_FLAGS);
+
+  std::cout << "test105: chunk file = " << locationS << ", compressed = " << (magic == 0x5A435248) << std::endl;
+
+  return (magic == 0x5A435248) && dataOk;
+}
+
+static std::vector<float> ComputeTestGridNormals(const wchar_t* a_flags)
+{
+  hrInit(a_flags);
+
+  hrSceneLibraryOpen(L"tests/test_106", HR_WRITE_DISCARD);
+
+  std::vector<float> pos, norm, texCoord;
+  std::vector<int>   indices;
+  CreateTestGrid(32, 2.0f, pos, norm, texCoord, indices);
+
+  std::vector<float> result;
+
+  HRMeshRef meshRef = hrMeshCreate(L"bumpy_grid");
+  hrMeshOpen(meshRef, HR_TRIANGLE_IND3, HR_WRITE_DISCARD);
+  {
+    hrMeshVertexAttribPointer4f(meshRef, L"pos",      &pos[0]);   // no normals, so they are computed
+    hrMeshVertexAttribPointer2f(meshRef, L"texcoord", &texCoord[0]);
+    hrMeshMaterialId(meshRef, 0);
+    hrMeshAppendTriangles3(meshRef, int(indices.size()), &indices[0], false);
+
+    const float* normals = (const float*)hrMeshGetAttribPointer(meshRef, L"norm");
+    if (normals != nullptr)
+      result.assign(normals, normals + pos.size());
+  }
+  hrMeshClose(meshRef);
+
+  return result;
+}
+
+bool test106_fast_normals_tolerance()
+{
+  hrErrorCallerPlace(L"test106");
+
+  const std::vector<float> exact = ComputeTestGridNormals(DEFAULT_TEST_INIT_FLAGS);
+  const std::vector<float> fast  = ComputeTestGridNormals((std::wstring(DEFAULT_TEST_INIT_FLAGS) + L" -fast_normals 1").c_str());
+
+  hrInit(DEFAULT_TEST_INIT_FLAGS);
+
+  if (exact.empty() || exact.size() != fast.size())
+    return false;
+
+  float maxDiff  = 0.0f;
+  float minDot   = 1.0f;
+  bool  unitOk   = true;
+  for (size_t i = 0; i < exact.size(); i += 4)
+  {
+    float dot = 0.0f;
+    float len = 0.0f;
+    for (int c = 0; c < 3; c++)
+    {
+      maxDiff = std::max(maxDiff, fabsf(exact[i + c] - fast[i + c]));
+      dot    += exact[i + c]*fast[i + c];
+      len    += fast[i + c]*fast[i + c];
+    }
+    minDot = std::min(minDot, dot);
+    unitOk = unitOk && fabsf(len - 1.0f) < 1e-4f;
+  }
+
+  std::cout << "test106: max normal component diff = " << maxDiff << ", min dot = " << minDot << std::endl;
+
+  return unitOk && maxDiff < 1e-3f && minDot > 0.99999f;
+}
+
+bool test107_weld_tolerance_custom_arrays()
+{
+  hrErrorCallerPlace(L"test107");
+
+  // v3 and v5 are near duplicates of v1 and v2; v6 is near v0, but its custom attribute differs, so it stays
+  //
+  const float pos[9*4] = { 0.0f,    0.0f,    0.0f, 1.0f,
+                           1.0f,    0.0f,    0.0f, 1.0f,
+                           0.0f,    1.0f,    0.0f, 1.0f,
+                           1.0001f, 0.0f,    0.0f, 1.0f,
+                           1.0f,    1.0f,    0.0f, 1.0f,
+                           0.0f,    1.0001f, 0.0f, 1.0f,
+                           0.0001f, 0.0f,    0.0f, 1.0f,
+                           2.0f,    0.0f,    0.0f, 1.0f,
+                           2.0f,    1.0f,    0.0f, 1.0f };
+
+  float norm[9*4];
+  float texCoord[9*2];
+  for (int v = 0; v < 9; v++)
+  {
+    norm[v*4 + 0] = 0.0f; norm[v*4 + 1] = 0.0f; norm[v*4 + 2] = 1.0f; norm[v*4 + 3] = 0.0f;
+    texCoord[v*2 + 0] = pos[v*4 + 0];
+    texCoord[v*2 + 1] = pos[v*4 + 1];
+  }
+
+  const float darkness[9] = { 0.0f, 1.0f, 2.0f, 1.0f, 4.0f, 2.0f, 7.0f, 5.0f, 6.0f };
+  const int   indices[9]  = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+
+  const float darknessExpected[7] = { 0.0f, 1.0f, 2.0f, 4.0f, 7.0f, 5.0f, 6.0f };
+  const int   indicesExpected[9]  = { 0, 1, 2, 1, 3, 2, 4, 5, 6 };
+
+  int  vertNum[2]    = { 0, 0 };
+  bool indicesOk     = false;
+  bool posOk         = false;
+  bool customOk      = false;
+
+  for (int pass = 0; pass < 2; pass++) // (1) default tolerance keeps all vertices, (2) 1e-3 tolerance merges near duplicates
+  {
+    if (pass == 1)
+      hrInit((std::wstring(DEFAULT_TEST_INIT_FLAGS) + L" -weld_pos_tolerance 3 -weld_uv_tolerance 3").c_str());
+
+    hrSceneLibraryOpen(L"tests/test_107", HR_WRITE_DISCARD);
+
+    HRMeshRef meshRef = hrMeshCreate(L"near_duplicates");
+    hrMeshOpen(meshRef, HR_TRIANGLE_IND3, HR_WRITE_DISCARD);
+    {
+      hrMeshVertexAttribPointer4f(meshRef, L"pos",      pos);
+      hrMeshVertexAttribPointer4f(meshRef, L"norm",     norm);
+      hrMeshVertexAttribPointer2f(meshRef, L"texcoord", texCoord);
+      hrMeshVertexAttribPointer1f(meshRef, L"darkness", darkness);
+      hrMeshMaterialId(meshRef, 0);
+      hrMeshAppendTriangles3(meshRef, 9, indices, true);
+
+      vertNum[pass] = hrMeshGetInfo(meshRef).vertNum;
+
+      if (pass == 1)
+      {
+        const float* pos2 = (const float*)hrMeshGetAttribPointer(meshRef, L"pos");
+        posOk = (pos2 != nullptr) && (pos2[1*4 + 0] == 1.0f) && (pos2[2*4 + 1] == 1.0f) && (pos2[4*4 + 0] == 0.0001f); // first used vertex of group is kept
+      }
+    }
+    hrMeshClose(meshRef);
+
+    if (pass == 0)
+      continue;
+
+    // (3) triangles and custom per vertex array are compacted in the same order
+    //
+    hrMeshOpen(meshRef, HR_TRIANGLE_IND3, HR_OPEN_READ_ONLY);
+    {
+      const pugi::xml_node meshNode   = hrMeshParamNode(meshRef);
+      const HRMeshDriverInput input   = HR_GetMeshDataPointers(size_t(meshRef.id));
+      const uint64_t customOffset     = meshNode.child(L"darkness").attribute(L"offset").as_ullong();
+      const uint64_t customBytes      = meshNode.child(L"darkness").attribute(L"bytesize").as_ullong();
+
+      indicesOk = (input.indices != nullptr) && (input.triNum == 3) && memcmp(input.indices, indicesExpected, sizeof(indicesExpected)) == 0;
+      customOk  = (input.allData != nullptr) && (customBytes == sizeof(darknessExpected)) &&
+                  memcmp(input.allData + customOffset, darknessExpected, sizeof(darknessExpected)) == 0;
+    }
+    hrMeshClose(meshRef);
+  }
+
+  hrInit(DEFAULT_TEST_INIT_FLAGS);
+
+  std::cout << "test107: vertices with default tolerance = " << vertNum[0] << ", with 1e-3 tolerance = " << vertNum[1] << std::endl;
+
+  return (vertNum[0] == 9) && (vertNum[1] == 7) && indicesOk && posOk && customOk;
+}